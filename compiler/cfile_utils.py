@@ -18,7 +18,7 @@ def get_pure_c_code(component, token) -> str:
     answer = ""
     if token in component.keys():
         for tree in component[token]:
-            assert (tree[0] == "startup" or tree[0] == "cleanup")
+            assert (tree[0] in ("startup", "cleanup", "checkpoint", "restore"))
             answer += tree[1]
     return answer
 
@@ -383,7 +383,8 @@ def event_sources_conn_code(event_sources, streams_to_events_map) -> str:
                 shm_stream_hole_handling hh_{name} = {{
                   .hole_event_size = sizeof({out_event}),
                   .init = &init_hole_{hole_name},
-                  .update = &update_hole_{hole_name}
+                  .update = &update_hole_{hole_name},
+                  .add_lost = &add_lost_hole_{hole_name}
                 }};\n
                 """
                 answer += f"\tEV_SOURCE_{name} = shm_stream_create_from_argv(\"{name}\", argc, argv, &hh_{name});\n"
@@ -408,7 +409,8 @@ def event_sources_conn_code(event_sources, streams_to_events_map) -> str:
                 shm_stream_hole_handling hh_{name} = {{
                   .hole_event_size = sizeof({out_event}),
                   .init = &init_hole_{hole_name},
-                  .update = &update_hole_{hole_name}
+                  .update = &update_hole_{hole_name},
+                  .add_lost = &add_lost_hole_{hole_name}
                 }};\n
                 """
             answer += f"\tEV_SOURCE_{name} = shm_stream_create_from_argv(\"{name}\", argc, argv, &hh_{name});\n"
@@ -662,7 +664,8 @@ mtx_unlock(&LOCK_{buffer_group});
             shm_stream_hole_handling hole_handling = {{
               .hole_event_size = sizeof({out_event}),
               .init = &init_hole_{hole_name},
-              .update = &update_hole_{hole_name}
+              .update = &update_hole_{hole_name},
+              .add_lost = &add_lost_hole_{hole_name}
             }};
             shm_stream *ev_source_temp = shm_stream_create_substream(stream, NULL, NULL, NULL, NULL, &hole_handling);
             if (!ev_source_temp) {{
@@ -686,14 +689,18 @@ mtx_unlock(&LOCK_{buffer_group});
     return answer
 
 
-def declare_perf_layer_funcs(mapping) -> str:
+def declare_perf_layer_funcs(mapping, offline=False) -> str:
     answer ="" 
+    # offline monitors (e.g., of trace files) wait for the arbiter
+    # instead of dropping events
+    fetch_fun = "stream_filter_fetch_nodrop" if offline else "stream_filter_fetch"
     
     for stream_type in TypeChecker.stream_types_data.keys():
         answer+=f'''
 int PERF_LAYER_forward_{stream_type} (shm_arbiter_buffer *buffer) {"{"}
     atomic_fetch_add(&count_event_streams, 1); 
     shm_stream *stream = shm_arbiter_buffer_stream(buffer);   
+    SHM_TRACE_THREAD_NAME(shm_stream_get_name(stream));
     void *inevent;
     void *outevent;   
 
@@ -702,7 +709,7 @@ int PERF_LAYER_forward_{stream_type} (shm_arbiter_buffer *buffer) {"{"}
         sleep_ns(10);
     {"}"}
     while(true) {"{"}
-        inevent = stream_filter_fetch(stream, buffer, &SHOULD_KEEP_forward);
+        inevent = {fetch_fun}(stream, buffer, &SHOULD_KEEP_forward);
 
         if (inevent == NULL) {"{"}
             // no more events
@@ -738,6 +745,7 @@ int PERF_LAYER_forward_{stream_type} (shm_arbiter_buffer *buffer) {"{"}
         answer += f'''int PERF_LAYER_{stream_processor} (shm_arbiter_buffer *buffer) {"{"}
         atomic_fetch_add(&count_event_streams, 1); 
     shm_stream *stream = shm_arbiter_buffer_stream(buffer);   
+    SHM_TRACE_THREAD_NAME(shm_stream_get_name(stream));
     STREAM_{stream_in_name}_in *inevent;
     STREAM_{stream_out_name}_out *outevent;   
 
@@ -746,7 +754,7 @@ int PERF_LAYER_forward_{stream_type} (shm_arbiter_buffer *buffer) {"{"}
         sleep_ns(10);
     {"}"}
     while(true) {"{"}
-        inevent = stream_filter_fetch(stream, buffer, &SHOULD_KEEP_{stream_processor});
+        inevent = {fetch_fun}(stream, buffer, &SHOULD_KEEP_{stream_processor});
 
         if (inevent == NULL) {"{"}
             // no more events
@@ -807,7 +815,168 @@ bool are_buffers_done() {"{"}
     '''
 
 
-def arbiter_code(tree, components):
+def checkpoint_streams():
+    """ Pairs of (name in the checkpoint, arbiter buffer) for all event sources """
+    answer = []
+    for (event_source, data) in TypeChecker.event_sources_data.items():
+        if data["copies"]:
+            for i in range(data["copies"]):
+                answer.append((f"{event_source}_{i}", f"BUFFER_{event_source}{i}"))
+        else:
+            answer.append((event_source, f"BUFFER_{event_source}"))
+    return answer
+
+
+def checkpoint_code(components):
+    """ Functions that save the state of the monitor into a checkpoint
+        and restore it after a restart. Checkpoints are taken only if
+        SHAMON_CHECKPOINT_FILE is set (every SHAMON_CHECKPOINT_INTERVAL_MS
+        milliseconds, 1000 by default). """
+    save_streams = ""
+    restore_streams = ""
+    for (name, buffer) in checkpoint_streams():
+        save_streams += f"""
+    __id = shm_arbiter_buffer_last_processed_id({buffer});
+    shm_checkpoint_write(__checkpoint, "stream:{name}", &__id, sizeof(__id));"""
+        restore_streams += f"""
+    if (shm_checkpoint_read(__checkpoint, "stream:{name}", &__id, sizeof(__id)))
+        shm_arbiter_buffer_resume_after({buffer}, __id);"""
+
+    save_groups = ""
+    restore_groups = ""
+    for buff_name in TypeChecker.buffer_group_data.keys():
+        save_groups += f"""
+    vamos_bg_checkpoint(__checkpoint, "bg:{buff_name}", &BG_{buff_name});"""
+        restore_groups += f"""
+    vamos_bg_restore(__checkpoint, "bg:{buff_name}", &BG_{buff_name});"""
+
+    return f"""
+static const char *__vamos_checkpoint_file;
+static uint64_t __vamos_checkpoint_interval = 1000000000UL;
+static uint64_t __vamos_last_checkpoint;
+
+static uint64_t vamos_now(void) {{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}}
+
+/* the group is stored as the names of its streams */
+static void vamos_bg_checkpoint(shm_checkpoint_writer *w, const char *name,
+                                buffer_group *bg) {{
+    size_t size = 0;
+    for (dll_node *n = bg->head; n; n = n->next)
+        size += strlen(shm_stream_get_name(n->stream)) + 1;
+    char *names = malloc(size + 1);
+    char *p = names;
+    for (dll_node *n = bg->head; n; n = n->next) {{
+        const char *s = shm_stream_get_name(n->stream);
+        const size_t len = strlen(s) + 1;
+        memcpy(p, s, len);
+        p += len;
+    }}
+    shm_checkpoint_write(w, name, names, size);
+    free(names);
+}}
+
+static bool vamos_bg_has(const char *names, size_t size, const char *name) {{
+    for (size_t off = 0; off < size; off += strlen(names + off) + 1) {{
+        if (strcmp(names + off, name) == 0)
+            return true;
+    }}
+    return false;
+}}
+
+/* remove the streams that were not in the group when the checkpoint
+ * was taken. Streams that were added dynamically cannot be restored. */
+static void vamos_bg_restore(shm_checkpoint *cp, const char *name,
+                             buffer_group *bg) {{
+    size_t size;
+    const char *names = shm_checkpoint_get(cp, name, &size);
+    if (!names)
+        return;
+    dll_node *n = bg->head, *next;
+    while (n) {{
+        next = n->next;
+        if (!vamos_bg_has(names, size, shm_stream_get_name(n->stream)))
+            bg_remove(bg, n->stream);
+        n = next;
+    }}
+    for (size_t off = 0; off < size; off += strlen(names + off) + 1) {{
+        bool found = false;
+        for (n = bg->head; n; n = n->next) {{
+            if (strcmp(names + off, shm_stream_get_name(n->stream)) == 0) {{
+                found = true;
+                break;
+            }}
+        }}
+        if (!found)
+            fprintf(stderr, "warning: stream '%s' from the checkpoint is not in group '%s'\\n",
+                    names + off, name + 3);
+    }}
+}}
+
+static void vamos_checkpoint(void) {{
+    shm_checkpoint_writer *__checkpoint = shm_checkpoint_begin(__vamos_checkpoint_file);
+    shm_eventid __id;
+    (void)__id;
+    SHM_CHECKPOINT_VAR(__checkpoint, current_rule_set);
+    SHM_CHECKPOINT_VAR(__checkpoint, arbiter_counter);
+{save_streams}
+{save_groups}
+    {{
+{get_pure_c_code(components, 'checkpoint')}
+    }}
+    if (shm_checkpoint_commit(__checkpoint) != 0) {{
+        fprintf(stderr, "failed writing the checkpoint\\n");
+    }}
+}}
+
+static inline void vamos_maybe_checkpoint(void) {{
+    if (!__vamos_checkpoint_file)
+        return;
+    if (vamos_now() - __vamos_last_checkpoint < __vamos_checkpoint_interval)
+        return;
+    /* wait until the monitor processes the events that we forwarded to it,
+     * so that the state of the arbiter and the monitor is consistent */
+    while (shm_monitor_buffer_size(monitor_buffer) > 0) {{
+        if (__work_done)
+            return;
+        thrd_yield();
+    }}
+    vamos_checkpoint();
+    __vamos_last_checkpoint = vamos_now();
+}}
+
+static void vamos_restore(void) {{
+    __vamos_checkpoint_file = getenv("SHAMON_CHECKPOINT_FILE");
+    if (!__vamos_checkpoint_file)
+        return;
+    const char *interval = getenv("SHAMON_CHECKPOINT_INTERVAL_MS");
+    if (interval)
+        __vamos_checkpoint_interval = strtoull(interval, NULL, 10) * 1000000UL;
+    __vamos_last_checkpoint = vamos_now();
+
+    shm_checkpoint *__checkpoint = shm_checkpoint_load(__vamos_checkpoint_file);
+    if (!__checkpoint)
+        return;
+
+    printf("-- restoring the state from '%s'\\n", __vamos_checkpoint_file);
+    shm_eventid __id;
+    (void)__id;
+    SHM_RESTORE_VAR(__checkpoint, current_rule_set);
+    SHM_RESTORE_VAR(__checkpoint, arbiter_counter);
+{restore_streams}
+{restore_groups}
+    {{
+{get_pure_c_code(components, 'restore')}
+    }}
+    shm_checkpoint_free(__checkpoint);
+}}
+"""
+
+
+def arbiter_code(tree, components, checkpoint=False):
     assert (tree[0] == "arbiter_def")
 
     rule_set_names = []
@@ -816,15 +985,20 @@ def arbiter_code(tree, components):
     rule_set_invocations = ""
     for name in rule_set_names:
         rule_set_invocations += f"\t\tif (!ARB_CHANGE_ && current_rule_set == SWITCH_TO_RULE_SET_{name}) {'{'} \n" \
+                                f"\t\t\tSHM_TRACE_BEGIN(SHM_TRACE_RULE_SET, SWITCH_TO_RULE_SET_{name});\n" \
                                 f"\t\t\tARB_CHANGE_ = RULE_SET_{name}();\n" \
+                                f"\t\t\tSHM_TRACE_END(SHM_TRACE_RULE_SET, ARB_CHANGE_);\n" \
                                 f"\t\t{'}'}\n"
 
     if len(rule_set_names) > 0:
         return f'''int arbiter() {"{"}
+        SHM_TRACE_THREAD_NAME("arbiter");
+        SHM_PERF_COUNTERS_OPEN("arbiter");
 
         while (!are_streams_done()) {"{"}
             ARB_CHANGE_ = false;
     {rule_set_invocations}
+    {"vamos_maybe_checkpoint();" if checkpoint else ""}
         {"}"}
         shm_monitor_set_finished(monitor_buffer);
         return 0;
@@ -1107,13 +1281,17 @@ def monitor_code(tree, mapping, arbiter_event_source) -> str:
         return f'''
         // monitor
         printf("-- starting monitor code \\n");
+        SHM_TRACE_THREAD_NAME("monitor");
+        SHM_PERF_COUNTERS_OPEN("monitor");
         STREAM_{arbiter_event_source}_out * received_event;
         while(true) {"{"}
             received_event = fetch_arbiter_stream(monitor_buffer);
             if (received_event == NULL) {"{"}
                 break;
             {"}"}
+            SHM_TRACE_BEGIN(SHM_TRACE_MONITOR, received_event->head.kind);
 {monitor_events_code(tree[PPMONITOR_RULE_LIST], arbiter_event_source, possible_events, 2)}
+            SHM_TRACE_END(SHM_TRACE_MONITOR, received_event->head.kind);
         shm_monitor_buffer_consume(monitor_buffer, 1);
     {"}"}
     '''
@@ -1260,6 +1438,7 @@ def arbiter_rule_code(tree, mapping, stream_types, output_ev_source) -> str:
            
             if({process_where_condition(tree[PPARB_RULE_CONDITION_CODE])}) {"{"}
                 bool local_continue_ = false;
+                SHM_TRACE_INSTANT(SHM_TRACE_MATCH, current_rule_set);
                 {get_arb_rule_stmt_list_code(tree[PPARB_RULE_STMT_LIST], mapping, binded_args, stream_types, output_ev_source)}
                 {stream_drops_code}
 
@@ -1630,11 +1809,12 @@ def declare_rule_set_counters(tree):
     return ans
 
 
-def get_imports():
-    return f'''
-#include "shamon.h"
+def get_imports(checkpoint=False):
+    return f'''#include "shamon.h"
 #include "mmlib.h"
 #include "monitor.h"
+#include "perf_counters.h"
+#include "trace.h"
 #include "./compiler/cfiles/compiler_utils.h"
 #include <threads.h>
 #include <signal.h>
@@ -1642,6 +1822,10 @@ def get_imports():
 #include <stdint.h>
 #include <stdatomic.h>
 #include <limits.h>
+{"""#include "checkpoint.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>""" if checkpoint else ""}
 '''
 
 def special_hole_structs():
@@ -1743,14 +1927,39 @@ static void update_hole_{hole_name}(shm_event *hev, shm_event *ev) {"{"}
 '''
     return answer
 
+def get_special_holes_add_lost_code():
+    # the source lost events and we do not know their kinds,
+    # only the attributes that count all events can be updated
+    answer = ""
+    for (stream_processor, data) in TypeChecker.stream_processors_data.items():
+        stream_type = data['input_type']
+        hole_name = data['hole_name']
+        add_lost_code = ""
+        for attr_data in data['special_hole']:
+            params = attr_data['agg_func_params']
+            if attr_data['agg_func_name'].lower() == "count" and \
+               len(params) == 1 and params[0] == "*":
+                add_lost_code += f"\th->{attr_data['attribute']} += n;\n"
+        if add_lost_code == "":
+            add_lost_code = "\t(void)h;\n\t(void)n;\n"
+        answer += f'''
+static void add_lost_hole_{hole_name}(shm_event *hev, size_t n) {"{"}
+    STREAM_{stream_type}_in *e = (STREAM_{stream_type}_in*) hev;
+    EVENT_{hole_name}_hole *h = &e->cases.{hole_name};
+{add_lost_code}{"}"}
+'''
+    return answer
+
 def generate_special_hole_functions(streams_to_events_map):
     answer = f"{get_special_holes_init_code(streams_to_events_map)}\n"
     answer += f"{get_special_holes_update_code(streams_to_events_map)}\n"
+    answer += f"{get_special_holes_add_lost_code()}\n"
               
     return answer
     
     
-def outside_main_code(components, streams_to_events_map, stream_types, ast, arbiter_event_source, existing_buffers):
+def outside_main_code(components, streams_to_events_map, stream_types, ast, arbiter_event_source, existing_buffers,
+                      offline=False, checkpoint=False):
     return f'''
 
 #define __vamos_min(a, b) ((a < b) ? (a) : (b))
@@ -1790,6 +1999,11 @@ static void update_hole_hole(shm_event *hev, shm_event *ev) {"{"}
     struct _EVENT_hole_wrapper *h = (struct _EVENT_hole_wrapper *) hev;
     ++h->cases.hole.n;
 {"}"}
+
+static void add_lost_hole_hole(shm_event *hev, size_t n) {"{"}
+    struct _EVENT_hole_wrapper *h = (struct _EVENT_hole_wrapper *) hev;
+    h->cases.hole.n += n;
+{"}"}
 {events_enum_kinds(components["event_source"], streams_to_events_map)}
 {special_hole_structs()}
 {stream_type_structs(components["stream_type"])}
@@ -1841,7 +2055,7 @@ int current_rule_set = {get_first_const_rule_set_name(ast[2])};
 {declare_order_expressions()}
 {declare_buffer_groups()}
 
-{declare_perf_layer_funcs(streams_to_events_map)}
+{declare_perf_layer_funcs(streams_to_events_map, offline)}
 
 // variables used to debug arbiter
 long unsigned no_consecutive_matches_limit = 1UL<<35;
@@ -1982,7 +2196,8 @@ STREAM_{arbiter_event_source}_out *arbiter_outevent;
 {get_event_at_head()}
 {print_buffers_state()}
 {build_rule_set_functions(ast[2], streams_to_events_map, stream_types, existing_buffers)}
-{arbiter_code(ast[2], components)}
+{checkpoint_code(components) if checkpoint else ''}
+{arbiter_code(ast[2], components, checkpoint)}
 
 {define_signal_handlers(components["event_source"])}
 
@@ -2004,12 +2219,14 @@ static void setup_signals() {{
     }}
 }}
     '''
-def get_c_program(components, ast, streams_to_events_map, stream_types, arbiter_event_source, existing_buffers):
+def get_c_program(components, ast, streams_to_events_map, stream_types, arbiter_event_source, existing_buffers,
+                  offline=False, checkpoint=False):
     program = f'''
 
-{get_imports()}
+{get_imports(checkpoint)}
 
-{outside_main_code(components, streams_to_events_map, stream_types, ast, arbiter_event_source, existing_buffers)}
+{outside_main_code(components, streams_to_events_map, stream_types, ast, arbiter_event_source, existing_buffers,
+                   offline, checkpoint)}
 int main(int argc, char **argv) {"{"}
     setup_signals();
 
@@ -2026,7 +2243,10 @@ int main(int argc, char **argv) {"{"}
  	 // init buffer groups
      printf("-- initializing buffer groups\\n");
      {init_buffer_groups()}
-
+{"""
+     // restore the state if there is a checkpoint
+     vamos_restore();
+""" if checkpoint else ""}
      // create source-events threads
      printf("-- creating performance threads\\n");
      {activate_threads()}
@@ -2039,6 +2259,8 @@ int main(int argc, char **argv) {"{"}
 
      printf("-- cleaning up\\n");
      {destroy_all()}
+     SHM_PERF_COUNTERS_DUMP();
+     SHM_TRACE_FLUSH();
 
 {get_pure_c_code(components, 'cleanup')}
 {"}"}
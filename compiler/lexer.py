@@ -147,6 +147,8 @@ class MyLexer(object):
         "globals" : "GLOBALS",
         "startup": "STARTUP",
         "cleanup": "CLEANUP",
+        "checkpoint": "CHECKPOINT",
+        "restore": "RESTORE",
         "processor" : "PROCESSOR",
         "include": "INCLUDE",
         "includes": "INCLUDES",
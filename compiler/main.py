@@ -17,6 +17,14 @@ parser.add_argument("-t", "--with-tessla",
 parser.add_argument("-d", "--dir",
 					help="Directory where the library generated by Tessla is (not needed if --with-tessla flag is present).")
 parser.add_argument("-b", "--bufsize")
+parser.add_argument("--offline",
+					help="Generate a monitor for offline monitoring (e.g., of trace files recorded by shamon-record -c) "
+						 "that never drops events and waits for the arbiter instead.",
+					action="store_true")
+parser.add_argument("--checkpoint",
+					help="Generate a monitor that periodically saves its state into the file given by "
+						 "SHAMON_CHECKPOINT_FILE and restores it from there after a restart.",
+					action="store_true")
 
 args = parser.parse_args()
 bufsize = args.bufsize
@@ -118,6 +126,6 @@ if args.with_tessla:
 else:
 
 	program = get_c_program(components, ast, streams_to_events_map, stream_types, arbiter_event_source,
-							existing_buffers)
+							existing_buffers, args.offline, args.checkpoint)
 	output_file = open(output_path, "w")
 	output_file.write(program)
@@ -40,9 +40,13 @@ def p_component(p):
               | STARTUP BEGIN_CCODE CCODE_TOKEN
               | CLEANUP '{' CCODE_TOKEN '}'
               | CLEANUP BEGIN_CCODE CCODE_TOKEN
+              | CHECKPOINT '{' CCODE_TOKEN '}'
+              | CHECKPOINT BEGIN_CCODE CCODE_TOKEN
+              | RESTORE '{' CCODE_TOKEN '}'
+              | RESTORE BEGIN_CCODE CCODE_TOKEN
     '''
 
-    if p[1] not in ["globals", "startup", "cleanup"]:
+    if p[1] not in ["globals", "startup", "cleanup", "checkpoint", "restore"]:
         p[0] = p[1]
     else:
         if len(p) == 3:
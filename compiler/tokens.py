@@ -42,6 +42,8 @@ reserved = {
     "globals" : "GLOBALS",
     "startup": "STARTUP",
     "cleanup": "CLEANUP",
+    "checkpoint": "CHECKPOINT",
+    "restore": "RESTORE",
     "processor" : "PROCESSOR",
     "include" : "INCLUDE",
     "includes": "INCLUDES",
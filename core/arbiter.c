@@ -1,11 +1,14 @@
 #include "arbiter.h"
 
 #include <assert.h>
+#include <sched.h>
 #include <stddef.h>
 #include <stdio.h>
 
 #include "par_queue.h"
+#include "perf_counters.h"
 #include "stream.h"
+#include "trace.h"
 #include "utils.h"
 
 #define DROP_SPACE_DEFAULT_THRESHOLD 1
@@ -24,12 +27,23 @@ typedef struct _shm_arbiter_buffer {
     size_t written_num;               // the number of calls to write_finish
     int last_was_drop;      // true if the last event written was drop()
     size_t waited_to_push;  // how many times the buffer waited to push
+#endif
+#ifdef PERF_COUNTERS
+    shm_perf_counters *perf;  // counters of the thread that fetches events
 #endif
     shm_eventid drop_begin_id;  // the id of the next 'dropped' event
+    shm_eventid last_processed_id;  // the id of the last dropped (processed)
+                                    // event
+    shm_eventid resume_id;  // skip events up to this id (after restoring
+                            // the state from a checkpoint)
 
     shm_stream *stream;  // the source for the buffer
     shm_event *hole_event;
     bool active;  // true while the events are being queued
+    bool may_lose_events;      // the source may lose events (see
+                               // shm_stream_may_lose_events)
+    shm_eventid last_read_id;  // the id of the last event read from a source
+                               // that may lose events
 } shm_arbiter_buffer;
 
 size_t shm_arbiter_buffer_sizeof(void) { return sizeof(shm_arbiter_buffer); }
@@ -79,6 +93,7 @@ size_t shm_arbiter_buffer_drop(shm_arbiter_buffer *buffer, size_t k) {
     shm_event *ev = shm_par_queue_peek_atmost_at(&buffer->buffer, &k);
     if (!ev)
         return 0; /* empty queue */
+    SHM_TRACE_BEGIN(SHM_TRACE_DROP, k + 1);
     shm_eventid last_id = shm_event_id(ev);
 #ifndef NDEBUG
     size_t n =
@@ -86,10 +101,12 @@ size_t shm_arbiter_buffer_drop(shm_arbiter_buffer *buffer, size_t k) {
         ++k; /* k is index, we must increase it back by one */
     shm_par_queue_drop(&buffer->buffer, k);
     assert(n == k && "Something changed the queue in between");
+    buffer->last_processed_id = last_id;
     shm_stream_notify_last_processed_id(buffer->stream, last_id);
 #ifdef DUMP_STATS
     buffer->volunt_dropped_num += k;
 #endif
+    SHM_TRACE_END(SHM_TRACE_DROP, k);
     return k;
 }
 
@@ -126,7 +143,9 @@ size_t shm_arbiter_buffer_drop_older_than(shm_arbiter_buffer *buffer,
         /* now consume everything up to the found event */
         if (k > 0) {
             shm_par_queue_drop(&buffer->buffer, k);
+            buffer->last_processed_id = id;
             shm_stream_notify_last_processed_id(buffer->stream, id);
+            SHM_TRACE_INSTANT(SHM_TRACE_DROP, k);
 
 #ifdef DUMP_STATS
             buffer->volunt_dropped_num_asked += k;
@@ -201,7 +220,9 @@ size_t shm_arbiter_buffer_drop_older_than(shm_arbiter_buffer *buffer,
     /* now consume everything up to the found event */
     if (k > 0) {
         shm_par_queue_drop(&buffer->buffer, k);
+        buffer->last_processed_id = id;
         shm_stream_notify_last_processed_id(buffer->stream, id);
+        SHM_TRACE_INSTANT(SHM_TRACE_DROP, k);
 
 #ifdef DUMP_STATS
         buffer->volunt_dropped_num_asked += k;
@@ -229,6 +250,18 @@ shm_stream *shm_arbiter_buffer_stream(shm_arbiter_buffer *buffer) {
     return buffer->stream;
 }
 
+shm_eventid shm_arbiter_buffer_last_processed_id(shm_arbiter_buffer *buffer) {
+    return buffer->last_processed_id;
+}
+
+void shm_arbiter_buffer_resume_after(shm_arbiter_buffer *buffer,
+                                     shm_eventid id) {
+    assert(shm_par_queue_size(&buffer->buffer) == 0 &&
+           "Resuming a buffer that is in use");
+    buffer->resume_id = id;
+    buffer->last_processed_id = id;
+}
+
 size_t shm_arbiter_buffer_dropped_num(shm_arbiter_buffer *buffer) {
     return buffer->total_dropped_num;
 }
@@ -266,8 +299,12 @@ void shm_arbiter_buffer_init(shm_arbiter_buffer *buffer, shm_stream *stream,
     buffer->stream = stream;
     buffer->active = false;
     buffer->dropped_num = 0;
+    buffer->last_processed_id = 0;
+    buffer->resume_id = 0;
     buffer->total_dropped_times = 0;
     buffer->total_dropped_num = 0;
+    buffer->may_lose_events = shm_stream_may_lose_events(stream);
+    buffer->last_read_id = 0;
 #ifdef DUMP_STATS
     buffer->written_num = 0;
     buffer->volunt_dropped_num = 0;
@@ -275,6 +312,9 @@ void shm_arbiter_buffer_init(shm_arbiter_buffer *buffer, shm_stream *stream,
     buffer->last_was_drop = 0;
     buffer->waited_to_push = 0;
 #endif
+#ifdef PERF_COUNTERS
+    buffer->perf = NULL;
+#endif
 }
 
 shm_arbiter_buffer *shm_arbiter_buffer_create(shm_stream *stream,
@@ -293,6 +333,14 @@ void shm_arbiter_buffer_free(shm_arbiter_buffer *buffer) {
 }
 
 void shm_arbiter_buffer_destroy(shm_arbiter_buffer *buffer) {
+#ifdef PERF_COUNTERS
+    /* the stream is being torn down, report its counters */
+    if (buffer->perf) {
+        shm_perf_counters_print(buffer->perf, stderr);
+        shm_perf_counters_close(buffer->perf);
+        buffer->perf = NULL;
+    }
+#endif
     shm_par_queue_destroy(&buffer->buffer);
     free(buffer->hole_event);
 }
@@ -415,7 +463,9 @@ static void *get_event(shm_stream *stream) {
          * (with some reasonable default value) and sleep according
          * to this value */
         if (++spinned > BUSY_WAIT_FOR_EVENTS) {
+            SHM_TRACE_BEGIN(SHM_TRACE_WAIT, sleep_time);
             sleep_ns(sleep_time);
+            SHM_TRACE_END(SHM_TRACE_WAIT, sleep_time);
 #ifdef DUMP_STATS
             stream->slept_waiting_for_ev += sleep_time;
 #endif
@@ -437,6 +487,7 @@ static void *get_event(shm_stream *stream) {
 
 static void push_dropped_event(shm_stream *stream, shm_arbiter_buffer *buffer,
                                size_t notify_id) {
+    SHM_TRACE_BEGIN(SHM_TRACE_HOLE, buffer->dropped_num);
     shm_stream_prepare_hole_event(stream, buffer->hole_event, notify_id,
                                   buffer->dropped_num);
     shm_par_queue_push(&buffer->buffer, buffer->hole_event,
@@ -448,6 +499,7 @@ static void push_dropped_event(shm_stream *stream, shm_arbiter_buffer *buffer,
     ++buffer->total_dropped_times;
     shm_arbiter_buffer_notify_dropped(buffer, buffer->drop_begin_id, notify_id);
     assert(shm_arbiter_buffer_free_space(buffer) > 0);
+    SHM_TRACE_END(SHM_TRACE_HOLE, notify_id);
 
     /*
     printf("PUSHED DROPPED event { kind = %lu, id = %lu, n = %lu}\n",
@@ -508,6 +560,7 @@ static inline void start_dropping(shm_stream *stream,
     buffer->drop_begin_id = shm_event_id(event);
     assert(buffer->dropped_num == 0);
     ++buffer->dropped_num;
+    SHM_TRACE_INSTANT(SHM_TRACE_DROP, buffer->drop_begin_id);
 
     assert(buffer->hole_event);
     stream->hole_handling.init(buffer->hole_event);
@@ -566,20 +619,88 @@ static bool handle_dropping_event(shm_stream *stream,
     return false;
 }
 
+/* After resuming from a checkpoint, skip the events that were processed
+ * before the checkpoint was taken. The events between the checkpoint and
+ * the first event that is still in the stream were lost, they start
+ * a hole. Return true if the event was skipped. */
+static bool handle_resumed_event(shm_stream *stream,
+                                 shm_arbiter_buffer *buffer,
+                                 shm_event *event) {
+    const shm_eventid id = shm_event_id(event);
+    if (id <= buffer->resume_id) {
+        shm_stream_consume(stream, 1);
+        return true;
+    }
+
+    if (id > buffer->resume_id + 1) {
+        assert(buffer->dropped_num == 0);
+        buffer->drop_begin_id = buffer->resume_id + 1;
+        buffer->dropped_num = id - buffer->drop_begin_id;
+        stream->hole_handling.init(buffer->hole_event);
+        stream->hole_handling.add_lost(buffer->hole_event,
+                                       buffer->dropped_num);
+    }
+#ifndef NDEBUG
+    stream->last_event_id = id - 1;
+#endif
+    buffer->last_read_id = id - 1;
+    buffer->resume_id = 0;
+    return false;
+}
+
+/* The events between the last read event and `event` were lost by the source
+ * (e.g., the writer of a broadcast buffer overwrote them), turn them into
+ * a hole. If we are dropping events, the lost events extend the hole. */
+static void handle_lost_events(shm_stream *stream, shm_arbiter_buffer *buffer,
+                               shm_event *event) {
+    const shm_eventid id = shm_event_id(event);
+    const shm_eventid expected = buffer->last_read_id + 1;
+    buffer->last_read_id = id;
+    if (id <= expected)
+        return;
+
+    if (buffer->dropped_num == 0) {
+        buffer->drop_begin_id = expected;
+        stream->hole_handling.init(buffer->hole_event);
+    }
+    assert(buffer->drop_begin_id + buffer->dropped_num == expected &&
+           "The lost events do not follow the dropped events");
+    buffer->dropped_num += id - expected;
+    SHM_TRACE_INSTANT(SHM_TRACE_DROP, expected);
+    stream->hole_handling.add_lost(buffer->hole_event, id - expected);
+#ifndef NDEBUG
+    stream->last_event_id = id - 1;
+#endif
+}
+
 /* wait for an event on the 'stream' */
 void *stream_fetch(shm_stream *stream, shm_arbiter_buffer *buffer) {
     void *ev;
     size_t last_ev_id = 1;
+    SHM_TRACE_BEGIN(SHM_TRACE_FETCH, stream->id);
+#ifdef PERF_COUNTERS
+    /* the counters are opened by the thread that fetches the events */
+    if (!buffer->perf)
+        buffer->perf = shm_perf_counters_open(stream->name);
+#endif
     while (1) {
         ev = get_event(stream);
         if (!ev) {
-            return handle_stream_end(stream, buffer, last_ev_id);
+            ev = handle_stream_end(stream, buffer, last_ev_id);
+            SHM_TRACE_END(SHM_TRACE_FETCH, 0);
+            return ev;
         }
 
         assert(ev && "Dont have event");
         assert(!shm_event_is_hole((shm_event *)ev) && "Got dropped event");
 
         last_ev_id = shm_event_id(ev);
+        if (buffer->resume_id > 0 &&
+            handle_resumed_event(stream, buffer, ev)) {
+            continue;
+        }
+        if (buffer->may_lose_events)
+            handle_lost_events(stream, buffer, ev);
         assert(last_ev_id == ++stream->last_event_id && "IDs are inconsistent");
         /*
            printf("FETCH: read event { kind = %lu, id = %lu}\n",
@@ -591,6 +712,7 @@ void *stream_fetch(shm_stream *stream, shm_arbiter_buffer *buffer) {
 #ifdef DUMP_STATS
             ++stream->fetched_events;
 #endif
+            SHM_TRACE_END(SHM_TRACE_FETCH, last_ev_id);
             return ev;
         }
 
@@ -603,16 +725,30 @@ void *stream_filter_fetch(shm_stream *stream, shm_arbiter_buffer *buffer,
                           shm_stream_filter_fn filter) {
     void *ev;
     size_t last_ev_id = 1;
+    SHM_TRACE_BEGIN(SHM_TRACE_FETCH, stream->id);
+#ifdef PERF_COUNTERS
+    /* the counters are opened by the thread that fetches the events */
+    if (!buffer->perf)
+        buffer->perf = shm_perf_counters_open(stream->name);
+#endif
     while (1) {
         ev = get_event(stream);
         if (!ev) {
-            return handle_stream_end(stream, buffer, last_ev_id);
+            ev = handle_stream_end(stream, buffer, last_ev_id);
+            SHM_TRACE_END(SHM_TRACE_FETCH, 0);
+            return ev;
         }
 
         assert(ev && "Dont have event");
         assert(!shm_event_is_hole((shm_event *)ev) && "Got hole event");
 
         last_ev_id = shm_event_id(ev);
+        if (buffer->resume_id > 0 &&
+            handle_resumed_event(stream, buffer, ev)) {
+            continue;
+        }
+        if (buffer->may_lose_events)
+            handle_lost_events(stream, buffer, ev);
         assert(last_ev_id == ++stream->last_event_id && "IDs are inconsistent");
 
         if (filter && !filter(stream, ev)) {
@@ -631,6 +767,7 @@ void *stream_filter_fetch(shm_stream *stream, shm_arbiter_buffer *buffer,
 #ifdef DUMP_STATS
             ++stream->fetched_events;
 #endif
+            SHM_TRACE_END(SHM_TRACE_FETCH, last_ev_id);
             return ev;
         }
 
@@ -639,6 +776,108 @@ void *stream_filter_fetch(shm_stream *stream, shm_arbiter_buffer *buffer,
 }
 
 
+/* get an event from the stream without sleeping, yield the CPU while
+ * there is none and return NULL only if the stream ended */
+static void *get_event_nodrop(shm_stream *stream) {
+    size_t num = 1;
+    size_t spinned = 0;
+    void *ev;
+    while (1) {
+        ev = shm_stream_read_events(stream, &num);
+        if (ev) {
+#ifdef DUMP_STATS
+            ++stream->read_events;
+#endif
+            return ev;
+        }
+
+        if (++spinned > BUSY_WAIT_FOR_EVENTS) {
+            if (!shm_stream_is_ready(stream)) {
+                /* the stream may have written events between
+                 * the read and the check */
+                return shm_stream_read_events(stream, &num);
+            }
+            sched_yield();
+            spinned = 0;
+        }
+    }
+
+    assert(0 && "Unreachable");
+}
+
+static void wait_for_free_space(shm_arbiter_buffer *buffer) {
+    size_t spinned = 0;
+    while (shm_arbiter_buffer_free_space(buffer) == 0) {
+#ifdef DUMP_STATS
+        ++buffer->waited_to_push;
+#endif
+        if (++spinned > BUSY_WAIT_FOR_EVENTS) {
+            sched_yield();
+            spinned = 0;
+        }
+    }
+}
+
+/* Wait for an event on the 'stream' like stream_filter_fetch(), but never
+ * drop events: if the arbiter buffer is full, wait until there is space
+ * in it. That is meant for offline monitoring (e.g., of trace files)
+ * where the source waits for the monitor. */
+void *stream_filter_fetch_nodrop(shm_stream *stream,
+                                 shm_arbiter_buffer *buffer,
+                                 shm_stream_filter_fn filter) {
+    void *ev;
+    SHM_TRACE_BEGIN(SHM_TRACE_FETCH, stream->id);
+#ifdef PERF_COUNTERS
+    /* the counters are opened by the thread that fetches the events */
+    if (!buffer->perf)
+        buffer->perf = shm_perf_counters_open(stream->name);
+#endif
+    while (1) {
+        ev = get_event_nodrop(stream);
+        if (!ev) {
+            assert(!shm_stream_is_ready(stream));
+            SHM_TRACE_END(SHM_TRACE_FETCH, 0);
+            return NULL; /* stream ended */
+        }
+
+        assert(!shm_event_is_hole((shm_event *)ev) && "Got hole event");
+        if (buffer->resume_id > 0 &&
+            handle_resumed_event(stream, buffer, ev)) {
+            continue;
+        }
+        if (buffer->may_lose_events)
+            handle_lost_events(stream, buffer, ev);
+        if (buffer->dropped_num > 0) {
+            /* we cannot wait with the hole for free space like
+             * when dropping, so push it right away */
+            wait_for_free_space(buffer);
+            push_dropped_event(stream, buffer, shm_event_id(ev) - 1);
+            buffer->dropped_num = 0;
+        }
+        assert(shm_event_id(ev) == ++stream->last_event_id &&
+               "IDs are inconsistent");
+
+        if (filter && !filter(stream, ev)) {
+            /* consume the filtered event */
+            shm_stream_consume(stream, 1);
+            continue;
+        }
+
+        wait_for_free_space(buffer);
+
+#ifdef DUMP_STATS
+        ++stream->fetched_events;
+#endif
+        SHM_TRACE_END(SHM_TRACE_FETCH, shm_event_id(ev));
+        return ev;
+    }
+}
+
+void *stream_fetch_nodrop(shm_stream *stream, shm_arbiter_buffer *buffer) {
+    return stream_filter_fetch_nodrop(stream, buffer, NULL);
+}
+
+
 bool shm_arbiter_buffer_is_done(shm_arbiter_buffer *buffer) {
     /* XXX: should we rather use a flag that we set to true when stream-fetch
      * knows that the stream is done? */
@@ -61,12 +61,26 @@ size_t shm_arbiter_buffer_drop(shm_arbiter_buffer *buffer, size_t n);
 size_t shm_arbiter_buffer_drop_older_than(shm_arbiter_buffer *buffer,
                                           shm_eventid id);
 bool shm_arbiter_buffer_pop(shm_arbiter_buffer *q, void *buff);
+/* the ID of the last event dropped from the buffer, i.e., processed
+ * by the monitor */
+shm_eventid shm_arbiter_buffer_last_processed_id(shm_arbiter_buffer *buffer);
+/* Skip events with ID up to `id` when fetching from the stream. Used when
+ * restoring the state of the monitor from a checkpoint, must be called
+ * before the events are fetched. */
+void shm_arbiter_buffer_resume_after(shm_arbiter_buffer *buffer,
+                                     shm_eventid id);
 
 void *stream_fetch(shm_stream *stream, shm_arbiter_buffer *buffer);
 
 void *stream_filter_fetch(shm_stream *stream, shm_arbiter_buffer *buffer,
                           shm_stream_filter_fn filter);
 
+/* variants of the functions above that never drop events */
+void *stream_fetch_nodrop(shm_stream *stream, shm_arbiter_buffer *buffer);
+void *stream_filter_fetch_nodrop(shm_stream *stream,
+                                 shm_arbiter_buffer *buffer,
+                                 shm_stream_filter_fn filter);
+
 bool shm_arbiter_buffer_is_done(shm_arbiter_buffer *buffer);
 
 size_t shm_arbiter_buffer_dropped_num(shm_arbiter_buffer *buffer);
@@ -0,0 +1,354 @@
+#include "bridge.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "lz.h"
+#include "utils.h"
+
+/* do not try to compress tiny payloads */
+#define MIN_COMPRESS_SIZE 64
+
+struct _shm_bridge_conn {
+    int fd;
+    bool compress;
+    /* compressed payloads that are sent */
+    unsigned char *send_buf;
+    /* received payloads (compressed and decompressed) */
+    unsigned char *recv_buf;
+    unsigned char *raw_buf;
+    uint64_t sent_raw;
+    uint64_t sent_wire;
+};
+
+static struct addrinfo *resolve(const char *host, const char *port,
+                                int flags) {
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = flags;
+    int ret = getaddrinfo(host, port, &hints, &res);
+    if (ret != 0) {
+        fprintf(stderr, "Failed resolving %s:%s: %s\n", host ? host : "*",
+                port, gai_strerror(ret));
+        return NULL;
+    }
+    return res;
+}
+
+static void set_nodelay(int fd) {
+    int one = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0)
+        perror("setsockopt(TCP_NODELAY)");
+}
+
+int shm_bridge_connect(const char *host, const char *port) {
+    struct addrinfo *res = resolve(host, port, 0);
+    if (!res)
+        return -1;
+
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd < 0) {
+        fprintf(stderr, "Failed connecting to %s:%s: %s\n", host, port,
+                strerror(errno));
+        return -1;
+    }
+    set_nodelay(fd);
+    return fd;
+}
+
+int shm_bridge_accept(const char *host, const char *port) {
+    struct addrinfo *res = resolve(host, port, AI_PASSIVE);
+    if (!res)
+        return -1;
+
+    int lfd = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        lfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (lfd < 0)
+            continue;
+        int one = 1;
+        setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(lfd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(lfd, 1) == 0)
+            break;
+        close(lfd);
+        lfd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (lfd < 0) {
+        fprintf(stderr, "Failed listening on port %s: %s\n", port,
+                strerror(errno));
+        return -1;
+    }
+
+    int fd = accept(lfd, NULL, NULL);
+    if (fd < 0)
+        perror("accept");
+    close(lfd);
+    if (fd >= 0)
+        set_nodelay(fd);
+    return fd;
+}
+
+shm_bridge_conn *shm_bridge_conn_create(int fd, bool compress) {
+    shm_bridge_conn *c = xalloc(sizeof(*c));
+    c->fd = fd;
+    c->compress = compress;
+    c->send_buf =
+        compress ? xalloc(SHM_LZ_COMPRESS_BOUND(SHM_BRIDGE_MAX_PAYLOAD)) : NULL;
+    c->recv_buf = xalloc(SHM_LZ_COMPRESS_BOUND(SHM_BRIDGE_MAX_PAYLOAD));
+    c->raw_buf = xalloc(SHM_BRIDGE_MAX_PAYLOAD);
+    c->sent_raw = 0;
+    c->sent_wire = 0;
+    return c;
+}
+
+void shm_bridge_conn_destroy(shm_bridge_conn *c) {
+    close(c->fd);
+    free(c->send_buf);
+    free(c->recv_buf);
+    free(c->raw_buf);
+    free(c);
+}
+
+void shm_bridge_conn_finish(shm_bridge_conn *c) {
+    if (shutdown(c->fd, SHUT_WR) < 0) {
+        perror("shutdown");
+        return;
+    }
+    ssize_t n;
+    while ((n = read(c->fd, c->recv_buf, SHM_BRIDGE_MAX_PAYLOAD)) != 0) {
+        if (n < 0 && errno != EINTR)
+            break;
+    }
+}
+
+static int write_all(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("writev");
+            return -1;
+        }
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+/* returns 1 on success, 0 on EOF before reading anything and -1 on error */
+static int read_all(int fd, void *buf, size_t size) {
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = read(fd, (char *)buf + got, size - got);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("read");
+            return -1;
+        }
+        if (n == 0) {
+            if (got == 0)
+                return 0;
+            fprintf(stderr, "Connection closed in the middle of a frame\n");
+            return -1;
+        }
+        got += n;
+    }
+    return 1;
+}
+
+static void encode_header(const shm_bridge_frame_header *hdr,
+                          unsigned char *out) {
+    shm_bridge_put_u32(out, hdr->size);
+    shm_bridge_put_u32(out + 4, hdr->raw_size);
+    out[8] = hdr->type >> 8;
+    out[9] = hdr->type & 0xff;
+    out[10] = hdr->flags >> 8;
+    out[11] = hdr->flags & 0xff;
+    shm_bridge_put_u32(out + 12, hdr->channel);
+}
+
+static void decode_header(const unsigned char *in,
+                          shm_bridge_frame_header *hdr) {
+    hdr->size = shm_bridge_get_u32(in);
+    hdr->raw_size = shm_bridge_get_u32(in + 4);
+    hdr->type = (in[8] << 8) | in[9];
+    hdr->flags = (in[10] << 8) | in[11];
+    hdr->channel = shm_bridge_get_u32(in + 12);
+}
+
+int shm_bridge_send(shm_bridge_conn *c, enum shm_bridge_frame_type type,
+                    uint32_t channel, const void *payload, size_t size) {
+    assert(size <= SHM_BRIDGE_MAX_PAYLOAD && "Payload too large");
+
+    shm_bridge_frame_header hdr = {.size = size,
+                                   .raw_size = size,
+                                   .type = type,
+                                   .flags = 0,
+                                   .channel = channel};
+    if (c->compress && size >= MIN_COMPRESS_SIZE) {
+        /* use the compressed payload only if it is smaller */
+        size_t csize = shm_lz_compress(payload, size, c->send_buf, size - 1);
+        if (csize > 0) {
+            hdr.size = csize;
+            hdr.flags |= SHM_BRIDGE_COMPRESSED;
+            payload = c->send_buf;
+        }
+    }
+
+    unsigned char wire[SHM_BRIDGE_HEADER_SIZE];
+    encode_header(&hdr, wire);
+    struct iovec iov[2] = {{.iov_base = wire, .iov_len = sizeof(wire)},
+                           {.iov_base = (void *)payload, .iov_len = hdr.size}};
+    if (write_all(c->fd, iov, hdr.size > 0 ? 2 : 1) < 0)
+        return -1;
+
+    c->sent_raw += size;
+    c->sent_wire += hdr.size;
+    return 0;
+}
+
+const void *shm_bridge_recv(shm_bridge_conn *c, shm_bridge_frame_header *hdr) {
+    unsigned char wire[SHM_BRIDGE_HEADER_SIZE];
+    int ret = read_all(c->fd, wire, sizeof(wire));
+    if (ret <= 0) {
+        hdr->type = 0;
+        return NULL;
+    }
+    decode_header(wire, hdr);
+
+    if (hdr->raw_size > SHM_BRIDGE_MAX_PAYLOAD ||
+        hdr->size > SHM_LZ_COMPRESS_BOUND(SHM_BRIDGE_MAX_PAYLOAD)) {
+        fprintf(stderr, "Got invalid frame (size %u)\n", hdr->raw_size);
+        return NULL;
+    }
+
+    if (!(hdr->flags & SHM_BRIDGE_COMPRESSED)) {
+        if (hdr->size != hdr->raw_size ||
+            read_all(c->fd, c->raw_buf, hdr->size) <= 0)
+            return NULL;
+        return c->raw_buf;
+    }
+
+    if (read_all(c->fd, c->recv_buf, hdr->size) <= 0)
+        return NULL;
+    if (shm_lz_decompress(c->recv_buf, hdr->size, c->raw_buf,
+                          SHM_BRIDGE_MAX_PAYLOAD) != hdr->raw_size) {
+        fprintf(stderr, "Failed decompressing a frame\n");
+        return NULL;
+    }
+    return c->raw_buf;
+}
+
+bool shm_bridge_can_recv(shm_bridge_conn *c) {
+    struct pollfd pfd = {.fd = c->fd, .events = POLLIN};
+    return poll(&pfd, 1, 0) > 0;
+}
+
+void shm_bridge_sent_bytes(shm_bridge_conn *c, uint64_t *raw, uint64_t *wire) {
+    *raw = c->sent_raw;
+    *wire = c->sent_wire;
+}
+
+static bool host_is_little_endian(void) {
+    const uint16_t one = 1;
+    return *(const unsigned char *)&one == 1;
+}
+
+void shm_bridge_hello_encode(const shm_bridge_hello *hello,
+                             const struct event_record *events,
+                             unsigned char *out) {
+    memset(out, 0, SHM_BRIDGE_HELLO_SIZE);
+    shm_bridge_put_u32(out, SHM_BRIDGE_VERSION);
+    shm_bridge_put_u32(out + 4, hello->events_num);
+    shm_bridge_put_u64(out + 8, hello->elem_size);
+    shm_bridge_put_u64(out + 16, hello->capacity);
+    shm_bridge_put_u32(out + 24,
+                       host_is_little_endian() ? SHM_BRIDGE_LITTLE_ENDIAN : 0);
+    strncpy((char *)out + 28, hello->key, sizeof(hello->key) - 1);
+
+    out += SHM_BRIDGE_HELLO_SIZE;
+    for (uint32_t i = 0; i < hello->events_num; ++i) {
+        const struct event_record *rec = &events[i];
+        memset(out, 0, SHM_BRIDGE_RECORD_SIZE);
+        strncpy((char *)out, rec->name, sizeof(rec->name) - 1);
+        shm_bridge_put_u64(out + 64, rec->kind);
+        shm_bridge_put_u64(out + 72, rec->size);
+        strncpy((char *)out + 80, (const char *)rec->signature,
+                sizeof(rec->signature) - 1);
+        out += SHM_BRIDGE_RECORD_SIZE;
+    }
+}
+
+struct event_record *shm_bridge_hello_decode(const unsigned char *payload,
+                                             size_t size,
+                                             shm_bridge_hello *hello) {
+    if (size < SHM_BRIDGE_HELLO_SIZE)
+        return NULL;
+    hello->version = shm_bridge_get_u32(payload);
+    hello->events_num = shm_bridge_get_u32(payload + 4);
+    hello->elem_size = shm_bridge_get_u64(payload + 8);
+    hello->capacity = shm_bridge_get_u64(payload + 16);
+    hello->flags = shm_bridge_get_u32(payload + 24);
+    memcpy(hello->key, payload + 28, sizeof(hello->key));
+    hello->key[sizeof(hello->key) - 1] = '\0';
+
+    if (hello->version != SHM_BRIDGE_VERSION ||
+        size != SHM_BRIDGE_HELLO_SIZE +
+                    (size_t)hello->events_num * SHM_BRIDGE_RECORD_SIZE)
+        return NULL;
+    const bool little = hello->flags & SHM_BRIDGE_LITTLE_ENDIAN;
+    if (little != host_is_little_endian()) {
+        fprintf(stderr, "The sender has a different byte order\n");
+        return NULL;
+    }
+
+    /* allocate at least one record, malloc(0) may return NULL */
+    struct event_record *events =
+        xalloc((hello->events_num + 1) * sizeof(struct event_record));
+    const unsigned char *in = payload + SHM_BRIDGE_HELLO_SIZE;
+    for (uint32_t i = 0; i < hello->events_num; ++i) {
+        struct event_record *rec = &events[i];
+        memcpy(rec->name, in, sizeof(rec->name));
+        rec->name[sizeof(rec->name) - 1] = '\0';
+        rec->kind = shm_bridge_get_u64(in + 64);
+        rec->size = shm_bridge_get_u64(in + 72);
+        memcpy(rec->signature, in + 80, sizeof(rec->signature));
+        rec->signature[sizeof(rec->signature) - 1] = '\0';
+        in += SHM_BRIDGE_RECORD_SIZE;
+    }
+    return events;
+}
@@ -0,0 +1,154 @@
+/***********************************************
+ * The protocol of the network bridge (shamon-bridge-send and
+ * shamon-bridge-recv) that forwards shared-memory buffers to another host.
+ *
+ * The data are sent over a TCP connection in frames. Every frame has
+ * a fixed-size header that carries the type of the frame, the channel
+ * (one channel per forwarded buffer) and the size of the payload.
+ * All integers of the protocol are big-endian and have the sizes given
+ * below, whatever the layout of the structures on the hosts is:
+ *
+ *  header  size (4), raw_size (4), type (2), flags (2), channel (4)
+ *  HELLO   version (4), events_num (4), elem_size (8), capacity (8),
+ *          flags (4), key (256 bytes, 0-terminated)
+ *  record  name (64 bytes), kind (8), size (8), signature (32 bytes)
+ *
+ * The payload of a frame may be compressed (see lz.h), in which case
+ * the header has the SHM_BRIDGE_COMPRESSED flag and also the size of
+ * the decompressed payload. The frames are:
+ *
+ *  HELLO   (sender -> receiver) describes a new buffer: the payload is
+ *          the encoded shm_bridge_hello followed by `events_num`
+ *          encoded event_records
+ *  DATA    (sender -> receiver) a batch of events of the channel,
+ *          every event is the buffer element as it is in the shared
+ *          memory, only string arguments are replaced by 0 and the
+ *          strings (with the terminating 0) follow the element, each
+ *          prefixed by its length (4)
+ *  END     (sender -> receiver) no more events come on the channel
+ *  CREDIT  (receiver -> sender) the payload is the number of bytes (8)
+ *          (of decompressed payloads of DATA frames) that the sender
+ *          may send more
+ *
+ * The sender never has more DATA bytes in flight than it got credit for,
+ * so the receiver controls how much data is buffered between the hosts
+ * and a slow monitor slows down the sender instead of exhausting memory.
+ * The elements of buffers are sent as raw bytes, so both hosts must have
+ * the same layout of events. HELLO carries the byte order of the sender
+ * and the receiver refuses buffers of the other byte order.
+ ************************************************/
+
+#ifndef SHAMON_BRIDGE_H_
+#define SHAMON_BRIDGE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "source.h"
+
+#define SHM_BRIDGE_VERSION 2
+/* the maximal size of the (decompressed) payload of a frame */
+#define SHM_BRIDGE_MAX_PAYLOAD (1 << 20)
+
+enum shm_bridge_frame_type {
+    SHM_BRIDGE_HELLO = 1,
+    SHM_BRIDGE_DATA = 2,
+    SHM_BRIDGE_END = 3,
+    SHM_BRIDGE_CREDIT = 4,
+};
+
+#define SHM_BRIDGE_COMPRESSED 0x1
+/* the flag of HELLO: the elements of the buffer are little-endian */
+#define SHM_BRIDGE_LITTLE_ENDIAN 0x1
+
+/* the sizes of the encoded structures */
+#define SHM_BRIDGE_HEADER_SIZE 16
+#define SHM_BRIDGE_HELLO_SIZE 284
+#define SHM_BRIDGE_RECORD_SIZE 112
+
+typedef struct _shm_bridge_frame_header {
+    /* the size of the payload that follows the header */
+    uint32_t size;
+    /* the size of the payload after decompression */
+    uint32_t raw_size;
+    uint16_t type;
+    uint16_t flags;
+    uint32_t channel;
+} shm_bridge_frame_header;
+
+typedef struct _shm_bridge_hello {
+    uint32_t version;
+    uint32_t events_num;
+    uint64_t elem_size;
+    uint64_t capacity;
+    uint32_t flags;
+    char key[256];
+} shm_bridge_hello;
+
+static inline void shm_bridge_put_u32(unsigned char *out, uint32_t v) {
+    for (int i = 3; i >= 0; --i, v >>= 8) out[i] = v & 0xff;
+}
+
+static inline void shm_bridge_put_u64(unsigned char *out, uint64_t v) {
+    for (int i = 7; i >= 0; --i, v >>= 8) out[i] = v & 0xff;
+}
+
+static inline uint32_t shm_bridge_get_u32(const unsigned char *in) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v = (v << 8) | in[i];
+    return v;
+}
+
+static inline uint64_t shm_bridge_get_u64(const unsigned char *in) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v = (v << 8) | in[i];
+    return v;
+}
+
+/* Encode the payload of HELLO into `out` that must have
+ * SHM_BRIDGE_HELLO_SIZE + events_num * SHM_BRIDGE_RECORD_SIZE bytes.
+ * The version and the byte order are filled in. */
+void shm_bridge_hello_encode(const shm_bridge_hello *hello,
+                             const struct event_record *events,
+                             unsigned char *out);
+/* Decode the payload of HELLO. Returns the (allocated) array of
+ * hello->events_num event records or NULL if the payload is invalid
+ * or comes from a host with a different byte order. */
+struct event_record *shm_bridge_hello_decode(const unsigned char *payload,
+                                             size_t size,
+                                             shm_bridge_hello *hello);
+
+/* Connect to the given host and port, returns the socket or -1 */
+int shm_bridge_connect(const char *host, const char *port);
+/* Listen on the given address (host may be NULL) and accept
+ * a single connection. Returns the socket or -1. */
+int shm_bridge_accept(const char *host, const char *port);
+
+typedef struct _shm_bridge_conn shm_bridge_conn;
+
+/* Take over the socket. If `compress` is true, the payloads of frames
+ * that are sent are compressed (if it makes them smaller). */
+shm_bridge_conn *shm_bridge_conn_create(int fd, bool compress);
+/* Close the connection and the socket */
+void shm_bridge_conn_destroy(shm_bridge_conn *c);
+/* Tell the other side that we will not send anything more and wait
+ * until it closes the connection, discarding the frames that still come.
+ * Closing the socket right away could make the other side lose the data
+ * that it has not read yet. */
+void shm_bridge_conn_finish(shm_bridge_conn *c);
+
+/* Send a frame, returns 0 on success and -1 on error */
+int shm_bridge_send(shm_bridge_conn *c, enum shm_bridge_frame_type type,
+                    uint32_t channel, const void *payload, size_t size);
+/* Receive a frame. Returns the (decompressed) payload that is valid until
+ * the next call or NULL on error or when the connection was closed
+ * (then hdr->type is 0). hdr->raw_size is the size of the payload. */
+const void *shm_bridge_recv(shm_bridge_conn *c, shm_bridge_frame_header *hdr);
+/* Check if a frame can be received without blocking */
+bool shm_bridge_can_recv(shm_bridge_conn *c);
+
+/* The number of payload bytes sent before and after compression */
+void shm_bridge_sent_bytes(shm_bridge_conn *c, uint64_t *raw, uint64_t *wire);
+
+#endif /* SHAMON_BRIDGE_H_ */
@@ -0,0 +1,217 @@
+#include "checkpoint.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+#define MAGIC "SHMCKPT"
+
+struct header {
+    char magic[8];
+    uint32_t version;
+    uint32_t values_num;
+};
+
+struct value_header {
+    uint32_t name_len;
+    uint64_t size;
+} __attribute__((packed));
+
+struct _shm_checkpoint_writer {
+    char *path;
+    unsigned char *data;
+    size_t size;
+    size_t allocated;
+    uint32_t values_num;
+};
+
+struct _shm_checkpoint {
+    unsigned char *data;
+    size_t size;
+    uint32_t values_num;
+};
+
+/* FNV-1a */
+static uint64_t checksum(const unsigned char *data, size_t size) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= data[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static void append(shm_checkpoint_writer *w, const void *data, size_t size) {
+    if (w->size + size > w->allocated) {
+        while (w->size + size > w->allocated) w->allocated *= 2;
+        w->data = realloc(w->data, w->allocated);
+        assert(w->data && "Memory allocation failed");
+    }
+    memcpy(w->data + w->size, data, size);
+    w->size += size;
+}
+
+shm_checkpoint_writer *shm_checkpoint_begin(const char *path) {
+    shm_checkpoint_writer *w = xalloc(sizeof(*w));
+    w->path = xstrdup(path);
+    w->allocated = 4096;
+    w->data = xalloc(w->allocated);
+    w->size = 0;
+    w->values_num = 0;
+
+    /* the number of values is filled in when committing */
+    struct header hdr = {.magic = MAGIC, .version = SHM_CHECKPOINT_VERSION};
+    append(w, &hdr, sizeof(hdr));
+    return w;
+}
+
+int shm_checkpoint_write(shm_checkpoint_writer *w, const char *name,
+                         const void *data, size_t size) {
+    struct value_header vh = {.name_len = strlen(name), .size = size};
+    append(w, &vh, sizeof(vh));
+    append(w, name, vh.name_len);
+    append(w, data, size);
+    ++w->values_num;
+    return 0;
+}
+
+static void writer_free(shm_checkpoint_writer *w) {
+    free(w->path);
+    free(w->data);
+    free(w);
+}
+
+void shm_checkpoint_abort(shm_checkpoint_writer *w) { writer_free(w); }
+
+int shm_checkpoint_commit(shm_checkpoint_writer *w) {
+    ((struct header *)w->data)->values_num = w->values_num;
+    const uint64_t sum = checksum(w->data, w->size);
+
+    const size_t pathlen = strlen(w->path);
+    char *tmppath = xalloc(pathlen + 5);
+    memcpy(tmppath, w->path, pathlen);
+    memcpy(tmppath + pathlen, ".tmp", 5);
+
+    int ret = -1;
+    FILE *f = fopen(tmppath, "wb");
+    if (!f) {
+        perror("opening checkpoint file");
+        goto out;
+    }
+    if (fwrite(w->data, 1, w->size, f) != w->size ||
+        fwrite(&sum, sizeof(sum), 1, f) != 1 || fflush(f) != 0 ||
+        fsync(fileno(f)) != 0) {
+        perror("writing checkpoint");
+        fclose(f);
+        unlink(tmppath);
+        goto out;
+    }
+    if (fclose(f) != 0) {
+        perror("closing checkpoint file");
+        unlink(tmppath);
+        goto out;
+    }
+    if (rename(tmppath, w->path) != 0) {
+        perror("renaming checkpoint file");
+        unlink(tmppath);
+        goto out;
+    }
+    ret = 0;
+
+out:
+    free(tmppath);
+    writer_free(w);
+    return ret;
+}
+
+shm_checkpoint *shm_checkpoint_load(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+
+    shm_checkpoint *cp = NULL;
+    unsigned char *data = NULL;
+    if (fseek(f, 0, SEEK_END) != 0)
+        goto fail;
+    long size = ftell(f);
+    if (size < (long)(sizeof(struct header) + sizeof(uint64_t)))
+        goto invalid;
+    rewind(f);
+
+    data = xalloc(size);
+    if (fread(data, 1, size, f) != (size_t)size)
+        goto fail;
+
+    size -= sizeof(uint64_t);
+    uint64_t sum;
+    memcpy(&sum, data + size, sizeof(sum));
+    struct header hdr;
+    memcpy(&hdr, data, sizeof(hdr));
+    if (memcmp(hdr.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        hdr.version != SHM_CHECKPOINT_VERSION ||
+        checksum(data, size) != sum)
+        goto invalid;
+
+    cp = xalloc(sizeof(*cp));
+    cp->data = data;
+    cp->size = size;
+    cp->values_num = hdr.values_num;
+    fclose(f);
+    return cp;
+
+invalid:
+    fprintf(stderr, "'%s' is not a valid checkpoint\n", path);
+    goto out;
+fail:
+    perror("reading checkpoint");
+out:
+    free(data);
+    fclose(f);
+    return NULL;
+}
+
+void shm_checkpoint_free(shm_checkpoint *cp) {
+    free(cp->data);
+    free(cp);
+}
+
+const void *shm_checkpoint_get(shm_checkpoint *cp, const char *name,
+                               size_t *size) {
+    const size_t name_len = strlen(name);
+    size_t off = sizeof(struct header);
+    for (uint32_t i = 0; i < cp->values_num; ++i) {
+        struct value_header vh;
+        if (off + sizeof(vh) > cp->size)
+            break;
+        memcpy(&vh, cp->data + off, sizeof(vh));
+        off += sizeof(vh);
+        if (vh.name_len > cp->size - off ||
+            vh.size > cp->size - off - vh.name_len)
+            break;
+        const unsigned char *value_name = cp->data + off;
+        off += vh.name_len;
+        if (vh.name_len == name_len &&
+            memcmp(value_name, name, name_len) == 0) {
+            if (size)
+                *size = vh.size;
+            return cp->data + off;
+        }
+        off += vh.size;
+    }
+    return NULL;
+}
+
+bool shm_checkpoint_read(shm_checkpoint *cp, const char *name, void *data,
+                         size_t size) {
+    size_t value_size;
+    const void *value = shm_checkpoint_get(cp, name, &value_size);
+    if (!value || value_size != size)
+        return false;
+    memcpy(data, value, size);
+    return true;
+}
@@ -0,0 +1,60 @@
+/***********************************************
+ * Checkpoints of the state of monitors.
+ *
+ * A checkpoint is a file with named binary values (e.g., the state
+ * of the arbiter, global variables of the monitor and the IDs of the
+ * last events processed from every stream). A monitor that crashed or
+ * was restarted can load the checkpoint and continue from the saved
+ * state while the sources keep running.
+ *
+ * The file starts with a header (magic, version and the number of
+ * values), then the values follow, each as the length of the name,
+ * the size of the data, the name and the data. The file ends with
+ * a checksum of everything before it. A checkpoint is written into
+ * a temporary file that replaces the old checkpoint only when it is
+ * complete, so a crash while writing the checkpoint keeps the old one.
+ * Values are stored as raw bytes, so the checkpoint can be loaded only
+ * by the same monitor on the same architecture.
+ ************************************************/
+
+#ifndef SHAMON_CHECKPOINT_H_
+#define SHAMON_CHECKPOINT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SHM_CHECKPOINT_VERSION 1
+
+typedef struct _shm_checkpoint_writer shm_checkpoint_writer;
+typedef struct _shm_checkpoint shm_checkpoint;
+
+/* Start writing a new checkpoint that will replace the one in `path` */
+shm_checkpoint_writer *shm_checkpoint_begin(const char *path);
+/* Add a value to the checkpoint, returns 0 on success and -1 on error */
+int shm_checkpoint_write(shm_checkpoint_writer *w, const char *name,
+                         const void *data, size_t size);
+/* Finish the checkpoint and replace the old one. Returns 0 on success
+ * and -1 on error, the writer is freed in both cases. */
+int shm_checkpoint_commit(shm_checkpoint_writer *w);
+/* Throw away the checkpoint that is being written */
+void shm_checkpoint_abort(shm_checkpoint_writer *w);
+
+/* Load the checkpoint from `path`. Returns NULL if the file does not
+ * exist or is not a valid checkpoint. */
+shm_checkpoint *shm_checkpoint_load(const char *path);
+void shm_checkpoint_free(shm_checkpoint *cp);
+/* Get the value with the given name or NULL if there is none */
+const void *shm_checkpoint_get(shm_checkpoint *cp, const char *name,
+                               size_t *size);
+/* Copy the value with the given name into `data`. Returns false
+ * if there is no such value or it has a different size. */
+bool shm_checkpoint_read(shm_checkpoint *cp, const char *name, void *data,
+                         size_t size);
+
+/* Save (restore) a variable under its name */
+#define SHM_CHECKPOINT_VAR(w, var) \
+    shm_checkpoint_write((w), #var, &(var), sizeof(var))
+#define SHM_RESTORE_VAR(cp, var) \
+    shm_checkpoint_read((cp), #var, &(var), sizeof(var))
+
+#endif /* SHAMON_CHECKPOINT_H_ */
@@ -0,0 +1,88 @@
+#include "line_reader.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+void shm_line_reader_init(struct shm_line_reader *reader, int fd,
+                          size_t capacity) {
+    assert(capacity > 0);
+    reader->fd = fd;
+    reader->capacity = capacity;
+    reader->buf = xalloc(capacity + 1);
+    reader->start = reader->end = 0;
+    reader->eof = false;
+}
+
+void shm_line_reader_destroy(struct shm_line_reader *reader) {
+    free(reader->buf);
+}
+
+/* read more data, return false if there are none */
+static bool fill(struct shm_line_reader *reader) {
+    /* move the partial line to the beginning of the buffer */
+    if (reader->start > 0) {
+        memmove(reader->buf, reader->buf + reader->start,
+                reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    /* the partial line is longer than the buffer */
+    if (reader->end == reader->capacity) {
+        reader->capacity *= 2;
+        reader->buf = realloc(reader->buf, reader->capacity + 1);
+        if (!reader->buf) {
+            perror("realloc");
+            abort();
+        }
+    }
+
+    ssize_t len;
+    do {
+        len = read(reader->fd, reader->buf + reader->end,
+                   reader->capacity - reader->end);
+    } while (len < 0 && errno == EINTR);
+
+    if (len <= 0) {
+        if (len < 0)
+            perror("reading lines");
+        reader->eof = true;
+        return false;
+    }
+    reader->end += len;
+    return true;
+}
+
+ssize_t shm_line_reader_next(struct shm_line_reader *reader, char **line) {
+    size_t searched = reader->start;
+    for (;;) {
+        char *nl = memchr(reader->buf + searched, '\n', reader->end - searched);
+        if (nl) {
+            *nl = '\0';
+            *line = reader->buf + reader->start;
+            const size_t len = nl - *line;
+            reader->start += len + 1;
+            return len;
+        }
+
+        /* do not search the partial line again */
+        searched = reader->end - reader->start;
+        if (reader->eof || !fill(reader))
+            break;
+        /* `fill` moved the partial line to the beginning */
+    }
+
+    /* the last line has no newline */
+    if (reader->start == reader->end)
+        return -1;
+    *line = reader->buf + reader->start;
+    const size_t len = reader->end - reader->start;
+    reader->buf[reader->end] = '\0';
+    reader->start = reader->end;
+    return len;
+}
@@ -0,0 +1,40 @@
+/***********************************************
+ * Reading lines from a file descriptor in big chunks.
+ *
+ * Unlike getline, the reader does not copy the lines: it reads large
+ * blocks into its buffer, finds the newlines with memchr (which is
+ * vectorised in libc) and hands out the lines in place.
+ ************************************************/
+
+#ifndef SHAMON_LINE_READER_H_
+#define SHAMON_LINE_READER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h> /* ssize_t */
+
+struct shm_line_reader {
+    int fd;
+    char *buf;
+    /* the buffer has `capacity + 1` bytes, so that we can always
+     * terminate the last line */
+    size_t capacity;
+    /* the unprocessed data are buf[start, end) */
+    size_t start, end;
+    bool eof;
+};
+
+/* The default size of the chunks that are read at once */
+#define SHM_LINE_READER_CAPACITY (256 * 1024)
+
+void shm_line_reader_init(struct shm_line_reader *reader, int fd,
+                          size_t capacity);
+void shm_line_reader_destroy(struct shm_line_reader *reader);
+
+/* Get the next line without the newline, terminated with NUL. Returns
+ * the length of the line or -1 at the end of input (or on error).
+ * The line is valid until the next call of the function, it can be
+ * modified in place. A line longer than the capacity grows the buffer. */
+ssize_t shm_line_reader_next(struct shm_line_reader *reader, char **line);
+
+#endif /* SHAMON_LINE_READER_H_ */
@@ -0,0 +1,171 @@
+#include "lz.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define HASH_LOG 12
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+/* the format requires that the last bytes are literals */
+#define LAST_LITERALS 5
+#define MF_LIMIT 12
+
+static inline uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash(uint32_t v) {
+    return (v * 2654435761U) >> (32 - HASH_LOG);
+}
+
+/* the number of bytes needed to encode the length in a sequence */
+static inline size_t len_size(size_t len) {
+    return len < 15 ? 0 : (len - 15) / 255 + 1;
+}
+
+static unsigned char *write_len(unsigned char *op, size_t len) {
+    len -= 15;
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+static unsigned char *write_sequence(unsigned char *op, unsigned char *oend,
+                                     const unsigned char *literals,
+                                     size_t lit_len, size_t offset,
+                                     size_t match_len) {
+    const size_t need = 1 + len_size(lit_len) + lit_len +
+                        (offset ? 2 + len_size(match_len - MIN_MATCH) : 0);
+    if ((size_t)(oend - op) < need)
+        return NULL;
+
+    unsigned char *token = op++;
+    *token = (unsigned char)((lit_len < 15 ? lit_len : 15) << 4);
+    if (lit_len >= 15)
+        op = write_len(op, lit_len);
+    memcpy(op, literals, lit_len);
+    op += lit_len;
+
+    if (offset) {
+        *op++ = offset & 0xff;
+        *op++ = offset >> 8;
+        match_len -= MIN_MATCH;
+        *token |= match_len < 15 ? match_len : 15;
+        if (match_len >= 15)
+            op = write_len(op, match_len);
+    }
+
+    return op;
+}
+
+size_t shm_lz_compress(const void *src, size_t size, void *dst,
+                       size_t capacity) {
+    const unsigned char *const base = src;
+    const unsigned char *const iend = base + size;
+    const unsigned char *ip = base;
+    const unsigned char *anchor = base;
+    unsigned char *op = dst;
+    unsigned char *const oend = op + capacity;
+    uint32_t table[1 << HASH_LOG] = {0};
+
+    if (size >= MF_LIMIT) {
+        const unsigned char *const mflimit = iend - MF_LIMIT;
+        const unsigned char *const matchlimit = iend - LAST_LITERALS;
+        while (ip < mflimit) {
+            const uint32_t seq = read32(ip);
+            const uint32_t h = hash(seq);
+            const unsigned char *ref = base + table[h];
+            table[h] = (uint32_t)(ip - base);
+
+            if (ref >= ip || ip - ref > MAX_OFFSET || read32(ref) != seq) {
+                ++ip;
+                continue;
+            }
+
+            size_t match_len = MIN_MATCH;
+            while (ip + match_len < matchlimit && ref[match_len] == ip[match_len])
+                ++match_len;
+
+            op = write_sequence(op, oend, anchor, ip - anchor, ip - ref,
+                                match_len);
+            if (!op)
+                return 0;
+            ip += match_len;
+            anchor = ip;
+        }
+    }
+
+    op = write_sequence(op, oend, anchor, iend - anchor, 0, 0);
+    if (!op)
+        return 0;
+    return op - (unsigned char *)dst;
+}
+
+/* read the extension of a length, returns false on malformed input */
+static inline int read_len(const unsigned char **ip, const unsigned char *iend,
+                           size_t *len) {
+    unsigned char b;
+    do {
+        if (*ip >= iend)
+            return 0;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 1;
+}
+
+size_t shm_lz_decompress(const void *src, size_t size, void *dst,
+                         size_t capacity) {
+    const unsigned char *ip = src;
+    const unsigned char *const iend = ip + size;
+    unsigned char *const ostart = dst;
+    unsigned char *op = ostart;
+    unsigned char *const oend = op + capacity;
+
+    while (ip < iend) {
+        const unsigned char token = *ip++;
+
+        size_t lit_len = token >> 4;
+        if (lit_len == 15 && !read_len(&ip, iend, &lit_len))
+            return 0;
+        if ((size_t)(iend - ip) < lit_len || (size_t)(oend - op) < lit_len)
+            return 0;
+        memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        /* the last sequence has no match */
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return 0;
+        const size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - ostart))
+            return 0;
+
+        size_t match_len = token & 15;
+        if (match_len == 15 && !read_len(&ip, iend, &match_len))
+            return 0;
+        match_len += MIN_MATCH;
+        if ((size_t)(oend - op) < match_len)
+            return 0;
+
+        /* the match may overlap the output, copy byte by byte */
+        const unsigned char *ref = op - offset;
+        if (offset >= match_len) {
+            memcpy(op, ref, match_len);
+            op += match_len;
+        } else {
+            for (size_t i = 0; i < match_len; ++i) *op++ = *ref++;
+        }
+    }
+
+    return op - ostart;
+}
@@ -0,0 +1,32 @@
+/***********************************************
+ * Fast LZ77 compression of blocks of memory.
+ *
+ * The compressed data use the LZ4 block format: a sequence of literals
+ * followed by a match (a 2-byte offset back into the already decompressed
+ * data and the length of the match), the last sequence has only literals.
+ * The compressor uses a single hash table and does not search for the
+ * best match, so it is fast but does not compress that well. It is meant
+ * for compressing batches of events that have a lot of repeated bytes
+ * (headers of events, small integers, etc.).
+ ************************************************/
+
+#ifndef SHAMON_LZ_H_
+#define SHAMON_LZ_H_
+
+#include <stddef.h>
+
+/* The maximal size of the data compressed from `size` bytes */
+#define SHM_LZ_COMPRESS_BOUND(size) ((size) + (size) / 255 + 16)
+
+/* Compress `size` bytes from `src` into `dst` that has space for `capacity`
+ * bytes. Returns the size of the compressed data or 0 if the data do not
+ * fit into `dst`. */
+size_t shm_lz_compress(const void *src, size_t size, void *dst,
+                       size_t capacity);
+/* Decompress `size` bytes from `src` into `dst` that has space for
+ * `capacity` bytes. Returns the size of the decompressed data or 0 if the
+ * compressed data are malformed or do not fit into `dst`. */
+size_t shm_lz_decompress(const void *src, size_t size, void *dst,
+                         size_t capacity);
+
+#endif /* SHAMON_LZ_H_ */
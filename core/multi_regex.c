@@ -0,0 +1,1004 @@
+#include "multi_regex.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* give up on expressions that need more NFA states (it is
+ * easy to get there with nested bounded repetitions) */
+#define MAX_NFA_STATES (1 << 16)
+#define MAX_REPEAT 255
+/* flush the cached DFA when it has this number of states */
+#define MAX_DFA_STATES 4096
+#define DFA_TABLE_SIZE (2 * MAX_DFA_STATES)
+/* the longest literal we remember for the prefilter */
+#define MAX_LITERAL 32
+/* the prefilter looks for at most this number of different bytes */
+#define MAX_PREFILTER_BYTES 8
+
+typedef struct {
+    uint64_t w[4];
+} byteset;
+
+static inline void byteset_add(byteset *set, unsigned char c) {
+    set->w[c >> 6] |= 1ULL << (c & 63);
+}
+
+static inline bool byteset_has(const byteset *set, unsigned char c) {
+    return set->w[c >> 6] & (1ULL << (c & 63));
+}
+
+static void byteset_negate(byteset *set) {
+    for (int i = 0; i < 4; ++i)
+        set->w[i] = ~set->w[i];
+    /* the strings end with NUL, it is never matched */
+    set->w[0] &= ~1ULL;
+}
+
+/*
+ * Parsing
+ */
+
+enum node_type { N_EMPTY, N_SET, N_CAT, N_ALT, N_REPEAT, N_BOL, N_EOL };
+
+struct node {
+    enum node_type type;
+    struct node *left, *right;
+    byteset set;
+    /* N_REPEAT, max is -1 if unbounded */
+    int min, max;
+};
+
+struct parser {
+    const unsigned char *s;
+};
+
+static struct node *new_node(enum node_type type, struct node *left,
+                             struct node *right) {
+    struct node *n = xalloc(sizeof(*n));
+    memset(n, 0, sizeof(*n));
+    n->type = type;
+    n->left = left;
+    n->right = right;
+    return n;
+}
+
+static void free_node(struct node *n) {
+    if (!n)
+        return;
+    free_node(n->left);
+    free_node(n->right);
+    free(n);
+}
+
+static const struct {
+    const char *name;
+    int (*fn)(int);
+} char_classes[] = {
+    {"alnum", isalnum}, {"alpha", isalpha}, {"blank", isblank},
+    {"cntrl", iscntrl}, {"digit", isdigit}, {"graph", isgraph},
+    {"lower", islower}, {"print", isprint}, {"punct", ispunct},
+    {"space", isspace}, {"upper", isupper}, {"xdigit", isxdigit},
+};
+
+static bool add_char_class(byteset *set, const unsigned char *name,
+                           size_t len) {
+    for (size_t i = 0; i < sizeof(char_classes) / sizeof(char_classes[0]);
+         ++i) {
+        if (strlen(char_classes[i].name) != len ||
+            strncmp(char_classes[i].name, (const char *)name, len) != 0)
+            continue;
+        for (int c = 1; c < 256; ++c) {
+            if (char_classes[i].fn(c))
+                byteset_add(set, c);
+        }
+        return true;
+    }
+    return false;
+}
+
+/* p->s points after '[' */
+static struct node *parse_bracket(struct parser *p) {
+    struct node *n = new_node(N_SET, NULL, NULL);
+    bool negate = false;
+    if (*p->s == '^') {
+        negate = true;
+        ++p->s;
+    }
+
+    /* ']' right after the opening bracket is an ordinary character */
+    bool first = true;
+    while (first || *p->s != ']') {
+        first = false;
+        const unsigned char c = *p->s;
+        if (c == '\0')
+            goto fail;
+        if (c == '[' && p->s[1] == ':') {
+            const char *end = strstr((const char *)p->s + 2, ":]");
+            if (!end || !add_char_class(&n->set, p->s + 2,
+                                        (const unsigned char *)end -
+                                            (p->s + 2)))
+                goto fail;
+            p->s = (const unsigned char *)end + 2;
+            continue;
+        }
+        /* collating elements and equivalence classes */
+        if (c == '[' && (p->s[1] == '.' || p->s[1] == '='))
+            goto fail;
+
+        ++p->s;
+        if (p->s[0] == '-' && p->s[1] != ']' && p->s[1] != '\0') {
+            const unsigned char hi = p->s[1];
+            if (hi == '[' || hi < c)
+                goto fail;
+            for (unsigned b = c; b <= hi; ++b)
+                byteset_add(&n->set, b);
+            p->s += 2;
+        } else {
+            byteset_add(&n->set, c);
+        }
+    }
+    ++p->s;
+
+    if (negate)
+        byteset_negate(&n->set);
+    return n;
+
+fail:
+    free_node(n);
+    return NULL;
+}
+
+/* p->s points after '\' */
+static struct node *parse_escape(struct parser *p) {
+    const unsigned char c = *p->s;
+    if (c == '\0')
+        return NULL;
+    ++p->s;
+
+    struct node *n = new_node(N_SET, NULL, NULL);
+    switch (c) {
+        case 'w':
+        case 'W':
+            byteset_add(&n->set, '_');
+            add_char_class(&n->set, (const unsigned char *)"alnum", 5);
+            if (c == 'W')
+                byteset_negate(&n->set);
+            return n;
+        case 's':
+        case 'S':
+            add_char_class(&n->set, (const unsigned char *)"space", 5);
+            if (c == 'S')
+                byteset_negate(&n->set);
+            return n;
+        default:
+            /* back-references, word boundaries and other GNU extensions */
+            if (isalnum(c) || c == '<' || c == '>' || c == '`' || c == '\'') {
+                free_node(n);
+                return NULL;
+            }
+            byteset_add(&n->set, c);
+            return n;
+    }
+}
+
+static struct node *parse_alt(struct parser *p);
+
+static struct node *parse_atom(struct parser *p) {
+    const unsigned char c = *p->s++;
+    struct node *n;
+    switch (c) {
+        case '(':
+            n = parse_alt(p);
+            if (!n)
+                return NULL;
+            if (*p->s != ')') {
+                free_node(n);
+                return NULL;
+            }
+            ++p->s;
+            return n;
+        case '[':
+            return parse_bracket(p);
+        case '.':
+            n = new_node(N_SET, NULL, NULL);
+            byteset_negate(&n->set);
+            return n;
+        case '^':
+            return new_node(N_BOL, NULL, NULL);
+        case '$':
+            return new_node(N_EOL, NULL, NULL);
+        case '\\':
+            return parse_escape(p);
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+            /* a repetition of nothing, the meaning is undefined */
+            return NULL;
+        default:
+            n = new_node(N_SET, NULL, NULL);
+            byteset_add(&n->set, c);
+            return n;
+    }
+}
+
+static int parse_number(struct parser *p) {
+    if (!isdigit(*p->s))
+        return -1;
+    int num = 0;
+    while (isdigit(*p->s)) {
+        num = num * 10 + (*p->s++ - '0');
+        if (num > MAX_REPEAT)
+            return -1;
+    }
+    return num;
+}
+
+/* p->s points to '{' */
+static bool parse_bounds(struct parser *p, int *min, int *max) {
+    ++p->s;
+    if ((*min = parse_number(p)) < 0)
+        return false;
+    if (*p->s == ',') {
+        ++p->s;
+        *max = isdigit(*p->s) ? parse_number(p) : -1;
+        if (*max == -1 && isdigit(*p->s))
+            return false;
+    } else {
+        *max = *min;
+    }
+    if (*p->s != '}' || (*max != -1 && *max < *min))
+        return false;
+    ++p->s;
+    return true;
+}
+
+static bool has_anchor(const struct node *n) {
+    if (!n)
+        return false;
+    if (n->type == N_BOL || n->type == N_EOL)
+        return true;
+    return has_anchor(n->left) || has_anchor(n->right);
+}
+
+static struct node *parse_repeat(struct parser *p) {
+    struct node *n = parse_atom(p);
+    if (!n)
+        return NULL;
+
+    for (;;) {
+        int min, max;
+        switch (*p->s) {
+            case '*':
+                min = 0, max = -1;
+                ++p->s;
+                break;
+            case '+':
+                min = 1, max = -1;
+                ++p->s;
+                break;
+            case '?':
+                min = 0, max = 1;
+                ++p->s;
+                break;
+            case '{':
+                if (!parse_bounds(p, &min, &max)) {
+                    free_node(n);
+                    return NULL;
+                }
+                break;
+            default:
+                return n;
+        }
+        /* glibc does not agree with itself on anchors in repetitions
+         * (the answer depends on whether we ask for submatches),
+         * leave them to regexec */
+        if (has_anchor(n)) {
+            free_node(n);
+            return NULL;
+        }
+        n = new_node(N_REPEAT, n, NULL);
+        n->min = min;
+        n->max = max;
+    }
+}
+
+static struct node *parse_cat(struct parser *p) {
+    struct node *n = NULL;
+    while (*p->s != '\0' && *p->s != '|' && *p->s != ')') {
+        struct node *a = parse_repeat(p);
+        if (!a) {
+            free_node(n);
+            return NULL;
+        }
+        n = n ? new_node(N_CAT, n, a) : a;
+    }
+    return n ? n : new_node(N_EMPTY, NULL, NULL);
+}
+
+static struct node *parse_alt(struct parser *p) {
+    struct node *n = parse_cat(p);
+    while (n && *p->s == '|') {
+        ++p->s;
+        struct node *r = parse_cat(p);
+        if (!r) {
+            free_node(n);
+            return NULL;
+        }
+        n = new_node(N_ALT, n, r);
+    }
+    return n;
+}
+
+/* returns NULL if the expression is not supported */
+static struct node *parse(const char *expr) {
+    struct parser p = {.s = (const unsigned char *)expr};
+    struct node *n = parse_alt(&p);
+    if (n && *p.s != '\0') {
+        /* unmatched ')' */
+        free_node(n);
+        return NULL;
+    }
+    return n;
+}
+
+/*
+ * Literals for the prefilter
+ */
+
+/* a string that every match of an expression contains */
+struct literal {
+    unsigned char s[MAX_LITERAL];
+    size_t len;
+    /* the position of the byte the prefilter looks for */
+    size_t rare;
+};
+
+static bool is_singleton(const struct node *n, unsigned char *c) {
+    if (n->type != N_SET)
+        return false;
+    int bits = 0;
+    for (int i = 0; i < 4; ++i) {
+        bits += __builtin_popcountll(n->set.w[i]);
+        if (n->set.w[i])
+            *c = i * 64 + __builtin_ctzll(n->set.w[i]);
+    }
+    return bits == 1;
+}
+
+static void take_longer(struct literal *best, const struct literal *lit) {
+    if (lit->len > best->len)
+        *best = *lit;
+}
+
+/* find the longest run of characters that every match of `n` contains */
+static void required_literal(const struct node *n, struct literal *best) {
+    struct literal cur = {.len = 0};
+    unsigned char c;
+
+    switch (n->type) {
+        case N_SET:
+            if (is_singleton(n, &c)) {
+                cur.s[cur.len++] = c;
+                take_longer(best, &cur);
+            }
+            return;
+        case N_REPEAT:
+            if (n->min > 0)
+                required_literal(n->left, best);
+            return;
+        case N_CAT:
+            break;
+        default:
+            /* alternatives could have a common factor, but we do not care */
+            return;
+    }
+
+    /* the concatenations are left-nested, flatten them */
+    size_t num = 1;
+    for (const struct node *l = n; l->type == N_CAT; l = l->left)
+        ++num;
+    const struct node **items = xalloc(num * sizeof(*items));
+    const struct node *l = n;
+    for (size_t i = num - 1; i > 0; --i, l = l->left)
+        items[i] = l->right;
+    items[0] = l;
+
+    for (size_t i = 0; i < num; ++i) {
+        if (is_singleton(items[i], &c)) {
+            if (cur.len == MAX_LITERAL) {
+                take_longer(best, &cur);
+                cur.len = 0;
+            }
+            cur.s[cur.len++] = c;
+        } else if (items[i]->type != N_BOL && items[i]->type != N_EOL &&
+                   items[i]->type != N_EMPTY) {
+            /* (the anchors and empty nodes do not break the literal) */
+            take_longer(best, &cur);
+            cur.len = 0;
+            required_literal(items[i], best);
+        }
+    }
+    take_longer(best, &cur);
+    free(items);
+}
+
+/*
+ * The NFA
+ */
+
+enum state_type { S_SET, S_SPLIT, S_BOL, S_EOL, S_MATCH };
+
+struct nfa_state {
+    enum state_type type;
+    int out, out1;
+    /* S_SET */
+    byteset set;
+    /* S_MATCH */
+    size_t expr;
+};
+
+/* a cached state of the DFA: a sorted set of NFA states */
+struct dfa_state {
+    uint32_t *states;
+    size_t num;
+    uint64_t hash;
+    /* the expressions that matched when we got into this state */
+    size_t *matches;
+    size_t matches_num;
+    /* the expressions that match if the string ends here */
+    size_t *end_matches;
+    size_t end_matches_num;
+    bool end_computed;
+};
+
+struct shm_multi_regex {
+    size_t num;
+    bool *exact;
+    /* the number of expressions that can match at all */
+    size_t matchable;
+
+    struct nfa_state *nfa;
+    size_t nfa_num, nfa_alloc;
+    /* the initial states of the compiled expressions */
+    int *starts;
+    size_t starts_num;
+    /* the closure of `starts` out of the beginning of the string,
+     * a match can start at every position */
+    uint32_t *restart;
+    size_t restart_num;
+
+    /* the bytes that no expression distinguishes share a class */
+    unsigned char classes[256];
+    size_t classes_num;
+
+    struct dfa_state *dfa;
+    size_t dfa_num;
+    /* dfa_num x classes_num, -1 if not computed yet */
+    int *trans;
+    /* open addressing hash table of DFA states */
+    int *table;
+    int initial;
+    size_t flushes;
+
+    /* every string that an exact expression matches contains one
+     * of the literals, so the strings without them are rejected
+     * by scanning for a few bytes (see prefilter()) */
+    bool prefilter;
+    struct literal *literals;
+    size_t literals_num;
+    unsigned char prefilter_bytes[MAX_PREFILTER_BYTES];
+    size_t prefilter_bytes_num;
+    bool is_prefilter_byte[256];
+
+    /* working space */
+    uint32_t *mark;
+    uint32_t gen;
+    uint32_t *stack;
+    uint32_t *set;
+    size_t set_num;
+};
+
+static int add_state(struct shm_multi_regex *mre, enum state_type type,
+                     int out, int out1) {
+    if (mre->nfa_num == mre->nfa_alloc) {
+        mre->nfa_alloc *= 2;
+        mre->nfa = realloc(mre->nfa, mre->nfa_alloc * sizeof(*mre->nfa));
+        if (!mre->nfa) {
+            perror("realloc");
+            abort();
+        }
+    }
+    struct nfa_state *st = &mre->nfa[mre->nfa_num];
+    memset(st, 0, sizeof(*st));
+    st->type = type;
+    st->out = out;
+    st->out1 = out1;
+    return mre->nfa_num++;
+}
+
+/* compile the node so that it continues to the state `next`,
+ * return the initial state of the node */
+static int compile_node(struct shm_multi_regex *mre, struct node *n,
+                        int next) {
+    if (mre->nfa_num > MAX_NFA_STATES)
+        return next; /* the caller throws the expression away */
+
+    int s, tail, count;
+    switch (n->type) {
+        case N_EMPTY:
+            return next;
+        case N_SET:
+            s = add_state(mre, S_SET, next, -1);
+            mre->nfa[s].set = n->set;
+            return s;
+        case N_BOL:
+            return add_state(mre, S_BOL, next, -1);
+        case N_EOL:
+            return add_state(mre, S_EOL, next, -1);
+        case N_CAT:
+            return compile_node(mre, n->left,
+                                compile_node(mre, n->right, next));
+        case N_ALT:
+            s = compile_node(mre, n->left, next);
+            return add_state(mre, S_SPLIT, s,
+                             compile_node(mre, n->right, next));
+        case N_REPEAT:
+            tail = next;
+            count = n->min;
+            if (n->max == -1) {
+                /* the last mandatory copy loops */
+                int loop = add_state(mre, S_SPLIT, -1, next);
+                int body = compile_node(mre, n->left, loop);
+                mre->nfa[loop].out = body;
+                if (n->min > 0) {
+                    tail = body;
+                    --count;
+                } else {
+                    tail = loop;
+                }
+            } else {
+                /* x{m,n} is x...x(x(x)?)? */
+                for (int k = 0; k < n->max - n->min; ++k) {
+                    s = compile_node(mre, n->left, tail);
+                    tail = add_state(mre, S_SPLIT, s, next);
+                }
+            }
+            for (int k = 0; k < count; ++k)
+                tail = compile_node(mre, n->left, tail);
+            return tail;
+    }
+
+    assert(0 && "Unknown node");
+    abort();
+}
+
+static void compute_classes(struct shm_multi_regex *mre) {
+    memset(mre->classes, 0, sizeof(mre->classes));
+    mre->classes_num = 1;
+
+    /* refine the classes by every set of bytes */
+    for (size_t i = 0; i < mre->nfa_num; ++i) {
+        if (mre->nfa[i].type != S_SET)
+            continue;
+        int ids[256][2];
+        memset(ids, -1, sizeof(ids));
+        int num = 0;
+        for (int c = 0; c < 256; ++c) {
+            int *id = &ids[mre->classes[c]][byteset_has(&mre->nfa[i].set, c)];
+            if (*id < 0)
+                *id = num++;
+            mre->classes[c] = *id;
+        }
+        mre->classes_num = num;
+    }
+}
+
+static void next_gen(struct shm_multi_regex *mre) {
+    mre->set_num = 0;
+    if (++mre->gen == 0) {
+        memset(mre->mark, 0, mre->nfa_num * sizeof(*mre->mark));
+        mre->gen = 1;
+    }
+}
+
+/* add the states reachable from `s` without reading a character to set */
+static void closure(struct shm_multi_regex *mre, uint32_t s, bool bol,
+                    bool eol) {
+    size_t top = 0;
+#define PUSH(x)                              \
+    do {                                     \
+        if (mre->mark[(x)] != mre->gen) {    \
+            mre->mark[(x)] = mre->gen;       \
+            mre->stack[top++] = (x);         \
+        }                                    \
+    } while (0)
+
+    PUSH(s);
+    while (top > 0) {
+        s = mre->stack[--top];
+        const struct nfa_state *st = &mre->nfa[s];
+        switch (st->type) {
+            case S_SPLIT:
+                PUSH(st->out1);
+                PUSH(st->out);
+                break;
+            case S_BOL:
+                if (bol)
+                    PUSH(st->out);
+                break;
+            case S_EOL:
+                if (eol)
+                    PUSH(st->out);
+                else /* we may be at the end later */
+                    mre->set[mre->set_num++] = s;
+                break;
+            default:
+                mre->set[mre->set_num++] = s;
+        }
+    }
+#undef PUSH
+}
+
+static int cmp_states(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static size_t *get_matches(struct shm_multi_regex *mre, size_t *num) {
+    *num = 0;
+    for (size_t i = 0; i < mre->set_num; ++i) {
+        *num += mre->nfa[mre->set[i]].type == S_MATCH;
+    }
+    if (*num == 0)
+        return NULL;
+
+    size_t *matches = xalloc(*num * sizeof(*matches));
+    size_t n = 0;
+    for (size_t i = 0; i < mre->set_num; ++i) {
+        if (mre->nfa[mre->set[i]].type == S_MATCH)
+            matches[n++] = mre->nfa[mre->set[i]].expr;
+    }
+    return matches;
+}
+
+static void flush_dfa(struct shm_multi_regex *mre) {
+    for (size_t i = 0; i < mre->dfa_num; ++i) {
+        free(mre->dfa[i].states);
+        free(mre->dfa[i].matches);
+        free(mre->dfa[i].end_matches);
+    }
+    mre->dfa_num = 0;
+    mre->initial = -1;
+    ++mre->flushes;
+    memset(mre->table, -1, DFA_TABLE_SIZE * sizeof(*mre->table));
+}
+
+/* get the DFA state for the set of NFA states in mre->set */
+static int dfa_state(struct shm_multi_regex *mre) {
+    qsort(mre->set, mre->set_num, sizeof(*mre->set), cmp_states);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < mre->set_num; ++i) {
+        hash = (hash ^ mre->set[i]) * 1099511628211ULL;
+    }
+
+    size_t idx = hash & (DFA_TABLE_SIZE - 1);
+    for (; mre->table[idx] >= 0; idx = (idx + 1) & (DFA_TABLE_SIZE - 1)) {
+        const struct dfa_state *ds = &mre->dfa[mre->table[idx]];
+        if (ds->hash == hash && ds->num == mre->set_num &&
+            memcmp(ds->states, mre->set, ds->num * sizeof(*mre->set)) == 0)
+            return mre->table[idx];
+    }
+
+    if (mre->dfa_num == MAX_DFA_STATES) {
+        flush_dfa(mre);
+        idx = hash & (DFA_TABLE_SIZE - 1);
+    }
+
+    const int id = mre->dfa_num++;
+    struct dfa_state *ds = &mre->dfa[id];
+    ds->num = mre->set_num;
+    ds->states = xalloc((ds->num + 1) * sizeof(*ds->states));
+    memcpy(ds->states, mre->set, ds->num * sizeof(*ds->states));
+    ds->hash = hash;
+    ds->matches = get_matches(mre, &ds->matches_num);
+    ds->end_matches = NULL;
+    ds->end_computed = false;
+    memset(&mre->trans[(size_t)id * mre->classes_num], -1,
+           mre->classes_num * sizeof(*mre->trans));
+    mre->table[idx] = id;
+    return id;
+}
+
+static int dfa_initial(struct shm_multi_regex *mre) {
+    if (mre->initial < 0) {
+        next_gen(mre);
+        for (size_t i = 0; i < mre->starts_num; ++i)
+            closure(mre, mre->starts[i], true, false);
+        const int d = dfa_state(mre);
+        mre->initial = d;
+    }
+    return mre->initial;
+}
+
+static int dfa_step(struct shm_multi_regex *mre, int d, unsigned char c) {
+    next_gen(mre);
+    const struct dfa_state *ds = &mre->dfa[d];
+    for (size_t i = 0; i < ds->num; ++i) {
+        const struct nfa_state *st = &mre->nfa[ds->states[i]];
+        if (st->type == S_SET && byteset_has(&st->set, c))
+            closure(mre, st->out, false, false);
+    }
+    for (size_t i = 0; i < mre->restart_num; ++i) {
+        const uint32_t s = mre->restart[i];
+        if (mre->mark[s] != mre->gen) {
+            mre->mark[s] = mre->gen;
+            mre->set[mre->set_num++] = s;
+        }
+    }
+
+    const size_t flushes = mre->flushes;
+    const int next = dfa_state(mre);
+    /* if the cache was flushed, `d` is gone */
+    if (flushes == mre->flushes)
+        mre->trans[(size_t)d * mre->classes_num + mre->classes[c]] = next;
+    return next;
+}
+
+/* the expressions that match if the string ends in `d` */
+static size_t *end_matches(struct shm_multi_regex *mre, int d, bool bol,
+                           size_t *num) {
+    next_gen(mre);
+    const struct dfa_state *ds = &mre->dfa[d];
+    for (size_t i = 0; i < ds->num; ++i) {
+        const struct nfa_state *st = &mre->nfa[ds->states[i]];
+        if (st->type == S_EOL)
+            closure(mre, st->out, bol, true);
+    }
+    return get_matches(mre, num);
+}
+
+/* a guess how rare the byte is in logs, the higher the rarer */
+static int byte_rarity(unsigned char c) {
+    if (islower(c) || c == ' ')
+        return 0;
+    if (isdigit(c))
+        return 1;
+    if (isupper(c))
+        return 2;
+    return 3;
+}
+
+static void add_literal(struct shm_multi_regex *mre, struct literal *lit) {
+    if (lit->len == 0) {
+        /* we cannot say anything about this expression */
+        mre->prefilter = false;
+        return;
+    }
+
+    /* pick the rarest byte, prefer those that we look for already */
+    int best = -1;
+    for (size_t i = 0; i < lit->len; ++i) {
+        const unsigned char c = lit->s[i];
+        const int score = byte_rarity(c) + 4 * mre->is_prefilter_byte[c];
+        if (score > best) {
+            best = score;
+            lit->rare = i;
+        }
+    }
+
+    const unsigned char c = lit->s[lit->rare];
+    if (!mre->is_prefilter_byte[c]) {
+        if (mre->prefilter_bytes_num == MAX_PREFILTER_BYTES) {
+            mre->prefilter = false;
+            return;
+        }
+        mre->prefilter_bytes[mre->prefilter_bytes_num++] = c;
+        mre->is_prefilter_byte[c] = true;
+    }
+    mre->literals[mre->literals_num++] = *lit;
+}
+
+/* is there a literal with its rare byte at `pos`? */
+static bool has_literal_at(const struct shm_multi_regex *mre,
+                           const unsigned char *s, size_t len, size_t pos) {
+    for (size_t i = 0; i < mre->literals_num; ++i) {
+        const struct literal *lit = &mre->literals[i];
+        if (lit->s[lit->rare] != s[pos] || pos < lit->rare ||
+            pos - lit->rare + lit->len > len)
+            continue;
+        if (memcmp(s + pos - lit->rare, lit->s, lit->len) == 0)
+            return true;
+    }
+    return false;
+}
+
+/* can an exact expression match `s`? */
+static bool prefilter(const struct shm_multi_regex *mre,
+                      const unsigned char *s, size_t len) {
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i bytes[MAX_PREFILTER_BYTES];
+    const size_t bytes_num = mre->prefilter_bytes_num;
+    for (size_t k = 0; k < bytes_num; ++k)
+        bytes[k] = _mm_set1_epi8((char)mre->prefilter_bytes[k]);
+
+    for (; i + 16 <= len; i += 16) {
+        const __m128i chunk = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i eq = _mm_cmpeq_epi8(chunk, bytes[0]);
+        for (size_t k = 1; k < bytes_num; ++k)
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi8(chunk, bytes[k]));
+        for (unsigned mask = _mm_movemask_epi8(eq); mask; mask &= mask - 1) {
+            if (has_literal_at(mre, s, len, i + __builtin_ctz(mask)))
+                return true;
+        }
+    }
+#endif
+    for (; i < len; ++i) {
+        if (mre->is_prefilter_byte[s[i]] && has_literal_at(mre, s, len, i))
+            return true;
+    }
+    return false;
+}
+
+static size_t add_matches(bool *matched, const size_t *matches, size_t num) {
+    size_t added = 0;
+    for (size_t i = 0; i < num; ++i) {
+        if (!matched[matches[i]]) {
+            matched[matches[i]] = true;
+            ++added;
+        }
+    }
+    return added;
+}
+
+struct shm_multi_regex *shm_multi_regex_compile(size_t num,
+                                                const char *exprs[]) {
+    struct shm_multi_regex *mre = xalloc(sizeof(*mre));
+    memset(mre, 0, sizeof(*mre));
+    mre->num = num;
+    mre->exact = xalloc((num + 1) * sizeof(*mre->exact));
+    mre->starts = xalloc((num + 1) * sizeof(*mre->starts));
+    mre->nfa_alloc = 64;
+    mre->nfa = xalloc(mre->nfa_alloc * sizeof(*mre->nfa));
+    mre->literals = xalloc((num + 1) * sizeof(*mre->literals));
+    mre->prefilter = true;
+
+    for (size_t i = 0; i < num; ++i) {
+        mre->exact[i] = true;
+        if (!exprs[i])
+            continue;
+        ++mre->matchable;
+
+        struct node *root = parse(exprs[i]);
+        if (!root) {
+            mre->exact[i] = false;
+            continue;
+        }
+        const size_t nfa_num = mre->nfa_num;
+        int match = add_state(mre, S_MATCH, -1, -1);
+        mre->nfa[match].expr = i;
+        int start = compile_node(mre, root, match);
+        struct literal lit = {.len = 0};
+        required_literal(root, &lit);
+        free_node(root);
+        if (mre->nfa_num > MAX_NFA_STATES) {
+            fprintf(stderr, "warning: regex '%s' is too big, using regexec\n",
+                    exprs[i]);
+            mre->nfa_num = nfa_num;
+            mre->exact[i] = false;
+            continue;
+        }
+        mre->starts[mre->starts_num++] = start;
+        add_literal(mre, &lit);
+    }
+    /* with no exact expression, there is nothing to filter */
+    mre->prefilter = mre->prefilter && mre->starts_num > 0;
+
+    compute_classes(mre);
+
+    const size_t n = mre->nfa_num + 1;
+    mre->mark = xalloc(n * sizeof(*mre->mark));
+    memset(mre->mark, 0, n * sizeof(*mre->mark));
+    mre->stack = xalloc(n * sizeof(*mre->stack));
+    mre->set = xalloc(n * sizeof(*mre->set));
+
+    mre->dfa = xalloc(MAX_DFA_STATES * sizeof(*mre->dfa));
+    mre->trans =
+        xalloc(MAX_DFA_STATES * mre->classes_num * sizeof(*mre->trans));
+    mre->table = xalloc(DFA_TABLE_SIZE * sizeof(*mre->table));
+    flush_dfa(mre);
+
+    next_gen(mre);
+    for (size_t i = 0; i < mre->starts_num; ++i)
+        closure(mre, mre->starts[i], false, false);
+    mre->restart_num = mre->set_num;
+    mre->restart = xalloc((mre->restart_num + 1) * sizeof(*mre->restart));
+    memcpy(mre->restart, mre->set, mre->restart_num * sizeof(*mre->restart));
+
+    return mre;
+}
+
+void shm_multi_regex_destroy(struct shm_multi_regex *mre) {
+    flush_dfa(mre);
+    free(mre->dfa);
+    free(mre->trans);
+    free(mre->table);
+    free(mre->mark);
+    free(mre->stack);
+    free(mre->set);
+    free(mre->restart);
+    free(mre->starts);
+    free(mre->nfa);
+    free(mre->exact);
+    free(mre->literals);
+    free(mre);
+}
+
+bool shm_multi_regex_is_exact(const struct shm_multi_regex *mre, size_t i) {
+    assert(i < mre->num);
+    return mre->exact[i];
+}
+
+bool shm_multi_regex_has_prefilter(const struct shm_multi_regex *mre) {
+    return mre->prefilter;
+}
+
+size_t shm_multi_regex_match(struct shm_multi_regex *mre, const char *str,
+                             size_t len, bool *matched) {
+    size_t count = 0;
+    for (size_t i = 0; i < mre->num; ++i) {
+        matched[i] = !mre->exact[i];
+        count += matched[i];
+    }
+
+    const unsigned char *s = (const unsigned char *)str;
+    if (mre->prefilter && !prefilter(mre, s, len))
+        return count;
+
+    int d = dfa_initial(mre);
+    count += add_matches(matched, mre->dfa[d].matches, mre->dfa[d].matches_num);
+
+    for (size_t i = 0; i < len; ++i) {
+        if (count == mre->matchable)
+            return count;
+
+        int next = mre->trans[(size_t)d * mre->classes_num + mre->classes[s[i]]];
+        if (next < 0)
+            next = dfa_step(mre, d, s[i]);
+        d = next;
+
+        const struct dfa_state *ds = &mre->dfa[d];
+        if (ds->matches_num > 0)
+            count += add_matches(matched, ds->matches, ds->matches_num);
+    }
+
+    if (count == mre->matchable)
+        return count;
+
+    if (len == 0) {
+        /* we are also at the beginning, the cached matches do not apply */
+        size_t num;
+        size_t *matches = end_matches(mre, d, true, &num);
+        count += add_matches(matched, matches, num);
+        free(matches);
+        return count;
+    }
+
+    struct dfa_state *ds = &mre->dfa[d];
+    if (!ds->end_computed) {
+        ds->end_matches = end_matches(mre, d, false, &ds->end_matches_num);
+        ds->end_computed = true;
+    }
+    return count + add_matches(matched, ds->end_matches, ds->end_matches_num);
+}
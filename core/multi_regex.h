@@ -0,0 +1,52 @@
+/***********************************************
+ * Matching many regular expressions in one pass over a string.
+ *
+ * All the expressions are compiled into a single NFA that is lazily
+ * determinised while matching: the DFA states are created only
+ * when the input reaches them and are cached for the next strings,
+ * so after a short warm-up every byte costs one table lookup no matter
+ * how many expressions there are. The engine only answers which
+ * expressions match (somewhere in the string), the sources then run
+ * regexec only on the winners to get the submatches.
+ *
+ * Before running the automaton, the string is scanned (with SIMD
+ * compares where available) for the literals that the matches
+ * of the expressions must contain. Most lines of logs match nothing
+ * and are rejected right there.
+ *
+ * The expressions are POSIX extended regular expressions. Constructs
+ * that the engine does not support (back-references, GNU escapes
+ * like \b or \<, collating elements, ...) are not an error: such
+ * an expression is just always reported as matching and it is up to
+ * regexec to decide.
+ ************************************************/
+
+#ifndef SHAMON_MULTI_REGEX_H_
+#define SHAMON_MULTI_REGEX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct shm_multi_regex;
+
+/* Compile `num` expressions. An expression can be NULL, then it never
+ * matches (e.g., the monitor is not interested in the event). */
+struct shm_multi_regex *shm_multi_regex_compile(size_t num,
+                                                const char *exprs[]);
+void shm_multi_regex_destroy(struct shm_multi_regex *mre);
+
+/* Is the expression `i` decided by the engine? If not, it is always
+ * reported as matching and must be checked by regexec. */
+bool shm_multi_regex_is_exact(const struct shm_multi_regex *mre, size_t i);
+
+/* Are the strings rejected by the literal prefilter first? That is the case
+ * when every exact expression has a literal that all its matches contain. */
+bool shm_multi_regex_has_prefilter(const struct shm_multi_regex *mre);
+
+/* Set `matched[i]` to true iff the expression `i` matches a substring
+ * of `str` (of the length `len`), like regexec does. Returns the number
+ * of matched expressions. */
+size_t shm_multi_regex_match(struct shm_multi_regex *mre, const char *str,
+                             size_t len, bool *matched);
+
+#endif /* SHAMON_MULTI_REGEX_H_ */
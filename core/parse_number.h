@@ -0,0 +1,161 @@
+/***********************************************
+ * Parsing numbers from spans of text.
+ *
+ * The sources get the arguments of events as (pointer, length) pairs
+ * into lines of text. These functions parse the numbers right from
+ * the span, without copying it into a NUL-terminated string first.
+ * They behave like atol and strtod in the "C" locale whatever locale
+ * the program uses, and need no terminating NUL.
+ *
+ * The numbers that are not parsed here go to strtod in the "C" locale,
+ * so the includers need POSIX 2008 (uselocale).
+ ************************************************/
+
+#ifndef SHAMON_PARSE_NUMBER_H_
+#define SHAMON_PARSE_NUMBER_H_
+
+#include <locale.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline bool _shm_is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline bool _shm_is_digit(char c) { return c >= '0' && c <= '9'; }
+
+/* Like atol on the first `len` bytes of `s`. The result of an overflow
+ * is undefined (it wraps around). */
+static inline long shm_parse_long(const char *s, size_t len) {
+    const char *end = s + len;
+    while (s < end && _shm_is_space(*s))
+        ++s;
+
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+
+    unsigned long num = 0;
+    for (; s < end && _shm_is_digit(*s); ++s)
+        num = num * 10 + (*s - '0');
+    return negative ? (long)(0UL - num) : (long)num;
+}
+
+static inline int shm_parse_int(const char *s, size_t len) {
+    return (int)shm_parse_long(s, len);
+}
+
+/* the powers of ten that a double represents exactly */
+static const double _shm_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+/* the "C" locale for strtod, created on the first use */
+static inline locale_t _shm_c_locale(void) {
+    static _Atomic(locale_t) c_locale;
+    locale_t loc = atomic_load_explicit(&c_locale, memory_order_acquire);
+    if (loc != (locale_t)0)
+        return loc;
+    locale_t created = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+    if (atomic_compare_exchange_strong(&c_locale, &loc, created))
+        return created;
+    /* another thread was faster */
+    if (created != (locale_t)0)
+        freelocale(created);
+    return loc;
+}
+
+/* the general case (long mantissas, big exponents, inf, nan, hex) */
+static inline double _shm_parse_double_slow(const char *s, size_t len) {
+    char tmp[64];
+    char *str = len < sizeof(tmp) ? tmp : malloc(len + 1);
+    if (!str)
+        return 0.0;
+    memcpy(str, s, len);
+    str[len] = '\0';
+    /* the locale of this thread only */
+    locale_t old = uselocale(_shm_c_locale());
+    double d = strtod(str, NULL);
+    uselocale(old);
+    if (str != tmp)
+        free(str);
+    return d;
+}
+
+/* Like strtod on the first `len` bytes of `s`, the decimal point is
+ * always '.'. Numbers with at most 19 significant digits and small
+ * exponents are computed with a single correctly rounded operation
+ * (so the result is the same as from strtod), the rest goes to strtod. */
+static inline double shm_parse_double(const char *s, size_t len) {
+    const char *const begin = s;
+    const char *end = s + len;
+    while (s < end && _shm_is_space(*s))
+        ++s;
+
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+    if (end - s > 1 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+        return _shm_parse_double_slow(begin, len);
+
+    uint64_t mantissa = 0;
+    int digits = 0, exp10 = 0;
+    bool any_digit = false;
+    for (; s < end && _shm_is_digit(*s); ++s) {
+        any_digit = true;
+        if (mantissa == 0 && *s == '0')
+            continue; /* leading zeros */
+        mantissa = mantissa * 10 + (*s - '0');
+        ++digits;
+        if (digits > 19)
+            return _shm_parse_double_slow(begin, len);
+    }
+    if (s < end && *s == '.') {
+        for (++s; s < end && _shm_is_digit(*s); ++s) {
+            any_digit = true;
+            if (mantissa == 0 && *s == '0') {
+                --exp10;
+                continue;
+            }
+            mantissa = mantissa * 10 + (*s - '0');
+            --exp10;
+            if (++digits > 19)
+                return _shm_parse_double_slow(begin, len);
+        }
+    }
+    if (!any_digit) /* inf, nan, or not a number at all */
+        return _shm_parse_double_slow(begin, len);
+
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char *e = s + 1;
+        bool exp_negative = false;
+        if (e < end && (*e == '-' || *e == '+'))
+            exp_negative = *e++ == '-';
+        if (e < end && _shm_is_digit(*e)) {
+            int exp = 0;
+            for (; e < end && _shm_is_digit(*e); ++e) {
+                if (exp > 10000)
+                    return _shm_parse_double_slow(begin, len);
+                exp = exp * 10 + (*e - '0');
+            }
+            exp10 += exp_negative ? -exp : exp;
+        }
+    }
+
+    /* a mantissa with more than 53 bits is not exact */
+    if (mantissa > (1ULL << 53) || exp10 < -22 || exp10 > 22)
+        return _shm_parse_double_slow(begin, len);
+
+    double d = (double)mantissa;
+    if (exp10 < 0)
+        d /= _shm_pow10[-exp10];
+    else
+        d *= _shm_pow10[exp10];
+    return negative ? -d : d;
+}
+
+#endif /* SHAMON_PARSE_NUMBER_H_ */
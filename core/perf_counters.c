@@ -0,0 +1,161 @@
+#include "perf_counters.h"
+
+#include <assert.h>
+#include <linux/perf_event.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_LLC_MISSES,
+    COUNTER_CONTEXT_SWITCHES,
+    COUNTERS_NUM
+};
+
+struct _shm_perf_counters {
+    struct _shm_perf_counters *next;
+    char *name;
+    int fds[COUNTERS_NUM];
+    /* the final values of closed counters */
+    shm_perf_counters_values values;
+    _Atomic bool closed;
+};
+
+static _Atomic(shm_perf_counters *) all_counters = NULL;
+
+static int open_counter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    /* pid = 0 and cpu = -1 measures the calling thread on any CPU */
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0)
+        return -1;
+
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    return fd;
+}
+
+shm_perf_counters *shm_perf_counters_open(const char *name) {
+    shm_perf_counters *counters = xalloc(sizeof(*counters));
+    counters->name = xstrdup(name);
+    counters->fds[COUNTER_CYCLES] =
+        open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    counters->fds[COUNTER_INSTRUCTIONS] =
+        open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    counters->fds[COUNTER_LLC_MISSES] =
+        open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    counters->fds[COUNTER_CONTEXT_SWITCHES] =
+        open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+    counters->closed = false;
+
+    if (counters->fds[COUNTER_CYCLES] < 0) {
+        perror("perf_event_open (counters will not be available)");
+    }
+
+    counters->next = atomic_load_explicit(&all_counters, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&all_counters,
+                                                  &counters->next, counters,
+                                                  memory_order_release,
+                                                  memory_order_relaxed))
+        ;
+
+    return counters;
+}
+
+const char *shm_perf_counters_name(shm_perf_counters *counters) {
+    return counters->name;
+}
+
+static uint64_t read_counter(int fd) {
+    uint64_t value;
+    if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value))
+        return SHM_PERF_COUNTER_NA;
+    return value;
+}
+
+void shm_perf_counters_read(shm_perf_counters *counters,
+                            shm_perf_counters_values *values) {
+    if (atomic_load_explicit(&counters->closed, memory_order_acquire)) {
+        *values = counters->values;
+        return;
+    }
+    values->cycles = read_counter(counters->fds[COUNTER_CYCLES]);
+    values->instructions = read_counter(counters->fds[COUNTER_INSTRUCTIONS]);
+    values->llc_misses = read_counter(counters->fds[COUNTER_LLC_MISSES]);
+    values->context_switches =
+        read_counter(counters->fds[COUNTER_CONTEXT_SWITCHES]);
+}
+
+void shm_perf_counters_close(shm_perf_counters *counters) {
+    if (atomic_load_explicit(&counters->closed, memory_order_relaxed))
+        return;
+    shm_perf_counters_read(counters, &counters->values);
+    atomic_store_explicit(&counters->closed, true, memory_order_release);
+    for (int i = 0; i < COUNTERS_NUM; ++i) {
+        if (counters->fds[i] >= 0) {
+            close(counters->fds[i]);
+            counters->fds[i] = -1;
+        }
+    }
+}
+
+static void print_value(FILE *out, const char *name, uint64_t value) {
+    if (value == SHM_PERF_COUNTER_NA)
+        fprintf(out, "   %-18s n/a\n", name);
+    else
+        fprintf(out, "   %-18s %lu\n", name, value);
+}
+
+void shm_perf_counters_print(shm_perf_counters *counters, FILE *out) {
+    shm_perf_counters_values values;
+    shm_perf_counters_read(counters, &values);
+
+    fprintf(out, "-- Perf counters of '%s' --\n", counters->name);
+    print_value(out, "cycles", values.cycles);
+    print_value(out, "instructions", values.instructions);
+    if (values.cycles != SHM_PERF_COUNTER_NA && values.cycles > 0 &&
+        values.instructions != SHM_PERF_COUNTER_NA) {
+        fprintf(out, "   %-18s %.2lf\n", "IPC",
+                values.instructions / (double)values.cycles);
+    }
+    print_value(out, "LLC misses", values.llc_misses);
+    print_value(out, "context switches", values.context_switches);
+}
+
+void shm_perf_counters_dump(FILE *out) {
+    /* the list is in the reverse order of opening */
+    size_t num = 0;
+    for (shm_perf_counters *c =
+             atomic_load_explicit(&all_counters, memory_order_acquire);
+         c; c = c->next) {
+        if (!atomic_load_explicit(&c->closed, memory_order_acquire))
+            ++num;
+    }
+
+    shm_perf_counters *counters[num > 0 ? num : 1];
+    size_t i = num;
+    for (shm_perf_counters *c =
+             atomic_load_explicit(&all_counters, memory_order_acquire);
+         c && i > 0; c = c->next) {
+        /* closed counters were reported when closing them */
+        if (!atomic_load_explicit(&c->closed, memory_order_acquire))
+            counters[--i] = c;
+    }
+
+    for (i = 0; i < num; ++i) {
+        shm_perf_counters_print(counters[i], out);
+    }
+}
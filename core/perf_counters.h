@@ -0,0 +1,56 @@
+/***********************************************
+ * Hardware and scheduler counters of the threads of the monitor.
+ *
+ * A thread opens the counters via shm_perf_counters_open() and they
+ * count only the events of that thread. Counters that cannot be opened
+ * (e.g., because of perf_event_paranoid or when running in a VM)
+ * are reported as not available.
+ *
+ * The SHM_PERF_COUNTERS_* macros expand to nothing unless the code is
+ * compiled with PERF_COUNTERS defined (cmake -DPERF_COUNTERS=ON).
+ ************************************************/
+
+#ifndef SHAMON_PERF_COUNTERS_H_
+#define SHAMON_PERF_COUNTERS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct _shm_perf_counters shm_perf_counters;
+
+/* the value of a counter that could not be opened */
+#define SHM_PERF_COUNTER_NA UINT64_MAX
+
+typedef struct _shm_perf_counters_values {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t llc_misses;
+    uint64_t context_switches;
+} shm_perf_counters_values;
+
+/* Open counters for the calling thread. The counters are registered
+ * under `name` (e.g., the name of the stream the thread handles)
+ * and are reported by shm_perf_counters_dump(). */
+shm_perf_counters *shm_perf_counters_open(const char *name);
+const char *shm_perf_counters_name(shm_perf_counters *counters);
+/* The counters can be read also from other threads and also
+ * after the measured thread exited */
+void shm_perf_counters_read(shm_perf_counters *counters,
+                            shm_perf_counters_values *values);
+void shm_perf_counters_print(shm_perf_counters *counters, FILE *out);
+/* Read the final values and close the counters. The final values
+ * can still be read and printed, but shm_perf_counters_dump()
+ * does not report closed counters anymore. */
+void shm_perf_counters_close(shm_perf_counters *counters);
+/* print the values of all counters that are still open */
+void shm_perf_counters_dump(FILE *out);
+
+#ifdef PERF_COUNTERS
+#define SHM_PERF_COUNTERS_OPEN(name) shm_perf_counters_open((name))
+#define SHM_PERF_COUNTERS_DUMP() shm_perf_counters_dump(stderr)
+#else
+#define SHM_PERF_COUNTERS_OPEN(name) ((void)0)
+#define SHM_PERF_COUNTERS_DUMP() ((void)0)
+#endif
+
+#endif /* SHAMON_PERF_COUNTERS_H_ */
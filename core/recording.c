@@ -0,0 +1,342 @@
+#include "recording.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "signatures.h"
+#include "utils.h"
+
+static const char recording_magic[8] = {'S', 'H', 'M', 'R', 'E', 'C', 0, 0};
+
+struct _shm_recording {
+    FILE *file;
+    bool writing;
+    char *key;
+    size_t capacity;
+    size_t elem_size;
+    size_t events_num;
+    struct event_record *events;
+    /* the last written/read time and id, the values in the file
+     * are differences from these */
+    uint64_t last_time;
+    shm_eventid last_id;
+    /* buffer for reading strings */
+    char *str;
+    size_t str_size;
+};
+
+static inline void write_varint(FILE *f, uint64_t v) {
+    while (v >= 0x80) {
+        putc((int)(v & 0x7f) | 0x80, f);
+        v >>= 7;
+    }
+    putc((int)v, f);
+}
+
+static inline int read_varint(FILE *f, uint64_t *v) {
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        const int c = getc(f);
+        if (c == EOF)
+            return -1;
+        result |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            *v = result;
+            return 0;
+        }
+    }
+    return -1; /* malformed */
+}
+
+/* sign-extend the value of the given size and zig-zag encode it,
+ * so that small negative numbers have short encodings */
+static inline uint64_t zigzag_encode(const void *data, size_t size) {
+    int64_t v;
+    switch (size) {
+        case 1:
+            v = *(const int8_t *)data;
+            break;
+        case 2:
+            v = *(const int16_t *)data;
+            break;
+        case 4:
+            v = *(const int32_t *)data;
+            break;
+        default:
+            v = *(const int64_t *)data;
+    }
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline void zigzag_decode(uint64_t u, void *data, size_t size) {
+    const int64_t v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+    switch (size) {
+        case 1:
+            *(int8_t *)data = (int8_t)v;
+            break;
+        case 2:
+            *(int16_t *)data = (int16_t)v;
+            break;
+        case 4:
+            *(int32_t *)data = (int32_t)v;
+            break;
+        default:
+            *(int64_t *)data = v;
+    }
+}
+
+shm_recording *shm_recording_create(const char *path, const char *key,
+                                    size_t capacity, size_t elem_size,
+                                    const struct event_record *events,
+                                    size_t events_num) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror("opening the recording");
+        return NULL;
+    }
+
+    shm_recording *rec = xalloc(sizeof(*rec));
+    memset(rec, 0, sizeof(*rec));
+    rec->file = f;
+    rec->writing = true;
+    rec->key = xstrdup(key);
+    rec->capacity = capacity;
+    rec->elem_size = elem_size;
+
+    fwrite(recording_magic, sizeof(recording_magic), 1, f);
+    write_varint(f, SHM_RECORDING_VERSION);
+    write_varint(f, capacity);
+    write_varint(f, elem_size);
+    const size_t key_len = strlen(key);
+    write_varint(f, key_len);
+    fwrite(key, 1, key_len, f);
+
+    write_varint(f, events_num);
+    for (size_t i = 0; i < events_num; ++i) {
+        fwrite(events[i].name, sizeof(events[i].name), 1, f);
+        fwrite(events[i].signature, sizeof(events[i].signature), 1, f);
+        write_varint(f, events[i].kind);
+        write_varint(f, events[i].size);
+    }
+
+    if (ferror(f)) {
+        perror("writing the recording");
+        shm_recording_close(rec);
+        return NULL;
+    }
+
+    return rec;
+}
+
+shm_recording *shm_recording_open(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror("opening the recording");
+        return NULL;
+    }
+
+    shm_recording *rec = xalloc(sizeof(*rec));
+    memset(rec, 0, sizeof(*rec));
+    rec->file = f;
+
+    char magic[sizeof(recording_magic)];
+    uint64_t version, capacity, elem_size, key_len, events_num;
+    if (fread(magic, sizeof(magic), 1, f) != 1 ||
+        memcmp(magic, recording_magic, sizeof(magic)) != 0) {
+        fprintf(stderr, "'%s' is not a recording\n", path);
+        goto err;
+    }
+    if (read_varint(f, &version) < 0 || version != SHM_RECORDING_VERSION) {
+        fprintf(stderr, "Unsupported version of the recording\n");
+        goto err;
+    }
+    if (read_varint(f, &capacity) < 0 || read_varint(f, &elem_size) < 0 ||
+        read_varint(f, &key_len) < 0)
+        goto err_read;
+    rec->capacity = capacity;
+    rec->elem_size = elem_size;
+
+    rec->key = xalloc(key_len + 1);
+    if (fread(rec->key, 1, key_len, f) != key_len)
+        goto err_read;
+    rec->key[key_len] = '\0';
+
+    if (read_varint(f, &events_num) < 0)
+        goto err_read;
+    rec->events_num = events_num;
+    rec->events = xalloc((events_num + 1) * sizeof(struct event_record));
+    for (size_t i = 0; i < events_num; ++i) {
+        struct event_record *ev = &rec->events[i];
+        uint64_t size;
+        if (fread(ev->name, sizeof(ev->name), 1, f) != 1 ||
+            fread(ev->signature, sizeof(ev->signature), 1, f) != 1 ||
+            read_varint(f, &ev->kind) < 0 || read_varint(f, &size) < 0)
+            goto err_read;
+        ev->size = size;
+        ev->name[sizeof(ev->name) - 1] = '\0';
+        ev->signature[sizeof(ev->signature) - 1] = '\0';
+    }
+
+    return rec;
+
+err_read:
+    fprintf(stderr, "Failed reading the header of the recording\n");
+err:
+    shm_recording_close(rec);
+    return NULL;
+}
+
+int shm_recording_close(shm_recording *rec) {
+    int ret = 0;
+    if (rec->writing) {
+        /* mark the end of the recording */
+        write_varint(rec->file, 0); /* time */
+        write_varint(rec->file, 0); /* kind */
+        if (ferror(rec->file)) {
+            perror("writing the recording");
+            ret = -1;
+        }
+    }
+    if (fclose(rec->file) != 0) {
+        perror("closing the recording");
+        ret = -1;
+    }
+    free(rec->key);
+    free(rec->events);
+    free(rec->str);
+    free(rec);
+    return ret;
+}
+
+const char *shm_recording_key(shm_recording *rec) { return rec->key; }
+
+size_t shm_recording_capacity(shm_recording *rec) { return rec->capacity; }
+
+size_t shm_recording_elem_size(shm_recording *rec) { return rec->elem_size; }
+
+struct event_record *shm_recording_events(shm_recording *rec, size_t *num) {
+    *num = rec->events_num;
+    return rec->events;
+}
+
+struct event_record *shm_recording_get_event(shm_recording *rec,
+                                             shm_kind kind) {
+    for (size_t i = 0; i < rec->events_num; ++i) {
+        if (rec->events[i].kind == kind)
+            return &rec->events[i];
+    }
+    return NULL;
+}
+
+void shm_recording_write_event(shm_recording *rec, uint64_t time_ns,
+                               shm_kind kind, shm_eventid id) {
+    assert(kind > 0 && "Kind 0 is reserved for the end of recording");
+    assert(time_ns >= rec->last_time && "Time goes backwards");
+    write_varint(rec->file, time_ns - rec->last_time);
+    write_varint(rec->file, kind);
+    /* ids may wrap around, the difference is then just a large number */
+    write_varint(rec->file, id - rec->last_id);
+    rec->last_time = time_ns;
+    rec->last_id = id;
+}
+
+void shm_recording_write_arg(shm_recording *rec, unsigned char op,
+                             const void *data) {
+    const size_t size = signature_op_get_size(op);
+    switch (op) {
+        case 'c':
+        case 'h':
+        case 'i':
+        case 'l':
+            write_varint(rec->file, zigzag_encode(data, size));
+            break;
+        case 'p':
+        case 't':
+            write_varint(rec->file, *(const uint64_t *)data);
+            break;
+        case 'S':
+        case 'L':
+        case 'M':
+            assert(0 && "Strings must be written by shm_recording_write_str");
+            abort();
+        default:
+            /* floats and unknown types are stored as they are */
+            fwrite(data, 1, size, rec->file);
+    }
+}
+
+void shm_recording_write_str(shm_recording *rec, const char *str,
+                             size_t len) {
+    write_varint(rec->file, len);
+    fwrite(str, 1, len, rec->file);
+}
+
+int shm_recording_read_event(shm_recording *rec, uint64_t *time_ns,
+                             shm_kind *kind, shm_eventid *id) {
+    uint64_t dt, did;
+    if (read_varint(rec->file, &dt) < 0 || read_varint(rec->file, kind) < 0)
+        goto err;
+    if (*kind == 0)
+        return 0;
+    if (read_varint(rec->file, &did) < 0)
+        goto err;
+
+    rec->last_time += dt;
+    rec->last_id += did;
+    *time_ns = rec->last_time;
+    *id = rec->last_id;
+    return 1;
+
+err:
+    fprintf(stderr, "Failed reading an event from the recording "
+                    "(truncated file?)\n");
+    return -1;
+}
+
+int shm_recording_read_arg(shm_recording *rec, unsigned char op,
+                           void *data) {
+    const size_t size = signature_op_get_size(op);
+    uint64_t v;
+    switch (op) {
+        case 'c':
+        case 'h':
+        case 'i':
+        case 'l':
+            if (read_varint(rec->file, &v) < 0)
+                return -1;
+            zigzag_decode(v, data, size);
+            return 0;
+        case 'p':
+        case 't':
+            if (read_varint(rec->file, &v) < 0)
+                return -1;
+            memcpy(data, &v, sizeof(v));
+            return 0;
+        case 'S':
+        case 'L':
+        case 'M':
+            assert(0 && "Strings must be read by shm_recording_read_str");
+            abort();
+        default:
+            return fread(data, 1, size, rec->file) == size ? 0 : -1;
+    }
+}
+
+const char *shm_recording_read_str(shm_recording *rec, size_t *len) {
+    uint64_t n;
+    if (read_varint(rec->file, &n) < 0)
+        return NULL;
+    if (n + 1 > rec->str_size) {
+        free(rec->str);
+        rec->str_size = n + 1 < 256 ? 256 : n + 1;
+        rec->str = xalloc(rec->str_size);
+    }
+    if (fread(rec->str, 1, n, rec->file) != n)
+        return NULL;
+    rec->str[n] = '\0';
+    *len = n;
+    return rec->str;
+}
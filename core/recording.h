@@ -0,0 +1,78 @@
+/***********************************************
+ * Recordings of events from a shared-memory buffer.
+ *
+ * A recording is a binary file that starts with a header describing
+ * the recorded buffer (its key, capacity, size of elements and the
+ * events that it carries -- the contents of `source_control`) and
+ * continues with the events in the order in which they were read
+ * from the buffer. Every event stores the time elapsed since the
+ * previous event, its kind and id (as the difference from the previous
+ * id) and then its arguments as described by the signature of the
+ * event. Integers are stored as (zig-zag) varints, strings as a varint
+ * length followed by the characters, so the recording is usually much
+ * smaller than the buffer elements. The end of the recording is marked
+ * by an event of kind 0.
+ *
+ * The writer and reader only encode the data, they do not know about
+ * signatures: the caller writes (reads) the arguments one by one
+ * according to the signature of the event.
+ ************************************************/
+
+#ifndef SHAMON_RECORDING_H_
+#define SHAMON_RECORDING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "event.h"
+#include "source.h"
+
+#define SHM_RECORDING_VERSION 1
+
+typedef struct _shm_recording shm_recording;
+
+/* Create a new recording in `path`. The `events` are stored together
+ * with their kinds, which are then used to identify events in the
+ * recording. */
+shm_recording *shm_recording_create(const char *path, const char *key,
+                                    size_t capacity, size_t elem_size,
+                                    const struct event_record *events,
+                                    size_t events_num);
+/* Open an existing recording for reading */
+shm_recording *shm_recording_open(const char *path);
+/* Finish (writing) the recording and free the resources.
+ * Returns 0 on success and -1 on error (e.g., when flushing
+ * the data to the disk failed). */
+int shm_recording_close(shm_recording *rec);
+
+const char *shm_recording_key(shm_recording *rec);
+size_t shm_recording_capacity(shm_recording *rec);
+size_t shm_recording_elem_size(shm_recording *rec);
+struct event_record *shm_recording_events(shm_recording *rec, size_t *num);
+/* Get the event with the given kind or NULL if there is no such event */
+struct event_record *shm_recording_get_event(shm_recording *rec,
+                                             shm_kind kind);
+
+/* Write the header of the event, `time_ns` is the time of the event
+ * (from an arbitrary, but fixed, point in the past). */
+void shm_recording_write_event(shm_recording *rec, uint64_t time_ns,
+                               shm_kind kind, shm_eventid id);
+/* Write one argument of the type `op` (a signature character)
+ * stored in `data` */
+void shm_recording_write_arg(shm_recording *rec, unsigned char op,
+                             const void *data);
+void shm_recording_write_str(shm_recording *rec, const char *str,
+                             size_t len);
+
+/* Read the header of the next event. Returns 0 at the end of the
+ * recording and -1 on error, otherwise 1. */
+int shm_recording_read_event(shm_recording *rec, uint64_t *time_ns,
+                             shm_kind *kind, shm_eventid *id);
+/* Read one argument of the type `op` into `data`. `data` must
+ * be large enough to hold the value (signature_op_get_size(op)). */
+int shm_recording_read_arg(shm_recording *rec, unsigned char op, void *data);
+/* Read a string, the returned pointer is valid until the next read
+ * of a string. Returns NULL on error. */
+const char *shm_recording_read_str(shm_recording *rec, size_t *len);
+
+#endif /* SHAMON_RECORDING_H_ */
@@ -12,17 +12,42 @@
 
 #include "arbiter.h"
 #include "par_queue.h"
+#include "perf_counters.h"
 #include "stream.h"
+#include "trace.h"
 #include "utils.h"
-#include "vector-aligned.h"
 #include "vector-macro.h"
+#include "vector.h"
+
+/* the thread that fetches events of a stream into its arbiter buffer */
+struct buffer_thread {
+    thrd_t thread;
+    shm_arbiter_buffer *buffer;
+    /* the counter of exited threads in shamon */
+    _Atomic size_t *exited_num;
+    _Atomic bool exited;
+    /* the exit was already handled by shamon */
+    bool handled;
+};
+
+/* a stream added by the user, it may get new substreams */
+struct parent_stream {
+    shm_stream *stream;
+    size_t buffer_capacity;
+};
 
 typedef struct _shamon {
     VEC(streams, shm_stream *);
-    /* shm_arbiter_buffers stored in this vector assume
-     * they are aligned in memory, so use aligned vector */
-    shm_vector_aligned buffers;
-    VEC(buffer_threads, thrd_t);
+    /* the arbiter buffers of the streams (shm_arbiter_buffer *).
+     * The buffers are allocated separately, because their threads
+     * hold pointers to them while the vector is reallocated. */
+    shm_vector buffers;
+    VEC(buffer_threads, struct buffer_thread *);
+    VEC(parents, struct parent_stream);
+    /* incremented by buffer threads when they exit
+     * and the number of the exits that were handled */
+    _Atomic size_t exited_threads;
+    size_t handled_exits;
     /* callbacks and their data */
     shamon_process_events_fn process_events;
     void *process_events_data;
@@ -32,13 +57,16 @@ typedef struct _shamon {
     size_t _ev_size;
 } shamon;
 
-#define _buffers(shmn) ((shm_vector *)&shmn->buffers)
+#define _buffers(shmn) (&shmn->buffers)
+#define _buffer(shmn, i) \
+    (*(shm_arbiter_buffer **)shm_vector_at(_buffers(shmn), (i)))
 
 #define SLEEP_NS_INIT (50)
 #define SLEEP_THRESHOLD_NS (10000000)
 
 static int default_buffer_manager_thrd(void *data) {
-    shm_arbiter_buffer *buffer = (shm_arbiter_buffer *)data;
+    struct buffer_thread *bt = (struct buffer_thread *)data;
+    shm_arbiter_buffer *buffer = bt->buffer;
     shm_stream *stream = shm_arbiter_buffer_stream(buffer);
     register shm_stream_alter_fn alter = stream->alter;
     register shm_stream_filter_fn filter = stream->filter;
@@ -48,6 +76,7 @@ static int default_buffer_manager_thrd(void *data) {
 
     printf("Running fetch & autodrop for stream %s\n",
            shm_stream_get_name(stream));
+    SHM_TRACE_THREAD_NAME(shm_stream_get_name(stream));
 
     void *ev, *out;
     while (1) {
@@ -60,20 +89,50 @@ static int default_buffer_manager_thrd(void *data) {
             continue;
         }
 
+        SHM_TRACE_BEGIN(SHM_TRACE_FORWARD, shm_event_id(ev));
         out = shm_arbiter_buffer_write_ptr(buffer);
         assert(out && "No space in the buffer");
         alter(stream, ev, out);
         shm_arbiter_buffer_write_finish(buffer);
         shm_stream_consume(stream, 1);
+        SHM_TRACE_END(SHM_TRACE_FORWARD, 0);
     }
 
-    // TODO: we should check if the stream is finished and remove it
-    // in that case
     printf("BMM for stream %lu (%s) exits\n", stream->id,
            shm_stream_get_type(stream));
+    /* nothing is written to the buffer anymore,
+     * let shamon know that it can remove the stream */
+    atomic_store(&bt->exited, true);
+    atomic_fetch_add(bt->exited_num, 1);
     thrd_exit(EXIT_SUCCESS);
 }
 
+/* Initialize `hole` from (at most `max`) events at the beginning
+ * of `buffer` and return how many events it covers. We stop at the first
+ * hole in the buffer, because dropping it would lose the number of events
+ * that it stands for. */
+static size_t prepare_hole(shm_stream *stream, shm_arbiter_buffer *buffer,
+                           shm_event *hole, size_t max) {
+    unsigned char *data[2];
+    size_t len[2];
+    shm_arbiter_buffer_peek(buffer, max, (void **)&data[0], &len[0],
+                            (void **)&data[1], &len[1]);
+    const size_t elem_size = shm_arbiter_buffer_elem_size(buffer);
+
+    size_t n = 0;
+    stream->hole_handling.init(hole);
+    for (int p = 0; p < 2; ++p) {
+        for (size_t k = 0; k < len[p]; ++k) {
+            shm_event *ev = (shm_event *)(data[p] + k * elem_size);
+            if (shm_event_is_hole(ev))
+                return n;
+            stream->hole_handling.update(hole, ev);
+            ++n;
+        }
+    }
+    return n;
+}
+
 static shm_event *default_process_events(shm_vector *buffers, void *data,
                                          shm_stream **streamret) {
     assert(buffers);
@@ -94,31 +153,36 @@ static shm_event *default_process_events(shm_vector *buffers, void *data,
     shm_event *inevent;
 
     while (i < shm_vector_size(buffers)) {
-        buffer = ((shm_arbiter_buffer *)shm_vector_at(buffers, i));
+        buffer = *((shm_arbiter_buffer **)shm_vector_at(buffers, i));
+        assert(buffer);
+        ++i;
         if (!shm_arbiter_buffer_active(buffer))
             continue;
-        assert(buffer);
         stream = shm_arbiter_buffer_stream(buffer);
-        ++i;
 
         qsize = shm_arbiter_buffer_peek1(buffer, (void **)&inevent);
         if (qsize > 0) {
             assert(shmn->_ev);
             const uint64_t c = shm_arbiter_buffer_capacity(buffer);
             /* is the buffer full from 75 or more percent? */
-            if (qsize > 0.8 * c) {
+            if (qsize > 0.8 * c && !shm_event_is_hole(inevent)) {
                 /* drop half of the buffer */
                 shm_eventid id = shm_event_id(inevent);
-                if (!shm_arbiter_buffer_drop(buffer, c / 2)) {
+                const size_t n =
+                    prepare_hole(stream, buffer, shmn->_ev, c / 2);
+                assert(n > 0);
+                if (!shm_arbiter_buffer_drop(buffer, n)) {
                     assert(0 && "Failed dropping events");
                 }
-                shm_stream_prepare_hole_event(stream, shmn->_ev, id, c / 2);
+                shm_stream_prepare_hole_event(stream, shmn->_ev, id, n);
+                SHM_TRACE_INSTANT(SHM_TRACE_HOLE, n);
                 *streamret = stream;
                 return shmn->_ev;
             }
 
             /* TODO: ideally, we do not copy the event here but pass it directly
              * to the monitor */
+            SHM_TRACE_INSTANT(SHM_TRACE_DISPATCH, shm_event_id(inevent));
             memcpy(shmn->_ev, inevent, shm_arbiter_buffer_elem_size(buffer));
 #ifndef NDEBUG
             size_t n =
@@ -130,8 +194,6 @@ static shm_event *default_process_events(shm_vector *buffers, void *data,
         }
     }
 
-    // TODO: we should check if the stream is finished and remove it
-    // in that case
     return NULL;
 }
 
@@ -141,15 +203,21 @@ shamon *shamon_create(shamon_process_events_fn process_events,
     assert(shmn);
 
     VEC_INIT(shmn->streams);
-    shm_vector_aligned_init(&shmn->buffers, shm_arbiter_buffer_sizeof(),
-                            CACHELINE_SIZE);
+    shm_vector_init(&shmn->buffers, sizeof(shm_arbiter_buffer *));
     VEC_INIT(shmn->buffer_threads);
+    VEC_INIT(shmn->parents);
+    atomic_init(&shmn->exited_threads, 0);
+    shmn->handled_exits = 0;
     shmn->_ev_size = sizeof(shm_event_default_hole);
     shmn->_ev = malloc(shmn->_ev_size);
     shmn->process_events =
         process_events ? process_events : default_process_events;
     shmn->process_events_data = process_events ? process_events_data : shmn;
 
+    /* we assume that the events are processed by the thread
+     * that creates shamon */
+    SHM_PERF_COUNTERS_OPEN("monitor");
+
     return shmn;
 }
 
@@ -172,13 +240,8 @@ void shamon_detach(shamon *shmn) {
 void shamon_destroy(shamon *shmn) {
     assert(VEC_SIZE(shmn->buffer_threads) == shm_vector_size(_buffers(shmn)));
     for (size_t i = 0; i < VEC_SIZE(shmn->buffer_threads); ++i) {
-        thrd_join(shmn->buffer_threads[i], NULL);
-        /*
-            shm_arbiter_buffer *buff
-                = *((shm_arbiter_buffer **)shm_vector_at(_buffers(shmn), i));
-            shm_arbiter_buffer_set_active(buff, false);
-            shm_arbiter_buffer_destroy(buff);
-        */
+        thrd_join(shmn->buffer_threads[i]->thread, NULL);
+        free(shmn->buffer_threads[i]);
     }
 
     for (size_t i = 0; i < VEC_SIZE(shmn->streams); ++i) {
@@ -186,11 +249,18 @@ void shamon_destroy(shamon *shmn) {
             shm_stream_destroy(shmn->streams[i]);
         }
     }
+    for (size_t i = 0; i < shm_vector_size(_buffers(shmn)); ++i) {
+        shm_arbiter_buffer_free(_buffer(shmn, i));
+    }
     VEC_DESTROY(shmn->streams);
     VEC_DESTROY(shmn->buffer_threads);
+    VEC_DESTROY(shmn->parents);
     shm_vector_destroy(_buffers(shmn));
     free(shmn->_ev);
     free(shmn);
+
+    SHM_PERF_COUNTERS_DUMP();
+    SHM_TRACE_FLUSH();
 }
 
 bool shamon_is_ready(shamon *shmn) {
@@ -199,8 +269,10 @@ bool shamon_is_ready(shamon *shmn) {
         if (shm_stream_is_ready(s) || shm_stream_has_new_substreams(s)) {
             return true;
         } else {
-            shm_arbiter_buffer *buff = shm_vector_at(_buffers(shmn), i);
-            if (shm_arbiter_buffer_size(buff) > 0) {
+            /* the stream may have ended while its buffer thread was
+             * dropping events and the hole was not pushed yet */
+            shm_arbiter_buffer *buff = _buffer(shmn, i);
+            if (!shm_arbiter_buffer_is_done(buff)) {
                 return true;
             }
         }
@@ -209,27 +281,89 @@ bool shamon_is_ready(shamon *shmn) {
     return false;
 }
 
+static void add_stream(shamon *shmn, shm_stream *stream,
+                       size_t buffer_capacity);
+
+/* Remove the stream at index `i` once its thread exited and the monitor
+ * processed all its events. The shared memory of the stream is released. */
+static void remove_stream(shamon *shmn, size_t i) {
+    struct buffer_thread *bt = shmn->buffer_threads[i];
+    shm_stream *stream = shmn->streams[i];
+    assert(bt->buffer == _buffer(shmn, i));
+
+    thrd_join(bt->thread, NULL);
+    printf("Removing finished stream %lu (%s)\n", shm_stream_id(stream),
+           shm_stream_get_name(stream));
+
+    VEC_REMOVE(shmn->streams, i);
+    VEC_REMOVE(shmn->buffer_threads, i);
+    shm_vector_remove(_buffers(shmn), i);
+
+    shm_arbiter_buffer_free(bt->buffer);
+    free(bt);
+    shm_stream_remove_substream(stream);
+}
+
+/* Remove finished substreams. The streams added by the user are kept
+ * until shamon is destroyed. */
+static void reclaim_finished_streams(shamon *shmn) {
+    for (size_t i = 0; i < VEC_SIZE(shmn->buffer_threads); ++i) {
+        struct buffer_thread *bt = shmn->buffer_threads[i];
+        if (bt->handled || !atomic_load(&bt->exited))
+            continue;
+        if (!shm_stream_is_substream(shmn->streams[i])) {
+            bt->handled = true;
+            ++shmn->handled_exits;
+            continue;
+        }
+        /* the monitor did not get all the events yet */
+        if (shm_arbiter_buffer_size(bt->buffer) > 0)
+            continue;
+
+        remove_stream(shmn, i--);
+        ++shmn->handled_exits;
+    }
+}
+
 shm_event *shamon_get_next_ev(shamon *shmn, shm_stream **streamret) {
-    for (size_t i = 0; i < VEC_SIZE(shmn->streams); ++i) {
-        shm_stream *s = shmn->streams[i];
-        shm_stream *new_stream =
-            shm_stream_create_substream(s, NULL, NULL, NULL, NULL, NULL);
-        if (new_stream) {
+    /* only the streams added by the user can get new substreams,
+     * the source announces them in the counter of sub-buffers
+     * in the shared memory of the stream */
+    for (size_t i = 0; i < VEC_SIZE(shmn->parents); ++i) {
+        struct parent_stream *p = &shmn->parents[i];
+        if (!shm_stream_has_new_substreams(p->stream))
+            continue;
+
+        shm_stream *new_stream;
+        while ((new_stream = shm_stream_create_substream(
+                    p->stream, NULL, NULL, NULL, NULL, NULL))) {
             fprintf(stderr, "Stream %lu has a new dynamic substream\n",
-                    shm_stream_id(s));
+                    shm_stream_id(p->stream));
             shm_stream_register_all_events(new_stream);
-            shamon_add_stream(
-                shmn, new_stream,
-                shm_arbiter_buffer_capacity(shm_vector_at(_buffers(shmn), i)));
+            add_stream(shmn, new_stream, p->buffer_capacity);
         }
     }
 
+    /* buffer threads notify us when their stream ends */
+    if (atomic_load_explicit(&shmn->exited_threads, memory_order_acquire) !=
+        shmn->handled_exits) {
+        reclaim_finished_streams(shmn);
+    }
+
     return shmn->process_events(_buffers(shmn), shmn->process_events_data,
                                 streamret);
 }
 
 void shamon_add_stream(shamon *shmn, shm_stream *stream,
                        size_t buffer_capacity) {
+    struct parent_stream p = {.stream = stream,
+                              .buffer_capacity = buffer_capacity};
+    VEC_PUSH(shmn->parents, &p);
+    add_stream(shmn, stream, buffer_capacity);
+}
+
+static void add_stream(shamon *shmn, shm_stream *stream,
+                       size_t buffer_capacity) {
     for (unsigned i = 0; i < VEC_SIZE(shmn->streams); ++i) {
         if (strcmp(shmn->streams[i]->name, stream->name) == 0) {
             fprintf(stderr, "Stream '%s' added multiple times\n", stream->name);
@@ -249,14 +383,18 @@ void shamon_add_stream(shamon *shmn, shm_stream *stream,
         shmn->_ev_size = strm_event_size;
     }
 
-    shm_arbiter_buffer *buffer = shm_vector_aligned_extend(_buffers(shmn));
     /* 0 as the output event size means same as the stream */
-    shm_arbiter_buffer_init(buffer, stream,
-                            /* output event size = */ 0, buffer_capacity);
-
-    thrd_t thread_id;
-    thrd_create(&thread_id, default_buffer_manager_thrd, buffer);
-    VEC_PUSH(shmn->buffer_threads, &thread_id);
+    shm_arbiter_buffer *buffer = shm_arbiter_buffer_create(
+        stream, /* output event size = */ 0, buffer_capacity);
+    shm_vector_push(_buffers(shmn), &buffer);
+
+    struct buffer_thread *bt = xalloc(sizeof(*bt));
+    bt->buffer = buffer;
+    bt->exited_num = &shmn->exited_threads;
+    atomic_init(&bt->exited, false);
+    bt->handled = false;
+    thrd_create(&bt->thread, default_buffer_manager_thrd, bt);
+    VEC_PUSH(shmn->buffer_threads, &bt);
 
     printf("Added a stream id %lu: '%s'\n", VEC_SIZE(shmn->streams) - 1,
            stream->type);
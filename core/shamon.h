@@ -9,6 +9,7 @@ typedef struct _shm_event shm_event;
 typedef struct _shm_stream shm_stream;
 typedef struct _shm_vector shm_vector;
 
+/* `buffers` is a vector of pointers to the arbiter buffers (shm_arbiter_buffer *) */
 typedef shm_event *(*shamon_process_events_fn)(shm_vector *buffers, void *data,
                                                shm_stream **);
 
@@ -21,6 +22,9 @@ void shamon_detach(shamon *shmn);
 
 void shamon_add_stream(shamon *shmn, shm_stream *stream,
                        size_t buffer_capacity);
+/* Get the next event. New substreams are added and the substreams that
+ * finished are removed here, so the stream returned in the previous call
+ * may not exist anymore. */
 shm_event *shamon_get_next_ev(shamon *, shm_stream **);
 shm_vector *shamon_get_buffers(shamon *);
 shm_stream **shamon_get_streams(shamon *, size_t *);
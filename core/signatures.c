@@ -22,6 +22,8 @@ size_t signature_op_get_size(unsigned char c) {
             return sizeof(op.p);
         case 't':
             return sizeof(op.t);
+        case 'P':
+            return sizeof(op.P);
         case 'S':
         case 'L': /* aliases for strings: line and match */
         case 'M':
@@ -13,6 +13,8 @@
  * d = double
  * p = pointer
  * S = string (0-terminated array of chars)
+ * P = payload (a reference into the payload ring of the buffer,
+ *     see shmbuf/payload.h)
  * _ = skip argument
  * E.g.: "i_c" means track first and third arguments that have 4 bytes
  * and 1 byte size
@@ -33,6 +35,7 @@ typedef union _signature_operand {
         const char *local;
     } S;
     uint64_t t; /* timestamp */
+    uint64_t P; /* payload reference */
     /* any of those types */
 } signature_operand;
 
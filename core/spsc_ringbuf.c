@@ -153,9 +153,18 @@ static inline size_t get_write_off(size_t head, size_t tail, size_t capacity,
     }
 
     if (__predict_false(tail == head)) {
-        *n = capacity - 1;
-        if (wrap_n) {
-            *wrap_n = 0;
+        /* the buffer is empty, but only the elements up to the end
+         * of the buffer are contiguous */
+        if (head == 0) {
+            *n = capacity - 1;
+            if (wrap_n) {
+                *wrap_n = 0;
+            }
+        } else {
+            *n = capacity - head;
+            if (wrap_n) {
+                *wrap_n = head - 1;
+            }
         }
         return capacity - 1;
     }
@@ -273,6 +282,9 @@ size_t shm_spsc_ringbuf_read_off_nowrap(shm_spsc_ringbuf *b, size_t *n) {
         tmp = get_written_num(b->seen_head, tail, b->capacity);
     }
 
+    /* only the elements up to the end of the buffer are contiguous */
+    if (tmp > b->capacity - tail)
+        tmp = b->capacity - tail;
     *n = tmp;
 
     return tail;
@@ -7,6 +7,7 @@
 
 #include "core/vector-macro.h"
 #include "shmbuf/buffer.h"
+#include "shmbuf/payload.h"
 #include "utils.h"
 
 /*****
@@ -25,10 +26,15 @@ static void default_hole_update(shm_event *hole, shm_event *ev) {
     ++((shm_event_default_hole *)hole)->n;
 }
 
+static void default_hole_add_lost(shm_event *hole, size_t n) {
+    ((shm_event_default_hole *)hole)->n += n;
+}
+
 static shm_stream_hole_handling default_hole_handling = {
     .hole_event_size = sizeof(shm_event_default_hole),
     .init = default_hole_init,
-    .update = default_hole_update};
+    .update = default_hole_update,
+    .add_lost = default_hole_add_lost};
 
 static uint64_t last_stream_id = 0;
 
@@ -41,6 +47,7 @@ void shm_stream_init(shm_stream *stream, struct buffer *incoming_events_buffer,
     stream->id = ++last_stream_id;
     stream->event_size = event_size;
     stream->incoming_events_buffer = incoming_events_buffer;
+    stream->source_ops = NULL;
     stream->substreams_no = 0;
     /* TODO: maybe we could just have a boolean flag that would be set
      * by a particular stream implementation instead of this function call?
@@ -65,11 +72,20 @@ void shm_stream_init(shm_stream *stream, struct buffer *incoming_events_buffer,
 
     hole_handling = hole_handling ? hole_handling : &default_hole_handling;
     assert(hole_handling->hole_event_size > 0 && hole_handling->update &&
-           hole_handling->init);
+           hole_handling->init && hole_handling->add_lost);
 
     stream->hole_handling = *hole_handling;
     stream->parent_stream = NULL;
     VEC_INIT(stream->substreams);
+    stream->payload = NULL;
+}
+
+static void close_payload(shm_stream *stream) {
+    if (stream->payload) {
+        /* the source stops waiting for us */
+        shm_payload_close(stream->payload);
+        stream->payload = NULL;
+    }
 }
 
 static void shm_substream_destroy(shm_stream *stream) {
@@ -93,8 +109,10 @@ static void shm_substream_destroy(shm_stream *stream) {
     free(stream->type);
     free(stream->name);
     free(stream->events_cache);
+    close_payload(stream);
 
-    release_shared_sub_buffer(stream->incoming_events_buffer);
+    if (stream->incoming_events_buffer)
+        release_shared_sub_buffer(stream->incoming_events_buffer);
     free(stream);
 }
 
@@ -119,11 +137,26 @@ void shm_stream_destroy(shm_stream *stream) {
     free(stream->type);
     free(stream->name);
     free(stream->events_cache);
+    close_payload(stream);
 
-    release_shared_buffer(stream->incoming_events_buffer);
+    if (stream->incoming_events_buffer)
+        release_shared_buffer(stream->incoming_events_buffer);
     free(stream);
 }
 
+void shm_stream_remove_substream(shm_stream *substream) {
+    shm_stream *parent = substream->parent_stream;
+    assert(parent && "The stream is not a substream");
+    for (unsigned i = 0; i < VEC_SIZE(parent->substreams); ++i) {
+        if (parent->substreams[i] == substream) {
+            VEC_REMOVE(parent->substreams, i);
+            shm_substream_destroy(substream);
+            return;
+        }
+    }
+    assert(0 && "The substream is not in its parent");
+}
+
 size_t shm_stream_id(shm_stream *stream) { return stream->id; }
 
 const char *shm_stream_get_name(shm_stream *stream) {
@@ -137,6 +170,8 @@ const char *shm_stream_get_type(shm_stream *stream) {
 }
 
 _Bool shm_stream_has_new_substreams(shm_stream *stream) {
+    if (stream->source_ops)
+        return 0;
     return buffer_get_sub_buffers_no(stream->incoming_events_buffer) >
            stream->substreams_no;
 }
@@ -181,6 +216,8 @@ shm_stream *shm_stream_create_substream(
 }
 
 struct event_record *shm_stream_get_avail_events(shm_stream *s, size_t *sz) {
+    if (s->source_ops)
+        return s->source_ops->get_avail_events(s, sz);
     return buffer_get_avail_events(s->incoming_events_buffer, sz);
 }
 
@@ -211,8 +248,7 @@ struct event_record *shm_stream_get_event_record(shm_stream *stream,
     } else {
         /* create cache */
         size_t sz;
-        struct event_record *recs =
-            buffer_get_avail_events(stream->incoming_events_buffer, &sz);
+        struct event_record *recs = shm_stream_get_avail_events(stream, &sz);
         size_t max_kind = get_max_kind(recs, sz);
         size_t cache_sz =
             (max_kind > MAX_EVENTS_CACHE_SIZE ? MAX_EVENTS_CACHE_SIZE
@@ -235,8 +271,7 @@ struct event_record *shm_stream_get_event_record(shm_stream *stream,
 struct event_record *shm_stream_get_event_record_no_cache(shm_stream *stream,
                                                           shm_kind kind) {
     size_t sz;
-    struct event_record *recs =
-        buffer_get_avail_events(stream->incoming_events_buffer, &sz);
+    struct event_record *recs = shm_stream_get_avail_events(stream, &sz);
     for (size_t i = 0; i < sz; ++i) {
         if (recs[i].kind == kind)
             return &recs[i];
@@ -246,11 +281,15 @@ struct event_record *shm_stream_get_event_record_no_cache(shm_stream *stream,
 
 /* the number of elements in the (shared memory) buffer of the stream */
 size_t shm_stream_buffer_size(shm_stream *s) {
+    if (s->source_ops)
+        return s->source_ops->size(s);
     return buffer_size(s->incoming_events_buffer);
 }
 
 /* the capacity the (shared memory) buffer of the stream */
 size_t shm_stream_buffer_capacity(shm_stream *s) {
+    if (s->source_ops)
+        return s->source_ops->capacity(s);
     return buffer_capacity(s->incoming_events_buffer);
 }
 
@@ -277,6 +316,8 @@ void *shm_stream_read_events(shm_stream *s, size_t *num) {
     /* the buffer may be already destroyed on the client's side,
      * but still may have some events to read */
     /* assert(shm_stream_is_ready(s)); */
+    if (s->source_ops)
+        return s->source_ops->read_events(s, num);
     return buffer_read_pointer(s->incoming_events_buffer, num);
 }
 
@@ -284,10 +325,25 @@ bool shm_stream_consume(shm_stream *stream, size_t num) {
 #ifdef DUMP_STATS
     stream->consumed_events += num;
 #endif
+    if (stream->source_ops)
+        return stream->source_ops->consume(stream, num);
     return buffer_drop_k(stream->incoming_events_buffer, num);
 }
 
+bool shm_stream_may_lose_events(shm_stream *stream) {
+    if (stream->source_ops || !stream->incoming_events_buffer)
+        return false;
+    return buffer_may_lose_events(stream->incoming_events_buffer);
+}
+
+struct shm_payload *shm_stream_get_payload(shm_stream *stream) {
+    return stream->payload;
+}
+
 const char *shm_stream_get_str(shm_stream *stream, uint64_t elem) {
+    /* such streams have strings stored directly as pointers */
+    if (stream->source_ops)
+        return (const char *)elem;
     return buffer_get_str(stream->incoming_events_buffer, elem);
 }
 
@@ -295,43 +351,69 @@ size_t shm_stream_event_size(shm_stream *s) { return s->event_size; }
 
 int shm_stream_register_event(shm_stream *stream, const char *name,
                               size_t kind) {
+    if (stream->source_ops)
+        return stream->source_ops->register_event(stream, name, kind);
     return buffer_register_event(stream->incoming_events_buffer, name, kind);
 }
 
 int shm_stream_register_events(shm_stream *stream, size_t ev_nums, ...) {
     va_list ap;
     va_start(ap, ev_nums);
-    int ret =
-        buffer_register_events(stream->incoming_events_buffer, ev_nums, ap);
+    /* we cannot pass `ap` to buffer_register_events, so register
+     * the events one by one */
+    int ret = 0;
+    for (size_t i = 0; i < ev_nums; ++i) {
+        const char *name = va_arg(ap, const char *);
+        shm_kind kind = va_arg(ap, shm_kind);
+        if (shm_stream_register_event(stream, name, kind) < 0) {
+            ret = -1;
+            break;
+        }
+    }
     va_end(ap);
     return ret;
 }
 
 int shm_stream_register_all_events(shm_stream *stream) {
+    if (stream->source_ops)
+        return stream->source_ops->register_all_events(stream);
     return buffer_register_all_events(stream->incoming_events_buffer);
 }
 
 void shm_stream_notify_last_processed_id(shm_stream *stream, shm_eventid id) {
+    if (stream->source_ops)
+        return;
+    if (stream->payload)
+        shm_payload_release_until(stream->payload, id);
     buffer_set_last_processed_id(stream->incoming_events_buffer, id);
 }
 
 void shm_stream_notify_dropped(shm_stream *stream, uint64_t begin_id,
                                uint64_t end_id) {
+    if (stream->source_ops)
+        return;
     buffer_notify_dropped(stream->incoming_events_buffer, begin_id, end_id);
 }
 
 void shm_stream_attach(shm_stream *stream) {
+    if (stream->source_ops)
+        return;
+    /* the source creates the ring before the buffer */
+    if (!stream->payload)
+        stream->payload =
+            shm_payload_open(buffer_get_key(stream->incoming_events_buffer));
     buffer_set_attached(stream->incoming_events_buffer, true);
 }
 
 void shm_stream_detach(shm_stream *stream) {
+    if (stream->source_ops)
+        return;
     buffer_set_attached(stream->incoming_events_buffer, false);
 }
 
 void shm_stream_dump_events(shm_stream *stream) {
     size_t evs_num;
-    struct event_record *events =
-        buffer_get_avail_events(stream->incoming_events_buffer, &evs_num);
+    struct event_record *events = shm_stream_get_avail_events(stream, &evs_num);
     for (size_t i = 0; i < evs_num; ++i) {
         fprintf(stderr,
                 "[%s:%s] event: %-20s, kind: %-3lu, size: %-3lu, sig: %s\n",
@@ -6,6 +6,7 @@
 #include "vector-macro.h"
 
 typedef struct _shm_arbiter_buffer shm_arbiter_buffer;
+struct shm_payload;
 
 typedef size_t (*shm_stream_buffer_events_fn)(struct _shm_stream *,
                                               shm_arbiter_buffer *buffer);
@@ -16,11 +17,27 @@ typedef bool (*shm_stream_filter_fn)(shm_stream *, shm_event *);
 typedef void (*shm_stream_alter_fn)(shm_stream *, shm_event *, shm_event *);
 typedef void (*shm_stream_hole_init_fn)(shm_event *);
 typedef void (*shm_stream_hole_update_fn)(shm_event *, shm_event *);
+typedef void (*shm_stream_hole_add_lost_fn)(shm_event *, size_t);
+
+/* Streams that do not read events from a shared-memory buffer
+ * (e.g., from a file) provide these operations. The operations
+ * that are not listed here are no-ops for such streams. */
+typedef struct _shm_stream_source_ops {
+    void *(*read_events)(struct _shm_stream *, size_t *);
+    bool (*consume)(struct _shm_stream *, size_t);
+    size_t (*size)(struct _shm_stream *);
+    size_t (*capacity)(struct _shm_stream *);
+    struct event_record *(*get_avail_events)(struct _shm_stream *, size_t *);
+    int (*register_event)(struct _shm_stream *, const char *, shm_kind);
+    int (*register_all_events)(struct _shm_stream *);
+} shm_stream_source_ops;
 
 typedef struct _shm_stream_hole_handling {
     size_t hole_event_size;
     shm_stream_hole_init_fn init;
     shm_stream_hole_update_fn update;
+    /* add events that the source lost, we do not know their kinds */
+    shm_stream_hole_add_lost_fn add_lost;
 } shm_stream_hole_handling;
 
 // TODO: make this opaque
@@ -31,6 +48,9 @@ typedef struct _shm_stream {
     size_t event_size;
     /* shared-memory buffer */
     struct buffer *incoming_events_buffer;
+    /* operations of streams that do not use the shared-memory buffer,
+     * NULL otherwise */
+    const shm_stream_source_ops *source_ops;
     /* the number of created substreams (sub-buffers) for the
      * shared memory buffer */
     size_t substreams_no;
@@ -45,6 +65,9 @@ typedef struct _shm_stream {
     /* substreams of this stream and the link to the parent */
     shm_stream *parent_stream;
     VEC(substreams, struct _shm_stream *);
+    /* the payload ring of the shared memory buffer (opened on attach),
+     * NULL if there is none */
+    struct shm_payload *payload;
 #ifndef NDEBUG
     /* for checking consistency */
     size_t last_event_id;
@@ -87,6 +110,8 @@ shm_stream *shm_stream_create_substream(
     shm_stream *stream, shm_stream_is_ready_fn is_ready,
     shm_stream_filter_fn filter, shm_stream_alter_fn alter,
     shm_stream_destroy_fn destroy, shm_stream_hole_handling *hole_handling);
+/* remove the substream from its parent stream and destroy it */
+void shm_stream_remove_substream(shm_stream *substream);
 
 /* the number of elements in the (shared memory) buffer of the stream */
 size_t shm_stream_buffer_size(shm_stream *);
@@ -96,6 +121,14 @@ size_t shm_stream_buffer_capacity(shm_stream *);
 void *shm_stream_read_events(shm_stream *, size_t *);
 bool shm_stream_consume(shm_stream *stream, size_t num);
 const char *shm_stream_get_str(shm_stream *stream, uint64_t elem);
+/* the payload ring for the 'P' arguments of events (see shmbuf/payload.h),
+ * NULL if there is none. The payloads are released when the stream
+ * is notified that their events were processed. */
+struct shm_payload *shm_stream_get_payload(shm_stream *stream);
+/* true if the source may lose events without the stream dropping them
+ * (e.g., non-primary readers of broadcast buffers), the lost events
+ * make a gap in the IDs of events */
+bool shm_stream_may_lose_events(shm_stream *stream);
 
 void shm_stream_notify_last_processed_id(shm_stream *stream, shm_eventid id);
 bool shm_stream_is_ready(shm_stream *);
@@ -0,0 +1,466 @@
+#include "struct_log.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h> /* ssize_t */
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "utils.h"
+
+struct key {
+    const char *str;
+    size_t len;
+};
+
+struct shm_struct_log {
+    size_t keys_num;
+    struct key *keys;
+    /* the positions of the quotes and of the structural characters
+     * outside of strings in the current line (stage 1) */
+    uint32_t *index;
+    size_t index_alloc;
+};
+
+struct shm_struct_log *shm_struct_log_create(size_t keys_num,
+                                             const char *keys[]) {
+    assert(keys_num > 0);
+    struct shm_struct_log *slog = xalloc(sizeof(*slog));
+    slog->keys_num = keys_num;
+    slog->keys = xalloc(keys_num * sizeof(struct key));
+    for (size_t i = 0; i < keys_num; ++i) {
+        slog->keys[i].str = keys[i];
+        slog->keys[i].len = strlen(keys[i]);
+    }
+    slog->index_alloc = 1024;
+    slog->index = xalloc(slog->index_alloc * sizeof(uint32_t));
+    return slog;
+}
+
+void shm_struct_log_destroy(struct shm_struct_log *slog) {
+    free(slog->keys);
+    free(slog->index);
+    free(slog);
+}
+
+/*
+ * Stage 1: the structural index
+ */
+
+struct block_masks {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t structural;
+};
+
+#ifdef __SSE2__
+static inline uint64_t eq_mask(const __m128i v[4], char c) {
+    const __m128i cv = _mm_set1_epi8(c);
+    uint64_t m = 0;
+    for (int i = 0; i < 4; ++i) {
+        m |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v[i], cv))
+             << (16 * i);
+    }
+    return m;
+}
+
+/* classify the 64 bytes at `p` */
+static void classify_block(const char *p, bool json, struct block_masks *m) {
+    __m128i v[4];
+    for (int i = 0; i < 4; ++i) {
+        v[i] = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+    }
+    m->quote = eq_mask(v, '"');
+    m->backslash = eq_mask(v, '\\');
+    if (json) {
+        m->structural = eq_mask(v, '{') | eq_mask(v, '}') | eq_mask(v, '[') |
+                        eq_mask(v, ']') | eq_mask(v, ':') | eq_mask(v, ',');
+    } else {
+        m->structural = eq_mask(v, '=') | eq_mask(v, ' ') | eq_mask(v, '\t');
+    }
+}
+#else
+static void classify_block(const char *p, bool json, struct block_masks *m) {
+    m->quote = m->backslash = m->structural = 0;
+    for (int i = 0; i < 64; ++i) {
+        const uint64_t bit = 1ULL << i;
+        switch (p[i]) {
+            case '"':
+                m->quote |= bit;
+                break;
+            case '\\':
+                m->backslash |= bit;
+                break;
+            case '{':
+            case '}':
+            case '[':
+            case ']':
+            case ':':
+            case ',':
+                if (json)
+                    m->structural |= bit;
+                break;
+            case '=':
+            case ' ':
+            case '\t':
+                if (!json)
+                    m->structural |= bit;
+                break;
+        }
+    }
+}
+#endif
+
+/* the characters escaped by backslashes, `carry` says whether the first
+ * character of the block is escaped and is set for the next block */
+static inline uint64_t find_escaped(uint64_t backslash, uint64_t *carry) {
+    uint64_t escaped = *carry;
+    *carry = 0;
+    /* escaped backslashes do not escape anything */
+    backslash &= ~escaped;
+    while (backslash) {
+        const int i = __builtin_ctzll(backslash);
+        backslash &= backslash - 1;
+        if (i == 63) {
+            *carry = 1;
+        } else {
+            escaped |= 1ULL << (i + 1);
+            backslash &= ~(1ULL << (i + 1));
+        }
+    }
+    return escaped;
+}
+
+/* the bit i is the xor of the bits 0..i, i.e., we are inside a string */
+static inline uint64_t prefix_xor(uint64_t m) {
+    m ^= m << 1;
+    m ^= m << 2;
+    m ^= m << 4;
+    m ^= m << 8;
+    m ^= m << 16;
+    m ^= m << 32;
+    return m;
+}
+
+/* find the tokens in the line, returns their number or -1 if a string
+ * is not terminated. The index is terminated with `len`. */
+static ssize_t build_index(struct shm_struct_log *slog, const char *line,
+                           size_t len, bool json) {
+    if (len + 1 > slog->index_alloc) {
+        slog->index_alloc = 2 * (len + 1);
+        free(slog->index);
+        slog->index = xalloc(slog->index_alloc * sizeof(uint32_t));
+    }
+
+    uint32_t *index = slog->index;
+    size_t n = 0;
+    uint64_t escaped_carry = 0;
+    uint64_t in_string_carry = 0;
+    struct block_masks m;
+    for (size_t pos = 0; pos < len; pos += 64) {
+        if (len - pos >= 64) {
+            classify_block(line + pos, json, &m);
+        } else {
+            char tmp[64] = {0};
+            memcpy(tmp, line + pos, len - pos);
+            classify_block(tmp, json, &m);
+        }
+
+        const uint64_t quotes =
+            m.quote & ~find_escaped(m.backslash, &escaped_carry);
+        const uint64_t in_string = prefix_xor(quotes) ^ in_string_carry;
+        in_string_carry = (uint64_t)((int64_t)in_string >> 63);
+
+        uint64_t tokens = (m.structural & ~in_string) | quotes;
+        while (tokens) {
+            index[n++] = pos + __builtin_ctzll(tokens);
+            tokens &= tokens - 1;
+        }
+    }
+    index[n] = len;
+    return in_string_carry ? -1 : (ssize_t)n;
+}
+
+/*
+ * Stage 2: walking the tokens
+ */
+
+static inline int find_key(struct shm_struct_log *slog, const char *key,
+                           size_t len) {
+    for (size_t i = 0; i < slog->keys_num; ++i) {
+        if (slog->keys[i].len == len && memcmp(slog->keys[i].str, key, len) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static inline int hex_digit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static int parse_hex4(const char *s, const char *end) {
+    if (end - s < 4)
+        return -1;
+    int cp = 0;
+    for (int i = 0; i < 4; ++i) {
+        const int d = hex_digit(s[i]);
+        if (d < 0)
+            return -1;
+        cp = cp * 16 + d;
+    }
+    return cp;
+}
+
+static char *put_utf8(char *w, unsigned cp) {
+    if (cp < 0x80) {
+        *w++ = cp;
+    } else if (cp < 0x800) {
+        *w++ = 0xc0 | (cp >> 6);
+        *w++ = 0x80 | (cp & 0x3f);
+    } else if (cp < 0x10000) {
+        *w++ = 0xe0 | (cp >> 12);
+        *w++ = 0x80 | ((cp >> 6) & 0x3f);
+        *w++ = 0x80 | (cp & 0x3f);
+    } else {
+        *w++ = 0xf0 | (cp >> 18);
+        *w++ = 0x80 | ((cp >> 12) & 0x3f);
+        *w++ = 0x80 | ((cp >> 6) & 0x3f);
+        *w++ = 0x80 | (cp & 0x3f);
+    }
+    return w;
+}
+
+/* unescape the string in place (the result is never longer),
+ * returns the new length */
+static size_t unescape(char *s, size_t len) {
+    const char *r = s;
+    const char *end = s + len;
+    char *w = s;
+    while (r < end) {
+        if (*r != '\\' || r + 1 == end) {
+            *w++ = *r++;
+            continue;
+        }
+        ++r;
+        switch (*r) {
+            case 'n':
+                *w++ = '\n';
+                break;
+            case 't':
+                *w++ = '\t';
+                break;
+            case 'r':
+                *w++ = '\r';
+                break;
+            case 'b':
+                *w++ = '\b';
+                break;
+            case 'f':
+                *w++ = '\f';
+                break;
+            case 'u': {
+                int cp = parse_hex4(r + 1, end);
+                if (cp < 0) {
+                    *w++ = 'u';
+                    break;
+                }
+                r += 4;
+                /* a surrogate pair */
+                if (cp >= 0xd800 && cp < 0xdc00 && end - r > 2 &&
+                    r[1] == '\\' && r[2] == 'u') {
+                    const int low = parse_hex4(r + 3, end);
+                    if (low >= 0xdc00 && low < 0xe000) {
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                        r += 6;
+                    }
+                }
+                w = put_utf8(w, cp);
+                break;
+            }
+            default: /* \" \\ \/ */
+                *w++ = *r;
+        }
+        ++r;
+    }
+    return w - s;
+}
+
+static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/* store the value of the key, returns true if all keys are found */
+static inline bool set_value(struct shm_struct_log *slog,
+                             struct shm_struct_log_value *values, int *found,
+                             const char *key, size_t key_len, char *val,
+                             size_t val_len, bool is_string) {
+    const int k = find_key(slog, key, key_len);
+    if (k < 0 || values[k].str)
+        return false;
+    if (is_string && memchr(val, '\\', val_len))
+        val_len = unescape(val, val_len);
+    values[k].str = val;
+    values[k].len = val_len;
+    return ++*found == (int)slog->keys_num;
+}
+
+static int parse_json(struct shm_struct_log *slog, char *line, size_t n,
+                      struct shm_struct_log_value *values) {
+    const uint32_t *idx = slog->index;
+    size_t i = 0;
+    int found = 0;
+
+    if (n == 0 || line[idx[0]] != '{')
+        return -1;
+    if (n > 1 && line[idx[1]] == '}')
+        return 0;
+    i = 1;
+    while (1) {
+        /* "key" : */
+        if (i + 2 >= n || line[idx[i]] != '"' || line[idx[i + 2]] != ':')
+            return -1;
+        const char *key = line + idx[i] + 1;
+        const size_t key_len = idx[i + 1] - idx[i] - 1;
+        const uint32_t colon = idx[i + 2];
+        i += 3;
+        if (i >= n)
+            return -1;
+
+        /* the value */
+        uint32_t t = idx[i];
+        char *val;
+        size_t val_len;
+        bool is_string = false;
+        if (line[t] == '"') {
+            val = line + t + 1;
+            val_len = idx[i + 1] - t - 1;
+            is_string = true;
+            i += 2;
+        } else if (line[t] == '{' || line[t] == '[') {
+            /* a nested value, skip it */
+            int depth = 0;
+            do {
+                const char c = line[idx[i]];
+                if (c == '{' || c == '[')
+                    ++depth;
+                else if (c == '}' || c == ']')
+                    --depth;
+                else if (c == '"')
+                    ++i; /* skip the closing quote */
+                ++i;
+            } while (depth > 0 && i < n);
+            if (depth > 0)
+                return -1;
+            val = line + t;
+            val_len = idx[i - 1] + 1 - t;
+        } else {
+            /* a number, true, false, null, ... up to the next token */
+            size_t b = colon + 1, e = t;
+            while (b < e && is_space(line[b]))
+                ++b;
+            while (e > b && is_space(line[e - 1]))
+                --e;
+            if (b == e)
+                return -1;
+            val = line + b;
+            val_len = e - b;
+        }
+
+        if (set_value(slog, values, &found, key, key_len, val, val_len,
+                      is_string))
+            return found;
+
+        /* , or } */
+        if (i >= n)
+            return -1;
+        const char c = line[idx[i++]];
+        if (c == '}')
+            return found;
+        if (c != ',')
+            return -1;
+    }
+}
+
+static int parse_logfmt(struct shm_struct_log *slog, char *line, size_t len,
+                        struct shm_struct_log_value *values) {
+    const uint32_t *idx = slog->index;
+    size_t i = 0, p = 0;
+    int found = 0;
+
+    while (1) {
+        while (p < len && is_space(line[p]))
+            ++p;
+        if (p >= len)
+            return found;
+        /* the next token after the key (the index ends with `len`) */
+        while (idx[i] < p)
+            ++i;
+
+        const char *key = line + p;
+        const uint32_t t = idx[i];
+        const char c = t < len ? line[t] : ' ';
+        if (c == '"' || t == p)
+            return -1; /* quoted key or no key */
+        const size_t key_len = t - p;
+
+        char *val;
+        size_t val_len;
+        bool is_string = false;
+        if (c == '=') {
+            ++i;
+            if (t + 1 < len && line[t + 1] == '"') {
+                /* a quoted value, idx[i] is the opening quote */
+                val = line + t + 2;
+                val_len = idx[i + 1] - t - 2;
+                is_string = true;
+                p = idx[i + 1] + 1;
+                i += 2;
+            } else {
+                /* a bare value up to the next space */
+                while (idx[i] < len && line[idx[i]] != ' ' &&
+                       line[idx[i]] != '\t')
+                    ++i;
+                val = line + t + 1;
+                val_len = idx[i] - t - 1;
+                p = idx[i];
+            }
+        } else {
+            /* a key without a value */
+            val = line + t;
+            val_len = 0;
+            p = t;
+        }
+
+        if (set_value(slog, values, &found, key, key_len, val, val_len,
+                      is_string))
+            return found;
+    }
+}
+
+int shm_struct_log_parse(struct shm_struct_log *slog, char *line, size_t len,
+                         struct shm_struct_log_value *values) {
+    memset(values, 0, slog->keys_num * sizeof(*values));
+    if (len >= UINT32_MAX)
+        return -1;
+
+    size_t start = 0;
+    while (start < len && is_space(line[start]))
+        ++start;
+    const bool json = start < len && line[start] == '{';
+
+    const ssize_t n = build_index(slog, line, len, json);
+    if (n < 0)
+        return -1;
+    if (json)
+        return parse_json(slog, line, n, values);
+    return parse_logfmt(slog, line, len, values);
+}
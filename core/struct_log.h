@@ -0,0 +1,46 @@
+/***********************************************
+ * Pulling fields out of structured logs.
+ *
+ * A line is either a JSON object (it starts with '{') or a sequence
+ * of logfmt pairs (key=value key2="quoted value" flag). The parser
+ * works in two stages like simdjson: first it finds the quotes and
+ * the structural characters outside of strings 64 bytes at a time
+ * (with SIMD compares where available), then it walks only these
+ * positions and picks the values of the wanted keys. The values stay
+ * in the line, JSON strings are unescaped in place.
+ *
+ * Only the top-level keys are looked up. A nested object or array is
+ * returned as its raw JSON text, other JSON values (numbers, true, ...)
+ * as the text of the token.
+ ************************************************/
+
+#ifndef SHAMON_STRUCT_LOG_H_
+#define SHAMON_STRUCT_LOG_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct shm_struct_log;
+
+struct shm_struct_log_value {
+    /* NULL if the key is not in the line */
+    char *str;
+    size_t len;
+};
+
+/* Create a parser that looks for the `keys_num` keys */
+struct shm_struct_log *shm_struct_log_create(size_t keys_num,
+                                             const char *keys[]);
+void shm_struct_log_destroy(struct shm_struct_log *slog);
+
+/* Parse the line `line` of the length `len`, the line may be modified
+ * (unescaping strings). `values[i]` is set to the value of the key `i`,
+ * if a key is there more times, the first value is taken.
+ * A logfmt key without a value gets an empty value.
+ * Returns the number of found keys or -1 if the line is malformed
+ * (then `values` may be filled only partially). */
+int shm_struct_log_parse(struct shm_struct_log *slog, char *line, size_t len,
+                         struct shm_struct_log_value *values);
+
+#endif /* SHAMON_STRUCT_LOG_H_ */
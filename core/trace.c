@@ -0,0 +1,179 @@
+#include "trace.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+#define TRACE_RING_DEFAULT_SIZE (1 << 16)
+#define TRACE_THREAD_NAME_LEN 64
+
+enum trace_record_type {
+    TRACE_BEGIN = 'B',
+    TRACE_END = 'E',
+    TRACE_INSTANT = 'i',
+};
+
+struct trace_record {
+    uint64_t ts; /* in nanoseconds */
+    uint64_t arg;
+    uint32_t type;
+    uint32_t span;
+};
+
+struct trace_ring {
+    struct trace_ring *next;
+    char name[TRACE_THREAD_NAME_LEN];
+    unsigned tid;
+    size_t mask;
+    /* the number of records ever written into the ring,
+     * the owner thread is the only writer */
+    _Atomic size_t head;
+    struct trace_record records[];
+};
+
+static const char *span_names[SHM_TRACE_SPAN_NUM] = {
+    [SHM_TRACE_FETCH] = "fetch",       [SHM_TRACE_WAIT] = "wait",
+    [SHM_TRACE_FORWARD] = "forward",   [SHM_TRACE_DROP] = "drop",
+    [SHM_TRACE_HOLE] = "hole",         [SHM_TRACE_RULE_SET] = "rule-set",
+    [SHM_TRACE_MATCH] = "match",       [SHM_TRACE_DISPATCH] = "dispatch",
+    [SHM_TRACE_MONITOR] = "monitor",
+};
+
+static _Atomic(struct trace_ring *) rings = NULL;
+static atomic_uint next_tid = 1;
+static _Thread_local struct trace_ring *thread_ring = NULL;
+
+static size_t ring_size(void) {
+    const char *env = getenv("SHAMON_TRACE_RING_SIZE");
+    size_t size = env ? strtoull(env, NULL, 10) : TRACE_RING_DEFAULT_SIZE;
+    if (size < 2)
+        size = TRACE_RING_DEFAULT_SIZE;
+    /* round up to a power of two */
+    size_t pow = 1;
+    while (pow < size) pow <<= 1;
+    return pow;
+}
+
+static struct trace_ring *get_ring(void) {
+    if (__builtin_expect(thread_ring != NULL, 1))
+        return thread_ring;
+
+    size_t size = ring_size();
+    struct trace_ring *ring =
+        xalloc(sizeof(struct trace_ring) + size * sizeof(struct trace_record));
+    ring->mask = size - 1;
+    ring->tid = atomic_fetch_add(&next_tid, 1);
+    snprintf(ring->name, TRACE_THREAD_NAME_LEN, "thread %u", ring->tid);
+    atomic_init(&ring->head, 0);
+
+    /* register the ring */
+    ring->next = atomic_load_explicit(&rings, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(
+        &rings, &ring->next, ring, memory_order_release, memory_order_relaxed))
+        ;
+
+    thread_ring = ring;
+    return ring;
+}
+
+static inline void record(uint32_t type, shm_trace_span span, uint64_t arg) {
+    assert(span < SHM_TRACE_SPAN_NUM);
+    struct trace_ring *ring = get_ring();
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    struct trace_record *rec = &ring->records[head & ring->mask];
+    rec->ts = now_ns();
+    rec->arg = arg;
+    rec->type = type;
+    rec->span = span;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void shm_trace_thread_name(const char *name) {
+    struct trace_ring *ring = get_ring();
+    strncpy(ring->name, name, TRACE_THREAD_NAME_LEN - 1);
+    ring->name[TRACE_THREAD_NAME_LEN - 1] = '\0';
+}
+
+void shm_trace_begin(shm_trace_span span, uint64_t arg) {
+    record(TRACE_BEGIN, span, arg);
+}
+
+void shm_trace_end(shm_trace_span span, uint64_t arg) {
+    record(TRACE_END, span, arg);
+}
+
+void shm_trace_instant(shm_trace_span span, uint64_t arg) {
+    record(TRACE_INSTANT, span, arg);
+}
+
+static void dump_json_string(FILE *f, const char *str) {
+    fputc('"', f);
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\')
+            fputc('\\', f);
+        if ((unsigned char)*str < 0x20)
+            continue;
+        fputc(*str, f);
+    }
+    fputc('"', f);
+}
+
+int shm_trace_dump(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror("opening trace file");
+        return -1;
+    }
+
+    const int pid = getpid();
+    int first = 1;
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (struct trace_ring *ring =
+             atomic_load_explicit(&rings, memory_order_acquire);
+         ring; ring = ring->next) {
+        fprintf(f,
+                "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"tid\":%u,\"args\":{\"name\":",
+                first ? "" : ",\n", pid, ring->tid);
+        dump_json_string(f, ring->name);
+        fprintf(f, "}}");
+        first = 0;
+
+        const size_t head =
+            atomic_load_explicit(&ring->head, memory_order_acquire);
+        const size_t capacity = ring->mask + 1;
+        const size_t start = head > capacity ? head - capacity : 0;
+        for (size_t i = start; i < head; ++i) {
+            struct trace_record *rec = &ring->records[i & ring->mask];
+            /* the timestamps are in microseconds */
+            fprintf(f,
+                    ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+                    "\"pid\":%d,\"tid\":%u,%s\"args\":{\"arg\":%lu}}",
+                    span_names[rec->span], (char)rec->type, rec->ts / 1000.0,
+                    pid, ring->tid,
+                    rec->type == TRACE_INSTANT ? "\"s\":\"t\"," : "",
+                    rec->arg);
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    if (fclose(f) != 0) {
+        perror("closing trace file");
+        return -1;
+    }
+    return 0;
+}
+
+int shm_trace_flush(void) {
+    const char *path = getenv("SHAMON_TRACE_FILE");
+    if (!path)
+        path = "shamon-trace.json";
+    fprintf(stderr, "Dumping trace to '%s'\n", path);
+    return shm_trace_dump(path);
+}
@@ -0,0 +1,62 @@
+/***********************************************
+ * Lightweight tracing of the monitoring pipeline.
+ *
+ * Every thread that records something gets its own ring of trace
+ * records.  The ring is written only by its owner thread, so recording
+ * a record takes no locks; the rings are registered in a lock-free
+ * list and can be dumped at the end as a Chrome/Perfetto JSON trace
+ * (load it in chrome://tracing or ui.perfetto.dev).
+ * When a ring is full, the oldest records are overwritten.
+ *
+ * The SHM_TRACE_* macros expand to nothing unless the code is compiled
+ * with TRACING defined (cmake -DTRACING=ON).
+ ************************************************/
+
+#ifndef SHAMON_TRACE_H_
+#define SHAMON_TRACE_H_
+
+#include <stdint.h>
+
+typedef enum _shm_trace_span {
+    SHM_TRACE_FETCH,    /* stream_fetch() */
+    SHM_TRACE_WAIT,     /* waiting (sleeping) for events on a stream */
+    SHM_TRACE_FORWARD,  /* forwarding an event into the arbiter buffer */
+    SHM_TRACE_DROP,     /* dropping events */
+    SHM_TRACE_HOLE,     /* emitting a hole event */
+    SHM_TRACE_RULE_SET, /* evaluation of a rule set in the arbiter */
+    SHM_TRACE_MATCH,    /* a rule of the arbiter matched */
+    SHM_TRACE_DISPATCH, /* dispatching an event to the monitor */
+    SHM_TRACE_MONITOR,  /* processing an event in the monitor */
+    SHM_TRACE_SPAN_NUM
+} shm_trace_span;
+
+/* Set the name of the calling thread in the trace. The name is copied. */
+void shm_trace_thread_name(const char *name);
+
+void shm_trace_begin(shm_trace_span span, uint64_t arg);
+void shm_trace_end(shm_trace_span span, uint64_t arg);
+void shm_trace_instant(shm_trace_span span, uint64_t arg);
+
+/* Write all the recorded data as a Chrome JSON trace into `path`.
+ * Must not run concurrently with threads that record into the trace.
+ * Returns 0 on success and -1 on error. */
+int shm_trace_dump(const char *path);
+/* Dump the trace to the file given by SHAMON_TRACE_FILE environment
+ * variable or to 'shamon-trace.json' if the variable is not set */
+int shm_trace_flush(void);
+
+#ifdef TRACING
+#define SHM_TRACE_THREAD_NAME(name) shm_trace_thread_name((name))
+#define SHM_TRACE_BEGIN(span, arg) shm_trace_begin((span), (uint64_t)(arg))
+#define SHM_TRACE_END(span, arg) shm_trace_end((span), (uint64_t)(arg))
+#define SHM_TRACE_INSTANT(span, arg) shm_trace_instant((span), (uint64_t)(arg))
+#define SHM_TRACE_FLUSH() shm_trace_flush()
+#else
+#define SHM_TRACE_THREAD_NAME(name) ((void)0)
+#define SHM_TRACE_BEGIN(span, arg) ((void)0)
+#define SHM_TRACE_END(span, arg) ((void)0)
+#define SHM_TRACE_INSTANT(span, arg) ((void)0)
+#define SHM_TRACE_FLUSH() ((void)0)
+#endif
+
+#endif /* SHAMON_TRACE_H_ */
@@ -0,0 +1,727 @@
+#include "trace_file.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "signatures.h"
+#include "utils.h"
+
+static const char trace_file_magic[8] = {'S', 'H', 'M', 'T', 'F', 0, 0, 0};
+
+struct trace_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t events_num;
+    uint64_t events_total;
+    uint64_t events_off;
+    uint64_t blocks_num;
+    uint64_t blocks_off;
+    uint64_t strings_num;
+    uint64_t strings_off; /* the table of offsets of strings */
+    uint64_t strings_data_off;
+};
+
+/* the descriptions of events are stored as they are */
+_Static_assert(sizeof(struct event_record) == 112,
+               "Unexpected layout of struct event_record");
+
+#define ALIGN8(x) (((x) + 7) & ~(uint64_t)7)
+
+static size_t encode_varint(unsigned char *p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (unsigned char)(v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+static inline const unsigned char *decode_varint(const unsigned char *p,
+                                                 uint64_t *v) {
+    uint64_t result = 0;
+    unsigned shift = 0;
+    while (*p & 0x80) {
+        result |= (uint64_t)(*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    *v = result | ((uint64_t)*p++ << shift);
+    return p;
+}
+
+static inline bool is_str_op(unsigned char op) {
+    return op == 'S' || op == 'L' || op == 'M';
+}
+
+/* the size of the value of the argument in the column */
+static inline size_t column_elem_size(unsigned char op) {
+    return is_str_op(op) ? sizeof(uint32_t) : signature_op_get_size(op);
+}
+
+/*
+ * Writer
+ */
+
+struct column {
+    unsigned char op;
+    size_t elem_size;
+    unsigned char *data;
+};
+
+struct pending_block {
+    size_t count;
+    size_t cols_num;
+    uint64_t *ids;
+    uint64_t *times;
+    struct column cols[sizeof(((struct event_record *)0)->signature)];
+};
+
+struct _shm_trace_file_writer {
+    FILE *file;
+    uint64_t off;
+    bool error;
+    uint64_t events_total;
+
+    size_t events_num;
+    struct event_record *events;
+    struct pending_block *pending;
+
+    shm_trace_file_block *blocks;
+    size_t blocks_num, blocks_alloc;
+
+    /* string dictionary */
+    char *strs;
+    size_t strs_size, strs_alloc;
+    uint64_t *str_offs;
+    size_t strs_num, str_offs_alloc;
+    /* open-addressing hash table of indices + 1 (0 is an empty slot) */
+    uint32_t *htab;
+    size_t htab_size;
+
+    /* temporary buffer for encoding blocks */
+    unsigned char *tmp;
+    size_t tmp_size;
+};
+
+static void *grow(void *ptr, size_t *alloc, size_t needed, size_t elem_size) {
+    if (needed <= *alloc)
+        return ptr;
+    size_t n = *alloc ? *alloc : 64;
+    while (n < needed) n *= 2;
+    ptr = realloc(ptr, n * elem_size);
+    if (!ptr) {
+        perror("realloc");
+        abort();
+    }
+    *alloc = n;
+    return ptr;
+}
+
+static void writer_output(shm_trace_file_writer *w, const void *data,
+                          size_t size) {
+    if (size > 0 && fwrite(data, 1, size, w->file) != size)
+        w->error = true;
+    w->off += size;
+}
+
+static void writer_pad(shm_trace_file_writer *w) {
+    static const unsigned char zeros[8] = {0};
+    writer_output(w, zeros, ALIGN8(w->off) - w->off);
+}
+
+shm_trace_file_writer *shm_trace_file_writer_create(
+    const char *path, const struct event_record *events, size_t events_num) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror("opening the trace file");
+        return NULL;
+    }
+
+    shm_trace_file_writer *w = xalloc(sizeof(*w));
+    memset(w, 0, sizeof(*w));
+    w->file = f;
+    w->events_num = events_num;
+    w->events = xalloc((events_num + 1) * sizeof(struct event_record));
+    memcpy(w->events, events, events_num * sizeof(struct event_record));
+    w->pending = xalloc((events_num + 1) * sizeof(struct pending_block));
+    memset(w->pending, 0, (events_num + 1) * sizeof(struct pending_block));
+
+    for (size_t i = 0; i < events_num; ++i) {
+        struct pending_block *pb = &w->pending[i];
+        pb->ids = xalloc(SHM_TRACE_FILE_BLOCK_EVENTS * sizeof(uint64_t));
+        pb->times = xalloc(SHM_TRACE_FILE_BLOCK_EVENTS * sizeof(uint64_t));
+        for (const unsigned char *o = events[i].signature; *o; ++o) {
+            struct column *col = &pb->cols[pb->cols_num++];
+            col->op = *o;
+            col->elem_size = column_elem_size(*o);
+            col->data =
+                col->elem_size > 0
+                    ? xalloc(SHM_TRACE_FILE_BLOCK_EVENTS * col->elem_size)
+                    : NULL;
+        }
+    }
+
+    w->htab_size = 1024;
+    w->htab = xalloc(w->htab_size * sizeof(uint32_t));
+    memset(w->htab, 0, w->htab_size * sizeof(uint32_t));
+
+    /* the header is written at the end, reserve the space for it */
+    struct trace_file_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    writer_output(w, &hdr, sizeof(hdr));
+    writer_pad(w);
+
+    return w;
+}
+
+static inline uint64_t str_hash(const char *s, size_t len) {
+    /* FNV-1a */
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static void htab_insert(shm_trace_file_writer *w, uint64_t h, uint32_t idx) {
+    size_t pos = h & (w->htab_size - 1);
+    while (w->htab[pos] != 0) pos = (pos + 1) & (w->htab_size - 1);
+    w->htab[pos] = idx + 1;
+}
+
+static void htab_rehash(shm_trace_file_writer *w) {
+    free(w->htab);
+    w->htab_size *= 2;
+    w->htab = xalloc(w->htab_size * sizeof(uint32_t));
+    memset(w->htab, 0, w->htab_size * sizeof(uint32_t));
+    for (size_t i = 0; i < w->strs_num; ++i) {
+        const char *s = w->strs + w->str_offs[i];
+        htab_insert(w, str_hash(s, strlen(s)), i);
+    }
+}
+
+static uint32_t intern_str(shm_trace_file_writer *w, const char *str) {
+    const size_t len = strlen(str);
+    const uint64_t h = str_hash(str, len);
+    size_t pos = h & (w->htab_size - 1);
+    while (w->htab[pos] != 0) {
+        const uint32_t idx = w->htab[pos] - 1;
+        if (strcmp(w->strs + w->str_offs[idx], str) == 0)
+            return idx;
+        pos = (pos + 1) & (w->htab_size - 1);
+    }
+
+    assert(w->strs_num < UINT32_MAX && "Too many strings");
+    const uint32_t idx = w->strs_num++;
+    w->str_offs = grow(w->str_offs, &w->str_offs_alloc, w->strs_num,
+                       sizeof(uint64_t));
+    w->str_offs[idx] = w->strs_size;
+    w->strs = grow(w->strs, &w->strs_alloc, w->strs_size + len + 1, 1);
+    memcpy(w->strs + w->strs_size, str, len + 1);
+    w->strs_size += len + 1;
+
+    if (2 * w->strs_num > w->htab_size)
+        htab_rehash(w);
+    else
+        w->htab[pos] = idx + 1;
+    return idx;
+}
+
+static void flush_block(shm_trace_file_writer *w, size_t ev_idx) {
+    struct pending_block *pb = &w->pending[ev_idx];
+    if (pb->count == 0)
+        return;
+
+    /* encode ids and timestamps */
+    w->tmp = grow(w->tmp, &w->tmp_size, 2 * 10 * pb->count, 1);
+    size_t ids_size = 0, times_size = 0;
+    uint64_t prev = pb->ids[0];
+    for (size_t i = 0; i < pb->count; ++i) {
+        ids_size += encode_varint(w->tmp + ids_size, pb->ids[i] - prev);
+        prev = pb->ids[i];
+    }
+    prev = pb->times[0];
+    for (size_t i = 0; i < pb->count; ++i) {
+        times_size += encode_varint(w->tmp + ids_size + times_size,
+                                    pb->times[i] - prev);
+        prev = pb->times[i];
+    }
+
+    assert(w->off % 8 == 0);
+    shm_trace_file_block *b;
+    w->blocks = grow(w->blocks, &w->blocks_alloc, w->blocks_num + 1,
+                     sizeof(shm_trace_file_block));
+    b = &w->blocks[w->blocks_num++];
+    b->kind = w->events[ev_idx].kind;
+    b->count = pb->count;
+    b->first_id = pb->ids[0];
+    b->last_id = pb->ids[pb->count - 1];
+    b->first_time = pb->times[0];
+    b->last_time = pb->times[pb->count - 1];
+    b->offset = w->off;
+    b->ids_size = ids_size;
+    b->times_size = times_size;
+
+    writer_output(w, w->tmp, ids_size + times_size);
+    writer_pad(w);
+    for (size_t c = 0; c < pb->cols_num; ++c) {
+        struct column *col = &pb->cols[c];
+        writer_output(w, col->data, col->elem_size * pb->count);
+        writer_pad(w);
+    }
+    b->size = w->off - b->offset;
+
+    pb->count = 0;
+}
+
+static size_t writer_event_idx(shm_trace_file_writer *w, shm_kind kind) {
+    for (size_t i = 0; i < w->events_num; ++i) {
+        if (w->events[i].kind == kind)
+            return i;
+    }
+    return w->events_num;
+}
+
+int shm_trace_file_write(shm_trace_file_writer *w, uint64_t time_ns,
+                         const shm_event *ev) {
+    const size_t idx = writer_event_idx(w, ev->kind);
+    if (idx == w->events_num) {
+        fprintf(stderr, "Unknown kind of event: %lu\n", ev->kind);
+        return -1;
+    }
+
+    struct pending_block *pb = &w->pending[idx];
+    assert((pb->count == 0 || pb->ids[pb->count - 1] <= ev->id) &&
+           "Ids must not decrease");
+    assert((pb->count == 0 || pb->times[pb->count - 1] <= time_ns) &&
+           "Time must not go backwards");
+
+    const size_t i = pb->count;
+    pb->ids[i] = ev->id;
+    pb->times[i] = time_ns;
+    const unsigned char *p = (const unsigned char *)ev + sizeof(shm_event);
+    for (size_t c = 0; c < pb->cols_num; ++c) {
+        struct column *col = &pb->cols[c];
+        if (is_str_op(col->op)) {
+            const char *str;
+            memcpy(&str, p, sizeof(str));
+            const uint32_t sidx = intern_str(w, str);
+            memcpy(col->data + i * col->elem_size, &sidx, sizeof(sidx));
+        } else {
+            memcpy(col->data + i * col->elem_size, p, col->elem_size);
+        }
+        p += signature_op_get_size(col->op);
+    }
+
+    ++w->events_total;
+    if (++pb->count == SHM_TRACE_FILE_BLOCK_EVENTS)
+        flush_block(w, idx);
+
+    return w->error ? -1 : 0;
+}
+
+static int cmp_blocks(const void *a, const void *b) {
+    const shm_trace_file_block *x = a, *y = b;
+    if (x->kind != y->kind)
+        return x->kind < y->kind ? -1 : 1;
+    if (x->first_id != y->first_id)
+        return x->first_id < y->first_id ? -1 : 1;
+    return 0;
+}
+
+int shm_trace_file_writer_close(shm_trace_file_writer *w) {
+    for (size_t i = 0; i < w->events_num; ++i) flush_block(w, i);
+
+    struct trace_file_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, trace_file_magic, sizeof(hdr.magic));
+    hdr.version = SHM_TRACE_FILE_VERSION;
+    hdr.events_num = w->events_num;
+    hdr.events_total = w->events_total;
+
+    hdr.strings_data_off = w->off;
+    hdr.strings_num = w->strs_num;
+    writer_output(w, w->strs, w->strs_size);
+    writer_pad(w);
+    hdr.strings_off = w->off;
+    writer_output(w, w->str_offs, w->strs_num * sizeof(uint64_t));
+
+    hdr.events_off = w->off;
+    writer_output(w, w->events, w->events_num * sizeof(struct event_record));
+
+    qsort(w->blocks, w->blocks_num, sizeof(shm_trace_file_block), cmp_blocks);
+    hdr.blocks_off = w->off;
+    hdr.blocks_num = w->blocks_num;
+    writer_output(w, w->blocks, w->blocks_num * sizeof(shm_trace_file_block));
+
+    if (fseek(w->file, 0, SEEK_SET) != 0 ||
+        fwrite(&hdr, sizeof(hdr), 1, w->file) != 1)
+        w->error = true;
+
+    int ret = w->error ? -1 : 0;
+    if (ret < 0)
+        perror("writing the trace file");
+    if (fclose(w->file) != 0) {
+        perror("closing the trace file");
+        ret = -1;
+    }
+
+    for (size_t i = 0; i < w->events_num; ++i) {
+        struct pending_block *pb = &w->pending[i];
+        for (size_t c = 0; c < pb->cols_num; ++c) free(pb->cols[c].data);
+        free(pb->ids);
+        free(pb->times);
+    }
+    free(w->pending);
+    free(w->events);
+    free(w->blocks);
+    free(w->strs);
+    free(w->str_offs);
+    free(w->htab);
+    free(w->tmp);
+    free(w);
+
+    return ret;
+}
+
+/*
+ * Reader
+ */
+
+struct _shm_trace_file {
+    unsigned char *data;
+    size_t size;
+    const struct trace_file_header *hdr;
+    struct event_record *events;
+    const shm_trace_file_block *blocks;
+    const uint64_t *str_offs;
+    const char *strs;
+    size_t max_event_size;
+};
+
+static bool in_file(size_t size, uint64_t off, uint64_t len) {
+    return off <= size && len <= size - off;
+}
+
+shm_trace_file *shm_trace_file_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("opening the trace file");
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("fstat");
+        close(fd);
+        return NULL;
+    }
+    if ((size_t)st.st_size < sizeof(struct trace_file_header)) {
+        fprintf(stderr, "'%s' is not a trace file\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap failure");
+        return NULL;
+    }
+
+    shm_trace_file *tf = xalloc(sizeof(*tf));
+    tf->data = data;
+    tf->size = st.st_size;
+    tf->hdr = data;
+
+    const struct trace_file_header *hdr = tf->hdr;
+    if (memcmp(hdr->magic, trace_file_magic, sizeof(hdr->magic)) != 0) {
+        fprintf(stderr, "'%s' is not a trace file\n", path);
+        goto err;
+    }
+    if (hdr->version != SHM_TRACE_FILE_VERSION) {
+        fprintf(stderr, "Unsupported version of the trace file\n");
+        goto err;
+    }
+    if (!in_file(tf->size, hdr->events_off,
+                 hdr->events_num * sizeof(struct event_record)) ||
+        !in_file(tf->size, hdr->blocks_off,
+                 hdr->blocks_num * sizeof(shm_trace_file_block)) ||
+        !in_file(tf->size, hdr->strings_off,
+                 hdr->strings_num * sizeof(uint64_t)) ||
+        hdr->strings_data_off > hdr->strings_off) {
+        fprintf(stderr, "The trace file is corrupted (truncated?)\n");
+        goto err;
+    }
+
+    tf->events = (struct event_record *)(tf->data + hdr->events_off);
+    tf->blocks = (const shm_trace_file_block *)(tf->data + hdr->blocks_off);
+    tf->str_offs = (const uint64_t *)(tf->data + hdr->strings_off);
+    tf->strs = (const char *)(tf->data + hdr->strings_data_off);
+
+    for (size_t i = 0; i < hdr->blocks_num; ++i) {
+        if (!in_file(tf->size, tf->blocks[i].offset, tf->blocks[i].size)) {
+            fprintf(stderr, "The trace file is corrupted (block %lu)\n", i);
+            goto err;
+        }
+    }
+
+    tf->max_event_size = sizeof(shm_event);
+    for (size_t i = 0; i < hdr->events_num; ++i) {
+        const size_t size =
+            sizeof(shm_event) + signature_get_size(tf->events[i].signature);
+        if (size > tf->max_event_size)
+            tf->max_event_size = size;
+    }
+
+    return tf;
+
+err:
+    shm_trace_file_close(tf);
+    return NULL;
+}
+
+void shm_trace_file_close(shm_trace_file *tf) {
+    munmap(tf->data, tf->size);
+    free(tf);
+}
+
+struct event_record *shm_trace_file_events(shm_trace_file *tf, size_t *num) {
+    *num = tf->hdr->events_num;
+    return tf->events;
+}
+
+struct event_record *shm_trace_file_get_event(shm_trace_file *tf,
+                                              shm_kind kind) {
+    for (size_t i = 0; i < tf->hdr->events_num; ++i) {
+        if (tf->events[i].kind == kind)
+            return &tf->events[i];
+    }
+    return NULL;
+}
+
+size_t shm_trace_file_max_event_size(shm_trace_file *tf) {
+    return tf->max_event_size;
+}
+
+uint64_t shm_trace_file_events_num(shm_trace_file *tf) {
+    return tf->hdr->events_total;
+}
+
+const shm_trace_file_block *shm_trace_file_blocks(shm_trace_file *tf,
+                                                  size_t *num) {
+    *num = tf->hdr->blocks_num;
+    return tf->blocks;
+}
+
+const shm_trace_file_block *shm_trace_file_kind_blocks(shm_trace_file *tf,
+                                                       shm_kind kind,
+                                                       size_t *num) {
+    /* the blocks are sorted by kinds, find the first block of the kind */
+    size_t lo = 0, hi = tf->hdr->blocks_num;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (tf->blocks[mid].kind < kind)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    size_t end = lo;
+    while (end < tf->hdr->blocks_num && tf->blocks[end].kind == kind) ++end;
+    *num = end - lo;
+    return *num > 0 ? &tf->blocks[lo] : NULL;
+}
+
+const shm_trace_file_block *shm_trace_file_find_block(shm_trace_file *tf,
+                                                      shm_kind kind,
+                                                      shm_eventid id) {
+    size_t num;
+    const shm_trace_file_block *blocks =
+        shm_trace_file_kind_blocks(tf, kind, &num);
+    /* find the last block that starts before or at `id` */
+    size_t lo = 0, hi = num;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (blocks[mid].first_id <= id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0 || blocks[lo - 1].last_id < id)
+        return NULL;
+    return &blocks[lo - 1];
+}
+
+const void *shm_trace_file_block_column(shm_trace_file *tf,
+                                        const shm_trace_file_block *block,
+                                        size_t arg) {
+    const struct event_record *rec = shm_trace_file_get_event(tf, block->kind);
+    assert(rec && "Block of unknown event");
+    assert(arg < strlen((const char *)rec->signature) && "Invalid argument");
+    if (rec->signature[arg] == '_')
+        return NULL;
+
+    uint64_t off = ALIGN8(block->offset + block->ids_size + block->times_size);
+    for (size_t i = 0; i < arg; ++i) {
+        off += ALIGN8(column_elem_size(rec->signature[i]) * block->count);
+    }
+    return tf->data + off;
+}
+
+const char *shm_trace_file_str(shm_trace_file *tf, uint32_t idx) {
+    assert(idx < tf->hdr->strings_num && "Invalid index of a string");
+    return tf->strs + tf->str_offs[idx];
+}
+
+size_t shm_trace_file_block_decode(shm_trace_file *tf,
+                                   const shm_trace_file_block *block,
+                                   void *out, size_t ev_size,
+                                   uint64_t *times) {
+    const struct event_record *rec = shm_trace_file_get_event(tf, block->kind);
+    assert(rec && "Block of unknown event");
+    assert(ev_size >= sizeof(shm_event) + signature_get_size(rec->signature));
+
+    unsigned char *row = out;
+    const unsigned char *p = tf->data + block->offset;
+    uint64_t id = block->first_id, delta;
+    for (size_t i = 0; i < block->count; ++i) {
+        p = decode_varint(p, &delta);
+        id += delta;
+        shm_event *ev = (shm_event *)(row + i * ev_size);
+        ev->kind = block->kind;
+        ev->id = id;
+    }
+    if (times) {
+        uint64_t time = block->first_time;
+        for (size_t i = 0; i < block->count; ++i) {
+            p = decode_varint(p, &delta);
+            time += delta;
+            times[i] = time;
+        }
+    }
+
+    const unsigned char *col =
+        tf->data +
+        ALIGN8(block->offset + block->ids_size + block->times_size);
+    size_t arg_off = sizeof(shm_event);
+    for (const unsigned char *o = rec->signature; *o; ++o) {
+        const size_t size = signature_op_get_size(*o);
+        const size_t col_size = column_elem_size(*o);
+        if (is_str_op(*o)) {
+            const uint32_t *idxs = (const uint32_t *)col;
+            for (size_t i = 0; i < block->count; ++i) {
+                const char *str = shm_trace_file_str(tf, idxs[i]);
+                memcpy(row + i * ev_size + arg_off, &str, sizeof(str));
+            }
+        } else if (size > 0) {
+            for (size_t i = 0; i < block->count; ++i) {
+                memcpy(row + i * ev_size + arg_off, col + i * size, size);
+            }
+        }
+        col += ALIGN8(col_size * block->count);
+        arg_off += size;
+    }
+
+    return block->count;
+}
+
+/*
+ * Iterator
+ */
+
+struct kind_cursor {
+    const shm_trace_file_block *blocks;
+    size_t blocks_num;
+    size_t next_block;
+    unsigned char *rows;
+    uint64_t *times;
+    size_t pos, count;
+};
+
+struct _shm_trace_file_iter {
+    shm_trace_file *tf;
+    size_t ev_size;
+    size_t cursors_num;
+    struct kind_cursor cursors[];
+};
+
+static bool cursor_has_event(shm_trace_file_iter *it, struct kind_cursor *c) {
+    if (c->pos < c->count)
+        return true;
+    if (c->next_block == c->blocks_num)
+        return false;
+
+    c->count = shm_trace_file_block_decode(
+        it->tf, &c->blocks[c->next_block++], c->rows, it->ev_size, c->times);
+    c->pos = 0;
+    return c->count > 0;
+}
+
+shm_trace_file_iter *shm_trace_file_iter_create(shm_trace_file *tf) {
+    const size_t num = tf->hdr->events_num;
+    shm_trace_file_iter *it =
+        xalloc(sizeof(*it) + num * sizeof(struct kind_cursor));
+    it->tf = tf;
+    it->ev_size = tf->max_event_size;
+    it->cursors_num = 0;
+    for (size_t i = 0; i < num; ++i) {
+        size_t blocks_num;
+        const shm_trace_file_block *blocks =
+            shm_trace_file_kind_blocks(tf, tf->events[i].kind, &blocks_num);
+        if (blocks_num == 0)
+            continue;
+
+        struct kind_cursor *c = &it->cursors[it->cursors_num++];
+        c->blocks = blocks;
+        c->blocks_num = blocks_num;
+        c->next_block = 0;
+        c->pos = c->count = 0;
+        c->rows = xalloc(SHM_TRACE_FILE_BLOCK_EVENTS * it->ev_size);
+        c->times = xalloc(SHM_TRACE_FILE_BLOCK_EVENTS * sizeof(uint64_t));
+    }
+
+    return it;
+}
+
+const shm_event *shm_trace_file_iter_next(shm_trace_file_iter *it,
+                                          uint64_t *time) {
+    /* there are usually only a few kinds of events, so just find
+     * the cursor with the smallest id linearly */
+    struct kind_cursor *min = NULL;
+    shm_eventid min_id = 0;
+    for (size_t i = 0; i < it->cursors_num; ++i) {
+        struct kind_cursor *c = &it->cursors[i];
+        if (!cursor_has_event(it, c))
+            continue;
+        const shm_eventid id =
+            ((shm_event *)(c->rows + c->pos * it->ev_size))->id;
+        if (!min || id < min_id) {
+            min = c;
+            min_id = id;
+        }
+    }
+
+    if (!min)
+        return NULL;
+
+    if (time)
+        *time = min->times[min->pos];
+    return (shm_event *)(min->rows + min->pos++ * it->ev_size);
+}
+
+void shm_trace_file_iter_destroy(shm_trace_file_iter *it) {
+    for (size_t i = 0; i < it->cursors_num; ++i) {
+        free(it->cursors[i].rows);
+        free(it->cursors[i].times);
+    }
+    free(it);
+}
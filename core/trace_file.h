@@ -0,0 +1,125 @@
+/***********************************************
+ * Columnar trace files for offline analysis.
+ *
+ * A trace file stores events of one stream split into blocks. Every
+ * block holds (up to SHM_TRACE_FILE_BLOCK_EVENTS) events of a single
+ * kind in columns: ids and timestamps are delta- and varint-encoded,
+ * every argument of the event has its own column of fixed-size values
+ * and strings are replaced by indices into a string dictionary that
+ * is shared by the whole file (so every distinct string is stored only
+ * once). At the end of the file, there is the dictionary, the
+ * descriptions of the events and the index of blocks sorted by kind
+ * and the first id, so blocks can be found without parsing the file.
+ *
+ * The reader maps the whole file into memory. Argument columns and
+ * strings are accessed directly in the mapped memory, only ids and
+ * timestamps need to be decoded. Blocks can be also decoded into arrays
+ * of events that have the same layout as events in shared-memory
+ * buffers (shm_event followed by the arguments), with the difference
+ * that strings are pointers into the mapped memory (the `local` member
+ * of signature_operand.S).
+ ************************************************/
+
+#ifndef SHAMON_TRACE_FILE_H_
+#define SHAMON_TRACE_FILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "event.h"
+#include "source.h"
+
+#define SHM_TRACE_FILE_VERSION 1
+#define SHM_TRACE_FILE_BLOCK_EVENTS 4096
+
+/* the entry of the index of blocks */
+typedef struct _shm_trace_file_block {
+    uint64_t kind;
+    uint64_t count;
+    uint64_t first_id;
+    uint64_t last_id;
+    uint64_t first_time;
+    uint64_t last_time;
+    /* the offset of the block in the file and the sizes of encoded
+     * ids and timestamps, columns of arguments follow them (aligned
+     * to 8 bytes) */
+    uint64_t offset;
+    uint64_t ids_size;
+    uint64_t times_size;
+    uint64_t size;
+} shm_trace_file_block;
+
+/*
+ * Writing
+ */
+typedef struct _shm_trace_file_writer shm_trace_file_writer;
+
+shm_trace_file_writer *shm_trace_file_writer_create(
+    const char *path, const struct event_record *events, size_t events_num);
+/* Add an event to the trace. The arguments of the event follow `ev` in
+ * memory as described by the signature of the event, strings are given
+ * as `const char *` pointers. Ids of events of the same kind must not
+ * decrease and the time must not go backwards. Returns 0 on success. */
+int shm_trace_file_write(shm_trace_file_writer *w, uint64_t time_ns,
+                         const shm_event *ev);
+/* Flush the remaining blocks, write the dictionary and the index and
+ * close the file. Returns 0 on success and -1 on error. */
+int shm_trace_file_writer_close(shm_trace_file_writer *w);
+
+/*
+ * Reading
+ */
+typedef struct _shm_trace_file shm_trace_file;
+
+shm_trace_file *shm_trace_file_open(const char *path);
+void shm_trace_file_close(shm_trace_file *tf);
+
+struct event_record *shm_trace_file_events(shm_trace_file *tf, size_t *num);
+struct event_record *shm_trace_file_get_event(shm_trace_file *tf,
+                                              shm_kind kind);
+/* the size of the largest event in the trace (with the arguments) */
+size_t shm_trace_file_max_event_size(shm_trace_file *tf);
+uint64_t shm_trace_file_events_num(shm_trace_file *tf);
+
+const shm_trace_file_block *shm_trace_file_blocks(shm_trace_file *tf,
+                                                  size_t *num);
+/* Blocks of the given kind (sorted by ids) */
+const shm_trace_file_block *shm_trace_file_kind_blocks(shm_trace_file *tf,
+                                                       shm_kind kind,
+                                                       size_t *num);
+/* Find the block that contains the event with the given kind and id.
+ * Returns NULL if there is no such block. */
+const shm_trace_file_block *shm_trace_file_find_block(shm_trace_file *tf,
+                                                      shm_kind kind,
+                                                      shm_eventid id);
+
+/* Get the column of the `arg`-th argument (counted in the signature of
+ * the event) of the block. Strings are columns of uint32_t indices into
+ * the dictionary, other arguments are arrays of values of the size
+ * given by signature_op_get_size(). */
+const void *shm_trace_file_block_column(shm_trace_file *tf,
+                                        const shm_trace_file_block *block,
+                                        size_t arg);
+const char *shm_trace_file_str(shm_trace_file *tf, uint32_t idx);
+
+/* Decode the events of the block into `out`, which must have space for
+ * `block->count` events of the size given by `ev_size` (that must be at
+ * least the size of the event). If `times` is not NULL, it gets the
+ * timestamps of the events. Returns the number of decoded events. */
+size_t shm_trace_file_block_decode(shm_trace_file *tf,
+                                   const shm_trace_file_block *block,
+                                   void *out, size_t ev_size,
+                                   uint64_t *times);
+
+/* Iterate over all events in the trace in the order of their ids */
+typedef struct _shm_trace_file_iter shm_trace_file_iter;
+
+shm_trace_file_iter *shm_trace_file_iter_create(shm_trace_file *tf);
+/* Get the next event or NULL if there are no more events. The returned
+ * event (laid out as by shm_trace_file_block_decode()) is valid until
+ * the next call. `time` may be NULL. */
+const shm_event *shm_trace_file_iter_next(shm_trace_file_iter *it,
+                                          uint64_t *time);
+void shm_trace_file_iter_destroy(shm_trace_file_iter *it);
+
+#endif /* SHAMON_TRACE_FILE_H_ */
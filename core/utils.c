@@ -1,6 +1,7 @@
 #include "utils.h"
 
 #include <assert.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,6 +23,21 @@ int sleep_ns(uint64_t ns) {
 
 int sleep_ms(uint64_t ms) { return sleep_ns(ms * 1000000); }
 
+uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void sleep_until(uint64_t t) {
+    uint64_t now = now_ns();
+    /* sleep only if we have enough time, otherwise just yield */
+    if (t > now + 20000) {
+        sleep_ns(t - now - 10000);
+    }
+    while (now_ns() < t) sched_yield();
+}
+
 void *xalloc_aligned(size_t size, size_t alignment) {
     assert(size > 0);
     assert(alignment > 0);
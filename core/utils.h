@@ -6,6 +6,15 @@
 
 int sleep_ns(uint64_t ns);
 int sleep_ms(uint64_t ms);
+/* the current time of the monotonic clock in nanoseconds */
+uint64_t now_ns(void);
+/* sleep until the monotonic clock reaches `t` ns, the last microseconds
+ * are spent yielding the CPU to be precise */
+void sleep_until(uint64_t t);
+
+/* yield the CPU after this number of unsuccessful attempts (e.g., to push
+ * into a full buffer) */
+#define SPIN_LIMIT 1000
 
 /* On x86 and ARM the cache line has 64 bytes, change if needed. */
 #define CACHELINE_SIZE 64
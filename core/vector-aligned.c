@@ -34,12 +34,13 @@ void shm_vector_aligned_resize(shm_vector *vec, size_t size) {
         void *new_data = xalloc_aligned(vec->alloc_size * vec->element_size,
                                         avec->alignment);
         if (vec->size > 0)
-            memcpy(new_data, vec->data, vec->size);
+            memcpy(new_data, vec->data, vec->size * vec->element_size);
+        free(vec->data);
         vec->data = new_data;
     }
 
     void *addr = ((unsigned char *)vec->data) + vec->size * vec->element_size;
-    memset(addr, 0, size - vec->size);
+    memset(addr, 0, (size - vec->size) * vec->element_size);
     vec->size = size;
 }
 
@@ -53,7 +54,8 @@ void *shm_vector_aligned_extend(shm_vector *vec) {
         void *new_data = xalloc_aligned(vec->alloc_size * vec->element_size,
                                         avec->alignment);
         if (vec->size > 0)
-            memcpy(new_data, vec->data, vec->size);
+            memcpy(new_data, vec->data, vec->size * vec->element_size);
+        free(vec->data);
         vec->data = new_data;
     }
 
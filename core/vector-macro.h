@@ -150,6 +150,17 @@
         --VEC_SIZE(vec); \
     } while (0)
 
+/**
+ * Remove the element at index `idx`, the elements after it are shifted.
+ */
+#define VEC_REMOVE(vec, idx)                                               \
+    do {                                                                   \
+        assert((idx) < VEC_SIZE(vec) && "Index out of bounds");            \
+        memmove((vec) + (idx), (vec) + (idx) + 1,                          \
+                (VEC_SIZE(vec) - (idx)-1) * VEC_ELEM_SIZE(vec));           \
+        VEC_SIZE(vec) -= 1;                                                \
+    } while (0)
+
 /**
  * Return the pointer to the top element in the vector.
  * There is no check if there is any element. If there is none,
@@ -42,7 +42,7 @@ void shm_vector_resize(shm_vector *vec, size_t size) {
     }
 
     void *addr = ((unsigned char *)vec->data) + vec->size * vec->element_size;
-    memset(addr, 0, size - vec->size);
+    memset(addr, 0, (size - vec->size) * vec->element_size);
     vec->size = size;
 }
 
@@ -72,6 +72,14 @@ size_t shm_vector_pop(shm_vector *vec) {
     return --vec->size;
 }
 
+void shm_vector_remove(shm_vector *vec, size_t idx) {
+    assert(idx < vec->size);
+    unsigned char *addr = ((unsigned char *)vec->data) + idx * vec->element_size;
+    memmove(addr, addr + vec->element_size,
+            (vec->size - idx - 1) * vec->element_size);
+    --vec->size;
+}
+
 size_t shm_vector_size(shm_vector *vec) { return vec->size; }
 
 size_t shm_vector_elem_size(shm_vector *vec) {
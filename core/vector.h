@@ -66,6 +66,11 @@ void *shm_vector_extend(shm_vector *vec);
  */
 size_t shm_vector_pop(shm_vector *vec);
 
+/**
+ * Remove the element at index `idx`, the elements after it are shifted.
+ */
+void shm_vector_remove(shm_vector *vec, size_t idx);
+
 
 /**
  * Return the pointer to the top element or NULL
@@ -0,0 +1,542 @@
+/***********************************************
+ * End-to-end scalability harness.
+ *
+ * For every combination of the number of sources and the rate of events,
+ * the harness forks the given number of synthetic sources, each of them
+ * sending `E(n, ts)` events through its own shared-memory buffer,
+ * and a monitor that reads all the sources. The monitor is either
+ * a process that uses the shamon API directly (-m shamon) or
+ * a compiled VAMOS monitor (-m vamos, see harness-monitor.txt.in).
+ *
+ * `ts` is the time when the event was scheduled to be sent, so the latency
+ * includes also the time that the source waited for a free slot in
+ * the buffer.
+ *
+ * One CSV line is written for each run:
+ * delivered and dropped events (and their numbers per second),
+ * CPU time of the sources and of the monitor (and of the thread that
+ * consumes the events for the shamon monitor -- the rest are the arbiter
+ * threads) and percentiles of the latency of delivered events.
+ ************************************************/
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "core/event.h"
+#include "core/shamon.h"
+#include "core/source.h"
+#include "core/stream.h"
+#include "core/utils.h"
+#include "experiments/scalability/latency.h"
+#include "shmbuf/buffer.h"
+#include "shmbuf/client.h"
+#include "streams/stream-generic.h"
+
+#define MAX_SOURCES 256
+#define MAX_SWEEP 32
+
+#ifndef SCALABILITY_ARBITER_CAPACITY
+#define SCALABILITY_ARBITER_CAPACITY 1024
+#endif
+#ifndef SCALABILITY_MONITOR_PATTERN
+#define SCALABILITY_MONITOR_PATTERN "./scalability-monitor-%d"
+#endif
+
+struct src_event {
+    shm_event base;
+    int64_t n;
+    int64_t ts;
+};
+
+struct source_result {
+    size_t sent;
+    size_t waited;
+};
+
+struct monitor_result {
+    size_t delivered;
+    size_t dropped;
+    size_t holes;
+    uint64_t consumer_cpu_ns;
+    latency_hist latency;
+};
+
+/* the memory shared between the harness, sources and the monitor */
+struct shared {
+    atomic_size_t sources_ready;
+    struct source_result sources[MAX_SOURCES];
+    struct monitor_result monitor;
+};
+
+enum mode { MODE_SHAMON, MODE_VAMOS };
+
+struct config {
+    enum mode mode;
+    size_t sources[MAX_SWEEP];
+    size_t sources_num;
+    size_t rates[MAX_SWEEP];
+    size_t rates_num;
+    size_t events;
+    size_t shm_capacity;
+    size_t arbiter_capacity;
+    size_t repeat;
+    const char *monitor_pattern;
+    bool verbose;
+};
+
+static struct shared *shared;
+/* the keys of the buffers are derived from the PID of the harness */
+static pid_t harness_pid;
+
+_Noreturn static void usage_and_exit(const char *prog, int ret) {
+    fprintf(stderr,
+            "Usage: %s [-m shamon|vamos] [-s N,N,...] [-r RATE,RATE,...]\n"
+            "          [-n events] [-c shm-capacity] [-a arbiter-capacity]\n"
+            "          [-R repeat] [-M monitor] [-o out.csv] [-v]\n"
+            "\n"
+            "  -m   monitor: a process using the shamon API (default)\n"
+            "       or a compiled VAMOS monitor\n"
+            "  -s   numbers of sources to run (default: 1,2,4,8)\n"
+            "  -r   events per second sent by every source, 0 means\n"
+            "       as fast as possible (default: 0)\n"
+            "  -n   events sent by every source (default: 100000)\n"
+            "  -c   capacity of the shared-memory buffers (default: 1340)\n"
+            "  -a   capacity of the arbiter buffers (default: %d),\n"
+            "       VAMOS monitors have it fixed at compile time\n"
+            "  -R   repeat every configuration this many times (default: 1)\n"
+            "  -M   the VAMOS monitor, %%d is replaced by the number of\n"
+            "       sources (default: %s)\n"
+            "  -o   append results to this file instead of stdout\n"
+            "  -v   do not suppress the output of the monitor\n",
+            prog, SCALABILITY_ARBITER_CAPACITY, SCALABILITY_MONITOR_PATTERN);
+    exit(ret);
+}
+
+static size_t parse_list(char *str, size_t *out, const char *prog) {
+    size_t num = 0;
+    for (char *tok = strtok(str, ","); tok; tok = strtok(NULL, ",")) {
+        if (num == MAX_SWEEP) {
+            fprintf(stderr, "Too many values (at most %d)\n", MAX_SWEEP);
+            usage_and_exit(prog, 1);
+        }
+        out[num++] = strtoull(tok, NULL, 10);
+    }
+    return num;
+}
+
+static void shmkey(char *out, size_t size, size_t i) {
+    snprintf(out, size, "/shamon-scalability.%d.%lu", (int)harness_pid, i);
+}
+
+static int run_source(const char *key, size_t idx, size_t capacity,
+                      size_t events, size_t rate) {
+    struct source_control *control = source_control_define(1, "E", "ll");
+    assert(control);
+    struct buffer *shm = create_shared_buffer(key, capacity, control);
+    free(control);
+    atomic_fetch_add(&shared->sources_ready, 1);
+    if (!shm) {
+        fprintf(stderr, "Failed creating the buffer '%s'\n", key);
+        return 1;
+    }
+
+    buffer_wait_for_monitor(shm);
+
+    size_t num;
+    struct event_record *rec = buffer_get_avail_events(shm, &num);
+    assert(num == 1);
+
+    struct src_event ev = {.base = {.id = 0, .kind = rec[0].kind}};
+    assert(ev.base.kind != 0 && "Monitor did not set kind");
+
+    struct source_result *res = &shared->sources[idx];
+    const uint64_t start = now_ns();
+    /* the period in nanoseconds of 1/`rate` */
+    const double period = rate ? 1e9 / rate : 0;
+    void *addr;
+    size_t spinned = 0;
+    for (size_t n = 1; n <= events; ++n) {
+        uint64_t t;
+        if (rate > 0) {
+            /* open-loop: the n-th event is due at a fixed time and we do
+             * not postpone the next events if this one is late */
+            t = start + (uint64_t)((n - 1) * period);
+            sleep_until(t);
+        } else {
+            t = now_ns();
+        }
+
+        while (!(addr = buffer_start_push(shm))) {
+            ++res->waited;
+            if (++spinned > SPIN_LIMIT) {
+                sched_yield();
+                spinned = 0;
+            }
+        }
+        ++ev.base.id;
+        ev.n = n;
+        ev.ts = t;
+        buffer_partial_push(shm, addr, &ev, sizeof(ev));
+        buffer_finish_push(shm);
+    }
+    res->sent = ev.base.id;
+
+    destroy_shared_buffer(shm);
+    return 0;
+}
+
+static int run_shamon_monitor(size_t sources, size_t arbiter_capacity) {
+    shamon *shmn = shamon_create(NULL, NULL);
+    assert(shmn);
+
+    char key[64], name[32];
+    for (size_t i = 0; i < sources; ++i) {
+        shmkey(key, sizeof(key), i);
+        snprintf(name, sizeof(name), "Src_%lu", i);
+        shm_stream *stream = shm_create_generic_stream(key, name, NULL);
+        if (!stream) {
+            fprintf(stderr, "Failed connecting to '%s'\n", key);
+            return 1;
+        }
+        shamon_add_stream(shmn, stream, arbiter_capacity);
+        shm_stream_register_all_events(stream);
+    }
+
+    struct monitor_result *res = &shared->monitor;
+    shm_stream *stream;
+    shm_event *ev;
+    while (shamon_is_ready(shmn)) {
+        while ((ev = shamon_get_next_ev(shmn, &stream))) {
+            if (shm_event_is_hole(ev)) {
+                ++res->holes;
+                res->dropped += ((shm_event_default_hole *)ev)->n;
+                continue;
+            }
+            ++res->delivered;
+            latency_hist_record(&res->latency, ((struct src_event *)ev)->ts);
+        }
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    res->consumer_cpu_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+    shamon_destroy(shmn);
+    return 0;
+}
+
+static pid_t spawn_vamos_monitor(const char *pattern, size_t sources,
+                                 int *out_fd) {
+    char exe[512];
+    snprintf(exe, sizeof(exe), pattern, (int)sources);
+    if (access(exe, X_OK) != 0) {
+        fprintf(stderr, "Cannot execute the monitor '%s': %s\n", exe,
+                strerror(errno));
+        return -1;
+    }
+
+    char *argv[MAX_SOURCES + 2];
+    char args[MAX_SOURCES][96];
+    char key[64];
+    argv[0] = exe;
+    for (size_t i = 0; i < sources; ++i) {
+        shmkey(key, sizeof(key), i);
+        snprintf(args[i], sizeof(args[i]), "Src_%lu:generic:%s", i, key);
+        argv[i + 1] = args[i];
+    }
+    argv[sources + 1] = NULL;
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        execv(exe, argv);
+        perror("execv");
+        _exit(1);
+    }
+
+    close(fds[1]);
+    *out_fd = fds[0];
+    return pid;
+}
+
+/* read the output of the VAMOS monitor and find the line with results */
+static int parse_vamos_output(int fd, bool verbose,
+                              struct monitor_result *res, uint64_t lat[4]) {
+    FILE *f = fdopen(fd, "r");
+    if (!f) {
+        perror("fdopen");
+        return -1;
+    }
+
+    int found = -1;
+    char *line = NULL;
+    size_t len = 0;
+    while (getline(&line, &len, f) > 0) {
+        if (verbose)
+            fputs(line, stderr);
+        if (sscanf(line,
+                   "harness: processed %lu dropped %lu holes %lu "
+                   "latency p50 %lu p99 %lu p999 %lu max %lu",
+                   &res->delivered, &res->dropped, &res->holes, &lat[0],
+                   &lat[1], &lat[2], &lat[3]) == 7)
+            found = 0;
+    }
+    free(line);
+    fclose(f);
+    return found;
+}
+
+static double rusage_cpu_s(struct rusage *ru) {
+    return ru->ru_utime.tv_sec + ru->ru_utime.tv_usec * 1e-6 +
+           ru->ru_stime.tv_sec + ru->ru_stime.tv_usec * 1e-6;
+}
+
+static void print_csv_header(FILE *out) {
+    fprintf(out,
+            "mode,sources,rate,events,shm_capacity,arbiter_capacity,"
+            "duration_s,sent,delivered,dropped,holes,lost,"
+            "delivered_per_s,dropped_per_s,source_waits,"
+            "cpu_sources_s,cpu_monitor_s,cpu_consumer_s,"
+            "latency_p50_us,latency_p99_us,latency_p999_us,latency_max_us\n");
+}
+
+static int run_one(const struct config *cfg, size_t sources, size_t rate,
+                   FILE *out) {
+    memset(shared, 0, sizeof(*shared));
+    latency_hist_init(&shared->monitor.latency);
+
+    pid_t pids[MAX_SOURCES];
+    char key[64];
+    for (size_t i = 0; i < sources; ++i) {
+        shmkey(key, sizeof(key), i);
+        pids[i] = fork();
+        if (pids[i] < 0) {
+            perror("fork");
+            return -1;
+        }
+        if (pids[i] == 0) {
+            _exit(run_source(key, i, cfg->shm_capacity, cfg->events, rate));
+        }
+    }
+
+    /* the monitor can attach only to existing buffers */
+    while (atomic_load(&shared->sources_ready) < sources) sched_yield();
+
+    const uint64_t start = now_ns();
+    pid_t monitor;
+    int monitor_out = -1;
+    if (cfg->mode == MODE_SHAMON) {
+        monitor = fork();
+        if (monitor == 0) {
+            if (!cfg->verbose) {
+                int devnull = open("/dev/null", O_WRONLY);
+                dup2(devnull, STDOUT_FILENO);
+                close(devnull);
+            }
+            _exit(run_shamon_monitor(sources, cfg->arbiter_capacity));
+        }
+    } else {
+        monitor =
+            spawn_vamos_monitor(cfg->monitor_pattern, sources, &monitor_out);
+    }
+    if (monitor < 0) {
+        for (size_t i = 0; i < sources; ++i) kill(pids[i], SIGKILL);
+        return -1;
+    }
+
+    struct monitor_result *res = &shared->monitor;
+    uint64_t lat[4] = {0};
+    int ret = 0;
+    if (cfg->mode == MODE_VAMOS) {
+        if (parse_vamos_output(monitor_out, cfg->verbose, res, lat) != 0) {
+            fprintf(stderr, "Did not find the results of the monitor\n");
+            ret = -1;
+        }
+    }
+
+    struct rusage ru;
+    int status;
+    if (wait4(monitor, &status, 0, &ru) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "The monitor failed\n");
+        ret = -1;
+    }
+    const double duration = (now_ns() - start) * 1e-9;
+    const double cpu_monitor = rusage_cpu_s(&ru);
+
+    double cpu_sources = 0;
+    size_t sent = 0, waited = 0;
+    for (size_t i = 0; i < sources; ++i) {
+        if (wait4(pids[i], &status, 0, &ru) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Source %lu failed\n", i);
+            ret = -1;
+        }
+        cpu_sources += rusage_cpu_s(&ru);
+        sent += shared->sources[i].sent;
+        waited += shared->sources[i].waited;
+    }
+
+    if (ret != 0)
+        return ret;
+
+    if (cfg->mode == MODE_SHAMON) {
+        lat[0] = latency_hist_percentile(&res->latency, 0.5);
+        lat[1] = latency_hist_percentile(&res->latency, 0.99);
+        lat[2] = latency_hist_percentile(&res->latency, 0.999);
+        lat[3] = res->latency.max;
+    }
+
+    fprintf(out, "%s,%lu,%lu,%lu,%lu,", cfg->mode == MODE_SHAMON ? "shamon" : "vamos",
+            sources, rate, cfg->events, cfg->shm_capacity);
+    if (cfg->mode == MODE_SHAMON)
+        fprintf(out, "%lu,", cfg->arbiter_capacity);
+    else
+        fputc(',', out);
+    fprintf(out, "%.6lf,%lu,%lu,%lu,%lu,%ld,%.1lf,%.1lf,%lu,%.3lf,%.3lf,",
+            duration, sent, res->delivered, res->dropped, res->holes,
+            (long)(sent - res->delivered - res->dropped),
+            res->delivered / duration, res->dropped / duration, waited,
+            cpu_sources, cpu_monitor);
+    if (cfg->mode == MODE_SHAMON)
+        fprintf(out, "%.3lf,", res->consumer_cpu_ns * 1e-9);
+    else
+        fputc(',', out);
+    fprintf(out, "%.3lf,%.3lf,%.3lf,%.3lf\n", lat[0] / 1000.0, lat[1] / 1000.0,
+            lat[2] / 1000.0, lat[3] / 1000.0);
+    fflush(out);
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    struct config cfg = {.mode = MODE_SHAMON,
+                         .sources = {1, 2, 4, 8},
+                         .sources_num = 4,
+                         .rates = {0},
+                         .rates_num = 1,
+                         .events = 100000,
+                         .shm_capacity = 1340,
+                         .arbiter_capacity = SCALABILITY_ARBITER_CAPACITY,
+                         .repeat = 1,
+                         .monitor_pattern = SCALABILITY_MONITOR_PATTERN,
+                         .verbose = false};
+    const char *outpath = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:s:r:n:c:a:R:M:o:vh")) != -1) {
+        switch (opt) {
+            case 'm':
+                if (strcmp(optarg, "shamon") == 0)
+                    cfg.mode = MODE_SHAMON;
+                else if (strcmp(optarg, "vamos") == 0)
+                    cfg.mode = MODE_VAMOS;
+                else
+                    usage_and_exit(argv[0], 1);
+                break;
+            case 's':
+                cfg.sources_num = parse_list(optarg, cfg.sources, argv[0]);
+                break;
+            case 'r':
+                cfg.rates_num = parse_list(optarg, cfg.rates, argv[0]);
+                break;
+            case 'n':
+                cfg.events = strtoull(optarg, NULL, 10);
+                break;
+            case 'c':
+                cfg.shm_capacity = strtoull(optarg, NULL, 10);
+                break;
+            case 'a':
+                cfg.arbiter_capacity = strtoull(optarg, NULL, 10);
+                break;
+            case 'R':
+                cfg.repeat = strtoull(optarg, NULL, 10);
+                break;
+            case 'M':
+                cfg.monitor_pattern = optarg;
+                break;
+            case 'o':
+                outpath = optarg;
+                break;
+            case 'v':
+                cfg.verbose = true;
+                break;
+            case 'h':
+                usage_and_exit(argv[0], 0);
+            default:
+                usage_and_exit(argv[0], 1);
+        }
+    }
+
+    for (size_t i = 0; i < cfg.sources_num; ++i) {
+        if (cfg.sources[i] == 0 || cfg.sources[i] > MAX_SOURCES) {
+            fprintf(stderr, "The number of sources must be in 1..%d\n",
+                    MAX_SOURCES);
+            return 1;
+        }
+    }
+
+    harness_pid = getpid();
+    shared = mmap(0, sizeof(*shared), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (outpath) {
+        out = fopen(outpath, "a");
+        if (!out) {
+            perror("opening the output file");
+            return 1;
+        }
+        /* write the header only into a new file */
+        if (ftell(out) == 0)
+            print_csv_header(out);
+    } else {
+        print_csv_header(out);
+    }
+
+    int ret = 0;
+    for (size_t r = 0; r < cfg.repeat; ++r) {
+        for (size_t s = 0; s < cfg.sources_num; ++s) {
+            for (size_t i = 0; i < cfg.rates_num; ++i) {
+                fprintf(stderr, "[%lu/%lu] %lu source(s), rate %lu ev/s\n",
+                        r + 1, cfg.repeat, cfg.sources[s], cfg.rates[i]);
+                if (run_one(&cfg, cfg.sources[s], cfg.rates[i], out) != 0)
+                    ret = 1;
+            }
+        }
+    }
+
+    if (out != stdout)
+        fclose(out);
+    munmap(shared, sizeof(*shared));
+    return ret;
+}
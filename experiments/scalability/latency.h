@@ -0,0 +1,86 @@
+/***********************************************
+ * Latency histogram shared by the scalability harness
+ * and the monitors that it runs.
+ *
+ * The histogram is log-linear: values are split into power-of-two
+ * ranges and every range into 16 linear sub-buckets, which gives
+ * percentiles with error below 7% in constant space.
+ ************************************************/
+
+#ifndef SHAMON_SCALABILITY_LATENCY_H_
+#define SHAMON_SCALABILITY_LATENCY_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+typedef struct _latency_hist {
+    uint64_t count;
+    uint64_t max;
+    uint64_t buckets[LATENCY_BUCKETS];
+} latency_hist;
+
+static inline uint64_t latency_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void latency_hist_init(latency_hist *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+static inline unsigned latency_bucket(uint64_t v) {
+    if (v < LATENCY_SUB_BUCKETS)
+        return (unsigned)v;
+    const unsigned msb = 63 - __builtin_clzll(v);
+    const unsigned sub =
+        (v >> (msb - LATENCY_SUB_BITS)) & (LATENCY_SUB_BUCKETS - 1);
+    return (msb - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS + sub;
+}
+
+/* the lowest value that falls into the bucket */
+static inline uint64_t latency_bucket_value(unsigned idx) {
+    if (idx < LATENCY_SUB_BUCKETS)
+        return idx;
+    const unsigned msb = idx / LATENCY_SUB_BUCKETS + LATENCY_SUB_BITS - 1;
+    const uint64_t sub = idx % LATENCY_SUB_BUCKETS;
+    return (1ULL << msb) | (sub << (msb - LATENCY_SUB_BITS));
+}
+
+static inline void latency_hist_add(latency_hist *h, uint64_t v) {
+    ++h->buckets[latency_bucket(v)];
+    ++h->count;
+    if (v > h->max)
+        h->max = v;
+}
+
+/* record the latency of an event that was (supposed to be)
+ * sent at `sent_ns` (CLOCK_MONOTONIC) */
+static inline void latency_hist_record(latency_hist *h, uint64_t sent_ns) {
+    const uint64_t now = latency_now_ns();
+    latency_hist_add(h, now > sent_ns ? now - sent_ns : 0);
+}
+
+/* `p` is from [0, 1] */
+static inline uint64_t latency_hist_percentile(const latency_hist *h,
+                                               double p) {
+    if (h->count == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(p * h->count);
+    if (rank >= h->count)
+        rank = h->count - 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < LATENCY_BUCKETS; ++i) {
+        seen += h->buckets[i];
+        if (seen > rank)
+            return latency_bucket_value(i);
+    }
+    return h->max;
+}
+
+#endif /* SHAMON_SCALABILITY_LATENCY_H_ */
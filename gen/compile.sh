@@ -28,6 +28,13 @@ else
         CPPFLAGS="$CPPFLAGS -DNDEBUG"
 fi
 
+if grep -q 'TRACING:BOOL=ON' $GENDIR/../CMakeCache.txt; then
+	CPPFLAGS="$CPPFLAGS -DTRACING"
+fi
+if grep -q 'PERF_COUNTERS:BOOL=ON' $GENDIR/../CMakeCache.txt; then
+	CPPFLAGS="$CPPFLAGS -DPERF_COUNTERS"
+fi
+
 LDFLAGS=-lpthread
 LIBRARIES="$SHAMONDIR/core/libshamon-arbiter.a\
            $SHAMONDIR/core/libshamon-stream.a\
@@ -40,6 +47,10 @@ LIBRARIES="$SHAMONDIR/core/libshamon-arbiter.a\
            $SHAMONDIR/core/libshamon-list.a\
            $SHAMONDIR/core/libshamon-utils.a\
            $SHAMONDIR/core/libshamon-monitor-buffer.a\
+           $SHAMONDIR/core/libshamon-trace.a\
+           $SHAMONDIR/core/libshamon-perf-counters.a\
+           $SHAMONDIR/core/libshamon-trace-file.a\
+           $SHAMONDIR/core/libshamon-checkpoint.a\
            $SHAMONDIR/streams/libshamon-streams.a"
 
 test -z $CC && CC=cc
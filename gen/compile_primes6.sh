@@ -34,6 +34,7 @@ LIBRARIES="$SHAMONDIR/core/libshamon-arbiter.a\
            $SHAMONDIR/core/libshamon-signature.a\
            $SHAMONDIR/core/libshamon-list.a\
            $SHAMONDIR/streams/libshamon-streams.a\
+           $SHAMONDIR/core/libshamon-checkpoint.a\
            $SHAMONDIR/core/libshamon-utils.a\
 	   $SHAMONDIR/compiler/cfiles/compiler_utils.o\
 	   $SHAMONDIR/compiler/cfiles/intmap.o"
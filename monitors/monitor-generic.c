@@ -10,6 +10,7 @@
 #include "arbiter.h"
 #include "event.h"
 #include "monitors-utils.h"
+#include "payload.h"
 #include "shamon.h"
 #include "signatures.h"
 #include "source.h"
@@ -21,6 +22,20 @@
 //#define CHECK_IDS
 #define CHECK_IDS_ABORT
 
+static inline void dump_payload(shm_stream *stream, uint64_t ref) {
+    struct shm_payload *payload = shm_stream_get_payload(stream);
+    size_t stored, len, chunk_len = 0;
+    if (!payload || !shm_payload_get_size(payload, ref, &stored, &len)) {
+        printf("P[none]");
+        return;
+    }
+    const char *data =
+        stored > 0 ? shm_payload_chunk(payload, ref, 0, &chunk_len) : NULL;
+    printf("P[%lu, %lu/%lu]('%.*s%s)", ref, stored, len,
+           chunk_len > 6 ? 6 : (int)chunk_len, data ? data : "",
+           len > 6 ? "...'" : "'");
+}
+
 static inline void dump_args(shm_stream *stream, shm_event_generic *ev,
                              const char *signature) {
     unsigned char *p = ev->args;
@@ -36,6 +51,11 @@ static inline void dump_args(shm_stream *stream, shm_event_generic *ev,
             p += sizeof(uint64_t);
             continue;
         }
+        if (*o == 'P') {
+            dump_payload(stream, *(uint64_t *)p);
+            p += sizeof(uint64_t);
+            continue;
+        }
 
         size_t size = signature_op_get_size(*o);
         if (*o == 'f') {
@@ -292,7 +312,7 @@ int main(int argc, char *argv[]) {
 #endif
 
         shm_arbiter_buffer *buff =
-            (shm_arbiter_buffer *)shm_vector_at(buffers, i);
+            *(shm_arbiter_buffer **)shm_vector_at(buffers, i);
         shm_arbiter_buffer_dump_stats(buff);
     }
 #ifdef CHECK_IDS
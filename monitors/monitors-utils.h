@@ -7,4 +7,8 @@ shm_stream *create_stream(int argc, char *argv[], int arg_i,
                           const char *expected_stream_name,
                           const shm_stream_hole_handling *hole_handling);
 
+/* the key of the shared buffer of the stream or the name of the stream
+ * if it does not read from a shared buffer (e.g., a trace file) */
+const char *stream_get_key(shm_stream *stream);
+
 #endif
@@ -0,0 +1,289 @@
+/***********************************************
+ * Forward events from shared-memory buffers to another host.
+ *
+ * The sender attaches to the buffers like any other monitor (the streams
+ * are given as 'name:type:key', e.g., 'src:generic:/key'), reads the
+ * events in large batches and sends them over TCP to `shamon-bridge-recv`
+ * that re-creates the buffers on the other host. See core/bridge.h for
+ * the protocol. The monitor then runs on the other host and the sender
+ * is the only thing that reads the buffers on this host.
+ * Sub-buffers (substreams) of the buffers are not forwarded.
+ ************************************************/
+
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bridge.h"
+#include "buffer.h"
+#include "event.h"
+#include "monitors-utils.h"
+#include "signatures.h"
+#include "source.h"
+#include "stream.h"
+#include "utils.h"
+
+#define SLEEP_NS_INIT (50)
+#define SLEEP_THRESHOLD_NS (100000)
+#define DEFAULT_BATCH_SIZE (64 * 1024)
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_interrupt(int sig) {
+    (void)sig;
+    interrupted = 1;
+}
+
+static _Noreturn void usage_and_exit(int ret) {
+    fprintf(stderr,
+            "Usage: shamon-bridge-send [-z] [-b batch] host:port "
+            "source-spec [source-spec ...]\n"
+            "\n"
+            "  -z   compress the data\n"
+            "  -b   the maximal size of a batch of events in bytes\n"
+            "       (default: %d)\n",
+            DEFAULT_BATCH_SIZE);
+    exit(ret);
+}
+
+struct channel {
+    shm_stream *stream;
+    bool ended;
+};
+
+/* bytes that we may still send */
+static uint64_t credit = 0;
+
+static int handle_frame(shm_bridge_conn *conn) {
+    shm_bridge_frame_header hdr;
+    const void *payload = shm_bridge_recv(conn, &hdr);
+    if (!payload) {
+        fprintf(stderr, "The receiver closed the connection\n");
+        return -1;
+    }
+    if (hdr.type != SHM_BRIDGE_CREDIT || hdr.raw_size != sizeof(uint64_t)) {
+        fprintf(stderr, "Got unexpected frame from the receiver\n");
+        return -1;
+    }
+    credit += shm_bridge_get_u64(payload);
+    return 0;
+}
+
+static int send_hello(shm_bridge_conn *conn, uint32_t channel,
+                      shm_stream *stream) {
+    size_t events_num;
+    struct event_record *events =
+        shm_stream_get_avail_events(stream, &events_num);
+
+    const size_t size =
+        SHM_BRIDGE_HELLO_SIZE + events_num * SHM_BRIDGE_RECORD_SIZE;
+    if (size > SHM_BRIDGE_MAX_PAYLOAD) {
+        fprintf(stderr, "Too many events in stream %s\n",
+                shm_stream_get_name(stream));
+        return -1;
+    }
+
+    shm_bridge_hello hello;
+    memset(&hello, 0, sizeof(hello));
+    hello.events_num = events_num;
+    hello.elem_size = shm_stream_event_size(stream);
+    hello.capacity = shm_stream_buffer_capacity(stream);
+    strncpy(hello.key, stream_get_key(stream), sizeof(hello.key) - 1);
+    unsigned char *payload = xalloc(size);
+    shm_bridge_hello_encode(&hello, events, payload);
+
+    int ret = shm_bridge_send(conn, SHM_BRIDGE_HELLO, channel, payload, size);
+    free(payload);
+    return ret;
+}
+
+/* Encode the event into `out` (see core/bridge.h), returns the size
+ * of the encoded event or 0 if it does not fit into `space` bytes. */
+static size_t encode_event(shm_stream *stream, shm_event *ev,
+                           unsigned char *out, size_t space) {
+    const size_t ev_size = shm_stream_event_size(stream);
+    if (space < ev_size)
+        return 0;
+
+    struct event_record *info =
+        shm_stream_get_event_record(stream, shm_event_kind(ev));
+    assert(info && "Got an unknown event");
+
+    memcpy(out, ev, ev_size);
+    size_t size = ev_size;
+    unsigned char *p = out + sizeof(shm_event);
+    for (const unsigned char *o = info->signature; *o; ++o) {
+        if (*o == 'S' || *o == 'L' || *o == 'M') {
+            uint64_t elem;
+            memcpy(&elem, p, sizeof(elem));
+            const char *str = shm_stream_get_str(stream, elem);
+            const uint32_t len = strlen(str) + 1;
+            if (space < size + sizeof(len) + len)
+                return 0;
+            memset(p, 0, sizeof(uint64_t));
+            shm_bridge_put_u32(out + size, len);
+            memcpy(out + size + sizeof(len), str, len);
+            size += sizeof(len) + len;
+        }
+        p += signature_op_get_size(*o);
+    }
+
+    return size;
+}
+
+/* send a batch of events of the channel, wait for the credit if needed */
+static int send_batch(shm_bridge_conn *conn, uint32_t channel,
+                      const unsigned char *batch, size_t size) {
+    while (credit < size) {
+        if (handle_frame(conn) < 0)
+            return -1;
+    }
+    credit -= size;
+    return shm_bridge_send(conn, SHM_BRIDGE_DATA, channel, batch, size);
+}
+
+int main(int argc, char *argv[]) {
+    bool compress = false;
+    size_t batch_size = DEFAULT_BATCH_SIZE;
+    int opt;
+    while ((opt = getopt(argc, argv, "zb:h")) != -1) {
+        switch (opt) {
+            case 'z':
+                compress = true;
+                break;
+            case 'b':
+                batch_size = strtoull(optarg, NULL, 10);
+                break;
+            case 'h':
+                usage_and_exit(0);
+            default:
+                usage_and_exit(1);
+        }
+    }
+
+    if (argc - optind < 2)
+        usage_and_exit(1);
+    if (batch_size == 0 || batch_size > SHM_BRIDGE_MAX_PAYLOAD) {
+        fprintf(stderr, "The size of batches must be between 1 and %d\n",
+                SHM_BRIDGE_MAX_PAYLOAD);
+        return 1;
+    }
+
+    char *host = xstrdup(argv[optind]);
+    char *port = strrchr(host, ':');
+    if (!port) {
+        fprintf(stderr, "Expected host:port, got '%s'\n", host);
+        return 1;
+    }
+    *port++ = '\0';
+
+    /* argv + optind starts with host:port, the specs follow */
+    const size_t channels_num = argc - optind - 1;
+    struct channel *channels = xalloc(channels_num * sizeof(*channels));
+    for (size_t i = 0; i < channels_num; ++i) {
+        channels[i].stream =
+            create_stream(argc - optind, argv + optind, i + 1, NULL, NULL);
+        assert(channels[i].stream && "Creating stream failed");
+        channels[i].ended = false;
+        shm_stream_register_all_events(channels[i].stream);
+    }
+
+    int fd = shm_bridge_connect(host, port);
+    if (fd < 0)
+        return 1;
+    shm_bridge_conn *conn = shm_bridge_conn_create(fd, compress);
+
+    for (size_t i = 0; i < channels_num; ++i) {
+        if (send_hello(conn, i, channels[i].stream) < 0)
+            return 1;
+        shm_stream_attach(channels[i].stream);
+    }
+
+    signal(SIGINT, on_interrupt);
+    signal(SIGTERM, on_interrupt);
+    /* we handle the closed connection ourselves */
+    signal(SIGPIPE, SIG_IGN);
+
+    unsigned char *batch = xalloc(batch_size);
+    uint64_t sleep_time = SLEEP_NS_INIT;
+    size_t active = channels_num, n = 0;
+    int ret = 0;
+    while (active > 0 && !interrupted && ret == 0) {
+        bool progress = false;
+        for (size_t i = 0; i < channels_num && ret == 0; ++i) {
+            struct channel *ch = &channels[i];
+            if (ch->ended)
+                continue;
+
+            size_t num;
+            unsigned char *evs = shm_stream_read_events(ch->stream, &num);
+            if (num == 0) {
+                if (shm_stream_is_finished(ch->stream)) {
+                    ret = shm_bridge_send(conn, SHM_BRIDGE_END, i, NULL, 0);
+                    ch->ended = true;
+                    --active;
+                }
+                continue;
+            }
+
+            const size_t ev_size = shm_stream_event_size(ch->stream);
+            size_t size = 0, k = 0;
+            shm_event *ev = NULL;
+            for (; k < num; ++k) {
+                ev = (shm_event *)(evs + k * ev_size);
+                size_t s =
+                    encode_event(ch->stream, ev, batch + size, batch_size - size);
+                if (s == 0)
+                    break;
+                size += s;
+            }
+            if (k == 0) {
+                fprintf(stderr,
+                        "An event does not fit into a batch, use larger "
+                        "batches (-b)\n");
+                ret = -1;
+                break;
+            }
+            ev = (shm_event *)(evs + (k - 1) * ev_size);
+
+            shm_stream_consume(ch->stream, k);
+            shm_stream_notify_last_processed_id(ch->stream, shm_event_id(ev));
+            ret = send_batch(conn, i, batch, size);
+            n += k;
+            progress = true;
+        }
+
+        /* take the credit as it comes, so that we do not block later */
+        while (ret == 0 && shm_bridge_can_recv(conn)) {
+            ret = handle_frame(conn);
+        }
+
+        if (progress) {
+            sleep_time = SLEEP_NS_INIT;
+        } else {
+            if (sleep_time < SLEEP_THRESHOLD_NS)
+                sleep_time *= 2;
+            sleep_ns(sleep_time);
+        }
+    }
+
+    uint64_t raw, wire;
+    shm_bridge_sent_bytes(conn, &raw, &wire);
+    fprintf(stderr, "Forwarded %lu events (%lu bytes, %lu on the wire)%s\n", n,
+            raw, wire, interrupted ? " (interrupted)" : "");
+
+    if (ret == 0)
+        shm_bridge_conn_finish(conn);
+    shm_bridge_conn_destroy(conn);
+    for (size_t i = 0; i < channels_num; ++i) {
+        shm_stream_destroy(channels[i].stream);
+    }
+    free(channels);
+    free(batch);
+    free(host);
+
+    return ret == 0 ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+/***********************************************
+ * Attach to shared-memory buffers as soon as they are created.
+ *
+ * The host creates the registry of buffers (see shmbuf/registry.h)
+ * and sleeps on it. Sources announce every buffer that they create
+ * in the registry, the host takes the announcements of buffers whose keys
+ * start with one of the given prefixes, attaches to the buffer as to
+ * a generic stream and reads it until the source finishes. Other buffers
+ * are left to the monitors that wait for them.
+ * Then it detaches from the buffer and frees its slot in the registry,
+ * so the host can run for a long time while sources come and go.
+ * Sub-buffers (substreams) of the buffers are not attached.
+ ************************************************/
+
+#include <assert.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "arbiter.h"
+#include "buffer.h"
+#include "event.h"
+#include "registry.h"
+#include "stream-generic.h"
+#include "stream.h"
+
+#define ARBITER_BUFFER_CAPACITY 16
+/* how often we check for finished streams when there are no announcements */
+#define RECLAIM_INTERVAL_MS 100
+#define MAX_PREFIXES 16
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_interrupt(int sig) {
+    (void)sig;
+    interrupted = 1;
+}
+
+static _Noreturn void usage_and_exit(int ret) {
+    fprintf(stderr,
+            "Usage: shamon-host -p prefix [-p prefix ...] [-r registry] "
+            "[-n num]\n"
+            "\n"
+            "  -p   host buffers whose keys start with `prefix`\n"
+            "       (e.g., '/' for all buffers), at most %d prefixes\n"
+            "  -r   the key of the registry (default: SHAMON_REGISTRY\n"
+            "       or '%s')\n"
+            "  -n   exit after `num` streams finished\n",
+            MAX_PREFIXES, SHM_REGISTRY_DEFAULT_KEY);
+    exit(ret);
+}
+
+struct hosted {
+    shm_stream *stream;
+    shm_arbiter_buffer *buffer;
+    thrd_t thread;
+    size_t events;
+    _Atomic bool done;
+};
+
+/* indexed by the slot of the buffer in the registry */
+static struct hosted *hosted[SHM_REGISTRY_CAPACITY];
+
+static int consume_thrd(void *data) {
+    struct hosted *h = (struct hosted *)data;
+    shm_stream *stream = h->stream;
+
+    shm_event *ev;
+    while ((ev = stream_fetch(stream, h->buffer))) {
+        ++h->events;
+        shm_stream_notify_last_processed_id(stream, shm_event_id(ev));
+        shm_stream_consume(stream, 1);
+    }
+
+    atomic_store(&h->done, true);
+    return 0;
+}
+
+static void attach(const char *key, int slot) {
+    assert(!hosted[slot] && "The slot is already hosted");
+
+    struct buffer *shmbuffer = try_get_shared_buffer(key, 0);
+    if (!shmbuffer) {
+        /* the source was faster than us and the buffer is gone */
+        fprintf(stderr, "Failed attaching to '%s'\n", key);
+        return;
+    }
+    /* another host reads the buffer */
+    if (!buffer_claim(shmbuffer)) {
+        release_shared_buffer(shmbuffer);
+        return;
+    }
+
+    struct hosted *h = malloc(sizeof(*h));
+    assert(h && "Memory allocation failed");
+    /* the name of the stream is the key without the leading slash */
+    h->stream = shm_create_generic_stream_from_buffer(
+        shmbuffer, key[0] == '/' ? key + 1 : key, NULL);
+    shm_stream_register_all_events(h->stream);
+    h->buffer = shm_arbiter_buffer_create(
+        h->stream, shm_stream_event_size(h->stream), ARBITER_BUFFER_CAPACITY);
+    shm_arbiter_buffer_set_active(h->buffer, true);
+    h->events = 0;
+    atomic_init(&h->done, false);
+
+    if (thrd_create(&h->thread, consume_thrd, h) != thrd_success) {
+        fprintf(stderr, "Failed creating a thread for '%s'\n", key);
+        shm_arbiter_buffer_free(h->buffer);
+        shm_stream_destroy(h->stream);
+        free(h);
+        return;
+    }
+
+    hosted[slot] = h;
+    printf("Attached to '%s'\n", key);
+}
+
+static void detach(struct shm_registry *reg, int slot) {
+    struct hosted *h = hosted[slot];
+    thrd_join(h->thread, NULL);
+
+    printf("Detached from '%s' after %lu events (%lu dropped)\n",
+           shm_stream_get_name(h->stream), h->events,
+           shm_arbiter_buffer_dropped_num(h->buffer));
+
+    shm_stream_destroy(h->stream);
+    shm_arbiter_buffer_free(h->buffer);
+    free(h);
+    hosted[slot] = NULL;
+    shm_registry_release(reg, slot);
+}
+
+int main(int argc, char *argv[]) {
+    const char *key = shm_registry_key();
+    long exit_after = -1;
+    const char *prefixes[MAX_PREFIXES];
+    int prefixes_num = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:r:n:h")) != -1) {
+        switch (opt) {
+        case 'p':
+            if (prefixes_num == MAX_PREFIXES)
+                usage_and_exit(1);
+            prefixes[prefixes_num++] = optarg;
+            break;
+        case 'r':
+            key = optarg;
+            break;
+        case 'n':
+            exit_after = atol(optarg);
+            break;
+        case 'h':
+            usage_and_exit(0);
+        default:
+            usage_and_exit(1);
+        }
+    }
+    if (optind != argc || prefixes_num == 0)
+        usage_and_exit(1);
+
+    struct shm_registry *reg = shm_registry_create(key);
+    if (!reg) {
+        fprintf(stderr, "Failed creating the registry '%s'\n", key);
+        return 1;
+    }
+
+    signal(SIGINT, on_interrupt);
+    signal(SIGTERM, on_interrupt);
+
+    printf("Waiting for buffers announced in '%s'\n", key);
+    fflush(stdout);
+
+    char buffer_key[SHM_NAME_MAXLEN];
+    long finished = 0;
+    while (!interrupted && finished != exit_after) {
+        /* read the sequence number before taking the announcements,
+         * so that we do not sleep through an announcement */
+        uint32_t seq = shm_registry_seq(reg);
+
+        int slot;
+        for (int p = 0; p < prefixes_num; ++p) {
+            while ((slot = shm_registry_take(reg, prefixes[p], buffer_key)) >=
+                   0) {
+                attach(buffer_key, slot);
+                if (!hosted[slot])
+                    shm_registry_release(reg, slot);
+            }
+        }
+
+        for (int i = 0; i < SHM_REGISTRY_CAPACITY; ++i) {
+            if (hosted[i] && atomic_load(&hosted[i]->done)) {
+                detach(reg, i);
+                ++finished;
+            }
+        }
+        fflush(stdout);
+
+        shm_registry_wait(reg, seq, RECLAIM_INTERVAL_MS);
+    }
+
+    /* stop taking new buffers before we detach from the current ones */
+    shm_registry_destroy(reg);
+
+    for (int i = 0; i < SHM_REGISTRY_CAPACITY; ++i) {
+        if (!hosted[i])
+            continue;
+        if (!atomic_load(&hosted[i]->done)) {
+            /* do not wait for sources that still run */
+            printf("Leaving '%s' after %lu events\n",
+                   shm_stream_get_name(hosted[i]->stream), hosted[i]->events);
+            shm_stream_detach(hosted[i]->stream);
+            continue;
+        }
+        thrd_join(hosted[i]->thread, NULL);
+        printf("Detached from '%s' after %lu events\n",
+               shm_stream_get_name(hosted[i]->stream), hosted[i]->events);
+    }
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+/***********************************************
+ * Record events from a shared-memory buffer into a file
+ * that can be replayed with `shamon-replay`.
+ *
+ * The recorder attaches to the buffer like any other monitor
+ * (the stream is given as 'name:type:key', e.g., 'src:generic:/key')
+ * and stores every event together with the strings that it references
+ * and the time when it was read from the buffer.
+ * With -c, the events are written into a columnar trace file
+ * (see core/trace_file.h) that is meant for offline analysis instead.
+ * Sub-buffers (substreams) of the buffer are not recorded.
+ ************************************************/
+
+#include <assert.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "event.h"
+#include "monitors-utils.h"
+#include "recording.h"
+#include "signatures.h"
+#include "source.h"
+#include "stream.h"
+#include "trace_file.h"
+#include "utils.h"
+
+#define SLEEP_NS_INIT (50)
+#define SLEEP_THRESHOLD_NS (100000)
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_interrupt(int sig) {
+    (void)sig;
+    interrupted = 1;
+}
+
+static void record_event(shm_recording *rec, shm_stream *stream,
+                         shm_event *ev, uint64_t time) {
+    struct event_record *info =
+        shm_stream_get_event_record(stream, shm_event_kind(ev));
+    assert(info && "Got an unknown event");
+
+    shm_recording_write_event(rec, time, ev->kind, ev->id);
+    unsigned char *p = (unsigned char *)ev + sizeof(shm_event);
+    for (const unsigned char *o = info->signature; *o; ++o) {
+        if (*o == 'S' || *o == 'L' || *o == 'M') {
+            const char *str = shm_stream_get_str(stream, *(uint64_t *)p);
+            shm_recording_write_str(rec, str, strlen(str));
+        } else if (*o != '_') {
+            shm_recording_write_arg(rec, *o, p);
+        }
+        p += signature_op_get_size(*o);
+    }
+}
+
+/* write the event into the trace file, strings are passed
+ * to the writer as pointers */
+static void write_trace_event(shm_trace_file_writer *tf, shm_stream *stream,
+                              shm_event *ev, uint64_t time,
+                              unsigned char *tmp) {
+    struct event_record *info =
+        shm_stream_get_event_record(stream, shm_event_kind(ev));
+    assert(info && "Got an unknown event");
+
+    memcpy(tmp, ev, shm_stream_event_size(stream));
+    unsigned char *p = tmp + sizeof(shm_event);
+    for (const unsigned char *o = info->signature; *o; ++o) {
+        if (*o == 'S' || *o == 'L' || *o == 'M') {
+            const char *str = shm_stream_get_str(stream, *(uint64_t *)p);
+            memcpy(p, &str, sizeof(str));
+        }
+        p += signature_op_get_size(*o);
+    }
+    if (shm_trace_file_write(tf, time, (shm_event *)tmp) < 0) {
+        fprintf(stderr, "Failed writing the event into the trace file\n");
+        interrupted = 1;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int columnar = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "c")) != -1) {
+        if (opt == 'c') {
+            columnar = 1;
+        } else {
+            argc = 0; /* print the usage */
+            break;
+        }
+    }
+
+    if (argc - optind != 2) {
+        fprintf(stderr,
+                "USAGE: shamon-record [-c] output-file source-spec\n"
+                "  -c   write a columnar trace file instead of a recording\n"
+                "       that can be replayed\n");
+        return -1;
+    }
+    const char *output = argv[optind];
+
+    /* pass only the spec, so that the output file cannot be mistaken
+     * for the spec of the stream */
+    shm_stream *stream = create_stream(2, argv + optind, 1, NULL, NULL);
+    assert(stream && "Creating stream failed");
+
+    shm_stream_register_all_events(stream);
+
+    size_t events_num;
+    struct event_record *events =
+        shm_stream_get_avail_events(stream, &events_num);
+    shm_recording *rec = NULL;
+    shm_trace_file_writer *tf = NULL;
+    if (columnar) {
+        tf = shm_trace_file_writer_create(output, events, events_num);
+    } else {
+        rec = shm_recording_create(
+            output, stream_get_key(stream),
+            shm_stream_buffer_capacity(stream), shm_stream_event_size(stream),
+            events, events_num);
+    }
+    if (!rec && !tf) {
+        shm_stream_destroy(stream);
+        return 1;
+    }
+
+    signal(SIGINT, on_interrupt);
+    signal(SIGTERM, on_interrupt);
+
+    shm_stream_attach(stream);
+
+    const size_t ev_size = shm_stream_event_size(stream);
+    unsigned char *tmp = xalloc(ev_size);
+    const uint64_t start = now_ns();
+    uint64_t sleep_time = SLEEP_NS_INIT;
+    size_t n = 0, num;
+    while (!interrupted) {
+        unsigned char *evs = shm_stream_read_events(stream, &num);
+        if (num == 0) {
+            if (shm_stream_is_finished(stream))
+                break;
+            if (sleep_time < SLEEP_THRESHOLD_NS)
+                sleep_time *= 2;
+            sleep_ns(sleep_time);
+            continue;
+        }
+        sleep_time = SLEEP_NS_INIT;
+
+        /* all the events that we got at once share the timestamp */
+        const uint64_t time = now_ns() - start;
+        shm_event *ev = NULL;
+        for (size_t i = 0; i < num; ++i) {
+            ev = (shm_event *)(evs + i * ev_size);
+            if (tf)
+                write_trace_event(tf, stream, ev, time, tmp);
+            else
+                record_event(rec, stream, ev, time);
+        }
+        n += num;
+
+        shm_stream_consume(stream, num);
+        shm_stream_notify_last_processed_id(stream, shm_event_id(ev));
+    }
+
+    fprintf(stderr, "Recorded %lu events%s\n", n,
+            interrupted ? " (interrupted)" : "");
+
+    const int ret =
+        tf ? shm_trace_file_writer_close(tf) : shm_recording_close(rec);
+    shm_stream_destroy(stream);
+    free(tmp);
+
+    return ret == 0 ? 0 : 1;
+}
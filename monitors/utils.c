@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "buffer.h"
 #include "monitors-utils.h"
 #include "source.h"
 #include "stream.h"
@@ -36,3 +37,9 @@ shm_stream *create_stream(int argc, char *argv[], int arg_i,
 
     return stream;
 }
+
+const char *stream_get_key(shm_stream *stream) {
+    if (stream->incoming_events_buffer)
+        return buffer_get_key(stream->incoming_events_buffer);
+    return shm_stream_get_name(stream);
+}
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <sys/mman.h>
 
@@ -54,14 +55,38 @@ void aux_buffer_destroy(struct aux_buffer *buffer) {
 }
 */
 
+/* aux buffers are named after their buffer, so that different buffers
+ * (e.g., a buffer and its sub-buffers) do not share them */
+static void aux_buffer_key(struct buffer *buff, size_t idx,
+                           char key[SHM_NAME_MAXLEN]) {
+    const int n = snprintf(key, SHM_NAME_MAXLEN, "%s.aux.%lu", buff->key, idx);
+    assert(n > 0 && n < SHM_NAME_MAXLEN && "The key is too long");
+    (void)n;
+}
+
+/* remove the aux buffers of the buffer, the buffers are numbered
+ * from 0, so we stop at the first one that does not exist */
+HIDE_SYMBOL
+void aux_buffers_unlink(struct buffer *buff) {
+    char key[SHM_NAME_MAXLEN];
+    for (size_t idx = 0;; ++idx) {
+        aux_buffer_key(buff, idx, key);
+        if (shamon_shm_unlink(key) != 0) {
+            if (errno != ENOENT)
+                perror("aux_buffers_unlink: shm_unlink failure");
+            break;
+        }
+    }
+}
+
 static struct aux_buffer *new_aux_buffer(struct buffer *buff, size_t size) {
     size_t idx = buff->aux_buf_idx++;
     const size_t pg_size = sysconf(_SC_PAGESIZE);
     size = (((size + sizeof(struct aux_buffer)) / pg_size) + 2) * pg_size;
 
     /* create the key */
-    char key[20];
-    snprintf(key, 19, "/aux.%lu", idx);
+    char key[SHM_NAME_MAXLEN];
+    aux_buffer_key(buff, idx, key);
 
     /* printf("Initializing aux buffer %s\n", key); */
 
@@ -127,11 +152,12 @@ struct aux_buffer *writer_get_aux_buffer(struct buffer *buff, size_t size) {
     if (!buff->cur_aux_buff ||
         aux_buffer_free_space(buff->cur_aux_buff) < size) {
         /* try to find a free buffer */
+        const shm_eventid last_processed_id = buffer_get_last_processed_id(buff);
         struct aux_buffer *ab;
         shm_list_elem *cur = shm_list_first(&buff->aux_buffers_age);
         while (cur) {
             ab = (struct aux_buffer *)cur->data;
-            if (ab->last_event_id <= buff->shmbuffer->info.last_processed_id ||
+            if (ab->last_event_id <= last_processed_id ||
                 ab_was_dropped(ab, buff)) {
                 ab->reusable = true;
                 ab->head = 0;
@@ -177,8 +203,8 @@ struct aux_buffer *reader_get_aux_buffer(struct buffer *buff, size_t idx) {
     }
 
     /* create the key */
-    char key[20];
-    snprintf(key, 19, "/aux.%lu", idx);
+    char key[SHM_NAME_MAXLEN];
+    aux_buffer_key(buff, idx, key);
 
     // printf("Getting aux buffer %s\n", key);
 
@@ -48,7 +48,7 @@ struct source_control *create_shared_control_buffer(
     shamon_map_ctrl_key(buff_key, key);
     size_t size = control->size;
 
-    printf("Initializing control buffer '%s' of size '%lu'\n", key, size);
+    fprintf(stderr, "Initializing control buffer '%s' of size '%lu'\n", key, size);
 
     char tmpkey[SHM_NAME_MAXLEN] = "";
     if (shamon_get_tmp_key(key, tmpkey, SHM_NAME_MAXLEN) == -1) {
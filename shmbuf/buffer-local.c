@@ -29,7 +29,8 @@ struct buffer *initialize_local_buffer(const char *key, size_t elem_size,
     printf("Initializing LOCAL buffer '%s' with elem size '%lu'\n", key,
            elem_size);
     void *mem;
-    const size_t memsize = compute_shm_size(elem_size, capacity);
+    /* the ringbuffer has one unusable dummy element */
+    const size_t memsize = compute_shm_size(elem_size, capacity + 1);
     int succ = posix_memalign(&mem, 64, memsize);
     if (succ != 0) {
         perror("allocation failure");
@@ -64,6 +65,9 @@ struct buffer *initialize_local_buffer(const char *key, size_t elem_size,
     buff->cur_aux_buff = NULL;
     buff->fd = -1;
     buff->control = control;
+    buff->reader = NULL;
+    buff->reader_event = NULL;
+    buff->registry_slot = -1;
 
     puts("Done");
     return buff;
@@ -10,6 +10,7 @@
 #include "core/list.h"
 #include "core/spsc_ringbuf.h"
 #include "core/vector-macro.h"
+#include "shmbuf/buffer.h"
 
 struct source_control;
 struct event_record;
@@ -30,6 +31,24 @@ struct dropped_range {
     shm_eventid end;
 };
 
+/* a reader of a broadcast buffer */
+struct buffer_reader {
+    /* the position of the reader in the ringbuf */
+    CACHELINE_ALIGNED _Atomic size_t tail;
+    _Atomic shm_eventid last_processed_id;
+    _Atomic size_t dropped;
+    /* the slot is taken by a reader */
+    _Atomic _Bool used;
+    /* the writer takes the tail of the reader into account */
+    _Atomic _Bool active;
+    /* the writer does not overwrite events that the reader did not consume
+     * (it can change when the primary reader leaves) */
+    _Atomic _Bool gating;
+    /* the reader becomes primary, the writer makes it gating */
+    _Atomic _Bool promote;
+    _Bool attached;
+};
+
 struct buffer_info {
     shm_spsc_ringbuf ringbuf;
 
@@ -45,6 +64,19 @@ struct buffer_info {
     /* the monitored program exited/destroyed the buffer */
     volatile _Bool destroyed;
     volatile _Bool monitor_attached;
+    /* Broadcast buffers. In these buffers, the tail of the ringbuf is
+     * maintained by the writer and it is the tail of the slowest gating
+     * reader. */
+    _Bool broadcast;
+    enum shm_broadcast_policy broadcast_policy;
+    /* the number of attached readers that the writer waits for */
+    size_t readers_wait;
+    _Atomic size_t readers_attached;
+    /* the slot of the primary reader or -1 */
+    _Atomic int primary;
+    /* spin lock, readers that come and go hand over the primary slot */
+    _Atomic _Bool readers_lock;
+    struct buffer_reader readers[SHM_BUFFER_MAX_READERS];
 } __attribute__((aligned(CACHELINE_SIZE)));
 
 struct shmbuffer {
@@ -83,6 +115,15 @@ struct buffer {
     mode_t mode;
     /* The number of the last subbufer */
     _Atomic size_t last_subbufer_no;
+    /* the reader slot if this is a reader of a broadcast buffer */
+    struct buffer_reader *reader;
+    /* a non-gating reader gets a copy of the event, because the writer
+     * may overwrite the event in the buffer while it is being processed */
+    void *reader_event;
+    /* the slot in the registry of buffers where the buffer was announced
+     * (-1 if it was not announced) and the number of the announcement */
+    int registry_slot;
+    uint32_t registry_gen;
 };
 
 #define _ringbuf(buff) (&buff->shmbuffer->info.ringbuf)
@@ -90,11 +131,17 @@ struct buffer {
 struct buffer *initialize_shared_buffer(const char *key, mode_t mode,
                                         size_t elem_size, size_t capacity,
                                         struct source_control *control);
+struct buffer *initialize_shared_broadcast_buffer(
+    const char *key, mode_t mode, size_t elem_size, size_t capacity,
+    struct source_control *control, size_t readers,
+    enum shm_broadcast_policy policy);
 
 struct buffer *get_shared_buffer(const char *key);
 struct buffer *try_get_shared_buffer(const char *key, size_t retry);
 
 size_t compute_shm_size(size_t elem_size, size_t capacity);
+shm_eventid buffer_get_last_processed_id(struct buffer *buff);
+size_t buffer_release_reader(struct buffer *buff);
 
 /*** LOCAL buffers ***/
 struct buffer *initialize_local_buffer(const char *key, size_t elem_size,
@@ -115,6 +162,7 @@ size_t aux_buffer_free_space(struct aux_buffer *buff);
 void aux_buffer_release(struct aux_buffer *buffer);
 struct aux_buffer *writer_get_aux_buffer(struct buffer *buff, size_t size);
 struct aux_buffer *reader_get_aux_buffer(struct buffer *buff, size_t idx);
+void aux_buffers_unlink(struct buffer *buff);
 
 void drop_ranges_lock(struct buffer *buff);
 void drop_ranges_unlock(struct buffer *buff);
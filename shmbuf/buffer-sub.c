@@ -31,8 +31,11 @@ struct buffer *create_shared_sub_buffer(struct buffer *buffer, size_t capacity,
     size_t elem_size = source_control_max_event_size(ctrl);
     if (capacity == 0)
         capacity = buffer_capacity(buffer);
-    struct buffer *sbuf =
-        initialize_shared_buffer(key, S_IRWXU, elem_size, capacity, ctrl);
+    /* sub-buffers are read by the same monitors as the parent buffer */
+    struct buffer_info *info = &buffer->shmbuffer->info;
+    struct buffer *sbuf = initialize_shared_broadcast_buffer(
+        key, S_IRWXU, elem_size, capacity, ctrl,
+        info->broadcast ? info->readers_wait : 0, info->broadcast_policy);
     /* XXX: we copy the key in 'initialize_shared_buffer' which is redundant as
      * we have created it in `get_sub_buffer_key` and can just move it */
     free(key);
@@ -75,6 +78,9 @@ void destroy_shared_sub_buffer(struct buffer *buff) {
 
 /* for readers */
 void release_shared_sub_buffer(struct buffer *buff) {
+    /* sub-buffers are removed by the last reader */
+    const bool last_reader = buffer_release_reader(buff) == 0;
+
     if (munmap(buff->shmbuffer, buff->shmbuffer->info.allocated_size) != 0) {
         perror("release_shared_sub_buffer: munmap failure");
     }
@@ -89,12 +95,16 @@ void release_shared_sub_buffer(struct buffer *buff) {
     }
     VEC_DESTROY(buff->aux_buffers);
 
-    if (shamon_shm_unlink(buff->key) != 0) {
-        perror("release_shared_sub_buffer: shm_unlink failure");
+    if (last_reader) {
+        if (shamon_shm_unlink(buff->key) != 0) {
+            perror("release_shared_sub_buffer: shm_unlink failure");
+        }
+        aux_buffers_unlink(buff);
+        destroy_shared_control_buffer(buff->key, buff->control);
+    } else {
+        release_shared_control_buffer(buff->control);
     }
 
-    destroy_shared_control_buffer(buff->key, buff->control);
-
     free(buff->key);
     free(buff);
 }
@@ -17,6 +17,7 @@
 
 #include "buffer-private.h"
 #include "list.h"
+#include "registry.h"
 #include "shm.h"
 #include "source.h"
 #include "spsc_ringbuf.h"
@@ -28,7 +29,36 @@ bool buffer_is_ready(struct buffer *buff) {
 }
 
 bool buffer_monitor_attached(struct buffer *buff) {
-    return buff->shmbuffer->info.monitor_attached;
+    struct buffer_info *info = &buff->shmbuffer->info;
+    if (info->broadcast)
+        return info->readers_attached >= info->readers_wait;
+    return info->monitor_attached;
+}
+
+bool buffer_is_broadcast(struct buffer *buff) {
+    return buff->shmbuffer->info.broadcast;
+}
+
+size_t buffer_get_readers_num(struct buffer *buff) {
+    return buff->shmbuffer->info.readers_attached;
+}
+
+size_t buffer_get_dropped_num(struct buffer *buff) {
+    assert(buff->reader && "Not a reader of a broadcast buffer");
+    return buff->reader->dropped;
+}
+
+bool buffer_may_lose_events(struct buffer *buff) {
+    return buff->reader && !atomic_load(&buff->reader->gating);
+}
+
+/* the number of events that the reader did not consume yet */
+static inline size_t reader_size(struct buffer *buff, size_t tail) {
+    shm_spsc_ringbuf *ringbuf = _ringbuf(buff);
+    size_t head = atomic_load_explicit(&ringbuf->head, memory_order_acquire);
+    if (tail <= head)
+        return head - tail;
+    return ringbuf->capacity - tail + head;
 }
 
 size_t buffer_capacity(struct buffer *buff) {
@@ -36,6 +66,8 @@ size_t buffer_capacity(struct buffer *buff) {
 }
 
 size_t buffer_size(struct buffer *buff) {
+    if (buff->reader)
+        return reader_size(buff, buff->reader->tail);
     return shm_spsc_ringbuf_size(_ringbuf(buff));
 }
 
@@ -82,9 +114,10 @@ int buffer_get_ctrl_key_path(struct buffer *buff, char keypath[],
     ((unsigned char *)b->data + (b->info.elem_size * (b->info.capacity + 1)))
 
 HIDE_SYMBOL
-struct buffer *initialize_shared_buffer(const char *key, mode_t mode,
-                                        size_t elem_size, size_t capacity,
-                                        struct source_control *control) {
+struct buffer *initialize_shared_broadcast_buffer(
+    const char *key, mode_t mode, size_t elem_size, size_t capacity,
+    struct source_control *control, size_t readers,
+    enum shm_broadcast_policy policy) {
     assert(elem_size > 0 && "Element size is 0");
     assert(capacity > 0 && "Capacity is 0");
     /* the ringbuffer has one unusable dummy element, so increase the capacity
@@ -146,6 +179,13 @@ struct buffer *initialize_shared_buffer(const char *key, mode_t mode,
     buff->shmbuffer->info.dropped_ranges_next = 0;
     buff->shmbuffer->info.dropped_ranges_lock = false;
     buff->shmbuffer->info.subbuffers_no = 0;
+    if (readers > 0) {
+        assert(readers <= SHM_BUFFER_MAX_READERS && "Too many readers");
+        buff->shmbuffer->info.broadcast = true;
+        buff->shmbuffer->info.broadcast_policy = policy;
+        buff->shmbuffer->info.readers_wait = readers;
+        buff->shmbuffer->info.primary = -1;
+    }
 
     fprintf(stderr, "  .. buffer allocated size = %lu, capacity = %lu\n",
             buff->shmbuffer->info.allocated_size,
@@ -172,6 +212,9 @@ struct buffer *initialize_shared_buffer(const char *key, mode_t mode,
     buff->control = control;
     buff->mode = mode;
     buff->last_subbufer_no = 0;
+    buff->reader = NULL;
+    buff->reader_event = NULL;
+    buff->registry_slot = -1;
 
     if (shamon_shm_rename(tmpkey, key) < 0) {
         perror("renaming SHM file");
@@ -186,7 +229,29 @@ struct buffer *initialize_shared_buffer(const char *key, mode_t mode,
         return NULL;
     }
 
-    puts("Done");
+    fputs("Done\n", stderr);
+    return buff;
+}
+
+HIDE_SYMBOL
+struct buffer *initialize_shared_buffer(const char *key, mode_t mode,
+                                        size_t elem_size, size_t capacity,
+                                        struct source_control *control) {
+    return initialize_shared_broadcast_buffer(key, mode, elem_size, capacity,
+                                              control, 0, 0);
+}
+
+/* Announce the new buffer in the registry of buffers (if there is some),
+ * so that a host process can attach to it right away */
+static struct buffer *announce_buffer(struct buffer *buff) {
+    if (!buff)
+        return NULL;
+    struct shm_registry *reg = shm_registry_open(shm_registry_key());
+    if (reg) {
+        buff->registry_slot =
+            shm_registry_announce(reg, buff->key, &buff->registry_gen);
+        shm_registry_close(reg);
+    }
     return buff;
 }
 
@@ -200,7 +265,8 @@ struct buffer *create_shared_buffer(const char *key, size_t capacity,
     }
 
     size_t elem_size = source_control_max_event_size(ctrl);
-    return initialize_shared_buffer(key, S_IRWXU, elem_size, capacity, ctrl);
+    return announce_buffer(
+        initialize_shared_buffer(key, S_IRWXU, elem_size, capacity, ctrl));
 }
 
 struct buffer *create_shared_buffer_adv(const char *key, mode_t mode,
@@ -221,21 +287,184 @@ struct buffer *create_shared_buffer_adv(const char *key, mode_t mode,
         mode = S_IRWXU;
     }
 
-    return initialize_shared_buffer(key, mode, elem_size, capacity, ctrl);
+    return announce_buffer(
+        initialize_shared_buffer(key, mode, elem_size, capacity, ctrl));
+}
+
+struct buffer *create_shared_broadcast_buffer(
+    const char *key, size_t capacity, const struct source_control *control,
+    size_t readers, enum shm_broadcast_policy policy) {
+    if (readers == 0 || readers > SHM_BUFFER_MAX_READERS) {
+        fprintf(stderr, "The number of readers must be between 1 and %d\n",
+                SHM_BUFFER_MAX_READERS);
+        return NULL;
+    }
+
+    struct source_control *ctrl =
+        create_shared_control_buffer(key, S_IRWXU, control);
+    if (!ctrl) {
+        fprintf(stderr, "Failed creating control buffer\n");
+        return NULL;
+    }
+
+    size_t elem_size = source_control_max_event_size(ctrl);
+    return announce_buffer(initialize_shared_broadcast_buffer(
+        key, S_IRWXU, elem_size, capacity, ctrl, readers, policy));
+}
+
+static void readers_lock(struct buffer_info *info) {
+    _Bool unlocked = false;
+    while (!atomic_compare_exchange_weak(&info->readers_lock, &unlocked,
+                                         true)) {
+        unlocked = false;
+    }
+}
+
+static void readers_unlock(struct buffer_info *info) {
+    atomic_store(&info->readers_lock, false);
+}
+
+/* the number of events between the position `t` and the head */
+static size_t reader_lag(struct buffer_info *info, size_t head, size_t t) {
+    const size_t capacity = info->ringbuf.capacity;
+    return (head + capacity - t) % capacity;
+}
+
+/* Take a free reader slot of a broadcast buffer. The reader starts with
+ * the oldest event that the writer keeps in the buffer. */
+static struct buffer_reader *claim_reader(struct buffer_info *info) {
+    readers_lock(info);
+    for (size_t i = 0; i < SHM_BUFFER_MAX_READERS; ++i) {
+        struct buffer_reader *r = &info->readers[i];
+        _Bool used = false;
+        if (!atomic_compare_exchange_strong(&r->used, &used, true))
+            continue;
+
+        /* with SHM_BROADCAST_PRIMARY, the reader that takes
+         * the free primary slot becomes primary */
+        int none = -1;
+        r->gating = info->broadcast_policy == SHM_BROADCAST_SLOWEST ||
+                    atomic_compare_exchange_strong(&info->primary, &none,
+                                                   (int)i);
+        r->promote = false;
+        r->attached = false;
+        r->dropped = 0;
+        r->last_processed_id = 0;
+
+        /* the writer may move the tail of the ringbuf before it notices
+         * the new reader, so check that the tail did not move after
+         * we became active */
+        size_t tail = atomic_load(&info->ringbuf.tail);
+        r->tail = tail;
+        atomic_store(&r->active, true);
+        while (tail != atomic_load(&info->ringbuf.tail)) {
+            tail = atomic_load(&info->ringbuf.tail);
+            r->tail = tail;
+        }
+        readers_unlock(info);
+        return r;
+    }
+    readers_unlock(info);
+    return NULL;
+}
+
+/* The primary reader `r` leaves, make the reader that is closest
+ * to the head primary. The writer may be overwriting the events behind
+ * the tail of the ringbuf right now, so it is the writer that makes
+ * the reader gating (see broadcast_update_tail).
+ * Called with the readers lock held. */
+static void handoff_primary(struct buffer_info *info,
+                            struct buffer_reader *r) {
+    const size_t head = atomic_load(&info->ringbuf.head);
+    struct buffer_reader *next = NULL;
+    size_t next_lag = 0;
+    for (size_t i = 0; i < SHM_BUFFER_MAX_READERS; ++i) {
+        struct buffer_reader *other = &info->readers[i];
+        if (other == r || !atomic_load(&other->active))
+            continue;
+        const size_t lag = reader_lag(info, head, other->tail);
+        if (!next || lag < next_lag) {
+            next = other;
+            next_lag = lag;
+        }
+    }
+
+    if (!next) {
+        atomic_store(&info->primary, -1);
+        return;
+    }
+    atomic_store(&next->promote, true);
+    atomic_store(&info->primary, (int)(next - info->readers));
+}
+
+/* Free the reader slot, returns the number of other readers
+ * that still use the buffer */
+HIDE_SYMBOL
+size_t buffer_release_reader(struct buffer *buff) {
+    struct buffer_reader *r = buff->reader;
+    if (!r)
+        return 0;
+    struct buffer_info *info = &buff->shmbuffer->info;
+    if (r->attached)
+        --info->readers_attached;
+    r->attached = false;
+
+    /* If the primary reader leaves, nobody would move the tail of the
+     * ringbuf and the writer would get stuck. Make another reader primary
+     * before we leave, so that there is always a gating reader. */
+    readers_lock(info);
+    if (atomic_load(&info->primary) == (int)(r - info->readers))
+        handoff_primary(info, r);
+    atomic_store(&r->promote, false);
+    atomic_store(&r->active, false);
+    atomic_store(&r->used, false);
+    readers_unlock(info);
+    buff->reader = NULL;
+    free(buff->reader_event);
+    buff->reader_event = NULL;
+
+    size_t num = 0;
+    for (size_t i = 0; i < SHM_BUFFER_MAX_READERS; ++i) {
+        if (buff->shmbuffer->info.readers[i].used)
+            ++num;
+    }
+    return num;
 }
 
 struct buffer *try_get_shared_buffer(const char *key, size_t retry) {
     fprintf(stderr, "getting shared buffer '%s'\n", key);
 
+    /* if there is a registry of buffers, we are woken up when a new buffer
+     * is announced instead of polling */
+    struct shm_registry *reg = NULL;
+    if (retry > 0)
+        reg = shm_registry_open(shm_registry_key());
+
+    /* we wait for the buffer at most `retry` times 300 ms, announcements
+     * of other buffers only wake us up to try again */
+    const uint64_t deadline = now_ns() + retry * 300 * 1000000ULL;
     int fd = -1;
-    ++retry;
-    do {
+    for (;;) {
+        /* get the sequence number before opening the buffer,
+         * so that we do not miss an announcement in between */
+        const uint32_t seq = reg ? shm_registry_seq(reg) : 0;
         fd = shamon_shm_open(key, O_RDWR, S_IRWXU);
         if (fd >= 0) {
             break;
         }
-        sleep_ms(300);
-    } while (--retry > 0);
+        const uint64_t now = now_ns();
+        if (now >= deadline) {
+            break;
+        }
+        const uint64_t timeout_ms = (deadline - now + 999999) / 1000000;
+        if (reg) {
+            shm_registry_wait(reg, seq, timeout_ms < 300 ? timeout_ms : 300);
+        } else {
+            sleep_ms(timeout_ms < 300 ? timeout_ms : 300);
+        }
+    }
+    if (reg)
+        shm_registry_close(reg);
 
     if (fd == -1) {
         perror("shm_open");
@@ -293,6 +522,25 @@ struct buffer *try_get_shared_buffer(const char *key, size_t retry) {
     buff->cur_aux_buff = NULL;
     buff->fd = fd;
     buff->mode = 0;
+    buff->reader = NULL;
+    buff->reader_event = NULL;
+    buff->registry_slot = -1;
+
+    if (buff->shmbuffer->info.broadcast) {
+        buff->reader = claim_reader(&buff->shmbuffer->info);
+        if (!buff->reader) {
+            /* do not unlink the buffer, other readers use it */
+            fprintf(stderr, "All reader slots of buffer '%s' are taken\n",
+                    key);
+            release_shared_control_buffer(buff->control);
+            VEC_DESTROY(buff->aux_buffers);
+            free(buff->key);
+            free(buff);
+            munmap(shmmem, info.allocated_size);
+            close(fd);
+            return NULL;
+        }
+    }
 
     return buff;
 
@@ -313,6 +561,19 @@ before_mmap_clean:
     return NULL;
 }
 
+bool buffer_claim(struct buffer *buff) {
+    /* every reader of a broadcast buffer gets all events */
+    if (buff->shmbuffer->info.broadcast)
+        return true;
+    /* the lock is dropped when we close the fd (also if we crash) */
+    if (flock(buff->fd, LOCK_EX | LOCK_NB) == -1) {
+        fprintf(stderr, "Buffer '%s' is already claimed by another reader\n",
+                buff->key);
+        return false;
+    }
+    return true;
+}
+
 struct buffer *get_shared_buffer(const char *key) {
     return try_get_shared_buffer(key, 10);
 }
@@ -328,19 +589,67 @@ struct event_record *buffer_get_avail_events(struct buffer *buff,
 }
 
 void buffer_set_attached(struct buffer *buff, bool val) {
-    if (!buff->shmbuffer->info.destroyed)
-        buff->shmbuffer->info.monitor_attached = val;
+    if (buff->shmbuffer->info.destroyed)
+        return;
+
+    struct buffer_reader *r = buff->reader;
+    if (r) {
+        if (r->attached != val) {
+            r->attached = val;
+            if (val)
+                ++buff->shmbuffer->info.readers_attached;
+            else
+                --buff->shmbuffer->info.readers_attached;
+        }
+        return;
+    }
+
+    buff->shmbuffer->info.monitor_attached = val;
 }
 
 /* set the ID of the last processed event */
 void buffer_set_last_processed_id(struct buffer *buff, shm_eventid id) {
+    if (buff->reader) {
+        assert(buff->reader->last_processed_id <= id &&
+               "The IDs are not monotonic");
+        buff->reader->last_processed_id = id;
+        return;
+    }
+
     assert(buff->shmbuffer->info.last_processed_id <= id &&
            "The IDs are not monotonic");
     buff->shmbuffer->info.last_processed_id = id;
 }
 
+/* The ID of the last event that all readers processed
+ * (used by the writer for the garbage collection of aux buffers) */
+HIDE_SYMBOL
+shm_eventid buffer_get_last_processed_id(struct buffer *buff) {
+    struct buffer_info *info = &buff->shmbuffer->info;
+    if (!info->broadcast)
+        return info->last_processed_id;
+
+    shm_eventid id = ~(shm_eventid)0;
+    bool found = false;
+    for (size_t i = 0; i < SHM_BUFFER_MAX_READERS; ++i) {
+        struct buffer_reader *r = &info->readers[i];
+        if (!r->active)
+            continue;
+        found = true;
+        if (r->last_processed_id < id)
+            id = r->last_processed_id;
+    }
+    /* if there are no readers, use the last known value */
+    if (found)
+        info->last_processed_id = id;
+    return info->last_processed_id;
+}
+
 /* for readers */
 void release_shared_buffer(struct buffer *buff) {
+    /* the last reader removes the aux buffers once the writer is done */
+    const bool remove_aux = buffer_release_reader(buff) == 0 &&
+                            buff->shmbuffer->info.destroyed;
     if (munmap(buff->shmbuffer, buff->shmbuffer->info.allocated_size) != 0) {
         perror("release_shared_buffer: munmap failure");
     }
@@ -354,6 +663,8 @@ void release_shared_buffer(struct buffer *buff) {
         aux_buffer_release(ab);
     }
     VEC_DESTROY(buff->aux_buffers);
+    if (remove_aux)
+        aux_buffers_unlink(buff);
 
     release_shared_control_buffer(buff->control);
 
@@ -365,6 +676,16 @@ void release_shared_buffer(struct buffer *buff) {
 void destroy_shared_buffer(struct buffer *buff) {
     buff->shmbuffer->info.destroyed = 1;
 
+    if (buff->registry_slot >= 0) {
+        /* nobody took the buffer from the registry */
+        struct shm_registry *reg = shm_registry_open(shm_registry_key());
+        if (reg) {
+            shm_registry_withdraw(reg, buff->registry_slot,
+                                  buff->registry_gen);
+            shm_registry_close(reg);
+        }
+    }
+
     size_t vecsize = VEC_SIZE(buff->aux_buffers);
     for (size_t i = 0; i < vecsize; ++i) {
         struct aux_buffer *ab = buff->aux_buffers[i];
@@ -391,9 +712,47 @@ void destroy_shared_buffer(struct buffer *buff) {
     free(buff);
 }
 
+/* Copy the oldest event of a non-gating reader. The writer moves the tail
+ * of the reader before it overwrites the event, so if the tail did not move
+ * while we were copying the event, the copy is consistent. Otherwise the
+ * event was dropped (the writer counted it) and we try the next one. */
+static void *reader_copy_event(struct buffer *buff, size_t *size) {
+    struct buffer_info *info = &buff->shmbuffer->info;
+    struct buffer_reader *r = buff->reader;
+    if (!buff->reader_event)
+        buff->reader_event = xalloc(info->elem_size);
+
+    for (;;) {
+        const size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (reader_size(buff, tail) == 0) {
+            *size = 0;
+            return NULL;
+        }
+        memcpy(buff->reader_event,
+               buff->shmbuffer->data + tail * info->elem_size,
+               info->elem_size);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&r->tail, memory_order_relaxed) == tail) {
+            *size = 1;
+            return buff->reader_event;
+        }
+    }
+}
+
 void *buffer_read_pointer(struct buffer *buff, size_t *size) {
     struct buffer_info *info = &buff->shmbuffer->info;
-    size_t tail = shm_spsc_ringbuf_read_off_nowrap(&info->ringbuf, size);
+    size_t tail;
+    if (buff->reader) {
+        if (!atomic_load_explicit(&buff->reader->gating, memory_order_relaxed))
+            return reader_copy_event(buff, size);
+        tail = buff->reader->tail;
+        *size = reader_size(buff, tail);
+        /* return only the contiguous part */
+        if (tail + *size > info->ringbuf.capacity)
+            *size = info->ringbuf.capacity - tail;
+    } else {
+        tail = shm_spsc_ringbuf_read_off_nowrap(&info->ringbuf, size);
+    }
     if (*size == 0)
         return NULL;
     /* TODO: get rid of the multiplication,
@@ -401,14 +760,108 @@ void *buffer_read_pointer(struct buffer *buff, size_t *size) {
     return buff->shmbuffer->data + tail * info->elem_size;
 }
 
+/* Move the tail of a reader of a broadcast buffer. The writer may move it
+ * too if the reader is not gating, so we must use CAS. */
+static size_t reader_consume(struct buffer *buff, size_t k) {
+    struct buffer_reader *r = buff->reader;
+    const size_t capacity = _ringbuf(buff)->capacity;
+    const size_t tail = r->tail;
+    const size_t size = reader_size(buff, tail);
+    if (k > size)
+        k = size;
+
+    const size_t new_tail = (tail + k) % capacity;
+    size_t cur = tail;
+    while (!atomic_compare_exchange_weak(&r->tail, &cur, new_tail)) {
+        /* The writer dropped some events of the reader. If it moved the tail
+         * beyond the consumed events, we are done. */
+        if ((cur + capacity - tail) % capacity >= k)
+            break;
+    }
+    /* the writer counted as dropped also the events that we consumed */
+    size_t skipped = (cur + capacity - tail) % capacity;
+    if (skipped > 0)
+        atomic_fetch_sub(&r->dropped, skipped < k ? skipped : k);
+    return k;
+}
+
 bool buffer_drop_k(struct buffer *buff, size_t k) {
+    if (buff->reader)
+        return reader_consume(buff, k) == k;
     return shm_spsc_ringbuf_consume_upto(_ringbuf(buff), k) == k;
 }
 
 size_t buffer_consume(struct buffer *buff, size_t k) {
+    if (buff->reader)
+        return reader_consume(buff, k);
     return shm_spsc_ringbuf_consume_upto(_ringbuf(buff), k);
 }
 
+/* Make the reader that is going to be primary gating. Its tail must not be
+ * behind the tail of the ringbuf, the events there may be overwritten
+ * already, so they are skipped and counted as dropped. */
+static void broadcast_promote_reader(struct buffer_info *info,
+                                     struct buffer_reader *r, size_t head) {
+    const size_t tail = info->ringbuf.tail;
+    const size_t tail_lag = reader_lag(info, head, tail);
+    /* the reader may consume meanwhile, so use CAS */
+    size_t t = atomic_load(&r->tail);
+    while (reader_lag(info, head, t) > tail_lag) {
+        if (atomic_compare_exchange_strong(&r->tail, &t, tail)) {
+            atomic_fetch_add(&r->dropped, reader_lag(info, head, t) - tail_lag);
+            break;
+        }
+    }
+    atomic_store(&r->gating, true);
+    atomic_store(&r->promote, false);
+}
+
+/* Set the tail of the ringbuf to the tail of the slowest gating reader.
+ * Returns false if there are no gating readers. */
+static bool broadcast_update_tail(struct buffer_info *info) {
+    shm_spsc_ringbuf *ringbuf = &info->ringbuf;
+    const size_t head = ringbuf->head;
+    for (size_t i = 0; i < SHM_BUFFER_MAX_READERS; ++i) {
+        struct buffer_reader *r = &info->readers[i];
+        if (r->active && r->promote)
+            broadcast_promote_reader(info, r, head);
+    }
+    size_t max_size = 0, tail = head;
+    bool found = false;
+    for (size_t i = 0; i < SHM_BUFFER_MAX_READERS; ++i) {
+        struct buffer_reader *r = &info->readers[i];
+        if (!r->active || !r->gating)
+            continue;
+        const size_t t = r->tail;
+        const size_t size =
+            t <= head ? head - t : ringbuf->capacity - t + head;
+        if (!found || size > max_size) {
+            max_size = size;
+            tail = t;
+            found = true;
+        }
+    }
+
+    if (found)
+        atomic_store_explicit(&ringbuf->tail, tail, memory_order_release);
+    return found;
+}
+
+/* Drop the oldest event of non-gating readers that have no space left,
+ * the writer is going to overwrite it. */
+static void broadcast_drop_slow_readers(struct buffer_info *info) {
+    const size_t capacity = info->ringbuf.capacity;
+    const size_t next = (info->ringbuf.head + 1) % capacity;
+    for (size_t i = 0; i < SHM_BUFFER_MAX_READERS; ++i) {
+        struct buffer_reader *r = &info->readers[i];
+        if (!r->active || r->gating)
+            continue;
+        size_t t = next;
+        if (atomic_compare_exchange_strong(&r->tail, &t, (next + 1) % capacity))
+            ++r->dropped;
+    }
+}
+
 /* buffer_push broken down into several operations:
  *
  *  p = buffer_start_push(...)
@@ -429,6 +882,9 @@ void *buffer_start_push(struct buffer *buff) {
     struct buffer_info *info = &buff->shmbuffer->info;
     assert(!info->destroyed && "Writing to a destroyed buffer");
 
+    if (info->broadcast)
+        broadcast_update_tail(info);
+
     size_t n;
     size_t off = shm_spsc_ringbuf_write_off_nowrap(_ringbuf(buff), &n);
     if (n == 0) {
@@ -436,6 +892,9 @@ void *buffer_start_push(struct buffer *buff) {
         return NULL;
     }
 
+    if (info->broadcast)
+        broadcast_drop_slow_readers(info);
+
     /* all ok, return the pointer to the data */
     /* FIXME: do not use multiplication, maintain the pointer to the head of
      * data */
@@ -486,6 +945,31 @@ void *buffer_partial_push_str_n(struct buffer *buff, void *prev_push,
     return (unsigned char *)prev_push + sizeof(uint64_t);
 }
 
+void *buffer_partial_push_bytes_str(struct buffer *buff, void *prev_push,
+                                    uint64_t evid, const void *data,
+                                    size_t len) {
+    assert(!buff->shmbuffer->info.destroyed && "Writing to a destroyed buffer");
+    assert(BUFF_START(buff->shmbuffer) <= (unsigned char *)prev_push);
+    assert((unsigned char *)prev_push < BUFF_END(buff->shmbuffer));
+
+    struct aux_buffer *ab = writer_get_aux_buffer(buff, len + 1);
+    assert(ab);
+    assert(ab == buff->cur_aux_buff);
+
+    size_t off = ab->head;
+    assert(off < (1LU << 32));
+    memcpy(ab->data + off, data, len);
+    ab->data[off + len] = '\0';
+    ab->head += len + 1;
+
+    if (ab->first_event_id == 0)
+        ab->first_event_id = evid;
+    ab->last_event_id = evid;
+
+    *((uint64_t *)prev_push) = off | (ab->idx << 32);
+    return (unsigned char *)prev_push + sizeof(uint64_t);
+}
+
 void buffer_finish_push(struct buffer *buff) {
     assert(!buff->shmbuffer->info.destroyed && "Writing to a destroyed buffer");
     shm_spsc_ringbuf_write_finish(_ringbuf(buff), 1);
@@ -514,7 +998,7 @@ bool buffer_pop(struct buffer *buff, void *dst) {
     void *pos = buffer_read_pointer(buff, &size);
     if (size > 0) {
         memcpy(dst, pos, buff->shmbuffer->info.elem_size);
-        shm_spsc_ringbuf_consume(_ringbuf(buff), 1);
+        buffer_consume(buff, 1);
         return true;
     }
 
@@ -563,6 +1047,11 @@ uint64_t buffer_push_strn(struct buffer *buff, uint64_t evid, const char *str,
 void buffer_notify_dropped(struct buffer *buff, uint64_t begin_id,
                            uint64_t end_id) {
     struct buffer_info *info = &buff->shmbuffer->info;
+    /* other readers of a broadcast buffer may still need the events,
+     * the garbage collection uses only the last processed IDs there */
+    if (info->broadcast)
+        return;
+
     size_t idx = info->dropped_ranges_next;
     struct dropped_range *r = &info->dropped_ranges[idx];
     if (r->begin == begin_id || r->end == r->begin - 1) {
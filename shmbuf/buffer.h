@@ -19,8 +19,44 @@ struct buffer *create_shared_sub_buffer(struct buffer *buffer, size_t capacity,
                                         const struct source_control *control);
 size_t buffer_get_sub_buffers_no(struct buffer *buffer);
 
+/* Broadcast buffers deliver every event to every reader (monitor) that gets
+ * the buffer, so several monitors can share one source. Every reader has its
+ * own tail and the aux (string) buffers are reused only after all readers
+ * processed the events. The readers must register the same kinds for events
+ * (e.g., all use buffer_register_all_events), because the kinds are stored in
+ * the (shared) control buffer. */
+#define SHM_BUFFER_MAX_READERS 8
+
+enum shm_broadcast_policy {
+    /* the writer waits for the slowest reader */
+    SHM_BROADCAST_SLOWEST = 1,
+    /* the writer waits only for the primary reader (the first reader that got
+     * the buffer), other readers that fall behind lose their oldest events.
+     * When the primary reader leaves, another reader becomes primary. */
+    SHM_BROADCAST_PRIMARY = 2,
+};
+
+/* `readers` is the number of readers that must attach before
+ * buffer_monitor_attached returns true */
+struct buffer *create_shared_broadcast_buffer(
+    const char *key, size_t capacity, const struct source_control *control,
+    size_t readers, enum shm_broadcast_policy policy);
+bool buffer_is_broadcast(struct buffer *buffer);
+size_t buffer_get_readers_num(struct buffer *buffer);
+/* the number of events that this reader lost because it was too slow */
+size_t buffer_get_dropped_num(struct buffer *buffer);
+/* True for readers that the writer does not wait for (non-primary readers
+ * with SHM_BROADCAST_PRIMARY). These readers read events one by one
+ * and the lost events make a gap in the IDs of events. */
+bool buffer_may_lose_events(struct buffer *buffer);
+
 struct buffer *try_get_shared_buffer(const char *key, size_t retry);
 struct buffer *get_shared_buffer(const char *key);
+/* Claim a non-broadcast buffer for this reader, so that two readers that
+ * both claim it (e.g., two hosts) do not consume the same events. Returns
+ * false if another reader claimed the buffer. Readers that do not claim
+ * buffers (monitors, shamon-record, ...) are not affected. */
+bool buffer_claim(struct buffer *);
 struct event_record *buffer_get_avail_events(struct buffer *, size_t *);
 
 int buffer_get_key_path(struct buffer *, char keypath[], size_t keypathsize);
@@ -59,6 +95,11 @@ void *buffer_partial_push_str(struct buffer *buff, void *prev_push,
                               uint64_t evid, const char *str);
 void *buffer_partial_push_str_n(struct buffer *buff, void *prev_push,
                                 uint64_t evid, const char *str, size_t len);
+/* push `len` bytes of `data` as a string, the terminating 0 is added
+ * in the shared memory (for data that we cannot terminate in place) */
+void *buffer_partial_push_bytes_str(struct buffer *buff, void *prev_push,
+                                    uint64_t evid, const void *data,
+                                    size_t len);
 void buffer_finish_push(struct buffer *buff);
 
 struct aux_buff_ptr {
@@ -0,0 +1,125 @@
+#include "mux.h"
+
+#include <assert.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "buffer.h"
+#include "core/signatures.h"
+#include "core/source.h"
+#include "core/utils.h"
+
+struct shm_mux {
+    struct buffer *buffer;
+    /* the writers hold the lock from start_push to finish_push */
+    atomic_flag lock;
+    shm_eventid last_id;
+    _Atomic shm_mux_channel last_channel;
+};
+
+/* prepend the channel to the signatures of events */
+static struct source_control *
+mux_control(const struct source_control *control) {
+    struct source_control *mc = xalloc(control->size);
+    memcpy(mc, control, control->size);
+
+    const size_t en =
+        source_control_get_records_num((struct source_control *)control);
+    for (size_t i = 0; i < en; ++i) {
+        struct event_record *rec = &mc->events[i];
+        const size_t len = strlen((const char *)rec->signature);
+        if (len + 1 >= sizeof(rec->signature)) {
+            fprintf(stderr, "The signature of event '%s' is too long\n",
+                    rec->name);
+            free(mc);
+            return NULL;
+        }
+        memmove(rec->signature + 1, rec->signature, len + 1);
+        rec->signature[0] = 'i';
+        rec->size += signature_op_get_size('i');
+    }
+    return mc;
+}
+
+struct shm_mux *shm_mux_create(const char *key, size_t capacity,
+                               const struct source_control *control) {
+    struct source_control *mc = mux_control(control);
+    if (!mc)
+        return NULL;
+
+    struct buffer *buffer = create_shared_buffer(key, capacity, mc);
+    free(mc);
+    if (!buffer)
+        return NULL;
+
+    struct shm_mux *mux = xalloc(sizeof(*mux));
+    mux->buffer = buffer;
+    atomic_flag_clear(&mux->lock);
+    mux->last_id = 0;
+    atomic_init(&mux->last_channel, 0);
+    return mux;
+}
+
+void shm_mux_destroy(struct shm_mux *mux) {
+    destroy_shared_buffer(mux->buffer);
+    free(mux);
+}
+
+struct buffer *shm_mux_buffer(struct shm_mux *mux) { return mux->buffer; }
+
+shm_mux_channel shm_mux_open_channel(struct shm_mux *mux) {
+    return atomic_fetch_add(&mux->last_channel, 1) + 1;
+}
+
+static void lock(struct shm_mux *mux) {
+    unsigned spinned = 0;
+    while (atomic_flag_test_and_set_explicit(&mux->lock,
+                                             memory_order_acquire)) {
+        if (++spinned > SPIN_LIMIT) {
+            sched_yield();
+            spinned = 0;
+        }
+    }
+}
+
+static void unlock(struct shm_mux *mux) {
+    atomic_flag_clear_explicit(&mux->lock, memory_order_release);
+}
+
+void *shm_mux_start_push(struct shm_mux *mux, shm_mux_channel channel,
+                         shm_kind kind) {
+    lock(mux);
+
+    shm_event *ev;
+    unsigned spinned = 0;
+    while (!(ev = buffer_start_push(mux->buffer))) {
+        if (++spinned > SPIN_LIMIT) {
+            sched_yield();
+            spinned = 0;
+        }
+    }
+
+    /* the IDs must be assigned under the lock,
+     * so that they increase in the buffer */
+    ev->id = ++mux->last_id;
+    ev->kind = kind;
+    int ch = (int)channel;
+    return buffer_partial_push(mux->buffer, ev + 1, &ch, sizeof(ch));
+}
+
+void shm_mux_finish_push(struct shm_mux *mux) {
+    buffer_finish_push(mux->buffer);
+    unlock(mux);
+}
+
+shm_eventid shm_mux_current_id(struct shm_mux *mux) { return mux->last_id; }
+
+void shm_mux_push(struct shm_mux *mux, shm_mux_channel channel, shm_kind kind,
+                  const void *args, size_t size) {
+    void *addr = shm_mux_start_push(mux, channel, kind);
+    if (size > 0)
+        buffer_partial_push(mux->buffer, addr, args, size);
+    shm_mux_finish_push(mux);
+}
@@ -0,0 +1,64 @@
+/***********************************************
+ * Multiplexed buffers: one shared-memory buffer for many writer threads.
+ *
+ * Instead of a sub-buffer for every thread of the monitored program,
+ * all threads (or any other logical channels) write into one buffer.
+ * Every event carries the ID of its channel as its first argument
+ * (of the type 'i'), so monitors see the channel as an ordinary attribute
+ * of the event. The writers serialize on a spin lock, and the IDs of events
+ * increase across all the channels in the buffer.
+ *
+ * A program with many short-lived threads can use a few multiplexed
+ * buffers (e.g., a buffer for every group of threads) instead of
+ * mapping a buffer for every thread.
+ ************************************************/
+
+#ifndef SHAMON_SHM_MUX_H_
+#define SHAMON_SHM_MUX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "core/event.h"
+
+struct buffer;
+struct source_control;
+struct shm_mux;
+
+typedef uint32_t shm_mux_channel;
+
+/* Create the buffer `key` for events from `control`. The events get
+ * the channel as their first argument, `control` itself is not changed. */
+struct shm_mux *shm_mux_create(const char *key, size_t capacity,
+                               const struct source_control *control);
+void shm_mux_destroy(struct shm_mux *mux);
+/* The underlying buffer, e.g., for waiting for the monitor,
+ * getting the kinds of events or for partial pushes */
+struct buffer *shm_mux_buffer(struct shm_mux *mux);
+
+/* Get a new channel, channels are numbered from 1 */
+shm_mux_channel shm_mux_open_channel(struct shm_mux *mux);
+
+/* Start pushing an event of the kind `kind` from `channel`. Returns
+ * the pointer for buffer_partial_push after the channel argument.
+ * The buffer is locked until shm_mux_finish_push. */
+void *shm_mux_start_push(struct shm_mux *mux, shm_mux_channel channel,
+                         shm_kind kind);
+void shm_mux_finish_push(struct shm_mux *mux);
+/* The ID of the event that is being pushed (between start and finish push),
+ * e.g., for pushing strings */
+shm_eventid shm_mux_current_id(struct shm_mux *mux);
+/* Push an event whose arguments (after the channel) are in `args` */
+void shm_mux_push(struct shm_mux *mux, shm_mux_channel channel, shm_kind kind,
+                  const void *args, size_t size);
+
+/* for monitors: the channel of an event from a multiplexed buffer */
+static inline shm_mux_channel shm_mux_event_channel(const shm_event *ev) {
+    int channel;
+    memcpy(&channel, ev + 1, sizeof(channel));
+    return (shm_mux_channel)channel;
+}
+
+#endif /* SHAMON_SHM_MUX_H_ */
@@ -0,0 +1,345 @@
+#include "payload.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "core/utils.h"
+#include "shm.h"
+
+#define PAYLOAD_MAGIC 0x53485041594c4421ULL /* "SHPAYLD!" */
+
+/* the header of every payload in the ring. Entries start at multiples
+ * of its size and the capacity is a power of two, so a header never
+ * wraps around the end of the ring (the data can) */
+struct payload_entry {
+    /* the original length of the data */
+    uint64_t len;
+    /* the number of bytes that were stored */
+    uint64_t stored;
+    /* the ID of the event with the reference */
+    uint64_t evid;
+    _Atomic uint64_t released;
+};
+
+#define ENTRY_SIZE sizeof(struct payload_entry)
+
+struct payload_info {
+    uint64_t magic;
+    uint64_t capacity;
+    uint64_t max_len;
+    /* the monitor closed the ring, do not wait for it */
+    _Atomic bool closed;
+    _Atomic uint64_t truncated;
+    _Atomic uint64_t dropped;
+    /* the writer and the reader positions are on separate cache lines */
+    _Alignas(64) _Atomic uint64_t head;
+    _Alignas(64) _Atomic uint64_t tail;
+};
+
+/* the data start on the page after the info */
+#define DATA_OFFSET 4096
+_Static_assert(sizeof(struct payload_info) <= DATA_OFFSET,
+               "Info does not fit into the page");
+
+struct shm_payload {
+    struct payload_info *info;
+    unsigned char *data;
+    size_t mapped_size;
+    /* capacity - 1 */
+    uint64_t mask;
+    char key[SHM_NAME_MAXLEN];
+};
+
+static void payload_key(const char *buffer_key, char key[SHM_NAME_MAXLEN]) {
+    const int n = snprintf(key, SHM_NAME_MAXLEN, "%s.payload", buffer_key);
+    assert(n > 0 && n < SHM_NAME_MAXLEN && "The key is too long");
+    (void)n;
+}
+
+static inline uint64_t align_entry(uint64_t n) {
+    return (n + ENTRY_SIZE - 1) & ~(uint64_t)(ENTRY_SIZE - 1);
+}
+
+/* the number of bytes that the entry takes in the ring */
+static inline uint64_t entry_size(const struct payload_entry *entry) {
+    return ENTRY_SIZE + align_entry(entry->stored);
+}
+
+static struct shm_payload *map_payload(const char *key, int fd, size_t size) {
+    void *mem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        perror("mmap failure");
+        return NULL;
+    }
+
+    struct shm_payload *payload = xalloc(sizeof(*payload));
+    payload->info = mem;
+    payload->data = (unsigned char *)mem + DATA_OFFSET;
+    payload->mapped_size = size;
+    strncpy(payload->key, key, SHM_NAME_MAXLEN - 1);
+    payload->key[SHM_NAME_MAXLEN - 1] = '\0';
+    return payload;
+}
+
+struct shm_payload *shm_payload_create(const char *buffer_key,
+                                       size_t capacity, size_t max_len) {
+    /* the capacity is a power of two, so the positions can be masked */
+    uint64_t cap = DATA_OFFSET;
+    while (cap < capacity)
+        cap <<= 1;
+
+    char key[SHM_NAME_MAXLEN];
+    payload_key(buffer_key, key);
+    /* initialize the ring under a temporary key,
+     * so that nobody sees it half-initialized */
+    char tmpkey[SHM_NAME_MAXLEN] = "";
+    if (shamon_get_tmp_key(key, tmpkey, SHM_NAME_MAXLEN) == -1) {
+        fprintf(stderr, "Failed creating a tmpkey for '%s'\n", key);
+        return NULL;
+    }
+
+    int fd = shamon_shm_open(tmpkey, O_RDWR | O_CREAT | O_TRUNC, S_IRWXU);
+    if (fd < 0) {
+        perror("shm_open");
+        return NULL;
+    }
+    const size_t size = DATA_OFFSET + cap;
+    if (ftruncate(fd, size) == -1) {
+        perror("ftruncate");
+        close(fd);
+        shamon_shm_unlink(tmpkey);
+        return NULL;
+    }
+
+    struct shm_payload *payload = map_payload(key, fd, size);
+    if (!payload) {
+        shamon_shm_unlink(tmpkey);
+        return NULL;
+    }
+    /* ftruncate zeroed the memory */
+    struct payload_info *info = payload->info;
+    info->capacity = cap;
+    info->max_len = max_len;
+    info->magic = PAYLOAD_MAGIC;
+    payload->mask = cap - 1;
+
+    if (shamon_shm_rename(tmpkey, key) < 0) {
+        perror("renaming SHM file");
+        shamon_shm_unlink(tmpkey);
+        munmap(payload->info, payload->mapped_size);
+        free(payload);
+        return NULL;
+    }
+
+    return payload;
+}
+
+void shm_payload_destroy(struct shm_payload *payload) {
+    if (shamon_shm_unlink(payload->key) != 0) {
+        perror("shm_unlink failure");
+    }
+    if (munmap(payload->info, payload->mapped_size) != 0) {
+        perror("munmap failure");
+    }
+    free(payload);
+}
+
+static void copy_in(struct shm_payload *payload, uint64_t pos,
+                    const void *data, size_t len) {
+    const size_t off = pos & payload->mask;
+    const size_t first = payload->mask + 1 - off;
+    if (len <= first) {
+        memcpy(payload->data + off, data, len);
+    } else {
+        memcpy(payload->data + off, data, first);
+        memcpy(payload->data, (const unsigned char *)data + first,
+               len - first);
+    }
+}
+
+shm_payload_ref shm_payload_push(struct shm_payload *payload, uint64_t evid,
+                                 const void *data, size_t len,
+                                 enum shm_payload_policy policy) {
+    struct payload_info *info = payload->info;
+    const uint64_t capacity = info->capacity;
+
+    size_t stored = len;
+    bool truncated = false;
+    if (info->max_len > 0 && stored > info->max_len) {
+        stored = info->max_len;
+        truncated = true;
+    }
+    if (ENTRY_SIZE + align_entry(stored) > capacity) {
+        stored = capacity - ENTRY_SIZE;
+        truncated = true;
+    }
+
+    /* only we move the head */
+    const uint64_t head =
+        atomic_load_explicit(&info->head, memory_order_relaxed);
+    uint64_t size = ENTRY_SIZE + align_entry(stored);
+    unsigned spinned = 0;
+    for (;;) {
+        const uint64_t free_space =
+            capacity -
+            (head - atomic_load_explicit(&info->tail, memory_order_acquire));
+        if (free_space >= size)
+            break;
+
+        if (policy == SHM_PAYLOAD_WAIT && !atomic_load(&info->closed)) {
+            if (++spinned > SPIN_LIMIT) {
+                sched_yield();
+                spinned = 0;
+            }
+            continue;
+        }
+
+        if (free_space < ENTRY_SIZE) {
+            atomic_fetch_add_explicit(&info->dropped, 1,
+                                      memory_order_relaxed);
+            return SHM_PAYLOAD_NONE;
+        }
+        if (policy == SHM_PAYLOAD_DROP) {
+            stored = 0;
+            atomic_fetch_add_explicit(&info->dropped, 1,
+                                      memory_order_relaxed);
+        } else {
+            /* the free space is a multiple of ENTRY_SIZE */
+            stored = free_space - ENTRY_SIZE;
+            truncated = true;
+        }
+        size = ENTRY_SIZE + align_entry(stored);
+        break;
+    }
+    if (truncated)
+        atomic_fetch_add_explicit(&info->truncated, 1, memory_order_relaxed);
+
+    struct payload_entry *entry =
+        (struct payload_entry *)(payload->data + (head & payload->mask));
+    entry->len = len;
+    entry->stored = stored;
+    entry->evid = evid;
+    atomic_store_explicit(&entry->released, 0, memory_order_relaxed);
+    copy_in(payload, head + ENTRY_SIZE, data, stored);
+
+    atomic_store_explicit(&info->head, head + size, memory_order_release);
+    return head;
+}
+
+void shm_payload_get_stats(struct shm_payload *payload, uint64_t *truncated,
+                           uint64_t *dropped) {
+    *truncated = atomic_load(&payload->info->truncated);
+    *dropped = atomic_load(&payload->info->dropped);
+}
+
+struct shm_payload *shm_payload_open(const char *buffer_key) {
+    char key[SHM_NAME_MAXLEN];
+    payload_key(buffer_key, key);
+
+    int fd = shamon_shm_open(key, O_RDWR, S_IRWXU);
+    if (fd < 0)
+        return NULL;
+
+    struct payload_info info;
+    if (pread(fd, &info, sizeof(info), 0) != sizeof(info) ||
+        info.magic != PAYLOAD_MAGIC) {
+        fprintf(stderr, "'%s' is not a payload ring\n", key);
+        close(fd);
+        return NULL;
+    }
+
+    struct shm_payload *payload =
+        map_payload(key, fd, DATA_OFFSET + info.capacity);
+    if (payload)
+        payload->mask = info.capacity - 1;
+    return payload;
+}
+
+void shm_payload_close(struct shm_payload *payload) {
+    atomic_store(&payload->info->closed, true);
+    if (munmap(payload->info, payload->mapped_size) != 0) {
+        perror("munmap failure");
+    }
+    free(payload);
+}
+
+static struct payload_entry *get_entry(struct shm_payload *payload,
+                                       shm_payload_ref ref) {
+    struct payload_info *info = payload->info;
+    if (ref == SHM_PAYLOAD_NONE || ref % ENTRY_SIZE != 0)
+        return NULL;
+    /* only we move the tail */
+    const uint64_t tail =
+        atomic_load_explicit(&info->tail, memory_order_relaxed);
+    const uint64_t head =
+        atomic_load_explicit(&info->head, memory_order_acquire);
+    if (ref < tail || ref >= head)
+        return NULL;
+
+    struct payload_entry *entry =
+        (struct payload_entry *)(payload->data + (ref & payload->mask));
+    if (atomic_load_explicit(&entry->released, memory_order_relaxed))
+        return NULL;
+    return entry;
+}
+
+bool shm_payload_get_size(struct shm_payload *payload, shm_payload_ref ref,
+                          size_t *stored, size_t *len) {
+    struct payload_entry *entry = get_entry(payload, ref);
+    if (!entry)
+        return false;
+    *stored = entry->stored;
+    *len = entry->len;
+    return true;
+}
+
+const void *shm_payload_chunk(struct shm_payload *payload, shm_payload_ref ref,
+                              size_t offset, size_t *chunk_len) {
+    struct payload_entry *entry = get_entry(payload, ref);
+    if (!entry || offset >= entry->stored)
+        return NULL;
+
+    const size_t off = (ref + ENTRY_SIZE + offset) & payload->mask;
+    const size_t until_end = payload->mask + 1 - off;
+    const size_t rest = entry->stored - offset;
+    *chunk_len = rest < until_end ? rest : until_end;
+    return payload->data + off;
+}
+
+/* free the space of the payloads at the tail that are released
+ * or whose events have IDs up to `evid` */
+static void move_tail(struct shm_payload *payload, uint64_t evid) {
+    struct payload_info *info = payload->info;
+    const uint64_t head =
+        atomic_load_explicit(&info->head, memory_order_acquire);
+    uint64_t tail = atomic_load_explicit(&info->tail, memory_order_relaxed);
+    while (tail < head) {
+        struct payload_entry *entry =
+            (struct payload_entry *)(payload->data + (tail & payload->mask));
+        if (!atomic_load_explicit(&entry->released, memory_order_relaxed) &&
+            (evid == SHM_PAYLOAD_NO_EVENT || entry->evid > evid))
+            break;
+        tail += entry_size(entry);
+    }
+    atomic_store_explicit(&info->tail, tail, memory_order_release);
+}
+
+void shm_payload_release(struct shm_payload *payload, shm_payload_ref ref) {
+    struct payload_entry *entry = get_entry(payload, ref);
+    if (!entry)
+        return;
+    atomic_store_explicit(&entry->released, 1, memory_order_relaxed);
+    move_tail(payload, SHM_PAYLOAD_NO_EVENT);
+}
+
+void shm_payload_release_until(struct shm_payload *payload, uint64_t evid) {
+    move_tail(payload, evid);
+}
@@ -0,0 +1,92 @@
+/***********************************************
+ * Bulk payloads: a large byte ring next to a buffer.
+ *
+ * Aux buffers are fine for short strings, but they are reclaimed only
+ * by ranges of event IDs and their references have 32-bit offsets.
+ * Big data (e.g., what the program writes or reads, megabytes at a time)
+ * go into a payload ring instead: the source copies the data into the ring
+ * and pushes only the reference (a 64-bit position in the ring) with
+ * the event. The monitor reads the data in place chunk by chunk (the data
+ * may wrap around the end of the ring) and the data stay valid until
+ * the monitor releases the reference. References can be released
+ * in any order, the space is reused once all older payloads are released.
+ * Every payload also remembers the ID of its event, so monitors that do
+ * not look at the references release the payloads together with
+ * the events (core/stream.c does that when it is notified about
+ * the last processed event).
+ *
+ * If the ring is full, the source either waits for the monitor or stores
+ * only a prefix of the data (or nothing). The monitor always gets
+ * the original length of the payload, so it knows what was cut off.
+ *
+ * There is one writer and one reader of the ring.
+ ************************************************/
+
+#ifndef SHAMON_SHM_PAYLOAD_H_
+#define SHAMON_SHM_PAYLOAD_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint64_t shm_payload_ref;
+
+/* the payload was not stored at all, not even its length */
+#define SHM_PAYLOAD_NONE (~(shm_payload_ref)0)
+/* the payload is not released with events, only explicitly */
+#define SHM_PAYLOAD_NO_EVENT (~(uint64_t)0)
+
+/* what to do if the payload does not fit into the free space */
+enum shm_payload_policy {
+    /* wait until the monitor releases enough space */
+    SHM_PAYLOAD_WAIT,
+    /* store the prefix of the data that fits */
+    SHM_PAYLOAD_TRUNCATE,
+    /* store only the length of the data */
+    SHM_PAYLOAD_DROP,
+};
+
+struct shm_payload;
+
+/* for sources */
+
+/* Create the ring for the buffer `buffer_key` with (at least) `capacity`
+ * bytes. Payloads longer than `max_len` are truncated (0 means no limit
+ * but the capacity). */
+struct shm_payload *shm_payload_create(const char *buffer_key,
+                                       size_t capacity, size_t max_len);
+void shm_payload_destroy(struct shm_payload *payload);
+/* Copy `len` bytes of `data` into the ring and return the reference
+ * for the event `evid`. The payloads must be pushed in the order
+ * of the IDs of their events. With SHM_PAYLOAD_WAIT the call spins until
+ * there is enough space (or until the monitor closes the ring). */
+shm_payload_ref shm_payload_push(struct shm_payload *payload, uint64_t evid,
+                                 const void *data, size_t len,
+                                 enum shm_payload_policy policy);
+/* The number of truncated and dropped payloads so far */
+void shm_payload_get_stats(struct shm_payload *payload, uint64_t *truncated,
+                           uint64_t *dropped);
+
+/* for monitors */
+
+/* Returns NULL if the buffer has no payload ring */
+struct shm_payload *shm_payload_open(const char *buffer_key);
+void shm_payload_close(struct shm_payload *payload);
+/* Get the number of stored bytes and the original length of the payload.
+ * Returns false if the reference is not valid (SHM_PAYLOAD_NONE,
+ * released or never pushed). */
+bool shm_payload_get_size(struct shm_payload *payload, shm_payload_ref ref,
+                          size_t *stored, size_t *len);
+/* Get the stored bytes of the payload from `offset` on that are contiguous
+ * in the memory, their number is put into `chunk_len`. Reading the whole
+ * payload takes at most two chunks. Returns NULL if `offset` is not
+ * below the number of stored bytes. */
+const void *shm_payload_chunk(struct shm_payload *payload, shm_payload_ref ref,
+                              size_t offset, size_t *chunk_len);
+/* The monitor does not need the payload anymore */
+void shm_payload_release(struct shm_payload *payload, shm_payload_ref ref);
+/* The monitor processed the events with IDs up to `evid`
+ * and does not need their payloads anymore */
+void shm_payload_release_until(struct shm_payload *payload, uint64_t evid);
+
+#endif /* SHAMON_SHM_PAYLOAD_H_ */
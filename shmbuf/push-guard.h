@@ -0,0 +1,79 @@
+/***********************************************
+ * Guard of the buffers of sources that live in the monitored program.
+ *
+ * Such sources destroy their buffers in a destructor that runs in one
+ * thread while other threads of the program may be in the middle
+ * of pushing an event. The threads enter the guard before they touch
+ * the buffers and leave it after buffer_finish_push. Closing the guard
+ * makes all following enters fail and waits until the threads that
+ * entered before left, then the buffers can be destroyed.
+ *
+ * The counters of threads are spread over several cache lines,
+ * so that threads that push in parallel do not contend on one line.
+ ************************************************/
+
+#ifndef SHAMON_SHM_PUSH_GUARD_H_
+#define SHAMON_SHM_PUSH_GUARD_H_
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "core/utils.h"
+
+#define SHM_PUSH_GUARD_STRIPES 16
+
+struct shm_push_guard {
+    _Atomic bool closed;
+    struct {
+        CACHELINE_ALIGNED _Atomic size_t inside;
+    } stripes[SHM_PUSH_GUARD_STRIPES];
+};
+
+/* a closed guard that is opened when the source is initialized */
+#define SHM_PUSH_GUARD_INIT \
+    { .closed = true }
+
+static inline _Atomic size_t *
+shm_push_guard_counter(struct shm_push_guard *guard) {
+    static _Atomic size_t threads;
+    /* the stripe of this thread + 1, 0 if not assigned yet */
+    static _Thread_local size_t stripe;
+    if (stripe == 0)
+        stripe = atomic_fetch_add_explicit(&threads, 1, memory_order_relaxed) %
+                     SHM_PUSH_GUARD_STRIPES +
+                 1;
+    return &guard->stripes[stripe - 1].inside;
+}
+
+static inline void shm_push_guard_open(struct shm_push_guard *guard) {
+    atomic_store(&guard->closed, false);
+}
+
+/* returns false if the guard is closed, the thread must not push then */
+static inline bool shm_push_guard_enter(struct shm_push_guard *guard) {
+    _Atomic size_t *inside = shm_push_guard_counter(guard);
+    /* both accesses are sequentially consistent: either we see that
+     * the guard is closed, or shm_push_guard_close sees us inside */
+    atomic_fetch_add(inside, 1);
+    if (!atomic_load(&guard->closed))
+        return true;
+    atomic_fetch_sub_explicit(inside, 1, memory_order_release);
+    return false;
+}
+
+static inline void shm_push_guard_leave(struct shm_push_guard *guard) {
+    atomic_fetch_sub_explicit(shm_push_guard_counter(guard), 1,
+                              memory_order_release);
+}
+
+/* close the guard and wait until all threads left it */
+static inline void shm_push_guard_close(struct shm_push_guard *guard) {
+    atomic_store(&guard->closed, true);
+    for (size_t i = 0; i < SHM_PUSH_GUARD_STRIPES; ++i) {
+        while (atomic_load(&guard->stripes[i].inside) > 0) sched_yield();
+    }
+}
+
+#endif /* SHAMON_SHM_PUSH_GUARD_H_ */
@@ -0,0 +1,235 @@
+#include "registry.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REGISTRY_MAGIC 0x5348524547495354ULL /* "SHREGIST" */
+
+/* the state of a slot is stored together with the number
+ * of the announcement (generation), so that a source does not withdraw
+ * an announcement of somebody else that reused the slot */
+enum slot_state {
+    SLOT_FREE = 0,
+    SLOT_WRITING = 1, /* the key is being written */
+    SLOT_ANNOUNCED = 2,
+    SLOT_TAKEN = 3,
+};
+
+#define SLOT(gen, state) (((uint64_t)(gen) << 8) | (state))
+#define SLOT_GEN(s) ((uint32_t)((s) >> 8))
+#define SLOT_STATE(s) ((enum slot_state)((s)&0xff))
+
+struct registry_entry {
+    _Atomic uint64_t slot;
+    char key[SHM_NAME_MAXLEN];
+};
+
+struct registry_info {
+    uint64_t magic;
+    /* the futex that is incremented on every announcement */
+    _Atomic uint32_t seq;
+    /* the number of announced buffers that were not taken yet */
+    _Atomic uint32_t pending;
+    struct registry_entry entries[SHM_REGISTRY_CAPACITY];
+};
+
+struct shm_registry {
+    struct registry_info *info;
+    char *key;
+};
+
+const char *shm_registry_key(void) {
+    const char *key = getenv("SHAMON_REGISTRY");
+    return key ? key : SHM_REGISTRY_DEFAULT_KEY;
+}
+
+static struct shm_registry *map_registry(const char *key, int fd) {
+    void *mem = mmap(0, sizeof(struct registry_info), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        perror("mmap failure");
+        return NULL;
+    }
+
+    struct shm_registry *reg = malloc(sizeof(*reg));
+    assert(reg && "Memory allocation failed");
+    reg->info = mem;
+    reg->key = strdup(key);
+    return reg;
+}
+
+struct shm_registry *shm_registry_create(const char *key) {
+    /* initialize the registry under a temporary key,
+     * so that nobody sees it half-initialized */
+    char tmpkey[SHM_NAME_MAXLEN] = "";
+    if (shamon_get_tmp_key(key, tmpkey, SHM_NAME_MAXLEN) == -1) {
+        fprintf(stderr, "Failed creating a tmpkey for '%s'\n", key);
+        return NULL;
+    }
+
+    int fd = shamon_shm_open(tmpkey, O_RDWR | O_CREAT | O_TRUNC, S_IRWXU);
+    if (fd < 0) {
+        perror("shm_open");
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(struct registry_info)) == -1) {
+        perror("ftruncate");
+        close(fd);
+        shamon_shm_unlink(tmpkey);
+        return NULL;
+    }
+
+    struct shm_registry *reg = map_registry(key, fd);
+    if (!reg) {
+        shamon_shm_unlink(tmpkey);
+        return NULL;
+    }
+    /* ftruncate zeroed the memory, so all slots are free */
+    reg->info->magic = REGISTRY_MAGIC;
+
+    if (shamon_shm_rename(tmpkey, key) < 0) {
+        perror("renaming SHM file");
+        shamon_shm_unlink(tmpkey);
+        shm_registry_close(reg);
+        return NULL;
+    }
+
+    return reg;
+}
+
+struct shm_registry *shm_registry_open(const char *key) {
+    int fd = shamon_shm_open(key, O_RDWR, S_IRWXU);
+    if (fd < 0)
+        return NULL;
+
+    struct shm_registry *reg = map_registry(key, fd);
+    if (reg && reg->info->magic != REGISTRY_MAGIC) {
+        fprintf(stderr, "'%s' is not a registry of buffers\n", key);
+        shm_registry_close(reg);
+        return NULL;
+    }
+    return reg;
+}
+
+void shm_registry_close(struct shm_registry *reg) {
+    if (munmap(reg->info, sizeof(struct registry_info)) != 0) {
+        perror("munmap failure");
+    }
+    free(reg->key);
+    free(reg);
+}
+
+void shm_registry_destroy(struct shm_registry *reg) {
+    if (shamon_shm_unlink(reg->key) != 0) {
+        perror("shm_unlink failure");
+    }
+    shm_registry_close(reg);
+}
+
+static void wake_waiters(struct registry_info *info) {
+    atomic_fetch_add(&info->seq, 1);
+    syscall(SYS_futex, &info->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+int shm_registry_announce(struct shm_registry *reg, const char *buffer_key,
+                          uint32_t *gen) {
+    struct registry_info *info = reg->info;
+    assert(strlen(buffer_key) < SHM_NAME_MAXLEN);
+
+    int ret = -1;
+    for (int i = 0; i < SHM_REGISTRY_CAPACITY; ++i) {
+        struct registry_entry *e = &info->entries[i];
+        uint64_t s = atomic_load(&e->slot);
+        if (SLOT_STATE(s) != SLOT_FREE)
+            continue;
+        const uint32_t g = SLOT_GEN(s) + 1;
+        if (!atomic_compare_exchange_strong(&e->slot, &s,
+                                            SLOT(g, SLOT_WRITING)))
+            continue;
+
+        strcpy(e->key, buffer_key);
+        atomic_fetch_add(&info->pending, 1);
+        atomic_store(&e->slot, SLOT(g, SLOT_ANNOUNCED));
+        *gen = g;
+        ret = i;
+        break;
+    }
+
+    if (ret < 0) {
+        fprintf(stderr, "The registry of buffers is full\n");
+    }
+    wake_waiters(info);
+    return ret;
+}
+
+void shm_registry_withdraw(struct shm_registry *reg, int slot, uint32_t gen) {
+    assert(slot >= 0 && slot < SHM_REGISTRY_CAPACITY);
+    struct registry_entry *e = &reg->info->entries[slot];
+    uint64_t s = SLOT(gen, SLOT_ANNOUNCED);
+    if (atomic_compare_exchange_strong(&e->slot, &s, SLOT(gen, SLOT_FREE))) {
+        atomic_fetch_sub(&reg->info->pending, 1);
+    }
+}
+
+int shm_registry_take(struct shm_registry *reg, const char *prefix,
+                      char key[SHM_NAME_MAXLEN]) {
+    struct registry_info *info = reg->info;
+    if (atomic_load(&info->pending) == 0)
+        return -1;
+
+    const size_t prefix_len = strlen(prefix);
+    for (int i = 0; i < SHM_REGISTRY_CAPACITY; ++i) {
+        struct registry_entry *e = &info->entries[i];
+        uint64_t s = atomic_load(&e->slot);
+        if (SLOT_STATE(s) != SLOT_ANNOUNCED)
+            continue;
+        /* the key is written before the slot is announced */
+        if (strncmp(e->key, prefix, prefix_len) != 0)
+            continue;
+        if (!atomic_compare_exchange_strong(
+                &e->slot, &s, SLOT(SLOT_GEN(s), SLOT_TAKEN)))
+            continue;
+
+        atomic_fetch_sub(&info->pending, 1);
+        strcpy(key, e->key);
+        return i;
+    }
+    return -1;
+}
+
+void shm_registry_release(struct shm_registry *reg, int slot) {
+    assert(slot >= 0 && slot < SHM_REGISTRY_CAPACITY);
+    struct registry_entry *e = &reg->info->entries[slot];
+    uint64_t s = atomic_load(&e->slot);
+    assert(SLOT_STATE(s) == SLOT_TAKEN && "Releasing a slot that is not taken");
+    atomic_store(&e->slot, SLOT(SLOT_GEN(s), SLOT_FREE));
+}
+
+uint32_t shm_registry_seq(struct shm_registry *reg) {
+    return atomic_load(&reg->info->seq);
+}
+
+bool shm_registry_wait(struct shm_registry *reg, uint32_t seq,
+                       unsigned timeout_ms) {
+    struct timespec ts = {.tv_sec = timeout_ms / 1000,
+                          .tv_nsec = (timeout_ms % 1000) * 1000000L};
+    /* the futex returns right away if seq changed in the meantime */
+    if (syscall(SYS_futex, &reg->info->seq, FUTEX_WAIT, seq, &ts, NULL, 0) ==
+            -1 &&
+        errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) {
+        perror("futex");
+    }
+    return atomic_load(&reg->info->seq) != seq;
+}
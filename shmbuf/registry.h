@@ -0,0 +1,61 @@
+/***********************************************
+ * Registry of shared-memory buffers.
+ *
+ * The registry is a shared-memory segment where sources announce
+ * the buffers that they create. A long-running host process (shamon-host)
+ * takes the announced buffers and attaches to them as soon as they appear,
+ * instead of polling for buffers with known names. Every announcement
+ * increments a sequence number on which the host and the monitors that
+ * wait for a buffer can sleep (futex), so they are woken up right away.
+ *
+ * The registry is created by the host. If there is no registry,
+ * sources do not announce anything and monitors wait for buffers
+ * by polling as before.
+ ************************************************/
+
+#ifndef SHAMON_SHM_REGISTRY_H_
+#define SHAMON_SHM_REGISTRY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "shmbuf/shm.h"
+
+#define SHM_REGISTRY_DEFAULT_KEY "/shamon.registry"
+#define SHM_REGISTRY_CAPACITY 256
+
+struct shm_registry;
+
+/* The key of the registry, SHAMON_REGISTRY or the default key */
+const char *shm_registry_key(void);
+
+/* for the host */
+struct shm_registry *shm_registry_create(const char *key);
+void shm_registry_destroy(struct shm_registry *reg);
+/* Take an announced buffer whose key starts with `prefix` and copy its key
+ * into `key`. Returns the slot of the buffer or -1 if no such buffer is
+ * announced. Buffers with other keys stay announced for other hosts. */
+int shm_registry_take(struct shm_registry *reg, const char *prefix,
+                      char key[SHM_NAME_MAXLEN]);
+/* Free the slot of a taken buffer after the host detached from it */
+void shm_registry_release(struct shm_registry *reg, int slot);
+
+/* for sources and monitors; returns NULL if there is no registry */
+struct shm_registry *shm_registry_open(const char *key);
+void shm_registry_close(struct shm_registry *reg);
+/* Announce a new buffer. Returns the slot or -1 if the registry is full
+ * (the waiters are woken up in both cases). `gen` identifies this
+ * announcement when withdrawing it. */
+int shm_registry_announce(struct shm_registry *reg, const char *buffer_key,
+                          uint32_t *gen);
+/* Withdraw the announcement if the buffer was not taken yet */
+void shm_registry_withdraw(struct shm_registry *reg, int slot, uint32_t gen);
+
+/* The sequence number of the last announcement */
+uint32_t shm_registry_seq(struct shm_registry *reg);
+/* Sleep until there is an announcement after `seq` or until the timeout
+ * expires. Returns true if there was an announcement. */
+bool shm_registry_wait(struct shm_registry *reg, uint32_t seq,
+                       unsigned timeout_ms);
+
+#endif /* SHAMON_SHM_REGISTRY_H_ */
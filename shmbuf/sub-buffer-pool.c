@@ -0,0 +1,125 @@
+#include "sub-buffer-pool.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "buffer.h"
+#include "core/utils.h"
+
+#define DEFAULT_POOL_SIZE 4
+
+struct shm_sub_buffer_pool {
+    struct buffer *parent;
+    const struct source_control *control;
+    size_t capacity;
+    bool recycle;
+    size_t size;
+    /* the free writers, NULL if the slot is empty */
+    _Atomic(struct shm_sub_buffer_writer *) slots[];
+};
+
+size_t shm_sub_buffer_pool_default_size(void) {
+    const char *size = getenv("SHAMON_SUB_BUFFER_POOL");
+    return size ? strtoul(size, NULL, 10) : DEFAULT_POOL_SIZE;
+}
+
+static struct shm_sub_buffer_writer *
+create_writer(struct shm_sub_buffer_pool *pool) {
+    struct buffer *buffer =
+        create_shared_sub_buffer(pool->parent, pool->capacity, pool->control);
+    if (!buffer) {
+        fprintf(stderr, "Failed creating a sub-buffer for the pool\n");
+        return NULL;
+    }
+
+    struct shm_sub_buffer_writer *writer = xalloc(sizeof(*writer));
+    writer->buffer = buffer;
+    writer->last_id = 0;
+    return writer;
+}
+
+static void destroy_writer(struct shm_sub_buffer_writer *writer) {
+    destroy_shared_sub_buffer(writer->buffer);
+    free(writer);
+}
+
+/* put the writer into an empty slot, return false if the pool is full */
+static bool put_writer(struct shm_sub_buffer_pool *pool,
+                       struct shm_sub_buffer_writer *writer) {
+    for (size_t i = 0; i < pool->size; ++i) {
+        struct shm_sub_buffer_writer *empty = NULL;
+        if (atomic_compare_exchange_strong(&pool->slots[i], &empty, writer))
+            return true;
+    }
+    return false;
+}
+
+struct shm_sub_buffer_pool *
+shm_sub_buffer_pool_create(struct buffer *parent, size_t capacity,
+                           const struct source_control *control, size_t size,
+                           bool recycle) {
+    struct shm_sub_buffer_pool *pool =
+        xalloc(sizeof(*pool) + size * sizeof(pool->slots[0]));
+    pool->parent = parent;
+    pool->control = control;
+    pool->capacity = capacity;
+    pool->recycle = recycle;
+    pool->size = size;
+
+    for (size_t i = 0; i < size; ++i) {
+        atomic_init(&pool->slots[i], create_writer(pool));
+    }
+
+    return pool;
+}
+
+void shm_sub_buffer_pool_destroy(struct shm_sub_buffer_pool *pool) {
+    for (size_t i = 0; i < pool->size; ++i) {
+        struct shm_sub_buffer_writer *writer =
+            atomic_exchange(&pool->slots[i], NULL);
+        if (writer)
+            destroy_writer(writer);
+    }
+    free(pool);
+}
+
+struct shm_sub_buffer_writer *
+shm_sub_buffer_pool_acquire(struct shm_sub_buffer_pool *pool) {
+    for (size_t i = 0; i < pool->size; ++i) {
+        if (atomic_load_explicit(&pool->slots[i], memory_order_relaxed) ==
+            NULL)
+            continue;
+        struct shm_sub_buffer_writer *writer =
+            atomic_exchange(&pool->slots[i], NULL);
+        if (writer)
+            return writer;
+    }
+
+    /* the pool is empty, we must pay for creating the buffer */
+    return create_writer(pool);
+}
+
+void shm_sub_buffer_pool_release(struct shm_sub_buffer_pool *pool,
+                                 struct shm_sub_buffer_writer *writer) {
+    if (pool->recycle && put_writer(pool, writer))
+        return;
+
+    destroy_writer(writer);
+    if (pool->recycle)
+        return;
+
+    bool has_empty_slot = false;
+    for (size_t i = 0; i < pool->size && !has_empty_slot; ++i) {
+        has_empty_slot = atomic_load(&pool->slots[i]) == NULL;
+    }
+    if (!has_empty_slot)
+        return;
+
+    /* keep the pool warm, the exiting thread pays for the new buffer
+     * instead of a thread that is yet to be created */
+    writer = create_writer(pool);
+    if (writer && !put_writer(pool, writer))
+        destroy_writer(writer);
+}
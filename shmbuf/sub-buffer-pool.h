@@ -0,0 +1,61 @@
+/***********************************************
+ * Pool of pre-created sub-buffers for multi-threaded sources.
+ *
+ * Creating a sub-buffer means creating two shared-memory segments
+ * (the control and the data buffer), which is too slow to be done
+ * every time the monitored program creates a thread. The pool creates
+ * sub-buffers ahead of time and hands them out to new threads as writer
+ * handles without taking any lock. When a thread exits, its handle goes
+ * back to the pool: the buffer is either reused by the next thread
+ * (if the pool recycles buffers) or it is destroyed and a fresh buffer
+ * is created in its place in the context of the exiting thread.
+ *
+ * Monitors see the sub-buffers in the pool as soon as they are created.
+ * A recycled sub-buffer carries events of several threads one after
+ * another, so sources whose monitors need one sub-buffer per thread must
+ * not recycle buffers.
+ ************************************************/
+
+#ifndef SHAMON_SUB_BUFFER_POOL_H_
+#define SHAMON_SUB_BUFFER_POOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "core/event.h"
+
+struct buffer;
+struct source_control;
+struct shm_sub_buffer_pool;
+
+/* the handle of a thread that writes into a sub-buffer */
+struct shm_sub_buffer_writer {
+    struct buffer *buffer;
+    /* the ID of the last event in the buffer, a thread that gets
+     * a recycled buffer must continue with the next ID */
+    shm_eventid last_id;
+};
+
+/* Create a pool of `size` sub-buffers of `parent`. The sub-buffers have
+ * the capacity `capacity` (0 means the capacity of the parent).
+ * `control` must live as long as the pool. */
+struct shm_sub_buffer_pool *
+shm_sub_buffer_pool_create(struct buffer *parent, size_t capacity,
+                           const struct source_control *control, size_t size,
+                           bool recycle);
+/* destroy the pool and the sub-buffers that are in the pool */
+void shm_sub_buffer_pool_destroy(struct shm_sub_buffer_pool *pool);
+
+/* Get a writer for a new thread. If the pool is empty, a new sub-buffer
+ * is created right away. Returns NULL if creating the buffer failed. */
+struct shm_sub_buffer_writer *
+shm_sub_buffer_pool_acquire(struct shm_sub_buffer_pool *pool);
+/* Give back the writer of a thread that exited */
+void shm_sub_buffer_pool_release(struct shm_sub_buffer_pool *pool,
+                                 struct shm_sub_buffer_writer *writer);
+
+/* The size of the pool that sources use by default,
+ * SHAMON_SUB_BUFFER_POOL or 4 */
+size_t shm_sub_buffer_pool_default_size(void);
+
+#endif /* SHAMON_SUB_BUFFER_POOL_H_ */
@@ -54,6 +54,7 @@
 
 #include "buffer.h"
 #include "client.h"
+#include "sub-buffer-pool.h"
 
 #ifdef WINDOWS
 #define IF_WINDOWS(x) x
@@ -82,12 +83,15 @@ static void event_thread_context_exit(void *drcontext, bool process_exit);
 
 static struct buffer *top_shmbuffer;
 static struct source_control *top_control;
+/* sub-buffers for new threads */
+static struct shm_sub_buffer_pool *sub_buffers;
 static struct event_record *events;
 unsigned long *addresses;
 static size_t events_num;
 
 typedef struct {
     size_t thread;
+    struct shm_sub_buffer_writer *writer;
     struct buffer *shm;
     size_t waiting_for_buffer;
 } per_thread_t;
@@ -215,6 +219,12 @@ DR_EXPORT void dr_client_main(client_id_t id, int argc, const char *argv[]) {
         perror("Waiting for the buffer failed");
         abort();
     }
+
+    /* TODO: for now we create buffers of the same type as the top buffer */
+    sub_buffers =
+        shm_sub_buffer_pool_create(top_shmbuffer, 0, top_control,
+                                   shm_sub_buffer_pool_default_size(),
+                                   /* recycle = */ false);
 }
 static void event_thread_context_init(void *drcontext, bool new_depth) {
     /* create an instance of our data structure for this thread context */
@@ -223,11 +233,10 @@ static void event_thread_context_init(void *drcontext, bool new_depth) {
         data = (per_thread_t *)dr_thread_alloc(drcontext, sizeof(per_thread_t));
         drmgr_set_cls_field(drcontext, tcls_idx, data);
         data->thread = ++thread_num;
-        /* TODO: for now we create a buffer of the same type as the top buffer
-         */
-        data->shm = create_shared_sub_buffer(top_shmbuffer, 0, top_control);
+        data->writer = shm_sub_buffer_pool_acquire(sub_buffers);
+        DR_ASSERT(data->writer && "Failed creating buffer");
+        data->shm = data->writer->buffer;
         data->waiting_for_buffer = 0;
-        DR_ASSERT(data->shm && "Failed creating buffer");
     } else {
         data = (per_thread_t *)drmgr_get_cls_field(drcontext, tcls_idx);
     }
@@ -242,7 +251,7 @@ static void event_thread_context_exit(void *drcontext, bool thread_exit) {
         "Thread %lu exits, looped in a busy wait for the buffer %lu times\n",
         data->thread, data->waiting_for_buffer);
     dr_printf("... (releasing shared buffer)\n");
-    release_shared_buffer(data->shm);
+    shm_sub_buffer_pool_release(sub_buffers, data->writer);
     dr_thread_free(drcontext, data, sizeof(per_thread_t));
 }
 
@@ -254,6 +263,7 @@ static void event_exit(void) {
     }
 #endif
     drmgr_exit();
+    shm_sub_buffer_pool_destroy(sub_buffers);
     destroy_shared_buffer(top_shmbuffer);
     dr_global_free(addresses, events_num * sizeof(unsigned long));
 }
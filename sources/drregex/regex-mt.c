@@ -15,6 +15,8 @@
 #include "buffer.h"
 #include "client.h"
 #include "list-embedded.h"
+#include "multi_regex.h"
+#include "parse_number.h"
 #include "shm_string-macro.h"
 #include "signatures.h"
 #include "source.h"
@@ -58,9 +60,6 @@ static void *xmalloc(size_t sz) {
     return mem;
 }
 
-static char *tmpline;
-static size_t tmpline_len;
-
 struct line {
     STRING(data);
     size_t timestamp;
@@ -144,6 +143,8 @@ char **exprs[3];
 char **names[3];
 static size_t exprs_num[3];
 static regex_t *re[3];
+/* finds the matching expressions in one pass, used only by the parser thread */
+static struct shm_multi_regex *mre[3];
 static char **signatures[3];
 struct event_record *events[3];
 static size_t waiting_for_buffer[3];
@@ -176,10 +177,16 @@ static int parse_line(int fd, struct line *line_info) {
     // info("[%d] parsing line (%p): '%s'\n", fd, line, line);
 
     shm_event *ev = &evs[fd];
+    /* bool is char here, but the matcher takes _Bool */
+    _Bool matched[num];
+    if (shm_multi_regex_match(mre[fd], line, strlen(line), matched) == 0)
+        return 0;
+
     for (int i = 0; i < num; ++i) {
-        if ((ev->kind = events[fd][i].kind) == 0) {
-            continue; /* monitor is not interested in this */
+        if (!matched[i]) {
+            continue;
         }
+        ev->kind = events[fd][i].kind;
 
         status = regexec(&re[fd][i], line, MAXMATCH, matches, 0);
         if (status != 0) {
@@ -211,67 +218,48 @@ static int parse_line(int fd, struct line *line_info) {
             ++o;
         }
 
-        /* push the arguments of the event */
+        /* push the arguments of the event right from the line */
         for (; *o && m <= MAXMATCH; ++o, ++m) {
             if (*o == 'L') { /* user wants the whole line */
                 addr = buffer_partial_push_str(shm, addr, ev->id, line);
                 continue;
             }
-            if (*o != 'M') {
-                if ((int)matches[m].rm_so < 0) {
-                    warn("have no match for '%c' in signature %s\n", *o,
-                         signatures[fd][i]);
-                    continue;
-                }
-                len = matches[m].rm_eo - matches[m].rm_so;
-            } else {
-                len = matches[0].rm_eo - matches[0].rm_so;
-            }
-
-            /* make sure we have big enough temporary buffer */
-            if (tmpline_len < (size_t)len) {
-                free(tmpline);
-                tmpline = xmalloc(sizeof(char) * len + 1);
-                tmpline_len = len;
-            }
-
-            if (*o == 'M') { /* user wants the whole match */
-                assert(matches[0].rm_so >= 0);
-                strncpy(tmpline, line + matches[0].rm_so, len);
-                tmpline[len] = '\0';
-                addr = buffer_partial_push_str(shm, addr, ev->id, tmpline);
+            /* 'M' is the whole match */
+            const regmatch_t *match = *o == 'M' ? &matches[0] : &matches[m];
+            if ((int)match->rm_so < 0) {
+                warn("have no match for '%c' in signature %s\n", *o,
+                     signatures[fd][i]);
                 continue;
-            } else {
-                strncpy(tmpline, line + matches[m].rm_so, len);
-                tmpline[len] = '\0';
             }
+            char *str = line + match->rm_so;
+            len = match->rm_eo - match->rm_so;
 
             switch (*o) {
+                case 'M':
+                case 'S':
+                    addr = buffer_partial_push_bytes_str(shm, addr, ev->id,
+                                                         str, len);
+                    break;
                 case 'c':
                     assert(len == 1);
-                    addr = buffer_partial_push(
-                        shm, addr, (char *)(line + matches[m].rm_eo),
-                        sizeof(op.c));
+                    addr = buffer_partial_push(shm, addr, str, sizeof(op.c));
                     break;
                 case 'i':
-                    op.i = atoi(tmpline);
+                    op.i = shm_parse_int(str, len);
                     addr = buffer_partial_push(shm, addr, &op.i, sizeof(op.i));
                     break;
                 case 'l':
-                    op.l = atol(tmpline);
+                    op.l = shm_parse_long(str, len);
                     addr = buffer_partial_push(shm, addr, &op.l, sizeof(op.l));
                     break;
                 case 'f':
-                    op.f = atof(tmpline);
+                    op.f = shm_parse_double(str, len);
                     addr = buffer_partial_push(shm, addr, &op.f, sizeof(op.f));
                     break;
                 case 'd':
-                    op.d = strtod(tmpline, NULL);
+                    op.d = shm_parse_double(str, len);
                     addr = buffer_partial_push(shm, addr, &op.d, sizeof(op.d));
                     break;
-                case 'S':
-                    addr = buffer_partial_push_str(shm, addr, ev->id, tmpline);
-                    break;
                 default:
                     assert(0 && "Invalid signature");
             }
@@ -725,6 +713,17 @@ DR_EXPORT void dr_client_main(client_id_t id, int argc, const char *argv[]) {
     }
     info("done\n");
 
+    for (int i = 0; i < 3; ++i) {
+        if (shmbuf[i] == NULL)
+            continue;
+        /* the monitor is attached, so we know which events it wants */
+        const char *wanted[exprs_num[i]];
+        for (size_t j = 0; j < exprs_num[i]; ++j) {
+            wanted[j] = events[i][j].kind == 0 ? NULL : exprs[i][j];
+        }
+        mre[i] = shm_multi_regex_compile(exprs_num[i], wanted);
+    }
+
     info("Creating parser thread...");
     if (!dr_create_client_thread(parser_thread, 0)) {
         warn("failed creating the parser thread\n");
@@ -788,6 +787,8 @@ static void event_exit(void) {
         for (int i = 0; i < (int)exprs_num[fd]; ++i) {
             regfree(&re[fd][i]);
         }
+        if (mre[fd])
+            shm_multi_regex_destroy(mre[fd]);
         free(exprs[fd]);
         free(names[fd]);
         for (size_t j = 0; j < exprs_num[fd]; ++j) {
@@ -798,7 +799,6 @@ static void event_exit(void) {
         VEC_DESTROY(line_pool[fd].lines);
     }
 
-    free(tmpline);
     /*info("Clean up done\n");*/
 }
 
@@ -13,6 +13,8 @@
 #include "buffer.h"
 #include "client.h"
 #include "event.h"
+#include "multi_regex.h"
+#include "parse_number.h"
 #include "signatures.h"
 #include "source.h"
 #include "streams/stream-drregex.h" /* event type */
@@ -67,7 +69,7 @@ static inline void write_lock() {
     bool unlocked;
     do {
         unlocked = false;
-    } while (atomic_compare_exchange_weak(l, &unlocked, true));
+    } while (!atomic_compare_exchange_weak(l, &unlocked, true));
 }
 
 static inline void write_unlock() {
@@ -100,11 +102,10 @@ static void usage_and_exit(int ret) {
 
 static char **signatures;
 static regex_t *re;
+static struct shm_multi_regex *mre;
 static size_t exprs_num;
 shm_event_drregex ev;
 
-static char *tmpline = NULL;
-static size_t tmpline_len = 0;
 static char *partial_line = 0;
 static size_t partial_line_len = 0;
 static size_t partial_line_alloc_len = 0;
@@ -121,9 +122,19 @@ static void parse_line(bool iswrite, per_thread_t *data, char *line) {
 
     /* fprintf(stderr, "LINE: %s\n", line); */
 
+    /* the cache of the automaton is shared by all threads */
+    /* bool is char here, but the matcher takes _Bool */
+    _Bool matched[exprs_num];
+    write_lock();
+    size_t matched_num =
+        shm_multi_regex_match(mre, line, strlen(line), matched);
+    write_unlock();
+    if (matched_num == 0)
+        return;
+
     for (int i = 0; i < (int)exprs_num; ++i) {
-        if (events[i].kind == 0)
-            continue; /* monitor is not interested in this */
+        if (!matched[i])
+            continue;
 
         status = regexec(&re[i], line, MAXMATCH, matches, 0);
         if (status != 0) {
@@ -150,71 +161,49 @@ static void parse_line(bool iswrite, per_thread_t *data, char *line) {
 #endif
         addr = buffer_partial_push(shm, addr, &ev, sizeof(ev));
 
-        /* push the arguments of the event */
+        /* push the arguments of the event right from the line */
         for (const char *o = signatures[i]; *o && m <= MAXMATCH; ++o, ++m) {
             if (*o == 'L') { /* user wants the whole line */
                 addr = buffer_partial_push_str(shm, addr, ev.base.id, line);
                 continue;
             }
-            if (*o != 'M') {
-                if ((int)matches[m].rm_so < 0) {
-                    dr_fprintf(
-                        STDERR,
-                        "warning: have no match for '%c' in signature %s\n", *o,
-                        signatures[i]);
-                    continue;
-                }
-                len = matches[m].rm_eo - matches[m].rm_so;
-            } else {
-                len = matches[0].rm_eo - matches[0].rm_so;
-            }
-
-            /* make sure we have big enough temporary buffer */
-            if (tmpline_len < (size_t)len) {
-                free(tmpline);
-                tmpline = malloc(sizeof(char) * len + 1);
-                assert(tmpline && "Memory allocation failed");
-                tmpline_len = len;
-            }
-
-            if (*o == 'M') { /* user wants the whole match */
-                assert(matches[0].rm_so >= 0);
-                strncpy(tmpline, line + matches[0].rm_so, len);
-                tmpline[len] = '\0';
-                addr = buffer_partial_push_str(shm, addr, ev.base.id, tmpline);
+            /* 'M' is the whole match */
+            const regmatch_t *match = *o == 'M' ? &matches[0] : &matches[m];
+            if ((int)match->rm_so < 0) {
+                dr_fprintf(STDERR,
+                           "warning: have no match for '%c' in signature %s\n",
+                           *o, signatures[i]);
                 continue;
-            } else {
-                strncpy(tmpline, line + matches[m].rm_so, len);
-                tmpline[len] = '\0';
             }
+            char *str = line + match->rm_so;
+            len = match->rm_eo - match->rm_so;
 
             switch (*o) {
+                case 'M':
+                case 'S':
+                    addr = buffer_partial_push_bytes_str(shm, addr,
+                                                         ev.base.id, str, len);
+                    break;
                 case 'c':
                     assert(len == 1);
-                    addr = buffer_partial_push(
-                        shm, addr, (char *)(line + matches[m].rm_eo),
-                        sizeof(op.c));
+                    addr = buffer_partial_push(shm, addr, str, sizeof(op.c));
                     break;
                 case 'i':
-                    op.i = atoi(tmpline);
+                    op.i = shm_parse_int(str, len);
                     addr = buffer_partial_push(shm, addr, &op.i, sizeof(op.i));
                     break;
                 case 'l':
-                    op.l = atol(tmpline);
+                    op.l = shm_parse_long(str, len);
                     addr = buffer_partial_push(shm, addr, &op.l, sizeof(op.l));
                     break;
                 case 'f':
-                    op.f = atof(tmpline);
+                    op.f = shm_parse_double(str, len);
                     addr = buffer_partial_push(shm, addr, &op.f, sizeof(op.f));
                     break;
                 case 'd':
-                    op.d = strtod(tmpline, NULL);
+                    op.d = shm_parse_double(str, len);
                     addr = buffer_partial_push(shm, addr, &op.d, sizeof(op.d));
                     break;
-                case 'S':
-                    addr =
-                        buffer_partial_push_str(shm, addr, ev.base.id, tmpline);
-                    break;
                 default:
                     assert(0 && "Invalid signature");
             }
@@ -236,9 +225,9 @@ static void push_event(bool iswrite, per_thread_t *data, ssize_t retlen) {
     const char *endptr = line + retlen;
     char *line_end = line;
     do {
-        while (line_end != endptr && *line_end != '\n') {
-            ++line_end;
-        }
+        line_end = memchr(line, '\n', endptr - line);
+        if (!line_end)
+            line_end = (char *)endptr;
 
         if (line_end == endptr) {
             const size_t linelen = endptr - line;
@@ -369,6 +358,15 @@ DR_EXPORT void dr_client_main(client_id_t id, int argc, const char *argv[]) {
 
     dr_fprintf(STDERR, "info: waiting for the monitor to attach\n");
     buffer_wait_for_monitor(shm);
+
+    /* find the matching expressions in one pass over the line
+     * and run regexec only on them to get the submatches */
+    const char *wanted[exprs_num];
+    for (int i = 0; i < (int)exprs_num; ++i) {
+        /* monitor is not interested in the rest */
+        wanted[i] = events[i].kind == 0 ? NULL : exprs[i];
+    }
+    mre = shm_multi_regex_compile(exprs_num, wanted);
 }
 
 static void event_exit(void) {
@@ -386,8 +384,8 @@ static void event_exit(void) {
     for (int i = 0; i < (int)exprs_num; ++i) {
         regfree(&re[i]);
     }
+    shm_multi_regex_destroy(mre);
 
-    free(tmpline);
     free(partial_line);
 
     dr_printf("Destroying shared buffer\n");
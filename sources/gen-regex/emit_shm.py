@@ -1,62 +1,209 @@
+from os.path import dirname, abspath, join as joinpath
+
 from utils import *
 
+# POSIX character classes expanded to ranges of bytes
+char_classes = {
+    "alnum": [("0", "9"), ("A", "Z"), ("a", "z")],
+    "alpha": [("A", "Z"), ("a", "z")],
+    "blank": [(" ", " "), ("\t", "\t")],
+    "cntrl": [("\x00", "\x1f"), ("\x7f", "\x7f")],
+    "digit": [("0", "9")],
+    "graph": [("\x21", "\x7e")],
+    "lower": [("a", "z")],
+    "print": [("\x20", "\x7e")],
+    "punct": [("\x21", "\x2f"), ("\x3a", "\x40"), ("\x5b", "\x60"),
+              ("\x7b", "\x7e")],
+    "space": [(" ", " "), ("\t", "\r")],
+    "upper": [("A", "Z")],
+    "xdigit": [("0", "9"), ("A", "F"), ("a", "f")],
+}
+
+# GNU escapes that glibc supports in extended regexes
+escape_classes = {
+    "w": (False, char_classes["alnum"] + [("_", "_")]),
+    "W": (True, char_classes["alnum"] + [("_", "_")]),
+    "s": (False, char_classes["space"]),
+    "S": (True, char_classes["space"]),
+}
+
+
+def _hex(c):
+    return f"\\x{ord(c):02x}"
+
+
+def _literal(c):
+    if c.isalnum() and c.isascii():
+        return f'"{c}"'
+    return f'"{_hex(c)}"'
+
+
+def _char_class(negated, ranges):
+    body = "".join(_hex(b) if b == e else f"{_hex(b)}-{_hex(e)}"
+                   for b, e in ranges)
+    return f"[{'^' if negated else ''}{body}]"
+
+
+def _parse_bracket(regex, i):
+    """ Parse the bracket expression that starts after '[' at `i`,
+    return the re2c class and the position after the closing ']' """
+    negated = False
+    if i < len(regex) and regex[i] == "^":
+        negated = True
+        i += 1
+    ranges = []
+    first = True
+    while True:
+        if i >= len(regex):
+            raise ValueError(f"Unterminated bracket expression: {regex}")
+        c = regex[i]
+        if c == "]" and not first:
+            return _char_class(negated, ranges), i + 1
+        first = False
+        if regex.startswith("[:", i):
+            end = regex.find(":]", i + 2)
+            name = regex[i + 2:end] if end != -1 else None
+            if name not in char_classes:
+                raise NotImplementedError(f"Unknown class in {regex}")
+            ranges += char_classes[name]
+            i = end + 2
+            continue
+        if regex.startswith("[.", i) or regex.startswith("[=", i):
+            raise NotImplementedError(f"Collating elements in {regex}")
+        if i + 2 < len(regex) and regex[i + 1] == "-" and regex[i + 2] != "]":
+            ranges.append((c, regex[i + 2]))
+            i += 3
+            continue
+        ranges.append((c, c))
+        i += 1
+
+
 def adjust_regex(regex):
-    """ Transform regex from POSIX syntax to RE2C syntax """
-    return regex
+    """ Transform regex from POSIX syntax to RE2C syntax.
+    Returns the re2c regex and whether it is anchored at the beginning
+    and at the end of the line. """
+    out = []
+    # can an empty regex appear at this point (after '(' or '|')?
+    empty = True
+    anchored_begin = regex.startswith("^")
+    anchored_end = regex.endswith("$") and not regex.endswith("\\$")
+    i = 1 if anchored_begin else 0
+    end = len(regex) - 1 if anchored_end else len(regex)
+    while i < end:
+        c = regex[i]
+        if c in "()|":
+            if c != "(" and empty:
+                out.append('""')
+            out.append(c)
+            empty = c != ")"
+            i += 1
+            continue
+        if c in "*+?":
+            out.append(c)
+        elif c == "{":
+            close = regex.find("}", i)
+            bound = regex[i + 1:close] if close != -1 else ""
+            if bound and all(b.isdigit() or b == "," for b in bound) and\
+               bound.count(",") <= 1:
+                # GNU allows {,n} for {0,n}
+                if bound[0] == ",":
+                    bound = "0" + bound
+                out.append(f"{{{bound}}}")
+                i = close + 1
+                empty = False
+                continue
+            out.append(_literal(c))
+        elif c == "[":
+            cls, i = _parse_bracket(regex, i + 1)
+            out.append(cls)
+            empty = False
+            continue
+        elif c == "\\":
+            if i + 1 >= end:
+                raise ValueError(f"Trailing backslash in {regex}")
+            e = regex[i + 1]
+            if e in escape_classes:
+                out.append(_char_class(*escape_classes[e]))
+            elif e.isdigit() or e.isalpha():
+                raise NotImplementedError(f"Unsupported escape \\{e} in {regex}")
+            else:
+                out.append(_literal(e))
+            i += 1
+        elif c == ".":
+            out.append("[^]")
+        elif c in "^$":
+            raise NotImplementedError(f"Anchors must be at the ends: {regex}")
+        else:
+            out.append(_literal(c))
+        empty = False
+        i += 1
+    if empty:
+        out.append('""')
+    return " ".join(out), anchored_begin, anchored_end
+
 
 class SourceGenerator:
     def __init__(self, template, output, shmkey, events):
-        self.template = template
-        if template.endswith(".in"):
-            template = template[:-3]
-        self.tmpoutput = f"{template}.tmp.c"
-        self.output = output
+        # the templates are next to the generator
+        self.template = joinpath(dirname(abspath(__file__)), template)
+        # the input for re2c is next to the output
+        if output.endswith(".c"):
+            output = output[:-2]
+        self.tmpoutput = f"{output}.tmp.c"
+        self.output = f"{output}.c"
         self.events = events
         self.shmkey = shmkey
 
         self.infile = open(self.template, "r")
         self.tmpfile = open(self.tmpoutput, "w")
 
-    def _gen_push_simple_arg(self, write, n, c):
-        fmt = c
-        if c == "i":
-            fmt = "d"
-        elif c == "l":
-            fmt = "ld"
-        elif c == "d":
-            fmt = "lf"
+    def event_fields_src(self):
+        """ Set the fields of the event besides the id and kind """
+        return ""
 
-        write(\
+    def gen_push_begin(self, ev_idx):
+        """ Start pushing the event, push the header of the event """
+        self.tmpfile.write(
         f"""
-         tmp_c = *yypmatch[{n}];
-         *yypmatch[{n}] = 0;
-         sscanf(yypmatch[{n-1}], \"%@FMT\", &op.@ARG);
-         *yypmatch[{n}] = tmp_c;
-         addr = buffer_partial_push(shm, addr, &op.@ARG, sizeof(op.@ARG));
-         """.replace("@FMT", fmt).replace("@ARG", c)
-         )
+        while (!(addr = buffer_start_push(shm))) {{
+            ++waiting_for_buffer;
+        }}
+        ++ev.base.id;
+        ev.base.kind = events[{ev_idx}].kind;
+        {self.event_fields_src()}
+        addr = buffer_partial_push(shm, addr, &ev, sizeof(ev));
+        """)
+
+    def gen_push_end(self):
+        self.tmpfile.write("buffer_finish_push(shm);\n")
 
     def gen_push_event(self, sig):
+        """ Push the arguments of the event right from the captures.
+        The group 2 is the whole match, the groups of the user
+        start at 3 (see gen_parse_and_push). """
         write = self.tmpfile.write
-        for n, c in enumerate(sig, start=1):
-            idx_begin = 2*n
-            idx_end = 2*n+1
+        for n, c in enumerate(sig, start=3):
+            begin = f"yypmatch[{2*n}]"
+            length = f"(size_t)(yypmatch[{2*n+1}] - yypmatch[{2*n}])"
             if c in ('i', 'l', 'f', 'd'):
-                self._gen_push_simple_arg(write, idx_end, c)
+                parse = {"i": "shm_parse_int", "l": "shm_parse_long",
+                         "f": "shm_parse_double", "d": "shm_parse_double"}[c]
+                write(f"op.{c} = {parse}({begin}, {length});\n")
+                write(f"addr = buffer_partial_push(shm, addr, &op.{c}, "
+                      f"sizeof(op.{c}));\n")
             elif c == 'c':
-                write("addr = buffer_partial_push(shm, addr, "
-                      f"yypmatch[{idx_begin}], sizeof(op.c));\n")
-            elif c == 'l':
-                write(f"tmp_c = *yypmatch[{idx_end}];\n")
-                write(f"*yypmatch[{idx_end}] = 0;\n")
-                write(f"sscanf(yypmatch[{idx_begin}], \"%l\", &op.l);\n")
-                write(f"*yypmatch[{idx_end}] = tmp_c;\n")
-                write("addr = buffer_partial_push(shm, addr, &op.l, sizeof(op.k));\n")
+                write(f"addr = buffer_partial_push(shm, addr, {begin}, "
+                      "sizeof(op.c));\n")
+            elif c == 'S':
+                write("addr = buffer_partial_push_bytes_str(shm, addr, "
+                      f"ev.base.id, {begin}, {length});\n")
             elif c == 'L':
-                write("addr = buffer_partial_push_str(shm, addr, ev.base.id, line);\n")
-            elif c == 'M':
                 write("addr = buffer_partial_push_str_n(shm, addr, ev.base.id, "
-                      "yypmatch[0], yypmatch[1] - yypmatch[0]);\n")
+                      "line, len + 1);\n")
+            elif c == 'M':
+                write("addr = buffer_partial_push_bytes_str(shm, addr, "
+                      "ev.base.id, yypmatch[4], "
+                      "(size_t)(yypmatch[5] - yypmatch[4]));\n")
             else:
                 raise NotImplementedError(f"Not implemented yet: {sig}")
 
@@ -66,42 +213,48 @@ class SourceGenerator:
         for i in range(0, len(events), 3):
             ev_idx = int(i/3)
             ev_name = events[i]
-            ev_regex = adjust_regex(events[i + 1])
+            ev_regex, anchored_begin, anchored_end = adjust_regex(events[i + 1])
             ev_sig = events[i + 2]
 
-            parse_start =\
+            # regexec finds the leftmost match and the longest one there.
+            # We scan the line once with the rule `[^]* ((re) [^]*)`:
+            # under the POSIX disambiguation of re2c -P, the group 1 is
+            # the longest possible, i.e., it starts at the leftmost match,
+            # and then the group 2 (the whole match) is the longest one
+            # there. The uncaptured prefix takes the rest of the line.
+            rule = f"({ev_regex})"
+            if not anchored_end:
+                rule = rule + " [^]*"
+            rule = f"({rule})"
+            if not anchored_begin:
+                rule = "[^]* " + rule
+
+            write = self.tmpfile.write
+            comment = events[i + 1].replace("*/", "* /")
+            write(f"/* parsing event {ev_idx}: {ev_name}:{ev_sig} -> {comment} */\n")
+            write(f"if (events[{ev_idx}].kind != 0) {{")
+            write(
             f"""
             YYCURSOR = line;
             YYLIMIT = line + len;
 
             /*!re2c
-               .*{ev_regex}.* {{
-                   while (!(out = buffer_start_push(shm))) {{
-                       ++waiting_for_buffer;
-                   }}
-                   out->base.kind = events[{ev_idx}].kind; // FIXME: cache these
-                   out->base.id = ++ev.base.id;
-                   addr = out->args;
-
-                   char tmp_c;
-            """
-            parse_end =\
+               {rule} {{
+                   if (YYCURSOR != YYLIMIT) goto next{ev_idx + 1};
+            """)
+            self.gen_push_begin(ev_idx)
+            self.gen_push_event(ev_sig)
+            self.gen_push_end()
+            write(
             f"""
-                   buffer_finish_push(shm);
-                   continue;
+                   goto next{ev_idx + 1};
                 }}
-                *      {{ printf("NO match\\n"); goto next{ev_idx + 1}; }}
+                * {{ goto next{ev_idx + 1}; }}
+                $ {{ goto next{ev_idx + 1}; }}
               */
-            """
-
-            write = self.tmpfile.write
-            write(f"/* parsing event {ev_idx}: {ev_name}:{ev_sig} -> {ev_regex} */\n")
-            write(f"if (events[{ev_idx}].kind != 0) {{")
-            write(parse_start)
-            self.gen_push_event(ev_sig)
-            write(parse_end)
-            write("}")
-            write(f"next{ev_idx + 1}: ;")
+            """)
+            write("}\n")
+            write(f"next{ev_idx + 1}: ;\n")
 
     def source_control_src(self):
         events = self.events
@@ -111,7 +264,7 @@ class SourceGenerator:
         f"""
         /* Initialize the info about this source */
         struct source_control *control
-            = source_control_define({len(events)/3}, {evs});
+            = source_control_define({int(len(events)/3)}, {evs});
         assert(control);
         """
 
@@ -129,7 +282,7 @@ class SourceGenerator:
     def emit_declarations(self):
         return None
 
-    def gen(self):
+    def substitutions(self):
         subs = [
             ("@EVENTS_NUM", str(int(len(self.events) / 3))),
             ("@SOURCE_CONTROL", self.source_control_src()),
@@ -137,8 +290,11 @@ class SourceGenerator:
         ]
 
         decl = self.emit_declarations()
-        if decl:
-            subs.append(("@DECLARATIONS", decl))
+        subs.append(("@DECLARATIONS", decl or ""))
+        return subs
+
+    def gen(self):
+        subs = self.substitutions()
 
         write = self.tmpfile.write
         for line in self.infile:
@@ -157,5 +313,3 @@ class SourceGenerator:
         run_re2c(self.tmpoutput, self.output)
 
         return self.output
-
-
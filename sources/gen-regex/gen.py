@@ -9,28 +9,24 @@ from utils import *
 def usage_and_exit(msg=None):
     if msg:
         print(msg, file=stderr)
-    print(f"Usage: {argv[0]} source-type shmkey "
+    print(f"Usage: {cmdargs[0]} [-o output.c] source-type shmkey "
            "event-name data-descr event-signature ",
            "[event-name data-descr event-signature] ...",
           file=stderr)
-    exit(1)
-
-def usage_and_exit(msg=None):
-    if msg:
-        print(msg, file=stderr)
-    print(f"Usage: {cmdargs[0]} source-type shmkey "
-           "event-name data-descr event-signature ",
-           "[event-name data-descr event-signature] ...",
+    print("With -o, only the source is generated (for build systems)",
           file=stderr)
     exit(1)
 
-def gen(source_type, shmkey, events):
+def gen(source_type, shmkey, events, output=None):
     if source_type == "stdin":
-        return gen_stdin(shmkey, events)
+        return gen_stdin(shmkey, events, output)
    #if source_type == "bpf":
    #    return gen_bpf("syscall.enter.write", shmkey, events)
-    if source_type in ("drio", "dynamorio", "dr"):
-        return gen_drio("drio-stdin", shmkey, events)
+    # DynamoRIO clients that parse what the program writes to stdout/stderr
+    if source_type in ("drio", "dynamorio", "dr", "drio-stdout"):
+        return gen_drio("drio-stdout", shmkey, events, output)
+    if source_type == "drio-stderr":
+        return gen_drio("drio-stderr", shmkey, events, output)
 
     msg_and_exit("Unknown source type")
 
@@ -41,6 +37,10 @@ def main(argv):
 
     data-descr is usually a regular expression
     """
+    output = None
+    if len(argv) > 2 and argv[1] == "-o":
+        output = argv[2]
+        argv = argv[:1] + argv[3:]
     if len(argv) < 6:
         usage_and_exit()
 
@@ -53,10 +53,17 @@ def main(argv):
     if len(events) % 3 != 0:
         usage_and_exit()
 
-    src = gen(source_type, shmkey, argv[3:])
+    src = gen(source_type, shmkey, events, output)
+    if output:
+        return
 
     run_clang_format(src)
-    run_clang(src, "source")
+    if source_type == "stdin":
+        run_clang(src, "source")
+    else:
+        # DynamoRIO clients are built with the DynamoRIO cmake package,
+        # like the clients in sources/drregex
+        print(f"Generated {src}, build it as a DynamoRIO client", file=stderr)
 
 if __name__ == "__main__":
     main(cmdargs)
@@ -1,11 +1,12 @@
 from emit_shm import SourceGenerator
 
 class DRioSourceGenerator(SourceGenerator):
-    def __init__(self, template, output, shmkey, events):
+    def __init__(self, template, output, shmkey, events, fd):
         super().__init__(template, output, shmkey, events)
+        self.fd = fd
 
     def emit_declarations(self):
-        return
+        return\
         """
         static _Atomic(bool) _write_lock = false;
         
@@ -14,7 +15,7 @@ class DRioSourceGenerator(SourceGenerator):
             bool unlocked;
             do {
                 unlocked = false;
-            } while (atomic_compare_exchange_weak(l, &unlocked, true));
+            } while (!atomic_compare_exchange_weak(l, &unlocked, true));
         }
         
         static inline void write_unlock() {
@@ -23,17 +24,33 @@ class DRioSourceGenerator(SourceGenerator):
         }
         """
 
-    def gen_push_event(self, sig):
-        # FIXME: the locked code is too big
-        self.tmpfile.write("write_lock(); /*FIXME: lock only the push */\n")
-        super().gen_push_event(sig)
+    def substitutions(self):
+        return super().substitutions() + [("@FD", str(self.fd))]
+
+    def gen_push_begin(self, ev_idx):
+        # the application may write from more threads, the scanning
+        # is done without the lock, only the push is locked
+        self.tmpfile.write("write_lock();\n")
+        super().gen_push_begin(ev_idx)
+
+    def event_fields_src(self):
+        return\
+        """
+#ifndef DRREGEX_ONLY_ARGS
+        ev.write = iswrite;
+        ev.fd = data->fd;
+        ev.thread = data->thread;
+#endif
+        """
+
+    def gen_push_end(self):
+        super().gen_push_end()
         self.tmpfile.write("write_unlock();\n")
 
 
-def gen_drio(evtype, shmkey, events):
-    # TODO: we ignore 'evtype' for now
-    if evtype == "drio-stdin":
-        return DRioSourceGenerator("drio-stdin.c.in", "drio-stdin.c",
-                                   shmkey, events).gen()
+def gen_drio(evtype, shmkey, events, output=None):
+    if evtype in ("drio-stdout", "drio-stderr"):
+        fd = 1 if evtype == "drio-stdout" else 2
+        return DRioSourceGenerator("drio-stdin.c.in", output or f"{evtype}.c",
+                                   shmkey, events, fd).gen()
     raise NotImplementedError(f"Not implemented: {evtype}")
-
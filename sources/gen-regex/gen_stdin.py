@@ -1,5 +1,6 @@
 from emit_shm import SourceGenerator
 
-def gen_stdin(shmkey, events):
-    return SourceGenerator("regex.c.in", "regex.c", shmkey, events).gen()
+def gen_stdin(shmkey, events, output=None):
+    return SourceGenerator("regex.c.in", output or "regex.c", shmkey,
+                           events).gen()
 
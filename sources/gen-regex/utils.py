@@ -20,7 +20,7 @@ def run_clang(src, out):
     include_dirs = [top_dir, core_dir]
     link_dirs = [core_dir, shmbuf_dir]
     cflags = ["-Wall", "-g"]
-    ldflags = ["-lshamon-source", "-lshamon-shmbuf",
+    ldflags = ["-lshamon-source", "-lshamon-shmbuf", "-lshamon-line-reader",
                "-lshamon-signature", "-lshamon-utils"]
     libraries = []
     run(["clang", src, "-o", out] +
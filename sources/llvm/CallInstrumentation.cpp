@@ -0,0 +1,370 @@
+#include <map>
+#include <string>
+#include <vector>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+/*
+ * Instrument entries and exits of chosen functions with events
+ * `fun(args...)` and `fun_ret(retval)` that are written right
+ * into the shared buffer of the thread. The functions are chosen by
+ * -vamos-calls=fun1,fun2:sig,... or by __attribute__((annotate("vamos.call")))
+ * (or annotate("vamos.call:sig")). Without the signature, it is derived
+ * from the types of the arguments, in a signature `_` skips an argument
+ * and `S` is a string. Booleans and `zeroext` values are zero-extended,
+ * other integers are sign-extended.
+ *
+ * The instrumentation calls the runtime (calls-runtime.c) only to start
+ * and to finish the event, the arguments are stored by inlined stores
+ * at offsets that are known when compiling. The pass must see the whole
+ * program (it runs at the end of LTO), because it generates the table
+ * of events for the runtime.
+ */
+
+namespace {
+using namespace llvm;
+
+static cl::list<std::string>
+    CallsOpt("vamos-calls", cl::CommaSeparated,
+             cl::desc("Functions to instrument (name or name:signature)"));
+
+struct Event {
+    std::string name;
+    std::string signature;
+};
+
+/* a value for an operand of the event */
+struct EventArg {
+    Value *value;
+    bool zext;
+};
+
+struct CallInstrumentation : public ModulePass {
+    static char ID;
+    std::vector<Event> events;
+
+    CallInstrumentation() : ModulePass(ID) {}
+
+    bool runOnModule(Module &M) override;
+
+    void instrumentFunction(Function &F, const std::string &sig);
+    void emitEvent(Instruction *before, size_t idx, const std::string &sig,
+                   const std::vector<EventArg> &vals);
+    void emitEventsTable(Module &M);
+};
+
+static size_t opSize(char op) {
+    switch (op) {
+        case 'c':
+            return 1;
+        case 'h':
+            return 2;
+        case 'i':
+            return 4;
+        /* 'f' takes the same space as 'l', see signature_op_get_size */
+        default:
+            return 8;
+    }
+}
+
+static Type *opType(LLVMContext &ctx, char op) {
+    switch (op) {
+        case 'c':
+            return Type::getInt8Ty(ctx);
+        case 'h':
+            return Type::getInt16Ty(ctx);
+        case 'i':
+            return Type::getInt32Ty(ctx);
+        case 'l':
+        case 't':
+            return Type::getInt64Ty(ctx);
+        case 'f':
+            return Type::getFloatTy(ctx);
+        case 'd':
+            return Type::getDoubleTy(ctx);
+        default: /* 'p', 'S' */
+            return Type::getInt8PtrTy(ctx);
+    }
+}
+
+static char typeOp(Type *ty) {
+    if (ty->isIntegerTy(8) || ty->isIntegerTy(1))
+        return 'c';
+    if (ty->isIntegerTy(16))
+        return 'h';
+    if (ty->isIntegerTy(32))
+        return 'i';
+    if (ty->isIntegerTy(64))
+        return 'l';
+    if (ty->isFloatTy())
+        return 'f';
+    if (ty->isDoubleTy())
+        return 'd';
+    if (ty->isPointerTy())
+        return 'p';
+    return '_';
+}
+
+static std::string deriveSignature(Function &F) {
+    std::string sig;
+    for (auto &arg : F.args())
+        sig += typeOp(arg.getType());
+    return sig;
+}
+
+/* convert the value to the type of the operand of the signature,
+ * `zext` tells that the value is unsigned */
+static Value *convert(IRBuilder<> &B, Value *val, char op, bool zext) {
+    Type *to = opType(B.getContext(), op);
+    Type *from = val->getType();
+    if (from == to)
+        return val;
+    /* true is 1, not -1 */
+    if (from->isIntegerTy(1))
+        zext = true;
+    if (from->isIntegerTy() && to->isIntegerTy())
+        return zext ? B.CreateZExtOrTrunc(val, to)
+                    : B.CreateSExtOrTrunc(val, to);
+    if (from->isPointerTy() && to->isIntegerTy())
+        return B.CreatePtrToInt(val, to);
+    if (from->isIntegerTy() && to->isPointerTy())
+        return B.CreateIntToPtr(val, to);
+    if (from->isPointerTy() && to->isPointerTy())
+        return B.CreatePointerCast(val, to);
+    if (from->isFloatingPointTy() && to->isFloatingPointTy())
+        return B.CreateFPCast(val, to);
+    if (from->isIntegerTy() && to->isFloatingPointTy())
+        return zext ? B.CreateUIToFP(val, to) : B.CreateSIToFP(val, to);
+    if (from->isFloatingPointTy() && to->isIntegerTy())
+        return B.CreateFPToSI(val, to);
+    return nullptr;
+}
+
+void CallInstrumentation::emitEvent(Instruction *before, size_t idx,
+                                    const std::string &sig,
+                                    const std::vector<EventArg> &vals) {
+    Module *module = before->getModule();
+    LLVMContext &ctx = module->getContext();
+    Type *i8ptr = Type::getInt8PtrTy(ctx);
+
+    const FunctionCallee &start_fun = module->getOrInsertFunction(
+        "__vamos_call_start", i8ptr, Type::getInt64Ty(ctx));
+    const FunctionCallee &finish_fun =
+        module->getOrInsertFunction("__vamos_call_finish", Type::getVoidTy(ctx));
+    const FunctionCallee &str_fun = module->getOrInsertFunction(
+        "__vamos_call_push_str", Type::getVoidTy(ctx), i8ptr, i8ptr);
+
+    IRBuilder<> B(before);
+    auto *addr = B.CreateCall(start_fun, {B.getInt64(idx)});
+    /* NULL if the monitor is not interested in the event */
+    auto *cond = B.CreateIsNotNull(addr);
+    Instruction *then = SplitBlockAndInsertIfThen(cond, before, false);
+
+    B.SetInsertPoint(then);
+    size_t offset = 0;
+    auto val = vals.begin();
+    for (char op : sig) {
+        if (val == vals.end())
+            break;
+        const EventArg &arg = *val++;
+        if (op == '_')
+            continue;
+        Value *v = arg.value;
+        Value *slot = B.CreateConstInBoundsGEP1_64(B.getInt8Ty(), addr, offset);
+        Value *converted = convert(B, v, op, arg.zext);
+        if (!converted) {
+            errs() << "WARNING: cannot store " << *v->getType() << " as '"
+                   << op << "'\n";
+            converted = Constant::getNullValue(opType(ctx, op));
+        }
+        if (op == 'S') {
+            B.CreateCall(str_fun, {slot, converted});
+        } else {
+            Value *ptr = B.CreatePointerCast(
+                slot, PointerType::getUnqual(converted->getType()));
+            B.CreateAlignedStore(converted, ptr, Align(1));
+        }
+        offset += opSize(op);
+    }
+    B.CreateCall(finish_fun, {});
+}
+
+void CallInstrumentation::instrumentFunction(Function &F,
+                                             const std::string &sig) {
+    /* the events of the arguments, skipped args are not a part of them */
+    std::string event_sig;
+    for (char op : sig) {
+        if (op != '_')
+            event_sig += op;
+    }
+
+    const size_t entry_idx = events.size();
+    events.push_back({F.getName().str(), event_sig});
+    const size_t ret_idx = events.size();
+    std::string ret_sig;
+    if (!F.getReturnType()->isVoidTy()) {
+        ret_sig = typeOp(F.getReturnType());
+        if (ret_sig == "_")
+            ret_sig = "";
+    }
+    events.push_back({F.getName().str() + "_ret", ret_sig});
+
+    errs() << "Instrumenting: ";
+    errs().write_escaped(F.getName()) << " (" << event_sig << ")\n";
+
+    /* collect the returns before we split blocks. A return after
+     * a musttail call must follow the call right away, so there is
+     * no event for returning from it. */
+    std::vector<ReturnInst *> returns;
+    for (auto &BB : F) {
+        auto *ret = dyn_cast<ReturnInst>(BB.getTerminator());
+        if (!ret)
+            continue;
+        if (BB.getTerminatingMustTailCall()) {
+            errs() << "WARNING: no return event after a musttail call in ";
+            errs().write_escaped(F.getName()) << '\n';
+            continue;
+        }
+        returns.push_back(ret);
+    }
+
+    /* keep the static allocas in the entry block */
+    BasicBlock::iterator it = F.getEntryBlock().getFirstInsertionPt();
+    while (isa<AllocaInst>(*it))
+        ++it;
+    std::vector<EventArg> args;
+    for (auto &arg : F.args())
+        args.push_back({&arg, arg.hasZExtAttr()});
+    emitEvent(&*it, entry_idx, sig, args);
+
+    const bool ret_zext = F.hasRetAttribute(Attribute::ZExt);
+    for (ReturnInst *ret : returns) {
+        std::vector<EventArg> vals;
+        if (!ret_sig.empty())
+            vals.push_back({ret->getReturnValue(), ret_zext});
+        emitEvent(ret, ret_idx, ret_sig, vals);
+    }
+}
+
+/* the names and signatures of events for the runtime */
+void CallInstrumentation::emitEventsTable(Module &M) {
+    LLVMContext &ctx = M.getContext();
+    Type *i8ptr = Type::getInt8PtrTy(ctx);
+    IRBuilder<> B(ctx);
+
+    std::vector<Constant *> names, signatures;
+    for (auto &ev : events) {
+        names.push_back(ConstantExpr::getPointerCast(
+            B.CreateGlobalString(ev.name, "vamos.name", 0, &M), i8ptr));
+        signatures.push_back(ConstantExpr::getPointerCast(
+            B.CreateGlobalString(ev.signature, "vamos.sig", 0, &M), i8ptr));
+    }
+
+    auto *arr_ty = ArrayType::get(i8ptr, events.size());
+    new GlobalVariable(M, arr_ty, true, GlobalValue::ExternalLinkage,
+                       ConstantArray::get(arr_ty, names),
+                       "__vamos_calls_names");
+    new GlobalVariable(M, arr_ty, true, GlobalValue::ExternalLinkage,
+                       ConstantArray::get(arr_ty, signatures),
+                       "__vamos_calls_signatures");
+    new GlobalVariable(M, Type::getInt64Ty(ctx), true,
+                       GlobalValue::ExternalLinkage,
+                       ConstantInt::get(Type::getInt64Ty(ctx), events.size()),
+                       "__vamos_calls_num");
+}
+
+/* functions with annotate("vamos.call") or annotate("vamos.call:sig") */
+static void getAnnotated(Module &M, std::map<Function *, std::string> &funs) {
+    auto *annotations = M.getNamedGlobal("llvm.global.annotations");
+    if (!annotations || !annotations->hasInitializer())
+        return;
+    auto *arr = dyn_cast<ConstantArray>(annotations->getInitializer());
+    if (!arr)
+        return;
+
+    for (auto &op : arr->operands()) {
+        auto *entry = dyn_cast<ConstantStruct>(op);
+        if (!entry || entry->getNumOperands() < 2)
+            continue;
+        auto *fun =
+            dyn_cast<Function>(entry->getOperand(0)->stripPointerCasts());
+        auto *str = dyn_cast<GlobalVariable>(
+            entry->getOperand(1)->stripPointerCasts());
+        if (!fun || !str || !str->hasInitializer())
+            continue;
+        auto *data = dyn_cast<ConstantDataArray>(str->getInitializer());
+        if (!data || !data->isCString())
+            continue;
+        StringRef text = data->getAsCString();
+        if (text == "vamos.call")
+            funs[fun] = deriveSignature(*fun);
+        else if (text.startswith("vamos.call:"))
+            funs[fun] = text.drop_front(sizeof("vamos.call:") - 1).str();
+    }
+}
+
+bool CallInstrumentation::runOnModule(Module &M) {
+    /* the chosen functions and their signatures */
+    std::map<Function *, std::string> chosen;
+    getAnnotated(M, chosen);
+    for (const std::string &opt : CallsOpt) {
+        StringRef name(opt), sig;
+        std::tie(name, sig) = name.split(':');
+        Function *F = M.getFunction(name);
+        if (!F || F->isDeclaration()) {
+            errs() << "WARNING: did not find the definition of " << name
+                   << "\n";
+            continue;
+        }
+        chosen[F] = opt.find(':') == std::string::npos ? deriveSignature(*F)
+                                                         : sig.str();
+    }
+
+    /* the events are numbered in the order of functions in the module */
+    bool changed = false;
+    for (auto &F : M) {
+        auto it = chosen.find(&F);
+        if (it == chosen.end() || F.isDeclaration())
+            continue;
+        if (F.getName().startswith("__vamos_")) {
+            errs() << "Skipping: ";
+            errs().write_escaped(F.getName()) << '\n';
+            continue;
+        }
+        if (it->second.size() > F.arg_size()) {
+            errs() << "WARNING: the signature '" << it->second << "' of ";
+            errs().write_escaped(F.getName())
+                << " is longer than its arguments, skipping it\n";
+            continue;
+        }
+        instrumentFunction(F, it->second);
+        changed = true;
+    }
+
+    if (changed)
+        emitEventsTable(M);
+    return changed;
+}
+
+}  // namespace
+
+char CallInstrumentation::ID = 0;
+static RegisterPass<CallInstrumentation>
+    VCI("vamos-call-instrumentation", "VAMOS call instrumentation pass",
+        false /* Only looks at CFG */, false /* Analysis Pass */);
+
+static RegisterStandardPasses VCIP(
+    PassManagerBuilder::EP_FullLinkTimeOptimizationLast,
+    [](const PassManagerBuilder &, legacy::PassManagerBase &PM) {
+        PM.add(new CallInstrumentation());
+    });
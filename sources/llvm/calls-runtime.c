@@ -0,0 +1,152 @@
+/*
+ * The runtime for programs instrumented by CallInstrumentation.cpp.
+ * The instrumentation starts an event, stores the arguments right into
+ * the returned memory and finishes the event. The table of events
+ * is generated by the pass.
+ *
+ * The main thread writes into the top buffer, other threads get
+ * sub-buffers from a pool when they start their first event.
+ *
+ * Environment variables:
+ *  SHAMON_CALLS_KEY  the key of the shared buffer (default /vamos-calls)
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "core/event.h"
+#include "core/source.h"
+#include "shmbuf/buffer.h"
+#include "shmbuf/client.h"
+#include "shmbuf/push-guard.h"
+#include "shmbuf/sub-buffer-pool.h"
+
+/* generated by the pass */
+extern const char *const __vamos_calls_names[];
+extern const char *const __vamos_calls_signatures[];
+extern const uint64_t __vamos_calls_num;
+
+static struct buffer *top_shmbuf;
+static struct source_control *top_control;
+static struct shm_sub_buffer_pool *sub_buffers;
+/* the writers of threads are released when the threads exit */
+static pthread_key_t writer_key;
+/* a thread is inside from __vamos_call_start to __vamos_call_finish */
+static struct shm_push_guard guard = SHM_PUSH_GUARD_INIT;
+/* 0 if the monitor is not interested in the event */
+static shm_kind *kinds;
+static shm_eventid main_last_id;
+
+static _Thread_local struct thread_data {
+    struct buffer *shmbuf;
+    shm_eventid *last_id;
+    size_t waiting_for_buffer;
+} thread_data;
+
+static void release_writer(void *writer) {
+    if (!shm_push_guard_enter(&guard)) {
+        /* the destructor destroyed the pool already */
+        destroy_shared_sub_buffer(
+            ((struct shm_sub_buffer_writer *)writer)->buffer);
+        free(writer);
+        return;
+    }
+    shm_sub_buffer_pool_release(sub_buffers, writer);
+    shm_push_guard_leave(&guard);
+}
+
+static bool get_thread_buffer(void) {
+    struct shm_sub_buffer_writer *writer =
+        shm_sub_buffer_pool_acquire(sub_buffers);
+    if (!writer)
+        return false;
+    pthread_setspecific(writer_key, writer);
+    thread_data.shmbuf = writer->buffer;
+    thread_data.last_id = &writer->last_id;
+    return true;
+}
+
+void *__vamos_call_start(uint64_t event) {
+    if (!shm_push_guard_enter(&guard))
+        return NULL;
+    if (kinds[event] == 0 ||
+        (!thread_data.shmbuf && !get_thread_buffer())) {
+        shm_push_guard_leave(&guard);
+        return NULL;
+    }
+
+    shm_event *ev;
+    while (!(ev = buffer_start_push(thread_data.shmbuf))) {
+        ++thread_data.waiting_for_buffer;
+    }
+    ev->id = ++*thread_data.last_id;
+    ev->kind = kinds[event];
+    return ev + 1;
+}
+
+void __vamos_call_push_str(void *addr, const char *str) {
+    buffer_partial_push_str(thread_data.shmbuf, addr, *thread_data.last_id,
+                            str ? str : "");
+}
+
+void __vamos_call_finish(void) {
+    buffer_finish_push(thread_data.shmbuf);
+    shm_push_guard_leave(&guard);
+}
+
+__attribute__((constructor)) static void __vamos_calls_init(void) {
+    const size_t events_num = __vamos_calls_num;
+    top_control = source_control_define_pairwise(
+        events_num, (const char **)__vamos_calls_names,
+        (const char **)__vamos_calls_signatures);
+    assert(top_control);
+
+    const char *key = getenv("SHAMON_CALLS_KEY");
+    top_shmbuf =
+        create_shared_buffer(key ? key : "/vamos-calls", 256, top_control);
+    if (!top_shmbuf) {
+        fprintf(stderr, "Failed creating the shared buffer\n");
+        abort();
+    }
+
+    fprintf(stderr, "info: waiting for the monitor to attach... ");
+    buffer_wait_for_monitor(top_shmbuf);
+    fprintf(stderr, "done\n");
+
+    size_t num;
+    struct event_record *events = buffer_get_avail_events(top_shmbuf, &num);
+    assert(num == events_num && "Information in shared memory does not fit");
+    kinds = malloc(events_num * sizeof(shm_kind));
+    assert(kinds && "Memory allocation failed");
+    for (size_t i = 0; i < events_num; ++i) {
+        kinds[i] = events[i].kind;
+    }
+
+    /* the monitor needs one sub-buffer per thread, so do not recycle */
+    sub_buffers = shm_sub_buffer_pool_create(
+        top_shmbuf, 0, top_control, shm_sub_buffer_pool_default_size(),
+        /* recycle = */ false);
+    pthread_key_create(&writer_key, release_writer);
+
+    /* this is the main thread */
+    thread_data.shmbuf = top_shmbuf;
+    thread_data.last_id = &main_last_id;
+    shm_push_guard_open(&guard);
+}
+
+__attribute__((destructor)) static void __vamos_calls_fini(void) {
+    /* wait for the threads that are in the middle of an event */
+    shm_push_guard_close(&guard);
+    fprintf(stderr,
+            "info: sent %lu events from the main thread, "
+            "busy waited on buffer %lu cycles\n",
+            main_last_id, thread_data.waiting_for_buffer);
+
+    shm_sub_buffer_pool_destroy(sub_buffers);
+    destroy_shared_buffer(top_shmbuf);
+    free(top_control);
+    free(kinds);
+}
@@ -0,0 +1,462 @@
+/***********************************************
+ * Open-loop synthetic load generator.
+ *
+ * Emits events according to a schedule (constant rate, Poisson arrivals,
+ * on/off bursts, or times read from a trace file) independently of how
+ * fast the monitor consumes them: when the generator gets behind (e.g.,
+ * because the buffer is full), it does not postpone the following events
+ * but sends them as soon as it can. Every event carries the time when it
+ * was supposed to be sent (its first argument of type 't', CLOCK_MONOTONIC
+ * in nanoseconds), so the latency measured by the monitor includes also
+ * the time the event waited in the generator.
+ *
+ * The events are given in the same format as for source_control_define_str,
+ * e.g., "Small:l,Big:lSS". The generator prepends the timestamp argument
+ * to each signature, so the events above are received as `Small(t, l)`
+ * and `Big(t, l, S, S)`. Arguments of non-string types get the sequence
+ * number of the event, strings get a random length from the given range.
+ ************************************************/
+
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "event.h"
+#include "shmbuf/buffer.h"
+#include "shmbuf/client.h"
+#include "signatures.h"
+#include "source.h"
+#include "utils.h"
+
+#define MAX_EVENTS 64
+
+enum schedule_kind {
+    SCHEDULE_CONSTANT,
+    SCHEDULE_POISSON,
+    SCHEDULE_BURSTY,
+    SCHEDULE_TRACE
+};
+
+struct schedule {
+    enum schedule_kind kind;
+    double rate; /* events per second */
+    /* bursty: the lengths of on and off periods in nanoseconds */
+    uint64_t on_ns, off_ns;
+    /* trace */
+    FILE *trace;
+    char *line;
+    size_t line_len;
+    /* the time of the next event relative to the start */
+    double next_ns;
+};
+
+struct gen_event {
+    char name[64];
+    char signature[32]; /* with the prepended 't' */
+    double weight;
+    shm_kind kind;
+};
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+/* xorshift64* */
+static inline uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+/* uniformly distributed number from (0, 1] */
+static inline double rng_uniform(void) {
+    return ((rng_next() >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static _Noreturn void usage_and_exit(int ret) {
+    fprintf(
+        stderr,
+        "Usage: loadgen shmkey [-e events] [-w weights] [-r rate]\n"
+        "               [-d constant|poisson|bursty:ON_MS:OFF_MS|trace:FILE]\n"
+        "               [-n events-num] [-T seconds] [-l MIN-MAX]\n"
+        "               [-c capacity] [-s seed] [-m monitors [-p]]\n"
+        "\n"
+        "  -e   events as 'name:signature,name:signature,...'\n"
+        "       (default: 'E:l'), the timestamp 't' is prepended\n"
+        "       to every signature\n"
+        "  -w   relative frequencies of the events (default: uniform)\n"
+        "  -r   the (average) rate in events per second (default: 100000)\n"
+        "  -d   the distribution of the emission times (default: constant),\n"
+        "       bursty emits with the rate during ON and nothing during OFF,\n"
+        "       trace reads times (ns from the start) of the events from\n"
+        "       the file, one per line, optionally followed by the name\n"
+        "       of the event\n"
+        "  -n   stop after this many events (default: unlimited)\n"
+        "  -T   stop after this many seconds (default: unlimited)\n"
+        "  -l   the range of lengths of strings (default: 8-8)\n"
+        "  -c   the capacity of the shared-memory buffer (default: 1340)\n"
+        "  -s   the seed of the random generator\n"
+        "  -m   create a broadcast buffer shared by this many monitors,\n"
+        "       the generator waits for the slowest monitor\n"
+        "  -p   with -m, wait only for the first monitor, other monitors\n"
+        "       lose events when they fall behind\n");
+    exit(ret);
+}
+
+static size_t parse_events(const char *spec, struct gen_event *events) {
+    size_t num = 0;
+    char *copy = strdup(spec);
+    char *saveptr;
+    for (char *tok = strtok_r(copy, ",", &saveptr); tok;
+         tok = strtok_r(NULL, ",", &saveptr)) {
+        char *colon = strchr(tok, ':');
+        if (!colon || num == MAX_EVENTS) {
+            fprintf(stderr, "Invalid events: '%s'\n", spec);
+            usage_and_exit(1);
+        }
+        *colon = '\0';
+        struct gen_event *ev = &events[num++];
+        if (strlen(tok) >= sizeof(ev->name) ||
+            strlen(colon + 1) + 1 >= sizeof(ev->signature)) {
+            fprintf(stderr, "Too long name or signature of '%s'\n", tok);
+            usage_and_exit(1);
+        }
+        strcpy(ev->name, tok);
+        ev->signature[0] = 't';
+        strcpy(ev->signature + 1, colon + 1);
+        ev->weight = 1;
+        for (const char *o = ev->signature; *o; ++o) {
+            if (!strchr("chilfdptSLM_", *o)) {
+                fprintf(stderr, "Invalid signature of '%s'\n", tok);
+                usage_and_exit(1);
+            }
+        }
+    }
+    free(copy);
+    return num;
+}
+
+static void parse_weights(char *str, struct gen_event *events, size_t num) {
+    size_t i = 0;
+    for (char *tok = strtok(str, ","); tok; tok = strtok(NULL, ",")) {
+        if (i == num) {
+            fprintf(stderr, "More weights than events\n");
+            usage_and_exit(1);
+        }
+        events[i++].weight = strtod(tok, NULL);
+    }
+}
+
+static void parse_schedule(const char *str, struct schedule *sched) {
+    if (strcmp(str, "constant") == 0) {
+        sched->kind = SCHEDULE_CONSTANT;
+    } else if (strcmp(str, "poisson") == 0) {
+        sched->kind = SCHEDULE_POISSON;
+    } else if (strncmp(str, "bursty:", 7) == 0) {
+        sched->kind = SCHEDULE_BURSTY;
+        double on, off;
+        if (sscanf(str + 7, "%lf:%lf", &on, &off) != 2 || on <= 0 ||
+            off < 0) {
+            fprintf(stderr, "Invalid bursty schedule: '%s'\n", str);
+            usage_and_exit(1);
+        }
+        sched->on_ns = on * 1000000;
+        sched->off_ns = off * 1000000;
+    } else if (strncmp(str, "trace:", 6) == 0) {
+        sched->kind = SCHEDULE_TRACE;
+        sched->trace = fopen(str + 6, "r");
+        if (!sched->trace) {
+            perror("opening the trace");
+            exit(1);
+        }
+    } else {
+        fprintf(stderr, "Unknown schedule: '%s'\n", str);
+        usage_and_exit(1);
+    }
+}
+
+/* Get the emission time (relative to the start) of the next event.
+ * For trace schedules, `event_name` is set to the name of the event
+ * if the trace specifies it. Return false if there are no more events. */
+static bool schedule_next(struct schedule *sched, uint64_t *time,
+                          const char **event_name) {
+    *event_name = NULL;
+    switch (sched->kind) {
+        case SCHEDULE_CONSTANT:
+            *time = sched->next_ns;
+            sched->next_ns += 1e9 / sched->rate;
+            return true;
+        case SCHEDULE_POISSON:
+            /* exponentially distributed inter-arrival times */
+            *time = sched->next_ns;
+            sched->next_ns += -log(rng_uniform()) * 1e9 / sched->rate;
+            return true;
+        case SCHEDULE_BURSTY: {
+            /* `next_ns` is the time of the next event as if there were
+             * no off periods, map it into the on periods */
+            const uint64_t active = sched->next_ns;
+            *time = (active / sched->on_ns) * (sched->on_ns + sched->off_ns) +
+                    active % sched->on_ns;
+            sched->next_ns += 1e9 / sched->rate;
+            return true;
+        }
+        case SCHEDULE_TRACE:
+            while (getline(&sched->line, &sched->line_len, sched->trace) > 0) {
+                char *end;
+                errno = 0;
+                *time = strtoull(sched->line, &end, 10);
+                if (end == sched->line || errno != 0)
+                    continue; /* skip empty and invalid lines */
+                while (*end == ' ' || *end == '\t') ++end;
+                end[strcspn(end, "\r\n")] = '\0';
+                if (*end)
+                    *event_name = end;
+                return true;
+            }
+            return false;
+    }
+
+    assert(0 && "Unreachable");
+    abort();
+}
+
+static struct gen_event *choose_event(struct gen_event *events, size_t num,
+                                      double weights_sum) {
+    double r = rng_uniform() * weights_sum;
+    for (size_t i = 0; i < num; ++i) {
+        if (r <= events[i].weight)
+            return &events[i];
+        r -= events[i].weight;
+    }
+    return &events[num - 1];
+}
+
+static struct gen_event *find_event(struct gen_event *events, size_t num,
+                                    const char *name) {
+    for (size_t i = 0; i < num; ++i) {
+        if (strcmp(events[i].name, name) == 0)
+            return &events[i];
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        usage_and_exit(1);
+    }
+
+    const char *shmkey = argv[1];
+    const char *events_spec = "E:l";
+    char *weights = NULL;
+    struct schedule sched = {.kind = SCHEDULE_CONSTANT, .rate = 100000};
+    size_t events_limit = ~(size_t)0;
+    double time_limit = 0;
+    size_t str_min = 8, str_max = 8;
+    size_t capacity = 1340;
+    size_t monitors = 0;
+    enum shm_broadcast_policy policy = SHM_BROADCAST_SLOWEST;
+
+    int opt;
+    optind = 2;
+    while ((opt = getopt(argc, argv, "e:w:r:d:n:T:l:c:s:m:ph")) != -1) {
+        switch (opt) {
+            case 'e':
+                events_spec = optarg;
+                break;
+            case 'w':
+                weights = optarg;
+                break;
+            case 'r':
+                sched.rate = strtod(optarg, NULL);
+                break;
+            case 'd':
+                parse_schedule(optarg, &sched);
+                break;
+            case 'n':
+                events_limit = strtoull(optarg, NULL, 10);
+                break;
+            case 'T':
+                time_limit = strtod(optarg, NULL);
+                break;
+            case 'l':
+                if (sscanf(optarg, "%zu-%zu", &str_min, &str_max) != 2 ||
+                    str_min > str_max) {
+                    fprintf(stderr, "Invalid range of lengths: '%s'\n",
+                            optarg);
+                    usage_and_exit(1);
+                }
+                break;
+            case 'c':
+                capacity = strtoull(optarg, NULL, 10);
+                break;
+            case 's':
+                rng_state = strtoull(optarg, NULL, 10) | 1;
+                break;
+            case 'm':
+                monitors = strtoull(optarg, NULL, 10);
+                break;
+            case 'p':
+                policy = SHM_BROADCAST_PRIMARY;
+                break;
+            case 'h':
+                usage_and_exit(0);
+            default:
+                usage_and_exit(1);
+        }
+    }
+
+    if (sched.rate <= 0 && sched.kind != SCHEDULE_TRACE) {
+        fprintf(stderr, "The rate must be positive\n");
+        return 1;
+    }
+
+    struct gen_event events[MAX_EVENTS];
+    const size_t events_num = parse_events(events_spec, events);
+    if (weights)
+        parse_weights(weights, events, events_num);
+    double weights_sum = 0;
+    for (size_t i = 0; i < events_num; ++i) weights_sum += events[i].weight;
+
+    /* Initialize the info about this source */
+    const char *names[MAX_EVENTS], *signatures[MAX_EVENTS];
+    for (size_t i = 0; i < events_num; ++i) {
+        names[i] = events[i].name;
+        signatures[i] = events[i].signature;
+    }
+    struct source_control *control =
+        source_control_define_pairwise(events_num, names, signatures);
+    assert(control);
+    struct buffer *shm =
+        monitors > 0 ? create_shared_broadcast_buffer(shmkey, capacity, control,
+                                                      monitors, policy)
+                     : create_shared_buffer(shmkey, capacity, control);
+    assert(shm);
+    free(control);
+
+    fprintf(stderr, "info: waiting for the monitor to attach... ");
+    buffer_wait_for_monitor(shm);
+    fprintf(stderr, "done\n");
+
+    size_t num;
+    struct event_record *recs = buffer_get_avail_events(shm, &num);
+    assert(num == events_num && "Information in shared memory does not fit");
+    for (size_t i = 0; i < events_num; ++i) events[i].kind = recs[i].kind;
+
+    /* strings are suffixes of this buffer */
+    char *strbuf = malloc(str_max + 1);
+    assert(strbuf);
+    memset(strbuf, 'x', str_max);
+    strbuf[str_max] = '\0';
+
+    shm_event ev = {.id = 0, .kind = 0};
+    signature_operand op;
+    size_t skipped = 0, waited = 0;
+    uint64_t max_lag = 0, total_lag = 0;
+    uint64_t rel_time;
+    const char *trace_event;
+    const uint64_t start = now_ns();
+    const uint64_t end =
+        time_limit > 0 ? start + (uint64_t)(time_limit * 1e9) : UINT64_MAX;
+    size_t n = 0;
+
+    while (n < events_limit && schedule_next(&sched, &rel_time, &trace_event)) {
+        const uint64_t t = start + rel_time;
+        if (t >= end)
+            break;
+
+        struct gen_event *gev;
+        if (trace_event) {
+            gev = find_event(events, events_num, trace_event);
+            if (!gev) {
+                fprintf(stderr, "Unknown event in the trace: '%s'\n",
+                        trace_event);
+                continue;
+            }
+        } else {
+            gev = choose_event(events, events_num, weights_sum);
+        }
+        ++n;
+
+        sleep_until(t);
+
+        if (gev->kind == 0) {
+            ++skipped; /* the monitor is not interested in this event */
+            continue;
+        }
+
+        void *addr;
+        size_t spinned = 0;
+        while (!(addr = buffer_start_push(shm))) {
+            ++waited;
+            if (++spinned > SPIN_LIMIT) {
+                sched_yield();
+                spinned = 0;
+            }
+        }
+
+        const uint64_t lag = now_ns() - t;
+        total_lag += lag;
+        if (lag > max_lag)
+            max_lag = lag;
+
+        ++ev.id;
+        ev.kind = gev->kind;
+        addr = buffer_partial_push(shm, addr, &ev, sizeof(ev));
+        for (const char *o = gev->signature; *o; ++o) {
+            switch (*o) {
+                case 't':
+                    /* the first argument is the intended emission time,
+                     * other timestamps are just the current time */
+                    op.t = o == gev->signature ? t : now_ns();
+                    break;
+                case 'S':
+                case 'L':
+                case 'M': {
+                    size_t len = str_min;
+                    if (str_max > str_min)
+                        len += rng_next() % (str_max - str_min + 1);
+                    addr = buffer_partial_push_str(shm, addr, ev.id,
+                                                   strbuf + str_max - len);
+                    continue;
+                }
+                case '_':
+                    continue;
+                case 'f':
+                    op.f = n;
+                    break;
+                case 'd':
+                    op.d = n;
+                    break;
+                default:
+                    op.l = n;
+            }
+            addr = buffer_partial_push(shm, addr, &op,
+                                       signature_op_get_size(*o));
+        }
+        buffer_finish_push(shm);
+    }
+
+    const double duration = (now_ns() - start) * 1e-9;
+    fprintf(stderr,
+            "info: sent %lu events in %.3lf s (%.0lf ev/s), skipped %lu,\n"
+            "      waited for the buffer %lu times, lag avg %.0lf ns, "
+            "max %lu ns\n",
+            ev.id, duration, ev.id / duration, skipped, waited,
+            ev.id ? total_lag / (double)ev.id : 0.0, max_lag);
+
+    free(strbuf);
+    if (sched.trace) {
+        free(sched.line);
+        fclose(sched.trace);
+    }
+    destroy_shared_buffer(shm);
+
+    return 0;
+}
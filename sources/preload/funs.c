@@ -0,0 +1,337 @@
+/*
+ * A source of calls of exported functions: a library for LD_PRELOAD
+ * that interposes the functions listed in the file SHAMON_PRELOAD_FUNS
+ * (given when compiling, see shamon_preload_funs in CMakeLists.txt).
+ * The file has a line FUN(name, "signature") for every function,
+ * the signature describes the arguments of the function as in event_record,
+ * `_` skips an argument. Every call is the event `name` with the captured
+ * arguments. No binary translation and no symbol lookups are needed,
+ * the dynamic linker binds the calls to us.
+ *
+ * For every function there is a stub that jumps into a common trampoline.
+ * The trampoline saves the registers with arguments, pushes the event
+ * and jumps into the real function with the original registers and stack,
+ * so we do not need to know the return type of the function and even
+ * variadic functions work. This is for x86-64 System V only.
+ *
+ * The main thread writes into the top buffer, other threads get
+ * sub-buffers from a pool when they call a function the first time.
+ *
+ * Environment variables:
+ *  SHAMON_FUNS_KEY  the key of the shared buffer (default /shamon-funs)
+ */
+
+#if !defined(__x86_64__) || !defined(__linux__)
+#error "The trampoline is implemented only for x86-64 Linux"
+#endif
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/event.h"
+#include "core/signatures.h"
+#include "core/source.h"
+#include "shmbuf/buffer.h"
+#include "shmbuf/client.h"
+#include "shmbuf/push-guard.h"
+#include "shmbuf/sub-buffer-pool.h"
+
+#ifndef SHAMON_PRELOAD_FUNS
+#error "Define SHAMON_PRELOAD_FUNS to the file with the functions"
+#endif
+
+enum {
+#define FUN(name, sig) FUN_##name,
+#include SHAMON_PRELOAD_FUNS
+#undef FUN
+    FUNS_NUM
+};
+
+static const char *fun_names[FUNS_NUM] = {
+#define FUN(name, sig) #name,
+#include SHAMON_PRELOAD_FUNS
+#undef FUN
+};
+
+static const char *fun_signatures[FUNS_NUM] = {
+#define FUN(name, sig) sig,
+#include SHAMON_PRELOAD_FUNS
+#undef FUN
+};
+
+/* the registers with the arguments as saved by the trampoline */
+struct saved_regs {
+    /* rdi, rsi, rdx, rcx, r8, r9 */
+    uint64_t gp[6];
+    uint64_t rax;
+    uint64_t idx;
+    unsigned char xmm[8][16];
+    /* the arguments passed on the stack */
+    const uint64_t *stack;
+};
+
+_Static_assert(sizeof(struct saved_regs) == 200, "The trampoline needs update");
+
+/* the real functions, the trampoline jumps there. These symbols are
+ * used only from the assembly, keep them also with LTO */
+__attribute__((visibility("hidden"), used)) void *shm_preload_real[FUNS_NUM];
+__attribute__((visibility("hidden"), used)) void
+shm_preload_on_call(uint64_t idx, struct saved_regs *regs);
+
+__asm__(".text\n"
+        ".p2align 4\n"
+        ".type shm_preload_trampoline, @function\n"
+        "shm_preload_trampoline:\n"
+        "    pushq %rbp\n"
+        "    movq %rsp, %rbp\n"
+        "    subq $208, %rsp\n"
+        "    andq $-16, %rsp\n"
+        "    movq %rdi, 0(%rsp)\n"
+        "    movq %rsi, 8(%rsp)\n"
+        "    movq %rdx, 16(%rsp)\n"
+        "    movq %rcx, 24(%rsp)\n"
+        "    movq %r8, 32(%rsp)\n"
+        "    movq %r9, 40(%rsp)\n"
+        "    movq %rax, 48(%rsp)\n"
+        "    movq %r11, 56(%rsp)\n"
+        "    movdqa %xmm0, 64(%rsp)\n"
+        "    movdqa %xmm1, 80(%rsp)\n"
+        "    movdqa %xmm2, 96(%rsp)\n"
+        "    movdqa %xmm3, 112(%rsp)\n"
+        "    movdqa %xmm4, 128(%rsp)\n"
+        "    movdqa %xmm5, 144(%rsp)\n"
+        "    movdqa %xmm6, 160(%rsp)\n"
+        "    movdqa %xmm7, 176(%rsp)\n"
+        /* the return address is at 8(%rbp) */
+        "    leaq 16(%rbp), %r10\n"
+        "    movq %r10, 192(%rsp)\n"
+        "    movq %r11, %rdi\n"
+        "    movq %rsp, %rsi\n"
+        "    call shm_preload_on_call\n"
+        "    movq 0(%rsp), %rdi\n"
+        "    movq 8(%rsp), %rsi\n"
+        "    movq 16(%rsp), %rdx\n"
+        "    movq 24(%rsp), %rcx\n"
+        "    movq 32(%rsp), %r8\n"
+        "    movq 40(%rsp), %r9\n"
+        "    movq 48(%rsp), %rax\n"
+        "    movq 56(%rsp), %r11\n"
+        "    movdqa 64(%rsp), %xmm0\n"
+        "    movdqa 80(%rsp), %xmm1\n"
+        "    movdqa 96(%rsp), %xmm2\n"
+        "    movdqa 112(%rsp), %xmm3\n"
+        "    movdqa 128(%rsp), %xmm4\n"
+        "    movdqa 144(%rsp), %xmm5\n"
+        "    movdqa 160(%rsp), %xmm6\n"
+        "    movdqa 176(%rsp), %xmm7\n"
+        "    leave\n"
+        "    leaq shm_preload_real(%rip), %r10\n"
+        "    jmpq *(%r10,%r11,8)\n"
+        ".size shm_preload_trampoline, .-shm_preload_trampoline\n");
+
+/* The stubs that the dynamic linker binds the calls to. They are defined
+ * in a function only to get the index of the function as an operand. */
+__attribute__((used)) static void define_stubs(void) {
+#define FUN(name, sig)                                                         \
+    __asm__ volatile(".pushsection .text\n"                                    \
+                     ".globl " #name "\n"                                      \
+                     ".type " #name ", @function\n"                            \
+                     ".p2align 4\n" #name ":\n"                                \
+                     "    movl %0, %%r11d\n"                                   \
+                     "    jmp shm_preload_trampoline\n"                        \
+                     ".size " #name ", .-" #name "\n"                          \
+                     ".popsection\n"                                           \
+                     :                                                         \
+                     : "i"(FUN_##name));
+#include SHAMON_PRELOAD_FUNS
+#undef FUN
+}
+
+static struct buffer *top_shmbuf;
+static struct source_control *top_control;
+static struct shm_sub_buffer_pool *sub_buffers;
+/* the writers of threads are released when the threads exit */
+static pthread_key_t writer_key;
+/* threads are inside while they use the buffers or the pool */
+static struct shm_push_guard guard = SHM_PUSH_GUARD_INIT;
+/* resolved when the monitor attached, 0 if the monitor
+ * is not interested in the event */
+static shm_kind kinds[FUNS_NUM];
+static shm_eventid main_last_id;
+
+static _Thread_local struct buffer *thread_shmbuf;
+static _Thread_local shm_eventid *thread_last_id;
+static _Thread_local size_t waiting_for_buffer;
+/* set while we push, so that we do not capture our own calls */
+static _Thread_local bool in_shim;
+
+static void resolve(uint64_t idx) {
+    void *fn = dlsym(RTLD_NEXT, fun_names[idx]);
+    if (!fn) {
+        fprintf(stderr, "shamon: did not find the function '%s'\n",
+                fun_names[idx]);
+        abort();
+    }
+    atomic_store_explicit((_Atomic(void *) *)&shm_preload_real[idx], fn,
+                          memory_order_relaxed);
+}
+
+static void release_writer(void *writer) {
+    if (!shm_push_guard_enter(&guard)) {
+        /* the pool is gone, the buffer is ours only */
+        destroy_shared_sub_buffer(
+            ((struct shm_sub_buffer_writer *)writer)->buffer);
+        free(writer);
+        return;
+    }
+    shm_sub_buffer_pool_release(sub_buffers, writer);
+    shm_push_guard_leave(&guard);
+}
+
+static bool get_thread_buffer(void) {
+    struct shm_sub_buffer_writer *writer =
+        shm_sub_buffer_pool_acquire(sub_buffers);
+    if (!writer)
+        return false;
+    pthread_setspecific(writer_key, writer);
+    thread_shmbuf = writer->buffer;
+    thread_last_id = &writer->last_id;
+    return true;
+}
+
+static void push_call(uint64_t idx, struct saved_regs *regs) {
+    if (!thread_shmbuf && !get_thread_buffer())
+        return;
+    struct buffer *shm = thread_shmbuf;
+
+    shm_event *ev;
+    while (!(ev = buffer_start_push(shm))) {
+        ++waiting_for_buffer;
+    }
+    ev->id = ++*thread_last_id;
+    ev->kind = kinds[idx];
+    void *addr = ev + 1;
+
+    size_t gp = 0, fp = 0;
+    const uint64_t *stack = regs->stack;
+    for (const char *o = fun_signatures[idx]; *o; ++o) {
+        const void *arg;
+        if (*o == 'f' || *o == 'd') {
+            arg = fp < 8 ? (const void *)regs->xmm[fp++] : stack++;
+        } else {
+            arg = gp < 6 ? &regs->gp[gp++] : stack++;
+        }
+
+        switch (*o) {
+            case '_':
+                break;
+            case 'S': {
+                const char *str = *(const char *const *)arg;
+                addr = buffer_partial_push_str(shm, addr, ev->id,
+                                               str ? str : "");
+                break;
+            }
+            default:
+                /* little endian, the value is at the beginning */
+                addr = buffer_partial_push(shm, addr, arg,
+                                           signature_op_get_size(*o));
+        }
+    }
+    buffer_finish_push(shm);
+}
+
+void shm_preload_on_call(uint64_t idx, struct saved_regs *regs) {
+    if (!atomic_load_explicit((_Atomic(void *) *)&shm_preload_real[idx],
+                              memory_order_relaxed))
+        resolve(idx);
+
+    if (kinds[idx] == 0 || in_shim || !shm_push_guard_enter(&guard))
+        return;
+
+    in_shim = true;
+    push_call(idx, regs);
+    in_shim = false;
+    shm_push_guard_leave(&guard);
+}
+
+__attribute__((constructor)) static void shim_init(void) {
+    in_shim = true;
+    for (size_t i = 0; i < FUNS_NUM; ++i) {
+        if (!shm_preload_real[i])
+            resolve(i);
+    }
+
+    /* `_` is not a part of the event */
+    char signatures[FUNS_NUM][sizeof(((struct event_record *)0)->signature)];
+    const char *sigs[FUNS_NUM];
+    for (size_t i = 0; i < FUNS_NUM; ++i) {
+        size_t n = 0;
+        for (const char *o = fun_signatures[i]; *o; ++o) {
+            if (*o == '_')
+                continue;
+            if (!strchr("chilfdptS", *o) || n + 1 >= sizeof(signatures[i])) {
+                fprintf(stderr, "shamon: invalid signature '%s' of '%s'\n",
+                        fun_signatures[i], fun_names[i]);
+                abort();
+            }
+            signatures[i][n++] = *o;
+        }
+        signatures[i][n] = '\0';
+        sigs[i] = signatures[i];
+    }
+
+    const char *key = getenv("SHAMON_FUNS_KEY");
+    top_control = source_control_define_pairwise(FUNS_NUM, fun_names, sigs);
+    top_shmbuf =
+        create_shared_buffer(key ? key : "/shamon-funs", 256, top_control);
+    if (!top_shmbuf) {
+        fprintf(stderr, "shamon: failed creating the shared buffer\n");
+        in_shim = false;
+        return;
+    }
+
+    fprintf(stderr, "info: waiting for the monitor to attach... ");
+    buffer_wait_for_monitor(top_shmbuf);
+    fprintf(stderr, "done\n");
+
+    size_t num;
+    struct event_record *events = buffer_get_avail_events(top_shmbuf, &num);
+    assert(num == FUNS_NUM && "Information in shared memory does not fit");
+    for (size_t i = 0; i < FUNS_NUM; ++i) {
+        kinds[i] = events[i].kind;
+    }
+
+    /* the monitor needs one sub-buffer per thread, so do not recycle */
+    sub_buffers = shm_sub_buffer_pool_create(
+        top_shmbuf, 0, top_control, shm_sub_buffer_pool_default_size(),
+        /* recycle = */ false);
+    pthread_key_create(&writer_key, release_writer);
+
+    /* this is the main thread */
+    thread_shmbuf = top_shmbuf;
+    thread_last_id = &main_last_id;
+    shm_push_guard_open(&guard);
+    in_shim = false;
+}
+
+__attribute__((destructor)) static void shim_fini(void) {
+    if (!top_shmbuf)
+        return;
+    in_shim = true;
+    /* wait for the threads that are pushing or releasing their writers */
+    shm_push_guard_close(&guard);
+    fprintf(stderr, "info: sent %lu events from the main thread\n",
+            main_last_id);
+
+    shm_sub_buffer_pool_destroy(sub_buffers);
+    destroy_shared_buffer(top_shmbuf);
+    top_shmbuf = NULL;
+    free(top_control);
+}
@@ -0,0 +1,260 @@
+/*
+ * A source that captures what a program writes to chosen file descriptors.
+ * It is a library for LD_PRELOAD that interposes write and writev:
+ * the data are copied right into the shared memory after the original
+ * function returns, there are no pipes and no binary translation.
+ *
+ * stdio does not call the interposable write, so stdout and stderr are
+ * replaced by streams that write into their file descriptors through us.
+ * The data of printf, puts, fwrite, etc. are captured when the stream
+ * is flushed, i.e., in the order in which they reach the file descriptor.
+ * The streams keep the buffering of the original ones, but fileno()
+ * of them is -1. Other streams opened for the chosen file descriptors
+ * (e.g., with fdopen) are not captured.
+ *
+ * The buffer has the event `write` with the signature `iS` (the file
+ * descriptor and the written data). The threads of the program write
+ * into one multiplexed buffer, the channel (the first argument of every
+ * event) is the thread of the program.
+ *
+ * Big writes can go into a payload ring next to the buffer instead
+ * (see shmbuf/payload.h), then the event is `write` with the signature `iPl`
+ * (the file descriptor, the reference to the payload and the length
+ * of the written data). The monitor releases the payload once it
+ * processed the event.
+ *
+ * Environment variables:
+ *  SHAMON_WRITE_KEY      the key of the shared buffer (default /shamon-write)
+ *  SHAMON_WRITE_FDS      comma-separated file descriptors (default 1,2)
+ *  SHAMON_WRITE_PAYLOAD  the size of the payload ring in bytes (default 0,
+ *                        i.e., no payload ring)
+ *  SHAMON_WRITE_POLICY   what to do when the payload ring is full: wait,
+ *                        truncate (default) or drop
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "core/source.h"
+#include "shmbuf/buffer.h"
+#include "shmbuf/client.h"
+#include "shmbuf/mux.h"
+#include "shmbuf/payload.h"
+#include "shmbuf/push-guard.h"
+
+#define MAX_FDS 64
+
+typedef ssize_t (*write_fn)(int, const void *, size_t);
+typedef ssize_t (*writev_fn)(int, const struct iovec *, int);
+
+/* POSIX allows this conversion of dlsym results, ISO C does not */
+#define LOOKUP(fn, name) (*(void **)&(fn) = dlsym(RTLD_NEXT, name))
+
+static write_fn real_write;
+static writev_fn real_writev;
+
+static struct shm_mux *mux;
+static struct shm_payload *payload;
+static enum shm_payload_policy policy = SHM_PAYLOAD_TRUNCATE;
+/* open while we capture writes, the destructor closes it */
+static struct shm_push_guard guard = SHM_PUSH_GUARD_INIT;
+static shm_kind write_kind;
+static bool watched[MAX_FDS];
+
+static _Thread_local shm_mux_channel channel;
+/* set while we push, so that we do not capture our own writes */
+static _Thread_local bool in_shim;
+
+static void parse_fds(const char *fds) {
+    char *end;
+    while (*fds) {
+        long fd = strtol(fds, &end, 10);
+        if (end == fds)
+            break;
+        if (fd >= 0 && fd < MAX_FDS)
+            watched[fd] = true;
+        fds = *end == ',' ? end + 1 : end;
+    }
+}
+
+static inline bool should_capture(int fd);
+static void push_write(int fd, const void *data, size_t len);
+
+/* the write function of the streams that replace stdout and stderr */
+static ssize_t stdio_write(void *cookie, const char *buf, size_t size) {
+    const int fd = (int)(intptr_t)cookie;
+    size_t written = 0;
+    while (written < size) {
+        ssize_t ret = real_write(fd, buf + written, size - written);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (should_capture(fd))
+            push_write(fd, buf + written, ret);
+        written += ret;
+    }
+    return written > 0 ? (ssize_t)written : -1;
+}
+
+static FILE *wrap_stdio(FILE *stream, int mode) {
+    const int fd = fileno(stream);
+    if (fd < 0 || fd >= MAX_FDS || !watched[fd])
+        return stream;
+
+    FILE *wrapped = fopencookie((void *)(intptr_t)fd, "w",
+                                (cookie_io_functions_t){.write = stdio_write});
+    if (!wrapped) {
+        perror("shamon: fopencookie");
+        return stream;
+    }
+    setvbuf(wrapped, NULL, mode, BUFSIZ);
+    /* what was written so far goes out before the new stream is used */
+    fflush(stream);
+    return wrapped;
+}
+
+__attribute__((constructor)) static void shim_init(void) {
+    LOOKUP(real_write, "write");
+    LOOKUP(real_writev, "writev");
+
+    const char *key = getenv("SHAMON_WRITE_KEY");
+    if (!key)
+        key = "/shamon-write";
+    const char *fds = getenv("SHAMON_WRITE_FDS");
+    parse_fds(fds ? fds : "1,2");
+    const char *payload_size = getenv("SHAMON_WRITE_PAYLOAD");
+    const size_t capacity = payload_size ? strtoul(payload_size, NULL, 10) : 0;
+    const char *pol = getenv("SHAMON_WRITE_POLICY");
+    if (pol && strcmp(pol, "wait") == 0)
+        policy = SHM_PAYLOAD_WAIT;
+    else if (pol && strcmp(pol, "drop") == 0)
+        policy = SHM_PAYLOAD_DROP;
+
+    in_shim = true;
+    /* the ring must exist when a monitor finds the buffer */
+    if (capacity > 0) {
+        payload = shm_payload_create(key, capacity, 0);
+        if (!payload) {
+            fprintf(stderr, "shamon: failed creating the payload ring\n");
+            in_shim = false;
+            return;
+        }
+    }
+    struct source_control *control =
+        source_control_define(1, "write", payload ? "iPl" : "iS");
+    mux = shm_mux_create(key, 256, control);
+    free(control);
+    if (!mux) {
+        fprintf(stderr, "shamon: failed creating the shared buffer\n");
+        if (payload) {
+            shm_payload_destroy(payload);
+            payload = NULL;
+        }
+        in_shim = false;
+        return;
+    }
+
+    struct buffer *shm = shm_mux_buffer(mux);
+    fprintf(stderr, "info: waiting for the monitor to attach... ");
+    buffer_wait_for_monitor(shm);
+    fprintf(stderr, "done\n");
+
+    size_t num;
+    struct event_record *events = buffer_get_avail_events(shm, &num);
+    write_kind = events[0].kind;
+    /* if the monitor is not interested in the writes,
+     * the guard stays closed */
+    if (write_kind != 0) {
+        shm_push_guard_open(&guard);
+        stdout = wrap_stdio(stdout, isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF);
+        stderr = wrap_stdio(stderr, _IONBF);
+    }
+    in_shim = false;
+}
+
+__attribute__((destructor)) static void shim_fini(void) {
+    if (!mux)
+        return;
+    /* the streams are flushed after the destructors,
+     * that would be too late */
+    fflush(stdout);
+    fflush(stderr);
+    in_shim = true;
+    /* other threads may be pushing right now */
+    shm_push_guard_close(&guard);
+    if (payload) {
+        uint64_t truncated, dropped;
+        shm_payload_get_stats(payload, &truncated, &dropped);
+        fprintf(stderr, "info: truncated %lu and dropped %lu payloads\n",
+                truncated, dropped);
+        /* the monitor keeps its mapping of the ring */
+        shm_payload_destroy(payload);
+    }
+    shm_mux_destroy(mux);
+    mux = NULL;
+}
+
+static inline bool should_capture(int fd) {
+    return fd >= 0 && fd < MAX_FDS && watched[fd] && !in_shim;
+}
+
+static void push_write(int fd, const void *data, size_t len) {
+    if (len == 0 || !shm_push_guard_enter(&guard))
+        return;
+    in_shim = true;
+    if (channel == 0)
+        channel = shm_mux_open_channel(mux);
+
+    /* the payload ring has a single writer,
+     * so the data are copied while we hold the lock of the buffer */
+    struct buffer *shm = shm_mux_buffer(mux);
+    void *addr = shm_mux_start_push(mux, channel, write_kind);
+    addr = buffer_partial_push(shm, addr, &fd, sizeof(fd));
+    if (payload) {
+        const shm_payload_ref ref = shm_payload_push(
+            payload, shm_mux_current_id(mux), data, len, policy);
+        const uint64_t n = len;
+        addr = buffer_partial_push(shm, addr, &ref, sizeof(ref));
+        buffer_partial_push(shm, addr, &n, sizeof(n));
+    } else {
+        buffer_partial_push_bytes_str(shm, addr, shm_mux_current_id(mux),
+                                      data, len);
+    }
+    shm_mux_finish_push(mux);
+    in_shim = false;
+    shm_push_guard_leave(&guard);
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+    if (!real_write)
+        LOOKUP(real_write, "write");
+    ssize_t ret = real_write(fd, buf, count);
+    if (ret > 0 && should_capture(fd))
+        push_write(fd, buf, ret);
+    return ret;
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+    if (!real_writev)
+        LOOKUP(real_writev, "writev");
+    ssize_t ret = real_writev(fd, iov, iovcnt);
+    if (ret > 0 && should_capture(fd)) {
+        /* an event for every written piece */
+        size_t left = ret;
+        for (int i = 0; i < iovcnt && left > 0; ++i) {
+            const size_t len = iov[i].iov_len < left ? iov[i].iov_len : left;
+            push_write(fd, iov[i].iov_base, len);
+            left -= len;
+        }
+    }
+    return ret;
+}
@@ -3,17 +3,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
+#include <unistd.h>
 
 #include "event.h"
+#include "line_reader.h"
+#include "multi_regex.h"
+#include "parse_number.h"
 #include "shmbuf/buffer.h"
 #include "shmbuf/client.h"
 #include "signatures.h"
 #include "source.h"
+#include "utils.h"
 
 #define MAXMATCH 20
 
+/* the size of the chunks of input that are parsed by the worker threads */
+#define CHUNK_SIZE (1024 * 1024)
+
 static void usage_and_exit(int ret) {
-    fprintf(stderr, "Usage: regex shmkey name expr sig [name expr sig] ...\n");
+    fprintf(stderr,
+            "Usage: regex [-j threads] shmkey name expr sig [name expr sig] "
+            "...\n");
     exit(ret);
 }
 
@@ -36,21 +47,540 @@ struct event {
 
 static size_t waiting_for_buffer = 0;
 
+static size_t exprs_num;
+static char **exprs;
+static char **signatures;
+
+/*
+ * Parsing is separated from pushing the events, so that it can run
+ * in worker threads. A parsed event is a `struct parsed_event` followed
+ * by one `struct parsed_arg` for every operand of its signature.
+ * The strings point into the input (which lives until the events are pushed).
+ */
+struct parsed_event {
+    size_t expr;
+#ifdef WITH_LINES
+    /* the line in the chunk */
+    size_t line;
+#endif
+    size_t args_num;
+};
+
+struct parsed_arg {
+    char *str;
+    size_t len;
+    signature_operand op;
+};
+
+static void *resize(void *ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (!ptr) {
+        perror("realloc");
+        abort();
+    }
+    return ptr;
+}
+
+struct batch {
+    unsigned char *data;
+    size_t size;
+    size_t alloc;
+};
+
+static void *batch_append(struct batch *b, size_t size) {
+    if (b->size + size > b->alloc) {
+        b->alloc = b->alloc == 0 ? 4096 : 2 * b->alloc;
+        if (b->alloc < b->size + size)
+            b->alloc = b->size + size;
+        b->data = resize(b->data, b->alloc);
+    }
+    void *ptr = b->data + b->size;
+    b->size += size;
+    return ptr;
+}
+
+/* the state needed for parsing, every thread has its own (glibc's regexec
+ * serializes the calls on the same pattern with a lock) */
+struct parser {
+    regex_t *re;
+    struct shm_multi_regex *mre;
+    bool *matched;
+    regmatch_t matches[MAXMATCH + 1];
+};
+
+static void parser_init(struct parser *p, const char *wanted[]) {
+    p->re = xalloc(exprs_num * sizeof(regex_t));
+    for (size_t i = 0; i < exprs_num; ++i) {
+        /* compile the regex, use extended RE */
+        int status = regcomp(&p->re[i], exprs[i], REG_EXTENDED);
+        if (status != 0) {
+            fprintf(stderr, "Failed compiling regex '%s'\n", exprs[i]);
+            /* FIXME: we leak the expressions compiled so far ... */
+            exit(1);
+        }
+    }
+    /* find the matching expressions in one pass over the line
+     * and run regexec only on them to get the submatches */
+    p->mre = wanted ? shm_multi_regex_compile(exprs_num, wanted) : NULL;
+    p->matched = xalloc(exprs_num * sizeof(bool));
+}
+
+static void parser_destroy(struct parser *p) {
+    if (p->mre)
+        shm_multi_regex_destroy(p->mre);
+    for (size_t i = 0; i < exprs_num; ++i) {
+        regfree(&p->re[i]);
+    }
+    free(p->re);
+    free(p->matched);
+}
+
+/* parse the NUL-terminated `line` and append its events to `out` */
+static void parse_line(struct parser *p, char *line, size_t line_len,
+                       size_t line_no, struct batch *out) {
+    (void)line_no;
+    if (shm_multi_regex_match(p->mre, line, line_len, p->matched) == 0)
+        return;
+
+    for (size_t i = 0; i < exprs_num; ++i) {
+        if (!p->matched[i])
+            continue;
+
+        if (regexec(&p->re[i], line, MAXMATCH, p->matches, 0) != 0) {
+            continue;
+        }
+
+        size_t args_num = 0;
+        for (const char *o = signatures[i]; *o && args_num < MAXMATCH; ++o)
+            ++args_num;
+
+        struct parsed_event *pev = batch_append(
+            out, sizeof(*pev) + args_num * sizeof(struct parsed_arg));
+        pev->expr = i;
+#ifdef WITH_LINES
+        pev->line = line_no;
+#endif
+        pev->args_num = args_num;
+        struct parsed_arg *arg = (struct parsed_arg *)(pev + 1);
+
+        int m = 1;
+        for (const char *o = signatures[i]; m <= (int)args_num;
+             ++o, ++m, ++arg) {
+            memset(arg, 0, sizeof(*arg));
+            if (*o == 'L') { /* user wants the whole line */
+                arg->str = line;
+                arg->len = line_len;
+                continue;
+            }
+            /* 'M' is the whole match */
+            const regmatch_t *match =
+                *o == 'M' ? &p->matches[0] : &p->matches[m];
+            if ((int)match->rm_so < 0) {
+                fprintf(stderr,
+                        "warning: have no match for '%c' in signature %s\n",
+                        *o, signatures[i]);
+                /* push an empty string or zero */
+                arg->str = line + line_len;
+                continue;
+            }
+            arg->str = line + match->rm_so;
+            arg->len = match->rm_eo - match->rm_so;
+
+            switch (*o) {
+                case 'M':
+                case 'S':
+                    break;
+                case 'c':
+                    assert(arg->len == 1);
+                    arg->op.c = *arg->str;
+                    break;
+                case 'i':
+                    arg->op.i = shm_parse_int(arg->str, arg->len);
+                    break;
+                case 'l':
+                    arg->op.l = shm_parse_long(arg->str, arg->len);
+                    break;
+                case 'f':
+                    arg->op.f = shm_parse_double(arg->str, arg->len);
+                    break;
+                case 'd':
+                    arg->op.d = shm_parse_double(arg->str, arg->len);
+                    break;
+                default:
+                    assert(0 && "Invalid signature");
+            }
+        }
+    }
+}
+
+/* push the parsed events to the shared buffer, this is done only
+ * by the main thread, so the IDs of events are increasing */
+static void push_batch(struct buffer *shm, struct event_record *events,
+                       struct event *ev, size_t first_line,
+                       struct batch *batch) {
+    (void)first_line;
+    unsigned char *pos = batch->data;
+    unsigned char *end = batch->data + batch->size;
+    while (pos < end) {
+        struct parsed_event *pev = (struct parsed_event *)pos;
+        struct parsed_arg *arg = (struct parsed_arg *)(pev + 1);
+        pos += sizeof(*pev) + pev->args_num * sizeof(*arg);
+
+        printf("{");
+        void *addr;
+        while (!(addr = buffer_start_push(shm))) {
+            ++waiting_for_buffer;
+        }
+        /* push the base info about event */
+        ++ev->base.id;
+        ev->base.kind = events[pev->expr].kind;
+#ifdef WITH_LINES
+        ev->line = first_line + pev->line;
+#endif
+        addr = buffer_partial_push(shm, addr, ev, sizeof(*ev));
+
+        /* push the arguments of the event right from the input */
+        const char *o = signatures[pev->expr];
+        for (size_t m = 0; m < pev->args_num; ++m, ++o, ++arg) {
+            if (m > 0)
+                printf(", ");
+            switch (*o) {
+                case 'L':
+                case 'M':
+                case 'S':
+                    printf("'%.*s'", (int)arg->len, arg->str);
+                    addr = buffer_partial_push_bytes_str(
+                        shm, addr, ev->base.id, arg->str, arg->len);
+                    break;
+                case 'c':
+                    printf("%c", arg->op.c);
+                    addr = buffer_partial_push(shm, addr, &arg->op.c,
+                                               sizeof(arg->op.c));
+                    break;
+                case 'i':
+                    printf("%d", arg->op.i);
+                    addr = buffer_partial_push(shm, addr, &arg->op.i,
+                                               sizeof(arg->op.i));
+                    break;
+                case 'l':
+                    printf("%ld", arg->op.l);
+                    addr = buffer_partial_push(shm, addr, &arg->op.l,
+                                               sizeof(arg->op.l));
+                    break;
+                case 'f':
+                    printf("%lf", arg->op.f);
+                    addr = buffer_partial_push(shm, addr, &arg->op.f,
+                                               sizeof(arg->op.f));
+                    break;
+                case 'd':
+                    printf("%lf", arg->op.d);
+                    addr = buffer_partial_push(shm, addr, &arg->op.d,
+                                               sizeof(arg->op.d));
+                    break;
+                default:
+                    assert(0 && "Invalid signature");
+            }
+        }
+        buffer_finish_push(shm);
+        printf("}\n");
+    }
+    batch->size = 0;
+}
+
+/*
+ * Parallel parsing. The reader thread reads the input in big chunks
+ * that end on a line boundary and puts them into a ring of slots.
+ * The workers take the chunks in order, parse them into batches
+ * of events and the main thread pushes the batches to the shared
+ * buffer in the order of chunks, so the events are in the order
+ * of the input and only one thread writes to the shared buffer.
+ * The main thread never blocks in read(), so a parsed chunk is pushed
+ * right away even if the next input comes much later.
+ */
+enum chunk_state { CHUNK_FREE, CHUNK_READY, CHUNK_PARSING, CHUNK_DONE };
+
+struct chunk {
+    char *data;
+    size_t size;
+    size_t alloc;
+    /* the number of lines in the chunk */
+    size_t lines;
+    struct batch events;
+    enum chunk_state state;
+};
+
+static struct {
+    struct chunk *chunks;
+    size_t chunks_num;
+    /* the number of chunks read so far */
+    size_t next_read;
+    /* the next chunk that a worker takes */
+    size_t next_parse;
+    /* the reader read all input */
+    bool eof;
+    bool quit;
+    mtx_t lock;
+    /* signalled when a chunk becomes ready or when we quit */
+    cnd_t ready;
+    /* signalled when a chunk is parsed or when the reader hits EOF */
+    cnd_t done;
+    /* signalled when a chunk was pushed and can be read into again */
+    cnd_t freed;
+    const char **wanted;
+    int fd;
+} pipeline;
+
+static void parse_chunk(struct parser *p, struct chunk *chunk) {
+    char *line = chunk->data;
+    char *end = chunk->data + chunk->size;
+    size_t line_no = 0;
+    while (line < end) {
+        char *nl = memchr(line, '\n', end - line);
+        if (!nl) /* the last line without newline, we have space for NUL */
+            nl = end;
+        *nl = '\0';
+        parse_line(p, line, nl - line, ++line_no, &chunk->events);
+        line = nl + 1;
+    }
+    chunk->lines = line_no;
+}
+
+static int worker_thrd(void *data) {
+    (void)data;
+    struct parser parser;
+    parser_init(&parser, pipeline.wanted);
+
+    mtx_lock(&pipeline.lock);
+    while (1) {
+        struct chunk *chunk =
+            &pipeline.chunks[pipeline.next_parse % pipeline.chunks_num];
+        if (chunk->state != CHUNK_READY) {
+            if (pipeline.quit)
+                break;
+            cnd_wait(&pipeline.ready, &pipeline.lock);
+            continue;
+        }
+        chunk->state = CHUNK_PARSING;
+        ++pipeline.next_parse;
+        mtx_unlock(&pipeline.lock);
+
+        parse_chunk(&parser, chunk);
+
+        mtx_lock(&pipeline.lock);
+        chunk->state = CHUNK_DONE;
+        cnd_signal(&pipeline.done);
+    }
+    mtx_unlock(&pipeline.lock);
+
+    parser_destroy(&parser);
+    return 0;
+}
+
+/* fill `chunk` with whole lines from `fd`, the start of an incomplete line
+ * is kept in `carry`. Returns false when there is no more input. */
+static bool read_chunk(int fd, struct chunk *chunk, struct batch *carry,
+                       bool *eof) {
+    if (chunk->alloc < CHUNK_SIZE + 1 || chunk->alloc < carry->size + 1) {
+        chunk->alloc = CHUNK_SIZE + 1 > carry->size + 1 ? CHUNK_SIZE + 1
+                                                        : 2 * carry->size + 1;
+        chunk->data = resize(chunk->data, chunk->alloc);
+    }
+    memcpy(chunk->data, carry->data, carry->size);
+    chunk->size = carry->size;
+    carry->size = 0;
+
+    while (!*eof) {
+        /* keep one byte to terminate the last line */
+        if (chunk->size + 1 == chunk->alloc) {
+            /* one line does not fit the chunk */
+            if (memchr(chunk->data, '\n', chunk->size))
+                break;
+            chunk->alloc = 2 * chunk->alloc;
+            chunk->data = resize(chunk->data, chunk->alloc);
+        }
+        ssize_t len = read(fd, chunk->data + chunk->size,
+                           chunk->alloc - 1 - chunk->size);
+        if (len < 0) {
+            perror("read");
+            *eof = true;
+        } else if (len == 0) {
+            *eof = true;
+        } else {
+            chunk->size += len;
+            /* do not wait for more data if we have some lines,
+             * the monitor wants the events as soon as possible */
+            if ((size_t)len < chunk->alloc - 1 - (chunk->size - len) &&
+                memchr(chunk->data + chunk->size - len, '\n', len))
+                break;
+        }
+    }
+
+    if (!*eof) {
+        /* cut the chunk after the last newline */
+        size_t cut = chunk->size;
+        while (chunk->data[cut - 1] != '\n')
+            --cut;
+        if (cut < chunk->size) {
+            memcpy(batch_append(carry, chunk->size - cut), chunk->data + cut,
+                   chunk->size - cut);
+            chunk->size = cut;
+        }
+    }
+    return chunk->size > 0;
+}
+
+static int reader_thrd(void *data) {
+    (void)data;
+    struct batch carry = {0};
+    bool eof = false;
+
+    mtx_lock(&pipeline.lock);
+    while (!eof) {
+        struct chunk *chunk =
+            &pipeline.chunks[pipeline.next_read % pipeline.chunks_num];
+        if (chunk->state != CHUNK_FREE) {
+            cnd_wait(&pipeline.freed, &pipeline.lock);
+            continue;
+        }
+
+        /* free chunks belong to the reader */
+        mtx_unlock(&pipeline.lock);
+        bool have_data = read_chunk(pipeline.fd, chunk, &carry, &eof);
+        mtx_lock(&pipeline.lock);
+        if (have_data) {
+            chunk->state = CHUNK_READY;
+            ++pipeline.next_read;
+            cnd_signal(&pipeline.ready);
+        }
+    }
+    pipeline.eof = true;
+    cnd_signal(&pipeline.done);
+    mtx_unlock(&pipeline.lock);
+
+    free(carry.data);
+    return 0;
+}
+
+static void parse_parallel(int fd, size_t threads_num, struct buffer *shm,
+                           struct event_record *events, struct event *ev,
+                           const char *wanted[]) {
+    pipeline.chunks_num = 2 * threads_num;
+    pipeline.chunks = xalloc(pipeline.chunks_num * sizeof(struct chunk));
+    memset(pipeline.chunks, 0, pipeline.chunks_num * sizeof(struct chunk));
+    pipeline.wanted = wanted;
+    pipeline.fd = fd;
+    mtx_init(&pipeline.lock, mtx_plain);
+    cnd_init(&pipeline.ready);
+    cnd_init(&pipeline.done);
+    cnd_init(&pipeline.freed);
+
+    thrd_t threads[threads_num];
+    for (size_t i = 0; i < threads_num; ++i) {
+        if (thrd_create(&threads[i], worker_thrd, NULL) != thrd_success) {
+            fprintf(stderr, "Failed creating a thread\n");
+            abort();
+        }
+    }
+    thrd_t reader;
+    if (thrd_create(&reader, reader_thrd, NULL) != thrd_success) {
+        fprintf(stderr, "Failed creating a thread\n");
+        abort();
+    }
+
+    size_t next_push = 0;
+    size_t lines = 0;
+
+    mtx_lock(&pipeline.lock);
+    while (1) {
+        struct chunk *chunk =
+            &pipeline.chunks[next_push % pipeline.chunks_num];
+        if (next_push < pipeline.next_read && chunk->state == CHUNK_DONE) {
+            mtx_unlock(&pipeline.lock);
+            push_batch(shm, events, ev, lines, &chunk->events);
+            lines += chunk->lines;
+            mtx_lock(&pipeline.lock);
+            chunk->state = CHUNK_FREE;
+            ++next_push;
+            cnd_signal(&pipeline.freed);
+            continue;
+        }
+        if (pipeline.eof && next_push == pipeline.next_read)
+            break;
+
+        cnd_wait(&pipeline.done, &pipeline.lock);
+    }
+    pipeline.quit = true;
+    cnd_broadcast(&pipeline.ready);
+    mtx_unlock(&pipeline.lock);
+
+    thrd_join(reader, NULL);
+    for (size_t i = 0; i < threads_num; ++i) {
+        thrd_join(threads[i], NULL);
+    }
+    for (size_t i = 0; i < pipeline.chunks_num; ++i) {
+        free(pipeline.chunks[i].data);
+        free(pipeline.chunks[i].events.data);
+    }
+    free(pipeline.chunks);
+    cnd_destroy(&pipeline.ready);
+    cnd_destroy(&pipeline.done);
+    cnd_destroy(&pipeline.freed);
+    mtx_destroy(&pipeline.lock);
+}
+
+static void parse_sequential(int fd, struct buffer *shm,
+                             struct event_record *events, struct event *ev,
+                             const char *wanted[]) {
+    struct parser parser;
+    parser_init(&parser, wanted);
+    struct batch batch = {0};
+
+    /* read big chunks of the input, the lines are split in place */
+    struct shm_line_reader reader;
+    shm_line_reader_init(&reader, fd, SHM_LINE_READER_CAPACITY);
+
+    char *line;
+    ssize_t line_len;
+    size_t line_no = 0;
+    while ((line_len = shm_line_reader_next(&reader, &line)) != -1) {
+        parse_line(&parser, line, line_len, ++line_no, &batch);
+        if (batch.size > 0)
+            push_batch(shm, events, ev, 0, &batch);
+    }
+
+    shm_line_reader_destroy(&reader);
+    free(batch.data);
+    parser_destroy(&parser);
+}
+
 int main(int argc, char *argv[]) {
+    size_t threads_num = 1;
+    if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+        long n = atol(argv[2]);
+        if (n < 1) {
+            fprintf(stderr, "Invalid number of threads: %s\n", argv[2]);
+            usage_and_exit(1);
+        }
+        threads_num = n;
+        argc -= 2;
+        argv += 2;
+    }
+
     if (argc < 5 && (argc - 2) % 3 != 0) {
         usage_and_exit(1);
     }
 
-    size_t exprs_num = (argc - 1) / 3;
+    exprs_num = (argc - 1) / 3;
     if (exprs_num == 0) {
         usage_and_exit(1);
     }
 
     const char *shmkey = argv[1];
-    char *exprs[exprs_num];
-    char *signatures[exprs_num];
+    char *exprs_arr[exprs_num];
+    char *signatures_arr[exprs_num];
     char *names[exprs_num];
-    regex_t re[exprs_num];
+    exprs = exprs_arr;
+    signatures = signatures_arr;
 
     int arg_i = 2;
     for (int i = 0; i < (int)exprs_num; ++i) {
@@ -62,13 +592,14 @@ int main(int argc, char *argv[]) {
         }
         signatures[i] = argv[arg_i++];
 
-        /* compile the regex, use extended RE */
-        int status = regcomp(&re[i], exprs[i], REG_EXTENDED);
+        /* check the regex before we create the buffer */
+        regex_t re;
+        int status = regcomp(&re, exprs[i], REG_EXTENDED);
         if (status != 0) {
             fprintf(stderr, "Failed compiling regex '%s'\n", exprs[i]);
-            /* FIXME: we leak the expressions compiled so far ... */
             exit(1);
         }
+        regfree(&re);
     }
 
     /* Initialize the info about this source */
@@ -84,153 +615,25 @@ int main(int argc, char *argv[]) {
     buffer_wait_for_monitor(shm);
     fprintf(stderr, "done\n");
 
-    regmatch_t matches[MAXMATCH + 1];
-
-    int status;
-    ssize_t len;
-    size_t line_len;
-    char *line = NULL;
-    char *tmpline = NULL;
-    size_t tmpline_len = 0;
-    signature_operand op;
-
     struct event ev;
     memset(&ev, 0, sizeof(ev));
     size_t num;
     struct event_record *events = buffer_get_avail_events(shm, &num);
     assert(num == exprs_num && "Information in shared memory does not fit");
 
-    while (1) {
-        len = getline(&line, &line_len, stdin);
-        if (len == -1)
-            break;
-        if (len == 0)
-            continue;
-
-#ifdef WITH_LINES
-        ++ev.line;
-#endif
-
-        /* remove newline from the line */
-        line[len - 1] = '\0';
-
-        for (int i = 0; i < (int)exprs_num; ++i) {
-            if (events[i].kind == 0)
-                continue; /* monitor is not interested in this */
-
-            status = regexec(&re[i], line, MAXMATCH, matches, 0);
-            if (status != 0) {
-                continue;
-            }
-            printf("{");
-            int m = 1;
-            void *addr;
-            while (!(addr = buffer_start_push(shm))) {
-                ++waiting_for_buffer;
-            }
-            /* push the base info about event */
-            ++ev.base.id;
-            ev.base.kind = events[i].kind;
-            addr = buffer_partial_push(shm, addr, &ev, sizeof(ev));
-
-            /* push the arguments of the event */
-            for (const char *o = signatures[i]; *o && m <= MAXMATCH; ++o, ++m) {
-                if (m > 1)
-                    printf(", ");
-
-                if (*o == 'L') { /* user wants the whole line */
-                    printf("'%s'", line);
-                    addr = buffer_partial_push_str(shm, addr, ev.base.id, line);
-                    continue;
-                }
-                if (*o != 'M') {
-                    if ((int)matches[m].rm_so < 0) {
-                        fprintf(
-                            stderr,
-                            "warning: have no match for '%c' in signature %s\n",
-                            *o, signatures[i]);
-                        continue;
-                    }
-                    len = matches[m].rm_eo - matches[m].rm_so;
-                } else {
-                    len = matches[0].rm_eo - matches[0].rm_so;
-                }
-
-                /* make sure we have big enough temporary buffer */
-                if (tmpline_len < (size_t)len) {
-                    free(tmpline);
-                    tmpline = malloc(sizeof(char) * len + 1);
-                    assert(tmpline && "Memory allocation failed");
-                    tmpline_len = len;
-                }
-
-                if (*o == 'M') { /* user wants the whole match */
-                    assert(matches[0].rm_so >= 0);
-                    strncpy(tmpline, line + matches[0].rm_so, len);
-                    tmpline[len] = '\0';
-                    addr =
-                        buffer_partial_push_str(shm, addr, ev.base.id, tmpline);
-                    printf("'%s'", tmpline);
-                    continue;
-                } else {
-                    strncpy(tmpline, line + matches[m].rm_so, len);
-                    tmpline[len] = '\0';
-                }
-
-                switch (*o) {
-                    case 'c':
-                        assert(len == 1);
-                        printf("%c", *(char *)(line + matches[m].rm_eo));
-                        addr = buffer_partial_push(
-                            shm, addr, (char *)(line + matches[m].rm_eo),
-                            sizeof(op.c));
-                        break;
-                    case 'i':
-                        op.i = atoi(tmpline);
-                        printf("%d", op.i);
-                        addr =
-                            buffer_partial_push(shm, addr, &op.i, sizeof(op.i));
-                        break;
-                    case 'l':
-                        op.l = atol(tmpline);
-                        printf("%ld", op.l);
-                        addr =
-                            buffer_partial_push(shm, addr, &op.l, sizeof(op.l));
-                        break;
-                    case 'f':
-                        op.f = atof(tmpline);
-                        printf("%lf", op.f);
-                        addr =
-                            buffer_partial_push(shm, addr, &op.f, sizeof(op.f));
-                        break;
-                    case 'd':
-                        op.d = strtod(tmpline, NULL);
-                        printf("%lf", op.d);
-                        addr =
-                            buffer_partial_push(shm, addr, &op.d, sizeof(op.d));
-                        break;
-                    case 'S':
-                        printf("'%s'", tmpline);
-                        addr = buffer_partial_push_str(shm, addr, ev.base.id,
-                                                       tmpline);
-                        break;
-                    default:
-                        assert(0 && "Invalid signature");
-                }
-            }
-            buffer_finish_push(shm);
-            printf("}\n");
-        }
+    const char *wanted[exprs_num];
+    for (int i = 0; i < (int)exprs_num; ++i) {
+        /* monitor is not interested in the rest */
+        wanted[i] = events[i].kind == 0 ? NULL : exprs[i];
     }
 
-    /* Free up memory held within the regex memory */
+    if (threads_num == 1)
+        parse_sequential(STDIN_FILENO, shm, events, &ev, wanted);
+    else
+        parse_parallel(STDIN_FILENO, threads_num, shm, events, &ev, wanted);
+
     fprintf(stderr, "info: sent %lu events, busy waited on buffer %lu cycles\n",
             ev.base.id, waiting_for_buffer);
-    free(tmpline);
-    free(line);
-    for (int i = 0; i < (int)exprs_num; ++i) {
-        regfree(&re[i]);
-    }
 
     destroy_shared_buffer(shm);
 
@@ -0,0 +1,317 @@
+/***********************************************
+ * Re-create shared-memory buffers forwarded from another host
+ * by `shamon-bridge-send`.
+ *
+ * The receiver accepts a single connection and for every buffer that
+ * the sender forwards, it creates a local buffer with the same events
+ * (and with the same key, possibly with a suffix, so that the receiver
+ * can run on the same host as the sender, e.g., for testing), waits
+ * for a monitor and pushes the received events into the buffer, keeping
+ * their ids. The sender gets credit only for the data that have been
+ * pushed into the buffers, so a slow monitor slows down the sender.
+ * See core/bridge.h for the protocol.
+ ************************************************/
+
+#include <assert.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bridge.h"
+#include "event.h"
+#include "shmbuf/buffer.h"
+#include "shmbuf/client.h"
+#include "signatures.h"
+#include "source.h"
+#include "utils.h"
+
+#define DEFAULT_WINDOW (4 * SHM_BRIDGE_MAX_PAYLOAD)
+
+static _Noreturn void usage_and_exit(int ret) {
+    fprintf(stderr,
+            "Usage: shamon-bridge-recv [-l address] [-p port] [-s suffix] "
+            "[-w window]\n"
+            "\n"
+            "  -l   the address to listen on (default: any)\n"
+            "  -p   the port to listen on (default: 4242)\n"
+            "  -s   append the suffix to the keys of the buffers\n"
+            "  -w   the number of bytes that the sender may send before\n"
+            "       the receiver pushes them into buffers (default: %d)\n",
+            DEFAULT_WINDOW);
+    exit(ret);
+}
+
+struct channel {
+    struct buffer *shm;
+    struct event_record *events;
+    size_t events_num;
+    size_t elem_size;
+    /* the kinds registered by the monitor */
+    shm_kind *kinds;
+    size_t pushed;
+    size_t skipped;
+};
+
+static struct channel *channels = NULL;
+static size_t channels_num = 0;
+
+static int open_channel(uint32_t id, const unsigned char *payload, size_t size,
+                        const char *suffix) {
+    shm_bridge_hello hello;
+    struct event_record *events =
+        shm_bridge_hello_decode(payload, size, &hello);
+    if (!events) {
+        fprintf(stderr, "Got invalid HELLO frame\n");
+        return -1;
+    }
+
+    if (id >= channels_num) {
+        channels = realloc(channels, (id + 1) * sizeof(*channels));
+        assert(channels && "Allocation failed");
+        memset(channels + channels_num, 0,
+               (id + 1 - channels_num) * sizeof(*channels));
+        channels_num = id + 1;
+    }
+    struct channel *ch = &channels[id];
+    if (ch->shm) {
+        fprintf(stderr, "Channel %u is already open\n", id);
+        free(events);
+        return -1;
+    }
+
+    ch->events_num = hello.events_num;
+    ch->elem_size = hello.elem_size;
+    ch->events = events;
+
+    const char **names = xalloc(ch->events_num * sizeof(char *));
+    const char **signatures = xalloc(ch->events_num * sizeof(char *));
+    for (size_t i = 0; i < ch->events_num; ++i) {
+        names[i] = ch->events[i].name;
+        signatures[i] = (const char *)ch->events[i].signature;
+    }
+    struct source_control *control =
+        source_control_define_pairwise(ch->events_num, names, signatures);
+    assert(control);
+    free(names);
+    free(signatures);
+
+    char key[sizeof(hello.key) + 64];
+    snprintf(key, sizeof(key), "%s%s", hello.key, suffix);
+    ch->shm = create_shared_buffer_adv(key, S_IRWXU, ch->elem_size,
+                                       hello.capacity, control);
+    free(control);
+    if (!ch->shm) {
+        fprintf(stderr, "Failed creating buffer '%s'\n", key);
+        return -1;
+    }
+
+    fprintf(stderr, "info: buffer '%s': waiting for the monitor to attach... ",
+            key);
+    buffer_wait_for_monitor(ch->shm);
+    fprintf(stderr, "done\n");
+
+    /* the monitor may have assigned different kinds to the events */
+    size_t num;
+    struct event_record *recs = buffer_get_avail_events(ch->shm, &num);
+    assert(num == ch->events_num && "Information in shared memory does not fit");
+    ch->kinds = xalloc(num * sizeof(shm_kind));
+    for (size_t i = 0; i < num; ++i) ch->kinds[i] = recs[i].kind;
+
+    return 0;
+}
+
+static struct event_record *get_event(struct channel *ch, shm_kind kind,
+                                      size_t *idx) {
+    for (size_t i = 0; i < ch->events_num; ++i) {
+        if (ch->events[i].kind == kind) {
+            *idx = i;
+            return &ch->events[i];
+        }
+    }
+    return NULL;
+}
+
+static int push_events(struct channel *ch, const unsigned char *p,
+                       size_t size, unsigned char *tmp) {
+    const unsigned char *const end = p + size;
+    while (p < end) {
+        if ((size_t)(end - p) < ch->elem_size)
+            return -1;
+
+        memcpy(tmp, p, ch->elem_size);
+        p += ch->elem_size;
+        shm_event *ev = (shm_event *)tmp;
+        size_t idx;
+        struct event_record *info = get_event(ch, ev->kind, &idx);
+        if (!info) {
+            fprintf(stderr, "Got unknown kind of event: %lu\n", ev->kind);
+            return -1;
+        }
+        ev->kind = ch->kinds[idx];
+
+        void *addr = NULL;
+        if (ev->kind != 0) {
+            size_t spinned = 0;
+            while (!(addr = buffer_start_push(ch->shm))) {
+                if (++spinned > SPIN_LIMIT) {
+                    sched_yield();
+                    spinned = 0;
+                }
+            }
+            buffer_partial_push(ch->shm, addr, tmp, ch->elem_size);
+        }
+
+        /* strings follow the element, we must read them even if
+         * the monitor is not interested in the event */
+        size_t off = sizeof(shm_event);
+        for (const unsigned char *o = info->signature; *o; ++o) {
+            if (*o == 'S' || *o == 'L' || *o == 'M') {
+                uint32_t len;
+                if ((size_t)(end - p) < sizeof(len))
+                    return -1;
+                len = shm_bridge_get_u32(p);
+                p += sizeof(len);
+                if ((size_t)(end - p) < len || len == 0 || p[len - 1] != '\0')
+                    return -1;
+                if (addr)
+                    buffer_partial_push_str_n(ch->shm,
+                                              (unsigned char *)addr + off,
+                                              ev->id, (const char *)p, len);
+                p += len;
+            }
+            off += signature_op_get_size(*o);
+        }
+
+        if (addr) {
+            buffer_finish_push(ch->shm);
+            ++ch->pushed;
+        } else {
+            ++ch->skipped;
+        }
+    }
+
+    return 0;
+}
+
+static int send_credit(shm_bridge_conn *conn, uint64_t credit) {
+    unsigned char payload[sizeof(credit)];
+    shm_bridge_put_u64(payload, credit);
+    return shm_bridge_send(conn, SHM_BRIDGE_CREDIT, 0, payload,
+                           sizeof(payload));
+}
+
+static void close_channel(uint32_t id, struct channel *ch) {
+    fprintf(stderr, "info: channel %u: pushed %lu events, skipped %lu\n", id,
+            ch->pushed, ch->skipped);
+    destroy_shared_buffer(ch->shm);
+    ch->shm = NULL;
+    free(ch->events);
+    free(ch->kinds);
+}
+
+int main(int argc, char *argv[]) {
+    const char *address = NULL;
+    const char *port = "4242";
+    const char *suffix = "";
+    uint64_t window = DEFAULT_WINDOW;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:p:s:w:h")) != -1) {
+        switch (opt) {
+            case 'l':
+                address = optarg;
+                break;
+            case 'p':
+                port = optarg;
+                break;
+            case 's':
+                suffix = optarg;
+                break;
+            case 'w':
+                window = strtoull(optarg, NULL, 10);
+                break;
+            case 'h':
+                usage_and_exit(0);
+            default:
+                usage_and_exit(1);
+        }
+    }
+
+    if (window < SHM_BRIDGE_MAX_PAYLOAD) {
+        fprintf(stderr, "The window must be at least %d bytes\n",
+                SHM_BRIDGE_MAX_PAYLOAD);
+        return 1;
+    }
+
+    fprintf(stderr, "info: waiting for the sender on port %s\n", port);
+    int fd = shm_bridge_accept(address, port);
+    if (fd < 0)
+        return 1;
+    shm_bridge_conn *conn = shm_bridge_conn_create(fd, false);
+
+    int ret = send_credit(conn, window);
+    unsigned char *tmp = NULL;
+    size_t tmp_size = 0;
+    shm_bridge_frame_header hdr;
+    const unsigned char *payload;
+    while (ret == 0 && (payload = shm_bridge_recv(conn, &hdr))) {
+        struct channel *ch =
+            hdr.channel < channels_num ? &channels[hdr.channel] : NULL;
+        switch (hdr.type) {
+            case SHM_BRIDGE_HELLO:
+                ret = open_channel(hdr.channel, payload, hdr.raw_size, suffix);
+                break;
+            case SHM_BRIDGE_DATA:
+                if (!ch || !ch->shm) {
+                    fprintf(stderr, "Got data for unknown channel %u\n",
+                            hdr.channel);
+                    ret = -1;
+                    break;
+                }
+                if (tmp_size < ch->elem_size) {
+                    tmp_size = ch->elem_size;
+                    tmp = realloc(tmp, tmp_size);
+                    assert(tmp && "Allocation failed");
+                }
+                if (push_events(ch, payload, hdr.raw_size, tmp) < 0) {
+                    fprintf(stderr, "Got malformed events\n");
+                    ret = -1;
+                    break;
+                }
+                ret = send_credit(conn, hdr.raw_size);
+                break;
+            case SHM_BRIDGE_END:
+                if (!ch || !ch->shm) {
+                    fprintf(stderr, "Got end of unknown channel %u\n",
+                            hdr.channel);
+                    ret = -1;
+                    break;
+                }
+                close_channel(hdr.channel, ch);
+                break;
+            default:
+                fprintf(stderr, "Got unknown frame type %u\n", hdr.type);
+                ret = -1;
+        }
+    }
+    /* hdr.type is 0 if the sender closed the connection, otherwise
+     * receiving the frame failed */
+    if (ret == 0 && hdr.type != 0)
+        ret = -1;
+
+    for (size_t i = 0; i < channels_num; ++i) {
+        if (channels[i].shm) {
+            fprintf(stderr, "warning: channel %lu was not ended\n", i);
+            close_channel(i, &channels[i]);
+        }
+    }
+
+    shm_bridge_conn_destroy(conn);
+    free(channels);
+    free(tmp);
+
+    return ret == 0 ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+/***********************************************
+ * Replay events recorded by `shamon-record`.
+ *
+ * The replayer re-creates the shared-memory buffer with the same
+ * events (and by default also with the same key, capacity and size
+ * of elements) and pushes the recorded events into it, keeping their
+ * ids. The events are emitted with the original timing, with the
+ * timing scaled by a factor, or as fast as possible.
+ ************************************************/
+
+#include <assert.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "event.h"
+#include "recording.h"
+#include "shmbuf/buffer.h"
+#include "shmbuf/client.h"
+#include "signatures.h"
+#include "source.h"
+#include "utils.h"
+
+static _Noreturn void usage_and_exit(int ret) {
+    fprintf(stderr,
+            "Usage: shamon-replay recording [-k shmkey] [-s speed] "
+            "[-c capacity]\n"
+            "\n"
+            "  -k   the key of the buffer (default: the recorded key)\n"
+            "  -s   the speed of the replay relative to the original\n"
+            "       speed, e.g., 2 is twice as fast, 0 replays\n"
+            "       as fast as possible (default: 1)\n"
+            "  -c   the capacity of the buffer (default: the recorded "
+            "capacity)\n");
+    exit(ret);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        usage_and_exit(1);
+    }
+
+    const char *shmkey = NULL;
+    double speed = 1;
+    size_t capacity = 0;
+
+    int opt;
+    optind = 2;
+    while ((opt = getopt(argc, argv, "k:s:c:h")) != -1) {
+        switch (opt) {
+            case 'k':
+                shmkey = optarg;
+                break;
+            case 's':
+                speed = strtod(optarg, NULL);
+                break;
+            case 'c':
+                capacity = strtoull(optarg, NULL, 10);
+                break;
+            case 'h':
+                usage_and_exit(0);
+            default:
+                usage_and_exit(1);
+        }
+    }
+
+    if (speed < 0) {
+        fprintf(stderr, "The speed must not be negative\n");
+        return 1;
+    }
+
+    shm_recording *rec = shm_recording_open(argv[1]);
+    if (!rec)
+        return 1;
+
+    if (!shmkey)
+        shmkey = shm_recording_key(rec);
+    if (capacity == 0)
+        capacity = shm_recording_capacity(rec);
+
+    size_t events_num;
+    struct event_record *events = shm_recording_events(rec, &events_num);
+    const char **names = malloc(events_num * sizeof(char *));
+    const char **signatures = malloc(events_num * sizeof(char *));
+    assert(names && signatures);
+    for (size_t i = 0; i < events_num; ++i) {
+        names[i] = events[i].name;
+        signatures[i] = (const char *)events[i].signature;
+    }
+    struct source_control *control =
+        source_control_define_pairwise(events_num, names, signatures);
+    assert(control);
+    free(names);
+    free(signatures);
+
+    struct buffer *shm =
+        create_shared_buffer_adv(shmkey, S_IRWXU, shm_recording_elem_size(rec),
+                                 capacity, control);
+    assert(shm);
+    free(control);
+
+    fprintf(stderr, "info: waiting for the monitor to attach... ");
+    buffer_wait_for_monitor(shm);
+    fprintf(stderr, "done\n");
+
+    /* the monitor may have assigned different kinds to the events,
+     * map the recorded kinds to the new ones */
+    size_t num;
+    struct event_record *recs = buffer_get_avail_events(shm, &num);
+    assert(num == events_num && "Information in shared memory does not fit");
+    shm_kind *kinds = malloc(events_num * sizeof(shm_kind));
+    assert(kinds);
+    for (size_t i = 0; i < events_num; ++i) kinds[i] = recs[i].kind;
+
+    shm_event ev;
+    signature_operand op;
+    uint64_t time;
+    shm_kind kind;
+    size_t n = 0, skipped = 0;
+    int ret;
+    const uint64_t start = now_ns();
+
+    while ((ret = shm_recording_read_event(rec, &time, &kind, &ev.id)) > 0) {
+        struct event_record *info = shm_recording_get_event(rec, kind);
+        if (!info) {
+            fprintf(stderr, "Unknown kind of event in the recording: %lu\n",
+                    kind);
+            ret = -1;
+            break;
+        }
+        ev.kind = kinds[info - events];
+
+        if (speed > 0)
+            sleep_until(start + (uint64_t)(time / speed));
+
+        void *addr = NULL;
+        if (ev.kind != 0) {
+            size_t spinned = 0;
+            while (!(addr = buffer_start_push(shm))) {
+                if (++spinned > SPIN_LIMIT) {
+                    sched_yield();
+                    spinned = 0;
+                }
+            }
+            addr = buffer_partial_push(shm, addr, &ev, sizeof(ev));
+        }
+
+        /* we must read the arguments even if the monitor is not
+         * interested in the event */
+        for (const unsigned char *o = info->signature; *o; ++o) {
+            if (*o == '_')
+                continue;
+            if (*o == 'S' || *o == 'L' || *o == 'M') {
+                size_t len;
+                const char *str = shm_recording_read_str(rec, &len);
+                if (!str) {
+                    ret = -1;
+                    break;
+                }
+                /* push also the terminating 0 */
+                if (addr)
+                    addr = buffer_partial_push_str_n(shm, addr, ev.id, str,
+                                                     len + 1);
+                continue;
+            }
+
+            if (shm_recording_read_arg(rec, *o, &op) < 0) {
+                ret = -1;
+                break;
+            }
+            if (addr)
+                addr = buffer_partial_push(shm, addr, &op,
+                                           signature_op_get_size(*o));
+        }
+
+        if (ret < 0) {
+            /* do not finish the push, the partial event is never
+             * seen by the monitor */
+            fprintf(stderr, "Failed reading arguments of an event, "
+                            "dropping it\n");
+            break;
+        }
+
+        if (addr) {
+            buffer_finish_push(shm);
+            ++n;
+        } else {
+            ++skipped;
+        }
+    }
+
+    const double duration = (now_ns() - start) * 1e-9;
+    fprintf(stderr,
+            "info: replayed %lu events in %.3lf s (%.0lf ev/s), skipped %lu\n",
+            n, duration, n / duration, skipped);
+
+    free(kinds);
+    shm_recording_close(rec);
+    destroy_shared_buffer(shm);
+
+    return ret == 0 ? 0 : 1;
+}
@@ -0,0 +1,218 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "event.h"
+#include "line_reader.h"
+#include "parse_number.h"
+#include "shmbuf/buffer.h"
+#include "shmbuf/client.h"
+#include "signatures.h"
+#include "source.h"
+#include "struct_log.h"
+#include "utils.h"
+
+/*
+ * A source of events from structured logs (JSON lines or logfmt).
+ * The kind of the event is given by the value of the discriminator field,
+ * the arguments of the event are the values of the given fields.
+ * E.g., `structlog /log event login user,uid Si` turns the line
+ * {"event": "login", "user": "joe", "uid": 7} into the event login('joe', 7).
+ */
+
+static void usage_and_exit(int ret) {
+    fprintf(stderr, "Usage: structlog shmkey discriminator name fields sig "
+                    "[name fields sig] ...\n"
+                    "  fields is a comma-separated list of keys, one for "
+                    "every character of the signature\n");
+    exit(ret);
+}
+
+struct event {
+    shm_event base;
+    unsigned char args[];
+};
+
+static size_t waiting_for_buffer = 0;
+
+/* JSON booleans are numbers for us */
+static long parse_long(const struct shm_struct_log_value *v) {
+    if (v->len == 4 && memcmp(v->str, "true", 4) == 0)
+        return 1;
+    return shm_parse_long(v->str, v->len);
+}
+
+/* add the key to `keys` if it is not there yet, return its index */
+static size_t add_key(const char *keys[], size_t *keys_num, const char *key) {
+    for (size_t i = 0; i < *keys_num; ++i) {
+        if (strcmp(keys[i], key) == 0)
+            return i;
+    }
+    keys[*keys_num] = key;
+    return (*keys_num)++;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 6 || (argc - 3) % 3 != 0) {
+        usage_and_exit(1);
+    }
+
+    const char *shmkey = argv[1];
+    const size_t events_num = (argc - 3) / 3;
+    char *names[events_num];
+    char *signatures[events_num];
+    size_t names_len[events_num];
+    /* the indices of the keys of the arguments of the events */
+    size_t *fields[events_num];
+
+    size_t max_keys = 1;
+    for (int i = 3; i < argc; ++i) {
+        max_keys += strlen(argv[i]);
+    }
+    const char *keys[max_keys];
+    size_t keys_num = 0;
+    add_key(keys, &keys_num, argv[2]);
+
+    int arg_i = 3;
+    for (size_t i = 0; i < events_num; ++i) {
+        names[i] = argv[arg_i++];
+        names_len[i] = strlen(names[i]);
+        char *event_fields = argv[arg_i++];
+        signatures[i] = argv[arg_i++];
+
+        const size_t args_num = strlen(signatures[i]);
+        fields[i] = xalloc((args_num + 1) * sizeof(size_t));
+        size_t n = 0;
+        for (char *f = strtok(event_fields, ","); f; f = strtok(NULL, ",")) {
+            if (n < args_num)
+                fields[i][n] = add_key(keys, &keys_num, f);
+            ++n;
+        }
+        if (n != args_num) {
+            fprintf(stderr, "Event '%s' has %lu fields for the signature '%s'\n",
+                    names[i], n, signatures[i]);
+            usage_and_exit(1);
+        }
+        for (const char *o = signatures[i]; *o; ++o) {
+            if (!strchr("cilfdS", *o)) {
+                fprintf(stderr, "Unsupported type '%c' in the signature '%s'\n",
+                        *o, signatures[i]);
+                usage_and_exit(1);
+            }
+        }
+    }
+
+    /* Initialize the info about this source */
+    struct source_control *control = source_control_define_pairwise(
+        events_num, (const char **)names, (const char **)signatures);
+    assert(control);
+    const size_t capacity = 256;
+    struct buffer *shm = create_shared_buffer(shmkey, capacity, control);
+    assert(shm);
+    free(control);
+
+    fprintf(stderr, "info: waiting for the monitor to attach... ");
+    buffer_wait_for_monitor(shm);
+    fprintf(stderr, "done\n");
+
+    struct event ev;
+    memset(&ev, 0, sizeof(ev));
+    size_t num;
+    struct event_record *events = buffer_get_avail_events(shm, &num);
+    assert(num == events_num && "Information in shared memory does not fit");
+
+    struct shm_struct_log *slog = shm_struct_log_create(keys_num, keys);
+    struct shm_struct_log_value values[keys_num];
+    /* missing values are pushed as empty strings or zeros */
+    char empty[1] = "";
+    const struct shm_struct_log_value missing = {.str = empty, .len = 0};
+    signature_operand op;
+    size_t malformed = 0;
+
+    /* read big chunks of the input, the lines are split in place */
+    struct shm_line_reader reader;
+    shm_line_reader_init(&reader, STDIN_FILENO, SHM_LINE_READER_CAPACITY);
+
+    char *line;
+    ssize_t line_len;
+    while ((line_len = shm_line_reader_next(&reader, &line)) != -1) {
+        if (shm_struct_log_parse(slog, line, line_len, values) < 0) {
+            ++malformed;
+            continue;
+        }
+        const struct shm_struct_log_value *disc = &values[0];
+        if (!disc->str)
+            continue;
+
+        size_t i = 0;
+        for (; i < events_num; ++i) {
+            if (names_len[i] == disc->len &&
+                memcmp(names[i], disc->str, disc->len) == 0)
+                break;
+        }
+        /* unknown event or the monitor is not interested in it */
+        if (i == events_num || events[i].kind == 0)
+            continue;
+
+        void *addr;
+        while (!(addr = buffer_start_push(shm))) {
+            ++waiting_for_buffer;
+        }
+        /* push the base info about event */
+        ++ev.base.id;
+        ev.base.kind = events[i].kind;
+        addr = buffer_partial_push(shm, addr, &ev, sizeof(ev));
+
+        /* push the arguments of the event right from the line */
+        const size_t *field = fields[i];
+        for (const char *o = signatures[i]; *o; ++o, ++field) {
+            const struct shm_struct_log_value *v =
+                values[*field].str ? &values[*field] : &missing;
+            switch (*o) {
+                case 'S':
+                    addr = buffer_partial_push_bytes_str(
+                        shm, addr, ev.base.id, v->str, v->len);
+                    break;
+                case 'c':
+                    op.c = v->len > 0 ? *v->str : 0;
+                    addr = buffer_partial_push(shm, addr, &op.c, sizeof(op.c));
+                    break;
+                case 'i':
+                    op.i = parse_long(v);
+                    addr = buffer_partial_push(shm, addr, &op.i, sizeof(op.i));
+                    break;
+                case 'l':
+                    op.l = parse_long(v);
+                    addr = buffer_partial_push(shm, addr, &op.l, sizeof(op.l));
+                    break;
+                case 'f':
+                    op.f = shm_parse_double(v->str, v->len);
+                    addr = buffer_partial_push(shm, addr, &op.f, sizeof(op.f));
+                    break;
+                case 'd':
+                    op.d = shm_parse_double(v->str, v->len);
+                    addr = buffer_partial_push(shm, addr, &op.d, sizeof(op.d));
+                    break;
+                default:
+                    assert(0 && "Invalid signature");
+            }
+        }
+        buffer_finish_push(shm);
+    }
+
+    fprintf(stderr,
+            "info: sent %lu events, skipped %lu malformed lines, "
+            "busy waited on buffer %lu cycles\n",
+            ev.base.id, malformed, waiting_for_buffer);
+    shm_line_reader_destroy(&reader);
+    shm_struct_log_destroy(slog);
+    for (size_t i = 0; i < events_num; ++i) {
+        free(fields[i]);
+    }
+
+    destroy_shared_buffer(shm);
+
+    return 0;
+}
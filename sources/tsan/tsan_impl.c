@@ -22,12 +22,19 @@
 #include "core/utils.h"
 #include "shmbuf/buffer.h"
 #include "shmbuf/client.h"
+#include "shmbuf/sub-buffer-pool.h"
 
 static CACHELINE_ALIGNED _Atomic size_t last_thread_id = 1;
 static CACHELINE_ALIGNED _Atomic size_t timestamp = 1;
 
 static struct buffer *top_shmbuf;
 static struct source_control *top_control;
+/* sub-buffers for new threads */
+static struct shm_sub_buffer_pool *sub_buffers;
+/* The main thread and every thread with a sub-buffer hold a reference
+ * to the pool and the top buffer (the pool creates sub-buffers of the top
+ * buffer). The thread that drops the last reference destroys them. */
+static _Atomic size_t pool_refs = 1;
 
 struct __vrd_thread_data {
     /* The original data passed to thrd_create */
@@ -37,8 +44,8 @@ struct __vrd_thread_data {
     /* ID assigned by the thrd_create/ptrhead_create function
      * (might not be uinque) */
     uint64_t std_thread_id;
-    /* SHM buffer */
-    struct buffer *shmbuf;
+    /* the writer of the SHM buffer */
+    struct shm_sub_buffer_writer *writer;
     /* the thread exited? */
     bool exited;
 
@@ -141,6 +148,24 @@ void __tsan_init() {
         event_kinds[i] = events[i].kind;
     }
     fprintf(stderr, "done\n");
+
+    /* threads must be able to exit even if they are not joined
+     * and the monitor needs one sub-buffer per thread, so do not recycle */
+    sub_buffers = shm_sub_buffer_pool_create(
+        top_shmbuf, 0, top_control, shm_sub_buffer_pool_default_size(),
+        /* recycle = */ false);
+}
+
+static void destroy_pool(void) {
+    shm_sub_buffer_pool_destroy(sub_buffers);
+    sub_buffers = NULL;
+    destroy_shared_buffer(top_shmbuf);
+    top_shmbuf = NULL;
+}
+
+static void put_pool_ref(void) {
+    if (atomic_fetch_sub(&pool_refs, 1) == 1)
+        destroy_pool();
 }
 
 static void __vrd_fini(void) __attribute__((destructor));
@@ -153,10 +178,16 @@ void __vrd_fini(void) {
         if (!data->exited) {
             /* XXX: in this case we could get a race... */
             fprintf(stderr, "Thread %lu still running\n", data->thread_id);
-            destroy_shared_sub_buffer(data->shmbuf);
+            destroy_shared_sub_buffer(data->writer->buffer);
+            free(data->writer);
         }
         free(data);
     }
+
+    /* some threads still run when the program exits */
+    if (atomic_load(&pool_refs) > 0 && sub_buffers) {
+        destroy_pool();
+    }
 }
 
 static inline void *start_event(struct buffer *shm, int type) {
@@ -195,9 +226,11 @@ void *__vrd_create_thrd(void *original_data) {
     data->data = original_data;
     data->thread_id = tid;
     data->exited = false;
-    data->shmbuf = create_shared_sub_buffer(top_shmbuf, 0, top_control);
-    if (!data->shmbuf) {
-        assert(data->shmbuf && "Failed creating buffer");
+    /* the reference of the new thread, we hold ours */
+    atomic_fetch_add(&pool_refs, 1);
+    data->writer = shm_sub_buffer_pool_acquire(sub_buffers);
+    if (!data->writer) {
+        assert(data->writer && "Failed creating buffer");
         abort();
     }
 
@@ -234,8 +267,9 @@ void *__vrd_thrd_entry(void *data) {
     }
 
     thread_data.thread_id = tdata->thread_id;
-    assert(tdata->shmbuf && "Do not have SHM buffer");
-    thread_data.shmbuf = tdata->shmbuf;
+    assert(tdata->writer && "Do not have SHM buffer");
+    thread_data.shmbuf = tdata->writer->buffer;
+    thread_data.last_id = tdata->writer->last_id;
 
 #ifdef DEBUG_STDOUT
     printf("[%lu] thread %lu started\n", rt_timestamp(), thread_data.thread_id);
@@ -245,7 +279,6 @@ void *__vrd_thrd_entry(void *data) {
 
 void __vrd_thrd_exit(void) {
     struct _thread_data *thr_data = &thread_data;
-    struct buffer *shm = thr_data->shmbuf;
     if (thr_data->data) {
         thr_data->data->exited = true;
     }
@@ -255,11 +288,14 @@ void __vrd_thrd_exit(void) {
     sizeof(thread_data.thread_id)); buffer_finish_push(shm);
     */
 
-    if (shm == top_shmbuf) {
-        destroy_shared_buffer(shm);
-    } else {
-        destroy_shared_sub_buffer(shm);
+    if (thr_data->data) {
+        /* not the main thread */
+        struct shm_sub_buffer_writer *writer = thr_data->data->writer;
+        writer->last_id = thr_data->last_id;
+        shm_sub_buffer_pool_release(sub_buffers, writer);
     }
+    /* other threads may still use the pool and the top buffer */
+    put_pool_ref();
 
 #ifdef DEBUG_STDOUT
     printf("[%lu] exitting thread %lu\n", rt_timestamp(),
@@ -26,9 +26,16 @@ static void generic_alter(shm_stream *stream, shm_event *in, shm_event *out) {
 
 shm_stream *shm_create_generic_stream(const char *key, const char *name,
                                       shm_stream_hole_handling *hole_handling) {
-    shm_stream_generic *ss = malloc(sizeof *ss);
     struct buffer *shmbuffer = get_shared_buffer(key);
     assert(shmbuffer && "Getting the shm buffer failed");
+    return shm_create_generic_stream_from_buffer(shmbuffer, name,
+                                                 hole_handling);
+}
+
+shm_stream *shm_create_generic_stream_from_buffer(
+    struct buffer *shmbuffer, const char *name,
+    shm_stream_hole_handling *hole_handling) {
+    shm_stream_generic *ss = malloc(sizeof *ss);
     size_t elem_size = buffer_elem_size(shmbuffer);
     assert(elem_size > 0);
     shm_stream_init((shm_stream *)ss, shmbuffer, elem_size, generic_is_ready,
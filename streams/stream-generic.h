@@ -25,5 +25,9 @@ typedef struct _shm_stream_generic {
 
 shm_stream *shm_create_generic_stream(const char *key, const char *name,
                                       shm_stream_hole_handling *hole_handling);
+/* the stream takes the ownership of the buffer */
+shm_stream *shm_create_generic_stream_from_buffer(
+    struct buffer *shmbuffer, const char *name,
+    shm_stream_hole_handling *hole_handling);
 
 #endif /* SHMN_STREAM_GENERIC_H_ */
@@ -0,0 +1,198 @@
+#include "stream-trace-file.h"
+
+#include <assert.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+/* the number of decoded events that the stream buffers */
+#define RING_CAPACITY (2 * SHM_TRACE_FILE_BLOCK_EVENTS)
+
+/* the kind registered by the monitor for the kind in the file */
+static inline shm_kind get_kind(shm_stream_trace_file *ts, shm_kind kind) {
+    if (kind >= ts->kinds_map_size || ts->kinds_map[kind] == 0)
+        return 0;
+    return ts->events[ts->kinds_map[kind] - 1].kind;
+}
+
+static int decoder_thread(void *data) {
+    shm_stream_trace_file *ts = (shm_stream_trace_file *)data;
+    const size_t ev_size = ts->base.event_size;
+    shm_trace_file_iter *it = shm_trace_file_iter_create(ts->tf);
+    assert(it && "Failed creating the iterator");
+
+    /* the monitor expects consecutive ids, so we renumber the events
+     * (the file may contain events that the monitor skips) */
+    shm_eventid id = 0;
+    size_t spinned = 0;
+    const shm_event *ev = shm_trace_file_iter_next(it, NULL);
+    while (ev && !atomic_load_explicit(&ts->stop, memory_order_relaxed)) {
+        size_t n;
+        const size_t off = shm_spsc_ringbuf_write_off_nowrap(&ts->ring, &n);
+        if (n == 0) {
+            if (++spinned > SPIN_LIMIT) {
+                sched_yield();
+                spinned = 0;
+            }
+            continue;
+        }
+        spinned = 0;
+
+        unsigned char *dst = ts->data + off * ev_size;
+        size_t written = 0;
+        while (ev && written < n) {
+            const shm_kind kind = get_kind(ts, ev->kind);
+            if (kind != 0) {
+                memcpy(dst, ev, ev_size);
+                ((shm_event *)dst)->kind = kind;
+                ((shm_event *)dst)->id = ++id;
+                dst += ev_size;
+                ++written;
+            }
+            ev = shm_trace_file_iter_next(it, NULL);
+        }
+        if (written > 0)
+            shm_spsc_ringbuf_write_finish(&ts->ring, written);
+    }
+
+    shm_trace_file_iter_destroy(it);
+    atomic_store_explicit(&ts->decoder_finished, true, memory_order_release);
+    return 0;
+}
+
+static bool trace_file_is_ready(shm_stream *stream) {
+    shm_stream_trace_file *ts = (shm_stream_trace_file *)stream;
+    /* check the flag first, after the decoder finished,
+     * the size of the ring can only decrease */
+    return !atomic_load_explicit(&ts->decoder_finished, memory_order_acquire) ||
+           shm_spsc_ringbuf_size(&ts->ring) > 0;
+}
+
+static void *trace_file_read_events(shm_stream *stream, size_t *num) {
+    shm_stream_trace_file *ts = (shm_stream_trace_file *)stream;
+    /* start decoding once the monitor is reading, so that it
+     * already has registered the events */
+    if (!ts->decoder_started) {
+        ts->decoder_started = true;
+        if (thrd_create(&ts->decoder, decoder_thread, ts) != thrd_success) {
+            fprintf(stderr, "Failed creating the decoder thread\n");
+            abort();
+        }
+    }
+    const size_t off = shm_spsc_ringbuf_read_off_nowrap(&ts->ring, num);
+    if (*num == 0)
+        return NULL;
+    return ts->data + off * stream->event_size;
+}
+
+static bool trace_file_consume(shm_stream *stream, size_t num) {
+    shm_stream_trace_file *ts = (shm_stream_trace_file *)stream;
+    shm_spsc_ringbuf_consume(&ts->ring, num);
+    return true;
+}
+
+static size_t trace_file_size(shm_stream *stream) {
+    return shm_spsc_ringbuf_size(&((shm_stream_trace_file *)stream)->ring);
+}
+
+static size_t trace_file_capacity(shm_stream *stream) {
+    return shm_spsc_ringbuf_max_size(&((shm_stream_trace_file *)stream)->ring);
+}
+
+static struct event_record *trace_file_get_avail_events(shm_stream *stream,
+                                                        size_t *num) {
+    shm_stream_trace_file *ts = (shm_stream_trace_file *)stream;
+    *num = ts->events_num;
+    return ts->events;
+}
+
+static int trace_file_register_event(shm_stream *stream, const char *name,
+                                     shm_kind kind) {
+    shm_stream_trace_file *ts = (shm_stream_trace_file *)stream;
+    assert(!ts->decoder_started && "Registering events too late");
+    for (size_t i = 0; i < ts->events_num; ++i) {
+        if (strncmp(ts->events[i].name, name, sizeof(ts->events[i].name)) ==
+            0) {
+            ts->events[i].kind = kind;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int trace_file_register_all_events(shm_stream *stream) {
+    shm_stream_trace_file *ts = (shm_stream_trace_file *)stream;
+    assert(!ts->decoder_started && "Registering events too late");
+    for (size_t i = 0; i < ts->events_num; ++i) {
+        ts->events[i].kind = 1 + i + shm_get_last_special_kind();
+    }
+    return 0;
+}
+
+static const shm_stream_source_ops trace_file_ops = {
+    .read_events = trace_file_read_events,
+    .consume = trace_file_consume,
+    .size = trace_file_size,
+    .capacity = trace_file_capacity,
+    .get_avail_events = trace_file_get_avail_events,
+    .register_event = trace_file_register_event,
+    .register_all_events = trace_file_register_all_events};
+
+static void trace_file_destroy(shm_stream *stream) {
+    shm_stream_trace_file *ts = (shm_stream_trace_file *)stream;
+    if (ts->decoder_started) {
+        atomic_store_explicit(&ts->stop, true, memory_order_relaxed);
+        thrd_join(ts->decoder, NULL);
+    }
+    shm_trace_file_close(ts->tf);
+    free(ts->events);
+    free(ts->kinds_map);
+    free(ts->data);
+}
+
+shm_stream *shm_create_trace_file_stream(
+    const char *path, const char *name,
+    shm_stream_hole_handling *hole_handling) {
+    shm_trace_file *tf = shm_trace_file_open(path);
+    if (!tf) {
+        fprintf(stderr, "Failed opening the trace file '%s'\n", path);
+        return NULL;
+    }
+
+    shm_stream_trace_file *ts = xalloc(sizeof *ts);
+    const size_t ev_size = shm_trace_file_max_event_size(tf);
+    shm_stream_init((shm_stream *)ts, NULL, ev_size, trace_file_is_ready, NULL,
+                    NULL, trace_file_destroy, hole_handling,
+                    "trace-file-stream", name);
+    ts->base.source_ops = &trace_file_ops;
+    ts->tf = tf;
+
+    /* the monitor registers its own kinds, until then
+     * no event is interesting */
+    struct event_record *events = shm_trace_file_events(tf, &ts->events_num);
+    ts->events = xalloc(ts->events_num * sizeof(struct event_record));
+    memcpy(ts->events, events, ts->events_num * sizeof(struct event_record));
+    shm_kind max_kind = 0;
+    for (size_t i = 0; i < ts->events_num; ++i) {
+        if (events[i].kind > max_kind)
+            max_kind = events[i].kind;
+        ts->events[i].kind = 0;
+    }
+    ts->kinds_map_size = max_kind + 1;
+    ts->kinds_map = calloc(ts->kinds_map_size, sizeof(size_t));
+    assert(ts->kinds_map && "Allocation failed");
+    for (size_t i = 0; i < ts->events_num; ++i) {
+        ts->kinds_map[events[i].kind] = i + 1;
+    }
+
+    shm_spsc_ringbuf_init(&ts->ring, RING_CAPACITY + 1);
+    ts->data = xalloc((RING_CAPACITY + 1) * ev_size);
+    ts->decoder_started = false;
+    atomic_init(&ts->decoder_finished, false);
+    atomic_init(&ts->stop, false);
+
+    return (shm_stream *)ts;
+}
@@ -0,0 +1,46 @@
+#ifndef SHMN_STREAM_TRACE_FILE_H_
+#define SHMN_STREAM_TRACE_FILE_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <threads.h>
+
+#include "event.h"
+#include "spsc_ringbuf.h"
+#include "stream.h"
+#include "trace_file.h"
+
+/* A stream that reads events from a trace file written by
+   `shamon-record -c` (see core/trace_file.h). The events are decoded
+   in a separate thread into a local ring buffer, so every stream
+   of the monitor decodes its file in parallel. Nothing is ever dropped:
+   the decoder waits for the monitor when the ring buffer is full.
+   Events that the monitor did not register are skipped and the ids
+   of the remaining events are consecutive. Strings are pointers into
+   the mapped file. */
+
+typedef struct _shm_stream_trace_file {
+    shm_stream base;
+    shm_trace_file *tf;
+    /* the events from the file with the kinds registered by the monitor
+     * (0 if the monitor is not interested in the event) */
+    struct event_record *events;
+    size_t events_num;
+    /* index of the event in `events` by the kind in the file */
+    size_t *kinds_map;
+    size_t kinds_map_size;
+    /* decoded events */
+    shm_spsc_ringbuf ring;
+    unsigned char *data;
+    thrd_t decoder;
+    bool decoder_started;
+    _Atomic bool decoder_finished;
+    /* tells the decoder to stop (when the stream is destroyed early) */
+    _Atomic bool stop;
+} shm_stream_trace_file;
+
+shm_stream *shm_create_trace_file_stream(
+    const char *path, const char *name,
+    shm_stream_hole_handling *hole_handling);
+
+#endif /* SHMN_STREAM_TRACE_FILE_H_ */
@@ -8,6 +8,7 @@
 #include "stream-generic.h"
 #include "stream-regex.h"
 #include "stream-regexrw.h"
+#include "stream-trace-file.h"
 #include "stream.h"
 
 const char *find_next_part(const char *params) {
@@ -56,6 +57,7 @@ static struct stream_rec avail_streams[] = {
     {"drregex",
      "read stdin and stdout and parse it using regexes (DynamoRIO based)"},
     {"generic", "receive events based purely on the information from source"},
+    {"tracefile", "read events from a trace file (recorded by shamon-record -c)"},
     {NULL, NULL} /* to mark the end */
 };
 
@@ -157,6 +159,21 @@ shm_stream *shm_stream_create(const char *stream_name, const char *spec,
         }
 
         return shm_create_generic_stream(key, stream_name, hole_handling);
+    } else if (strncmp(source, "tracefile", 10) == 0) {
+        if (!next || *next == 0) {
+            fprintf(stderr, "error: source 'tracefile' needs the path to the "
+                            "trace file as parameter\n");
+            return NULL;
+        }
+        char path[256];
+        next = get_next_part(next, path, ';');
+        if (next) {
+            fprintf(stderr,
+                    "warning: source 'tracefile' takes only one parameter, "
+                    "ignoring others\n");
+        }
+
+        return shm_create_trace_file_stream(path, stream_name, hole_handling);
     }
 
     fprintf(stderr, "Unknown stream. Available streams:\n");
@@ -0,0 +1,786 @@
+/***********************************************
+ * Benchmarks of the transport primitives.
+ *
+ * Measures the throughput (and latency when the reader and the writer
+ * run in parallel) of shm_spsc_ringbuf, shm_par_queue, shm_queue_spsc
+ * and shmbuf buffers single-threaded, cross-thread and cross-process
+ * for different sizes of events and capacities of the buffers.
+ * Further, it measures pushing strings via aux buffers and the forward
+ * and drop paths of the arbiter buffer.
+ *
+ * The results are written as JSON and can be compared against
+ * a stored baseline:
+ *
+ *   transport-bench -o results.json
+ *   transport-bench -b results.json -t 10
+ *
+ * The latter run fails if some benchmark has throughput more than 10%
+ * lower than in the baseline.
+ ************************************************/
+
+#include <assert.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "core/arbiter.h"
+#include "core/par_queue.h"
+#include "core/queue_spsc.h"
+#include "core/source.h"
+#include "core/spsc_ringbuf.h"
+#include "core/stream.h"
+#include "core/utils.h"
+#include "shmbuf/buffer-private.h"
+#include "shmbuf/buffer.h"
+
+#define MAX_RESULTS 512
+/* take a latency sample every LAT_SAMPLE_PERIOD events */
+#define LAT_SAMPLE_PERIOD 64
+
+static const size_t event_sizes[] = {8, 64, 256};
+static const size_t capacities[] = {64, 1024, 65536};
+static const size_t string_lengths[] = {16, 256};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(*a))
+
+struct result {
+    char name[128];
+    double throughput; /* events per second */
+    double ns_per_event;
+    bool has_latency;
+    double lat_p50_ns;
+    double lat_p99_ns;
+};
+
+static struct result results[MAX_RESULTS];
+static size_t results_num = 0;
+static size_t N = 2000000;
+
+static inline void spin_wait(size_t *spinned) {
+    if (++*spinned > SPIN_LIMIT) {
+        sched_yield();
+        *spinned = 0;
+    }
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void add_result(const char *name, size_t events, uint64_t elapsed_ns,
+                       uint64_t *lat, size_t lat_num) {
+    assert(results_num < MAX_RESULTS);
+    struct result *r = &results[results_num++];
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    if (elapsed_ns == 0)
+        elapsed_ns = 1;
+    r->throughput = events / (elapsed_ns * 1e-9);
+    r->ns_per_event = elapsed_ns / (double)events;
+    r->has_latency = lat && lat_num > 0;
+    if (r->has_latency) {
+        qsort(lat, lat_num, sizeof(*lat), cmp_u64);
+        r->lat_p50_ns = lat[lat_num / 2];
+        r->lat_p99_ns = lat[(lat_num * 99) / 100];
+    }
+
+    fprintf(stderr, "%-48s %12.0lf ev/s %8.2lf ns/ev", r->name, r->throughput,
+            r->ns_per_event);
+    if (r->has_latency)
+        fprintf(stderr, "  latency p50 %.0lf ns, p99 %.0lf ns", r->lat_p50_ns,
+                r->lat_p99_ns);
+    fputc('\n', stderr);
+}
+
+/* Allocate memory that is shared with forked processes */
+static void *xalloc_shared(size_t size) {
+    void *mem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                     -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        abort();
+    }
+    return mem;
+}
+
+/*
+ * A common interface to the benchmarked primitives
+ */
+struct transport {
+    const char *name;
+    /* if `shared` is true, the transport must work also across fork() */
+    void *(*create)(size_t elem_size, size_t capacity, bool shared);
+    void (*destroy)(void *t, size_t elem_size, size_t capacity, bool shared);
+    /* returns NULL if the transport is full */
+    void *(*write_ptr)(void *t);
+    void (*write_finish)(void *t);
+    /* returns NULL if the transport is empty */
+    void *(*read_ptr)(void *t);
+    void (*consume)(void *t);
+    bool cross_process;
+};
+
+/* shm_spsc_ringbuf */
+struct spsc_ringbuf_t {
+    shm_spsc_ringbuf rb;
+    size_t elem_size;
+    unsigned char *data;
+};
+
+static void *spsc_ringbuf_create(size_t elem_size, size_t capacity,
+                                 bool shared) {
+    const size_t size = sizeof(struct spsc_ringbuf_t) + elem_size * capacity;
+    struct spsc_ringbuf_t *t =
+        shared ? xalloc_shared(size) : xalloc_aligned(size, CACHELINE_SIZE);
+    shm_spsc_ringbuf_init(&t->rb, capacity);
+    t->elem_size = elem_size;
+    t->data = (unsigned char *)(t + 1);
+    return t;
+}
+
+static void spsc_ringbuf_destroy(void *t, size_t elem_size, size_t capacity,
+                                 bool shared) {
+    if (shared)
+        munmap(t, sizeof(struct spsc_ringbuf_t) + elem_size * capacity);
+    else
+        free(t);
+}
+
+static void *spsc_ringbuf_write_ptr(void *data) {
+    struct spsc_ringbuf_t *t = data;
+    size_t n;
+    size_t off = shm_spsc_ringbuf_write_off_nowrap(&t->rb, &n);
+    return n == 0 ? NULL : t->data + off * t->elem_size;
+}
+
+static void spsc_ringbuf_write_finish(void *data) {
+    shm_spsc_ringbuf_write_finish(&((struct spsc_ringbuf_t *)data)->rb, 1);
+}
+
+static void *spsc_ringbuf_read_ptr(void *data) {
+    struct spsc_ringbuf_t *t = data;
+    size_t n;
+    size_t off = shm_spsc_ringbuf_read_off_nowrap(&t->rb, &n);
+    return n == 0 ? NULL : t->data + off * t->elem_size;
+}
+
+static void spsc_ringbuf_consume(void *data) {
+    shm_spsc_ringbuf_consume(&((struct spsc_ringbuf_t *)data)->rb, 1);
+}
+
+/* shm_par_queue */
+static void *par_queue_create(size_t elem_size, size_t capacity, bool shared) {
+    assert(!shared && "par_queue cannot be shared between processes");
+    (void)shared;
+    shm_par_queue *q = xalloc_aligned(sizeof(*q), CACHELINE_SIZE);
+    shm_par_queue_init(q, capacity, elem_size);
+    return q;
+}
+
+static void par_queue_destroy(void *t, size_t elem_size, size_t capacity,
+                              bool shared) {
+    (void)elem_size, (void)capacity, (void)shared;
+    shm_par_queue_destroy(t);
+    free(t);
+}
+
+static void *par_queue_write_ptr(void *t) { return shm_par_queue_write_ptr(t); }
+static void par_queue_write_finish(void *t) { shm_par_queue_write_finish(t); }
+
+static void *par_queue_read_ptr(void *t) {
+    void *ptr;
+    return shm_par_queue_peek1(t, &ptr) > 0 ? ptr : NULL;
+}
+
+static void par_queue_consume(void *t) { shm_par_queue_drop(t, 1); }
+
+/* shm_queue_spsc */
+struct queue_spsc_t {
+    shm_queue_spsc q;
+    size_t elem_size;
+    size_t off; /* the offset of the current write */
+    unsigned char *data;
+};
+
+static void *queue_spsc_create(size_t elem_size, size_t capacity,
+                               bool shared) {
+    const size_t size = sizeof(struct queue_spsc_t) + elem_size * capacity;
+    struct queue_spsc_t *t =
+        shared ? xalloc_shared(size) : xalloc_aligned(size, CACHELINE_SIZE);
+    shm_queue_spsc_init(&t->q, capacity);
+    t->elem_size = elem_size;
+    t->data = (unsigned char *)(t + 1);
+    return t;
+}
+
+static void queue_spsc_destroy(void *t, size_t elem_size, size_t capacity,
+                               bool shared) {
+    if (shared)
+        munmap(t, sizeof(struct queue_spsc_t) + elem_size * capacity);
+    else
+        free(t);
+}
+
+static void *queue_spsc_write_ptr(void *data) {
+    struct queue_spsc_t *t = data;
+    if (!shm_queue_spsc_write_offset(&t->q, &t->off))
+        return NULL;
+    return t->data + t->off * t->elem_size;
+}
+
+static void queue_spsc_write_finish(void *data) {
+    shm_queue_spsc_write_finish(&((struct queue_spsc_t *)data)->q);
+}
+
+static void *queue_spsc_read_ptr(void *data) {
+    struct queue_spsc_t *t = data;
+    size_t off;
+    if (shm_queue_spsc_read_offset(&t->q, &off) == 0)
+        return NULL;
+    return t->data + off * t->elem_size;
+}
+
+static void queue_spsc_consume(void *data) {
+    shm_queue_spsc_consume(&((struct queue_spsc_t *)data)->q, 1);
+}
+
+/* shmbuf */
+#define SHMBUF_KEY "/shamon-transport-bench"
+
+static void *shmbuf_create(size_t elem_size, size_t capacity, bool shared) {
+    (void)shared; /* shmbuf is always shared */
+    struct source_control *ctrl = source_control_define(1, "E", "l");
+    struct buffer *b =
+        create_shared_buffer_adv(SHMBUF_KEY, 0, elem_size, capacity, ctrl);
+    free(ctrl);
+    assert(b && "Failed creating the buffer");
+    return b;
+}
+
+static void shmbuf_destroy(void *t, size_t elem_size, size_t capacity,
+                           bool shared) {
+    (void)elem_size, (void)capacity, (void)shared;
+    destroy_shared_buffer(t);
+}
+
+static void *shmbuf_write_ptr(void *t) { return buffer_start_push(t); }
+static void shmbuf_write_finish(void *t) { buffer_finish_push(t); }
+
+static void *shmbuf_read_ptr(void *t) {
+    size_t n;
+    return buffer_read_pointer(t, &n);
+}
+
+static void shmbuf_consume(void *t) { buffer_consume(t, 1); }
+
+static const struct transport transports[] = {
+    {"spsc_ringbuf", spsc_ringbuf_create, spsc_ringbuf_destroy,
+     spsc_ringbuf_write_ptr, spsc_ringbuf_write_finish, spsc_ringbuf_read_ptr,
+     spsc_ringbuf_consume, true},
+    {"par_queue", par_queue_create, par_queue_destroy, par_queue_write_ptr,
+     par_queue_write_finish, par_queue_read_ptr, par_queue_consume, false},
+    {"queue_spsc", queue_spsc_create, queue_spsc_destroy, queue_spsc_write_ptr,
+     queue_spsc_write_finish, queue_spsc_read_ptr, queue_spsc_consume, true},
+    {"shmbuf", shmbuf_create, shmbuf_destroy, shmbuf_write_ptr,
+     shmbuf_write_finish, shmbuf_read_ptr, shmbuf_consume, true},
+};
+
+/*
+ * single-threaded: fill the buffer and then drain it
+ */
+static void bench_single_thread(const struct transport *tr, size_t elem_size,
+                                size_t capacity) {
+    void *t = tr->create(elem_size, capacity, false);
+    unsigned char elem[elem_size];
+    memset(elem, 0xab, elem_size);
+
+    size_t written = 0, read = 0;
+    void *ptr;
+    uint64_t start = now_ns();
+    while (read < N) {
+        while (written < N && (ptr = tr->write_ptr(t))) {
+            memcpy(ptr, elem, elem_size);
+            tr->write_finish(t);
+            ++written;
+        }
+        while ((ptr = tr->read_ptr(t))) {
+            memcpy(elem, ptr, elem_size);
+            tr->consume(t);
+            ++read;
+        }
+    }
+    uint64_t end = now_ns();
+
+    char name[128];
+    snprintf(name, sizeof(name), "%s/st/size=%lu/cap=%lu", tr->name, elem_size,
+             capacity);
+    add_result(name, N, end - start, NULL, 0);
+    tr->destroy(t, elem_size, capacity, false);
+}
+
+/*
+ * cross-thread and cross-process
+ */
+struct writer_data {
+    const struct transport *tr;
+    void *t;
+    size_t elem_size;
+};
+
+static int writer_thrd(void *arg) {
+    struct writer_data *data = arg;
+    const struct transport *tr = data->tr;
+    void *t = data->t;
+    const size_t elem_size = data->elem_size;
+    unsigned char *ptr;
+    size_t spinned = 0;
+
+    for (size_t i = 0; i < N; ++i) {
+        while (!(ptr = tr->write_ptr(t)))
+            spin_wait(&spinned);
+        /* the first 8 bytes carry the timestamp for measuring latency */
+        uint64_t ts = (i % LAT_SAMPLE_PERIOD == 0) ? now_ns() : 0;
+        memcpy(ptr, &ts, sizeof(ts));
+        memset(ptr + sizeof(ts), (int)i, elem_size - sizeof(ts));
+        tr->write_finish(t);
+    }
+
+    return 0;
+}
+
+static uint64_t run_reader(const struct transport *tr, void *t,
+                           size_t elem_size, uint64_t *lat, size_t *lat_num) {
+    unsigned char *ptr;
+    unsigned char elem[elem_size];
+    uint64_t ts, start = 0;
+    size_t n = 0, spinned = 0;
+
+    *lat_num = 0;
+    while (n < N) {
+        if (!(ptr = tr->read_ptr(t))) {
+            spin_wait(&spinned);
+            continue;
+        }
+        if (n == 0)
+            start = now_ns();
+        memcpy(elem, ptr, elem_size);
+        memcpy(&ts, elem, sizeof(ts));
+        if (ts != 0)
+            lat[(*lat_num)++] = now_ns() - ts;
+        tr->consume(t);
+        ++n;
+    }
+
+    return now_ns() - start;
+}
+
+static void bench_cross_thread(const struct transport *tr, size_t elem_size,
+                               size_t capacity) {
+    void *t = tr->create(elem_size, capacity, false);
+    uint64_t *lat = xalloc((N / LAT_SAMPLE_PERIOD + 1) * sizeof(uint64_t));
+    size_t lat_num;
+
+    thrd_t tid;
+    struct writer_data data = {tr, t, elem_size};
+    thrd_create(&tid, writer_thrd, &data);
+    uint64_t elapsed = run_reader(tr, t, elem_size, lat, &lat_num);
+    thrd_join(tid, NULL);
+
+    char name[128];
+    snprintf(name, sizeof(name), "%s/mt/size=%lu/cap=%lu", tr->name, elem_size,
+             capacity);
+    add_result(name, N, elapsed, lat, lat_num);
+    free(lat);
+    tr->destroy(t, elem_size, capacity, false);
+}
+
+static void bench_cross_process(const struct transport *tr, size_t elem_size,
+                                size_t capacity) {
+    void *t = tr->create(elem_size, capacity, true);
+    uint64_t *lat = xalloc((N / LAT_SAMPLE_PERIOD + 1) * sizeof(uint64_t));
+    size_t lat_num;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        abort();
+    }
+    if (pid == 0) {
+        struct writer_data data = {tr, t, elem_size};
+        writer_thrd(&data);
+        _exit(0);
+    }
+
+    uint64_t elapsed = run_reader(tr, t, elem_size, lat, &lat_num);
+    waitpid(pid, NULL, 0);
+
+    char name[128];
+    snprintf(name, sizeof(name), "%s/mp/size=%lu/cap=%lu", tr->name, elem_size,
+             capacity);
+    add_result(name, N, elapsed, lat, lat_num);
+    free(lat);
+    tr->destroy(t, elem_size, capacity, true);
+}
+
+/*
+ * strings in aux buffers
+ */
+struct str_event {
+    shm_event base;
+    uint64_t str;
+};
+
+struct str_writer_data {
+    struct buffer *buffer;
+    size_t len;
+};
+
+static int str_writer_thrd(void *arg) {
+    struct str_writer_data *data = arg;
+    struct buffer *b = data->buffer;
+    char str[data->len + 1];
+    memset(str, 'a', data->len);
+    str[data->len] = '\0';
+
+    shm_event ev = {.kind = shm_get_last_special_kind() + 1};
+    void *ptr;
+    size_t spinned = 0;
+    for (size_t i = 0; i < N; ++i) {
+        while (!(ptr = buffer_start_push(b)))
+            spin_wait(&spinned);
+        ev.id = i + 1;
+        ptr = buffer_partial_push(b, ptr, &ev, sizeof(ev));
+        buffer_partial_push_str(b, ptr, ev.id, str);
+        buffer_finish_push(b);
+    }
+
+    return 0;
+}
+
+static void bench_aux_strings(size_t len, size_t capacity) {
+    struct source_control *ctrl = source_control_define(1, "E", "S");
+    struct buffer *wb = create_shared_buffer(SHMBUF_KEY, capacity, ctrl);
+    free(ctrl);
+    assert(wb);
+    /* the reader needs its own view of the aux buffers */
+    struct buffer *rb = get_shared_buffer(SHMBUF_KEY);
+    assert(rb);
+
+    thrd_t tid;
+    struct str_writer_data data = {wb, len};
+    thrd_create(&tid, str_writer_thrd, &data);
+
+    size_t n = 0, total_len = 0, sz, spinned = 0;
+    uint64_t start = 0;
+    struct str_event *ev;
+    while (n < N) {
+        if (!(ev = buffer_read_pointer(rb, &sz))) {
+            spin_wait(&spinned);
+            continue;
+        }
+        if (n == 0)
+            start = now_ns();
+        total_len += strlen(buffer_get_str(rb, ev->str));
+        if (n % LAT_SAMPLE_PERIOD == 0)
+            buffer_set_last_processed_id(rb, ev->base.id);
+        buffer_consume(rb, 1);
+        ++n;
+    }
+    uint64_t elapsed = now_ns() - start;
+    thrd_join(tid, NULL);
+    assert(total_len == N * len);
+
+    char name[128];
+    snprintf(name, sizeof(name), "shmbuf-aux/mt/strlen=%lu/cap=%lu", len,
+             capacity);
+    add_result(name, N, elapsed, NULL, 0);
+
+    release_shared_buffer(rb);
+    destroy_shared_buffer(wb);
+}
+
+/*
+ * the arbiter buffer
+ */
+static atomic_bool arbiter_writer_done;
+
+static bool arbiter_stream_is_ready(shm_stream *s) {
+    (void)s;
+    return !atomic_load(&arbiter_writer_done);
+}
+
+struct arbiter_bench {
+    struct buffer *buffer;
+    shm_arbiter_buffer *abuffer;
+    size_t elem_size;
+    /* for the drop path: the consumer waits until all events are processed
+     * by stream_fetch */
+    bool wait_for_end;
+    uint64_t end;
+};
+
+static int arbiter_writer_thrd(void *arg) {
+    struct arbiter_bench *data = arg;
+    unsigned char elem[data->elem_size];
+    memset(elem, 0, data->elem_size);
+    shm_event *ev = (shm_event *)elem;
+    ev->kind = shm_get_last_special_kind() + 1;
+    size_t spinned = 0;
+    for (size_t i = 0; i < N; ++i) {
+        ev->id = i + 1;
+        while (!buffer_push(data->buffer, elem, data->elem_size))
+            spin_wait(&spinned);
+    }
+    atomic_store(&arbiter_writer_done, true);
+    return 0;
+}
+
+static int arbiter_consumer_thrd(void *arg) {
+    struct arbiter_bench *data = arg;
+    size_t spinned = 0;
+    if (data->wait_for_end) {
+        while (!atomic_load(&arbiter_writer_done) ||
+               buffer_size(data->buffer) > 0)
+            spin_wait(&spinned);
+        data->end = now_ns();
+    }
+
+    size_t n = 0;
+    shm_event *ev;
+    while (n < N) {
+        if (shm_arbiter_buffer_peek1(data->abuffer, (void **)&ev) == 0) {
+            spin_wait(&spinned);
+            continue;
+        }
+        if (shm_event_is_hole(ev))
+            n += ((shm_event_default_hole *)ev)->n;
+        else
+            ++n;
+        shm_arbiter_buffer_drop(data->abuffer, 1);
+    }
+
+    if (!data->wait_for_end)
+        data->end = now_ns();
+    return 0;
+}
+
+static void bench_arbiter(bool drop, size_t elem_size, size_t capacity) {
+    atomic_store(&arbiter_writer_done, false);
+    if (elem_size < sizeof(shm_event_default_hole))
+        elem_size = sizeof(shm_event_default_hole);
+
+    struct arbiter_bench data;
+    data.buffer = initialize_local_buffer(SHMBUF_KEY, elem_size, capacity, NULL);
+    data.elem_size = elem_size;
+    data.wait_for_end = drop;
+
+    shm_stream stream;
+    shm_stream_init(&stream, data.buffer, elem_size, arbiter_stream_is_ready,
+                    NULL, NULL, NULL, NULL, "bench-stream", "bench");
+    /* in the drop path, the arbiter buffer gets full immediately */
+    data.abuffer = shm_arbiter_buffer_create(&stream, elem_size,
+                                             drop ? 4 : capacity);
+    shm_arbiter_buffer_set_active(data.abuffer, true);
+
+    thrd_t writer, consumer;
+    uint64_t start = now_ns();
+    thrd_create(&consumer, arbiter_consumer_thrd, &data);
+    thrd_create(&writer, arbiter_writer_thrd, &data);
+
+    void *ev, *out;
+    while ((ev = stream_fetch(&stream, data.abuffer))) {
+        out = shm_arbiter_buffer_write_ptr(data.abuffer);
+        assert(out && "No space in the buffer");
+        memcpy(out, ev, elem_size);
+        shm_arbiter_buffer_write_finish(data.abuffer);
+        shm_stream_consume(&stream, 1);
+    }
+
+    thrd_join(writer, NULL);
+    thrd_join(consumer, NULL);
+
+    char name[128];
+    snprintf(name, sizeof(name), "arbiter/%s/size=%lu/cap=%lu",
+             drop ? "drop" : "forward", elem_size, capacity);
+    add_result(name, N, data.end - start, NULL, 0);
+
+    shm_arbiter_buffer_free(data.abuffer);
+    release_local_buffer(data.buffer);
+    free(stream.type);
+    free(stream.name);
+}
+
+/*
+ * output and comparison with the baseline
+ */
+static int write_json(FILE *out) {
+    fprintf(out, "{\n  \"events\": %lu,\n  \"results\": [\n", N);
+    for (size_t i = 0; i < results_num; ++i) {
+        struct result *r = &results[i];
+        /* keep one result per line, compare_with_baseline() relies on it */
+        fprintf(out,
+                "    {\"name\": \"%s\", \"throughput\": %.1lf, "
+                "\"ns_per_event\": %.3lf",
+                r->name, r->throughput, r->ns_per_event);
+        if (r->has_latency)
+            fprintf(out, ", \"lat_p50_ns\": %.0lf, \"lat_p99_ns\": %.0lf",
+                    r->lat_p50_ns, r->lat_p99_ns);
+        fprintf(out, "}%s\n", i + 1 < results_num ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    return 0;
+}
+
+static struct result *find_result(const char *name) {
+    for (size_t i = 0; i < results_num; ++i) {
+        if (strcmp(results[i].name, name) == 0)
+            return &results[i];
+    }
+    return NULL;
+}
+
+/* return the number of regressions or -1 on error */
+static int compare_with_baseline(const char *path, double threshold) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror("opening baseline");
+        return -1;
+    }
+
+    char line[512];
+    char name[128];
+    double throughput;
+    int regressions = 0;
+    size_t compared = 0;
+    while (fgets(line, sizeof(line), f)) {
+        const char *p = strstr(line, "\"name\": \"");
+        if (!p)
+            continue;
+        if (sscanf(p, "\"name\": \"%127[^\"]\", \"throughput\": %lf", name,
+                   &throughput) != 2)
+            continue;
+
+        struct result *r = find_result(name);
+        if (!r)
+            continue;
+        ++compared;
+        double change = (r->throughput - throughput) / throughput * 100;
+        if (change < -threshold) {
+            fprintf(stderr,
+                    "\033[31mREGRESSION\033[0m %s: %.0lf ev/s -> %.0lf ev/s "
+                    "(%.1lf%%)\n",
+                    name, throughput, r->throughput, change);
+            ++regressions;
+        }
+    }
+    fclose(f);
+
+    fprintf(stderr, "Compared %lu results with the baseline, %d regressions\n",
+            compared, regressions);
+    return regressions;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-n events] [-o output.json] [-b baseline.json] "
+            "[-t threshold%%] [-f filter]\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+#ifndef NDEBUG
+    fprintf(stderr, "\033[31mWARNING: this is not a Release build!\033[0m\n");
+#endif
+    const char *output = NULL;
+    const char *baseline = NULL;
+    const char *filter = NULL;
+    double threshold = 10;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:o:b:t:f:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                N = strtoull(optarg, NULL, 10);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'b':
+                baseline = optarg;
+                break;
+            case 't':
+                threshold = atof(optarg);
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (N < LAT_SAMPLE_PERIOD) {
+        fprintf(stderr, "The number of events must be at least %d\n",
+                LAT_SAMPLE_PERIOD);
+        return 1;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(transports); ++i) {
+        const struct transport *tr = &transports[i];
+        if (filter && !strstr(tr->name, filter))
+            continue;
+        for (size_t s = 0; s < ARRAY_SIZE(event_sizes); ++s) {
+            for (size_t c = 0; c < ARRAY_SIZE(capacities); ++c) {
+                bench_single_thread(tr, event_sizes[s], capacities[c]);
+                bench_cross_thread(tr, event_sizes[s], capacities[c]);
+                if (tr->cross_process)
+                    bench_cross_process(tr, event_sizes[s], capacities[c]);
+            }
+        }
+    }
+
+    if (!filter || strstr("shmbuf-aux", filter)) {
+        for (size_t l = 0; l < ARRAY_SIZE(string_lengths); ++l) {
+            for (size_t c = 0; c < ARRAY_SIZE(capacities); ++c) {
+                bench_aux_strings(string_lengths[l], capacities[c]);
+            }
+        }
+    }
+
+    if (!filter || strstr("arbiter", filter)) {
+        for (size_t s = 0; s < ARRAY_SIZE(event_sizes); ++s) {
+            for (size_t c = 0; c < ARRAY_SIZE(capacities); ++c) {
+                bench_arbiter(/* drop = */ false, event_sizes[s],
+                              capacities[c]);
+                bench_arbiter(/* drop = */ true, event_sizes[s], capacities[c]);
+            }
+        }
+    }
+
+    if (output) {
+        FILE *out = fopen(output, "w");
+        if (!out) {
+            perror("opening output file");
+            return 1;
+        }
+        write_json(out);
+        fclose(out);
+    } else {
+        write_json(stdout);
+    }
+
+    if (baseline) {
+        int regressions = compare_with_baseline(baseline, threshold);
+        if (regressions != 0)
+            return 1;
+    }
+
+    return 0;
+}
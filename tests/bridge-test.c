@@ -0,0 +1,299 @@
+#undef NDEBUG
+#include <assert.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "core/bridge.h"
+#include "core/event.h"
+#include "core/lz.h"
+#include "shmbuf/buffer.h"
+#include "shmbuf/client.h"
+
+#define DATA_SIZE (64 * 1024)
+
+static unsigned char data[DATA_SIZE];
+static unsigned char compressed[SHM_LZ_COMPRESS_BOUND(DATA_SIZE)];
+static unsigned char decompressed[DATA_SIZE];
+
+static size_t roundtrip(size_t size) {
+    size_t csize =
+        shm_lz_compress(data, size, compressed, sizeof(compressed));
+    assert(csize > 0 && csize <= SHM_LZ_COMPRESS_BOUND(size));
+    assert(shm_lz_decompress(compressed, csize, decompressed,
+                             sizeof(decompressed)) == size);
+    assert(memcmp(data, decompressed, size) == 0);
+    return csize;
+}
+
+static void test_lz(void) {
+    /* events-like data: repeated headers with growing ids */
+    for (size_t i = 0; i < DATA_SIZE / 16; ++i) {
+        uint64_t v[2] = {i, 2};
+        memcpy(data + i * 16, v, sizeof(v));
+    }
+    assert(roundtrip(DATA_SIZE) < DATA_SIZE / 2);
+
+    /* long runs (overlapping matches) */
+    memset(data, 'x', DATA_SIZE);
+    assert(roundtrip(DATA_SIZE) < 1024);
+
+    /* incompressible data and data too short to have a match */
+    srand(1);
+    for (size_t i = 0; i < DATA_SIZE; ++i) data[i] = rand();
+    roundtrip(DATA_SIZE);
+    for (size_t size = 1; size < 20; ++size) roundtrip(size);
+
+    /* too small output */
+    assert(shm_lz_compress(data, DATA_SIZE, compressed, DATA_SIZE / 2) == 0);
+    /* malformed input */
+    size_t csize = shm_lz_compress(data, 100, compressed, sizeof(compressed));
+    assert(shm_lz_decompress(compressed, csize - 1, decompressed,
+                             sizeof(decompressed)) != 100);
+    assert(shm_lz_decompress(compressed, csize, decompressed, 50) == 0);
+}
+
+static void test_frames(void) {
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    shm_bridge_conn *s = shm_bridge_conn_create(fds[0], true);
+    shm_bridge_conn *r = shm_bridge_conn_create(fds[1], false);
+
+    for (size_t i = 0; i < DATA_SIZE; ++i) data[i] = i % 7;
+
+    shm_bridge_frame_header hdr;
+    const unsigned char *payload;
+
+    assert(shm_bridge_send(s, SHM_BRIDGE_DATA, 3, data, DATA_SIZE) == 0);
+    assert(shm_bridge_can_recv(r));
+    payload = shm_bridge_recv(r, &hdr);
+    assert(payload);
+    assert(hdr.type == SHM_BRIDGE_DATA && hdr.channel == 3);
+    assert(hdr.flags & SHM_BRIDGE_COMPRESSED);
+    assert(hdr.raw_size == DATA_SIZE && hdr.size < DATA_SIZE);
+    assert(memcmp(payload, data, DATA_SIZE) == 0);
+
+    /* empty frame and a frame in the other direction (not compressed) */
+    assert(shm_bridge_send(s, SHM_BRIDGE_END, 3, NULL, 0) == 0);
+    payload = shm_bridge_recv(r, &hdr);
+    assert(payload && hdr.type == SHM_BRIDGE_END && hdr.raw_size == 0);
+    assert(!shm_bridge_can_recv(r));
+
+    uint64_t credit = 12345;
+    assert(shm_bridge_send(r, SHM_BRIDGE_CREDIT, 0, &credit,
+                           sizeof(credit)) == 0);
+    payload = shm_bridge_recv(s, &hdr);
+    assert(payload && hdr.type == SHM_BRIDGE_CREDIT && hdr.flags == 0);
+    assert(memcmp(payload, &credit, sizeof(credit)) == 0);
+
+    uint64_t raw, wire;
+    shm_bridge_sent_bytes(s, &raw, &wire);
+    assert(raw == DATA_SIZE && wire < raw);
+
+    /* closed connection */
+    shm_bridge_conn_destroy(s);
+    assert(shm_bridge_recv(r, &hdr) == NULL && hdr.type == 0);
+    shm_bridge_conn_destroy(r);
+}
+
+/* the integers on the wire are big-endian whatever the host is */
+static void test_wire_format(void) {
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    shm_bridge_conn *s = shm_bridge_conn_create(fds[0], false);
+
+    const unsigned char payload[3] = {7, 8, 9};
+    assert(shm_bridge_send(s, SHM_BRIDGE_DATA, 0x01020304, payload,
+                           sizeof(payload)) == 0);
+    const unsigned char expected[SHM_BRIDGE_HEADER_SIZE + 3] = {
+        0, 0, 0, 3, 0, 0, 0, 3, 0, SHM_BRIDGE_DATA, 0, 0, 1, 2, 3, 4,
+        7, 8, 9};
+    unsigned char wire[sizeof(expected)];
+    assert(read(fds[1], wire, sizeof(wire)) == (ssize_t)sizeof(wire));
+    assert(memcmp(wire, expected, sizeof(expected)) == 0);
+    shm_bridge_conn_destroy(s);
+    close(fds[1]);
+
+    struct event_record events[2];
+    memset(events, 0, sizeof(events));
+    strcpy(events[0].name, "first");
+    events[0].kind = 0x0102030405060708;
+    events[0].size = 40;
+    strcpy((char *)events[0].signature, "lS");
+    strcpy(events[1].name, "second");
+    events[1].kind = 3;
+    events[1].size = 24;
+    strcpy((char *)events[1].signature, "i");
+
+    shm_bridge_hello hello;
+    memset(&hello, 0, sizeof(hello));
+    hello.events_num = 2;
+    hello.elem_size = 40;
+    hello.capacity = 1024;
+    strcpy(hello.key, "/bridge-key");
+    const size_t size = SHM_BRIDGE_HELLO_SIZE + 2 * SHM_BRIDGE_RECORD_SIZE;
+    unsigned char encoded[SHM_BRIDGE_HELLO_SIZE + 2 * SHM_BRIDGE_RECORD_SIZE];
+    shm_bridge_hello_encode(&hello, events, encoded);
+    assert(shm_bridge_get_u32(encoded) == SHM_BRIDGE_VERSION);
+    assert(encoded[4 + 3] == 2 && encoded[16 + 6] == 1024 >> 8);
+    const unsigned char *rec = encoded + SHM_BRIDGE_HELLO_SIZE;
+    assert(rec[64] == 1 && rec[71] == 8);
+
+    shm_bridge_hello decoded;
+    struct event_record *recs =
+        shm_bridge_hello_decode(encoded, size, &decoded);
+    assert(recs);
+    assert(decoded.version == SHM_BRIDGE_VERSION && decoded.events_num == 2);
+    assert(decoded.elem_size == 40 && decoded.capacity == 1024);
+    assert(strcmp(decoded.key, "/bridge-key") == 0);
+    for (size_t i = 0; i < 2; ++i) {
+        assert(strcmp(recs[i].name, events[i].name) == 0);
+        assert(recs[i].kind == events[i].kind);
+        assert(recs[i].size == events[i].size);
+        assert(strcmp((char *)recs[i].signature,
+                      (char *)events[i].signature) == 0);
+    }
+    free(recs);
+
+    /* truncated payload and the other byte order */
+    assert(!shm_bridge_hello_decode(encoded, size - 1, &decoded));
+    encoded[27] ^= SHM_BRIDGE_LITTLE_ENDIAN;
+    assert(!shm_bridge_hello_decode(encoded, size, &decoded));
+}
+
+#define LOOPBACK_EVENTS 1000
+
+struct loopback_event {
+    shm_event base;
+    uint64_t n;
+    uint64_t str;
+};
+
+static pid_t spawn(char *const argv[]) {
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDERR_FILENO);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+static int wait_exit(pid_t pid) {
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status));
+    return WEXITSTATUS(status);
+}
+
+/* The sender connects only once and the receiver may not listen yet,
+ * so run the sender until it connects (it fails right away if not). */
+static pid_t spawn_sender(char *const argv[]) {
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        for (int i = 0; i < 100; ++i) {
+            if (wait_exit(spawn(argv)) == 0)
+                _exit(0);
+            nanosleep(&(struct timespec){.tv_nsec = 50000000}, NULL);
+        }
+        _exit(1);
+    }
+    return pid;
+}
+
+/* forward a buffer with shamon-bridge-send and shamon-bridge-recv
+ * over 127.0.0.1 and check the events that come out on the other side */
+static void test_loopback(const char *send, const char *recv,
+                          bool compress) {
+    char key[64], out_key[80], spec[80], port[16], addr[32];
+    snprintf(key, sizeof(key), "/bridge-test.%d", (int)getpid());
+    snprintf(out_key, sizeof(out_key), "%s.out", key);
+    snprintf(spec, sizeof(spec), "src:generic:%s", key);
+    snprintf(port, sizeof(port), "%d",
+             20000 + (int)(getpid() % 20000) + compress);
+    snprintf(addr, sizeof(addr), "127.0.0.1:%s", port);
+
+    struct source_control *control = source_control_define(1, "ev", "lS");
+    struct buffer *src = create_shared_buffer(key, 2 * LOOPBACK_EVENTS,
+                                              control);
+    free(control);
+    assert(src);
+
+    char *const recv_argv[] = {(char *)recv, "-l",   "127.0.0.1", "-p",
+                               port,         "-s",   ".out",      NULL};
+    pid_t recv_pid = spawn(recv_argv);
+    /* small batches without compression, so that there are more frames */
+    char *const send_argv[] = {(char *)send, "-b", "4096", addr, spec, NULL};
+    char *const send_argv_z[] = {(char *)send, "-z", addr, spec, NULL};
+    pid_t send_pid = spawn_sender(compress ? send_argv_z : send_argv);
+
+    struct buffer *out = try_get_shared_buffer(out_key, 20);
+    assert(out);
+    buffer_register_all_events(out);
+    buffer_set_attached(out, true);
+    size_t num;
+    const shm_kind out_kind = buffer_get_avail_events(out, &num)[0].kind;
+
+    buffer_wait_for_monitor(src);
+    const shm_kind kind = buffer_get_avail_events(src, &num)[0].kind;
+    assert(kind != 0);
+    for (uint64_t i = 0; i < LOOPBACK_EVENTS; ++i) {
+        /* the ids do not have to be consecutive */
+        const shm_event base = {.kind = kind, .id = 3 * i + 1};
+        char str[32];
+        snprintf(str, sizeof(str), "event %lu", i);
+        void *p = buffer_start_push(src);
+        assert(p);
+        p = buffer_partial_push(src, p, &base, sizeof(base));
+        p = buffer_partial_push(src, p, &i, sizeof(i));
+        buffer_partial_push_str(src, p, base.id, str);
+        buffer_finish_push(src);
+    }
+    destroy_shared_buffer(src);
+
+    uint64_t n = 0;
+    for (;;) {
+        size_t size;
+        struct loopback_event *ev = buffer_read_pointer(out, &size);
+        if (!ev) {
+            if (!buffer_is_ready(out) && buffer_size(out) == 0)
+                break;
+            sched_yield();
+            continue;
+        }
+        assert(ev->base.kind == out_kind);
+        assert(ev->base.id == 3 * n + 1);
+        assert(ev->n == n);
+        char str[32];
+        snprintf(str, sizeof(str), "event %lu", n);
+        assert(strcmp(buffer_get_str(out, ev->str), str) == 0);
+        buffer_consume(out, 1);
+        ++n;
+    }
+    assert(n == LOOPBACK_EVENTS);
+    release_shared_buffer(out);
+
+    assert(wait_exit(send_pid) == 0);
+    assert(wait_exit(recv_pid) == 0);
+}
+
+int main(int argc, char *argv[]) {
+    test_lz();
+    test_frames();
+    test_wire_format();
+    if (argc == 3) {
+        test_loopback(argv[1], argv[2], false);
+        test_loopback(argv[1], argv[2], true);
+    }
+    return 0;
+}
@@ -0,0 +1,322 @@
+#undef NDEBUG
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "shmbuf/buffer.h"
+#include "source.h"
+
+#define CAPACITY 64
+#define STR_LEN 1000
+
+struct elem {
+    uint64_t id;
+    uint64_t str;
+};
+
+static struct source_control *make_control(size_t elem_size) {
+    const size_t ctrl_size = sizeof(size_t) + sizeof(struct event_record);
+    struct source_control *ctrl = calloc(1, ctrl_size);
+    ctrl->size = ctrl_size;
+    ctrl->events[0].size = elem_size;
+    ctrl->events[0].kind = 2;
+    return ctrl;
+}
+
+static bool push(struct buffer *b, uint64_t id) {
+    void *p = buffer_start_push(b);
+    if (!p)
+        return false;
+    p = buffer_partial_push(b, p, &id, sizeof(id));
+    char str[STR_LEN];
+    memset(str, 'a' + id % 26, STR_LEN - 1);
+    str[STR_LEN - 1] = '\0';
+    buffer_partial_push_str(b, p, id, str);
+    buffer_finish_push(b);
+    return true;
+}
+
+static void check_str(struct buffer *b, struct elem *e) {
+    const char *str = buffer_get_str(b, e->str);
+    assert(strlen(str) == STR_LEN - 1);
+    assert(str[0] == (char)('a' + e->id % 26));
+    assert(str[STR_LEN - 2] == (char)('a' + e->id % 26));
+}
+
+/* pop an event and check its string */
+static uint64_t pop(struct buffer *b) {
+    struct elem e;
+    assert(buffer_pop(b, &e));
+    check_str(b, &e);
+    return e.id;
+}
+
+static void test_slowest(struct source_control *ctrl) {
+    struct buffer *w =
+        create_shared_broadcast_buffer("/bcast", CAPACITY, ctrl, 2,
+                                       SHM_BROADCAST_SLOWEST);
+    assert(w && buffer_is_broadcast(w));
+
+    struct buffer *r1 = get_shared_buffer("/bcast");
+    struct buffer *r2 = get_shared_buffer("/bcast");
+    assert(r1 && r2);
+    buffer_set_attached(r1, true);
+    assert(!buffer_monitor_attached(w));
+    buffer_set_attached(r2, true);
+    assert(buffer_monitor_attached(w));
+    assert(buffer_get_readers_num(w) == 2);
+
+    /* both readers get all events, the writer waits for the slower one */
+    uint64_t id = 1;
+    while (push(w, id)) ++id;
+    assert(id == CAPACITY + 1);
+    for (uint64_t i = 1; i < id; ++i) {
+        assert(pop(r1) == i);
+        buffer_set_last_processed_id(r1, i);
+    }
+    assert(buffer_size(r1) == 0 && buffer_size(r2) == CAPACITY);
+    assert(!push(w, id));
+    struct elem popped[CAPACITY / 2];
+    for (uint64_t i = 1; i <= CAPACITY / 2; ++i) {
+        assert(buffer_pop(r2, &popped[i - 1]) && popped[i - 1].id == i);
+    }
+    /* the aux buffers with strings of the events that r2 popped but did not
+     * process yet must not be reused */
+    for (size_t i = 0; i < CAPACITY / 2; ++i) {
+        assert(push(w, id++));
+    }
+    assert(!push(w, id));
+    for (size_t i = 0; i < CAPACITY / 2; ++i) {
+        check_str(r2, &popped[i]);
+    }
+    for (uint64_t i = CAPACITY / 2 + 1; i < id; ++i) {
+        assert(pop(r2) == i);
+        buffer_set_last_processed_id(r2, i);
+    }
+    for (uint64_t i = CAPACITY + 1; i < id; ++i) {
+        assert(pop(r1) == i);
+    }
+    assert(buffer_get_dropped_num(r1) == 0 && buffer_get_dropped_num(r2) == 0);
+
+    /* the writer does not wait for readers that left */
+    release_shared_buffer(r2);
+    while (push(w, id)) ++id;
+    assert(buffer_size(r1) == CAPACITY);
+
+    release_shared_buffer(r1);
+    destroy_shared_buffer(w);
+}
+
+static void test_primary(struct source_control *ctrl) {
+    struct buffer *w =
+        create_shared_broadcast_buffer("/bcast", CAPACITY, ctrl, 2,
+                                       SHM_BROADCAST_PRIMARY);
+    assert(w);
+
+    struct buffer *primary = get_shared_buffer("/bcast");
+    struct buffer *slow = get_shared_buffer("/bcast");
+    assert(primary && slow);
+
+    /* the writer waits only for the primary reader */
+    uint64_t id = 1;
+    while (push(w, id)) ++id;
+    assert(id == CAPACITY + 1);
+    for (uint64_t i = 1; i < id; ++i) assert(pop(primary) == i);
+    for (size_t i = 0; i < 10; ++i) assert(push(w, id++));
+
+    /* the slow reader lost its oldest events */
+    assert(buffer_get_dropped_num(slow) == 10);
+    assert(buffer_size(slow) == CAPACITY);
+    assert(pop(slow) == 11);
+
+    /* the slow reader processes a copy of the event, so the event does not
+     * change when the writer overwrites it */
+    size_t dropped = buffer_get_dropped_num(slow);
+    size_t size;
+    struct elem *e = buffer_read_pointer(slow, &size);
+    assert(e && size == 1 && e->id == 12);
+    for (uint64_t i = 0; i < CAPACITY; ++i) {
+        assert(pop(primary) == CAPACITY + 1 + i);
+        assert(push(w, id++));
+    }
+    assert(e->id == 12);
+    check_str(slow, e);
+    buffer_consume(slow, 1);
+    /* the consumed event is not counted as dropped */
+    const uint64_t next = pop(slow);
+    assert(buffer_get_dropped_num(slow) - dropped == next - 13);
+
+    release_shared_buffer(primary);
+    release_shared_buffer(slow);
+    destroy_shared_buffer(w);
+}
+
+static void test_primary_leaves(struct source_control *ctrl) {
+    struct buffer *w =
+        create_shared_broadcast_buffer("/bcast", CAPACITY, ctrl, 2,
+                                       SHM_BROADCAST_PRIMARY);
+    assert(w);
+    struct buffer *primary = get_shared_buffer("/bcast");
+    struct buffer *slow = get_shared_buffer("/bcast");
+    assert(primary && slow);
+    assert(!buffer_may_lose_events(primary) && buffer_may_lose_events(slow));
+
+    uint64_t id = 1;
+    while (push(w, id)) ++id;
+    for (uint64_t i = 1; i < id; ++i) assert(pop(primary) == i);
+
+    /* the other reader becomes primary, so the writer is not stuck
+     * with the tail of the reader that left */
+    release_shared_buffer(primary);
+    for (size_t n = 0; n < 3; ++n) {
+        for (size_t i = 0; i < CAPACITY; ++i) {
+            assert(pop(slow) == id - CAPACITY + i);
+            buffer_set_last_processed_id(slow, id - CAPACITY + i);
+        }
+        for (size_t i = 0; i < CAPACITY; ++i) assert(push(w, id++));
+        assert(!push(w, id));
+        /* the writer made the reader gating when it pushed */
+        assert(!buffer_may_lose_events(slow));
+    }
+    assert(buffer_get_dropped_num(slow) == 0);
+
+    release_shared_buffer(slow);
+    destroy_shared_buffer(w);
+}
+
+/* the reader that is closest to the head becomes primary and it skips
+ * the events that the writer could have overwritten */
+static void test_primary_handoff(struct source_control *ctrl) {
+    struct buffer *w =
+        create_shared_broadcast_buffer("/bcast", CAPACITY, ctrl, 3,
+                                       SHM_BROADCAST_PRIMARY);
+    assert(w);
+    struct buffer *primary = get_shared_buffer("/bcast");
+    struct buffer *behind = get_shared_buffer("/bcast");
+    struct buffer *half = get_shared_buffer("/bcast");
+    assert(primary && behind && half);
+    assert(!buffer_may_lose_events(primary));
+    assert(buffer_may_lose_events(behind) && buffer_may_lose_events(half));
+
+    uint64_t id = 1;
+    while (push(w, id)) ++id;
+    assert(id == CAPACITY + 1);
+    for (uint64_t i = 1; i < id; ++i) assert(pop(primary) == i);
+    for (uint64_t i = 1; i <= CAPACITY / 2; ++i) assert(pop(half) == i);
+    /* overwrite the oldest events that `behind` did not read */
+    for (size_t i = 0; i < CAPACITY / 4; ++i) assert(push(w, id++));
+    const size_t behind_dropped = buffer_get_dropped_num(behind);
+    assert(behind_dropped > 0);
+
+    release_shared_buffer(primary);
+    assert(push(w, id++));
+    assert(!buffer_may_lose_events(half) && buffer_may_lose_events(behind));
+    /* the writer could overwrite the events after the tail
+     * of the primary reader */
+    assert(buffer_get_dropped_num(half) == CAPACITY / 2);
+    for (uint64_t i = CAPACITY + 1; i < id; ++i) assert(pop(half) == i);
+    assert(pop(behind) == buffer_get_dropped_num(behind) + 1);
+
+    /* only the new primary reader gates the writer */
+    while (push(w, id)) ++id;
+    assert(id == 2 * CAPACITY + CAPACITY / 4 + 2);
+    assert(buffer_get_dropped_num(half) == CAPACITY / 2);
+
+    release_shared_buffer(behind);
+    release_shared_buffer(half);
+    destroy_shared_buffer(w);
+}
+
+/* events of the concurrent test, every word of the event is its id */
+#define WORDS 32
+#define EVENTS 50000
+
+struct big_elem {
+    uint64_t words[WORDS];
+};
+
+static _Atomic bool writer_done;
+
+static int concurrent_writer(void *data) {
+    struct buffer *w = data;
+    struct big_elem e;
+    for (uint64_t id = 1; id <= EVENTS; ++id) {
+        for (size_t i = 0; i < WORDS; ++i) e.words[i] = id;
+        while (!buffer_push(w, &e, sizeof(e)))
+            thrd_yield();
+    }
+    atomic_store(&writer_done, true);
+    return 0;
+}
+
+static int concurrent_primary(void *data) {
+    struct buffer *r = data;
+    struct big_elem e;
+    uint64_t next = 1;
+    while (next <= EVENTS) {
+        if (!buffer_pop(r, &e)) {
+            thrd_yield();
+            continue;
+        }
+        assert(e.words[0] == next);
+        ++next;
+    }
+    return 0;
+}
+
+/* the slow reader loses events, but never gets an overwritten event
+ * and every lost event is counted */
+static void test_primary_concurrent(void) {
+    struct source_control *ctrl = make_control(sizeof(struct big_elem));
+    struct buffer *w =
+        create_shared_broadcast_buffer("/bcast", CAPACITY, ctrl, 2,
+                                       SHM_BROADCAST_PRIMARY);
+    assert(w);
+    struct buffer *primary = get_shared_buffer("/bcast");
+    struct buffer *slow = get_shared_buffer("/bcast");
+    assert(primary && slow);
+
+    thrd_t wthrd, pthrd;
+    thrd_create(&pthrd, concurrent_primary, primary);
+    thrd_create(&wthrd, concurrent_writer, w);
+
+    struct big_elem e;
+    uint64_t last = 0, lost = 0, n = 0;
+    while (last < EVENTS) {
+        if (!buffer_pop(slow, &e)) {
+            thrd_yield();
+            continue;
+        }
+        for (size_t i = 1; i < WORDS; ++i) assert(e.words[i] == e.words[0]);
+        assert(e.words[0] > last);
+        lost += e.words[0] - last - 1;
+        last = e.words[0];
+        /* be slow sometimes */
+        if (++n % 256 == 0) {
+            thrd_sleep(&(struct timespec){.tv_nsec = 100000}, NULL);
+        }
+    }
+    thrd_join(wthrd, NULL);
+    thrd_join(pthrd, NULL);
+    assert(atomic_load(&writer_done));
+    assert(buffer_get_dropped_num(slow) == lost);
+
+    release_shared_buffer(primary);
+    release_shared_buffer(slow);
+    destroy_shared_buffer(w);
+    free(ctrl);
+}
+
+int main(void) {
+    struct source_control *ctrl = make_control(sizeof(struct elem));
+    test_slowest(ctrl);
+    test_primary(ctrl);
+    test_primary_leaves(ctrl);
+    test_primary_handoff(ctrl);
+    free(ctrl);
+    test_primary_concurrent();
+    return 0;
+}
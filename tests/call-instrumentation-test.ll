@@ -0,0 +1,45 @@
+; Check the IR that the pass vamos-call-instrumentation generates,
+; run by opt with the options in tests/CMakeLists.txt
+
+; booleans and zeroext values are zero-extended
+; CHECK-LABEL: define zeroext i1 @flag(
+; CHECK: call i8* @__vamos_call_start(i64 0)
+; CHECK: zext i1 %b to i64
+; CHECK: zext i8 %u to i64
+; CHECK: sext i8 %s to i64
+; CHECK: call void @__vamos_call_finish()
+; CHECK: call i8* @__vamos_call_start(i64 1)
+; CHECK: zext i1 %b to i8
+; CHECK: call void @__vamos_call_finish()
+; CHECK: ret i1 %b
+define zeroext i1 @flag(i1 %b, i8 zeroext %u, i8 signext %s) {
+  ret i1 %b
+}
+
+; CHECK-LABEL: define i32 @callee(
+; CHECK-NOT: __vamos_call_start
+; CHECK: ret i32 %x
+define i32 @callee(i32 %x) {
+  ret i32 %x
+}
+
+; no return event after a musttail call
+; CHECK-LABEL: define i32 @tail(
+; CHECK: call i8* @__vamos_call_start(i64 2)
+; CHECK: call void @__vamos_call_finish()
+; CHECK: musttail call i32 @callee(i32 %x)
+; CHECK-NEXT: ret i32 %r
+define i32 @tail(i32 %x) {
+  %r = musttail call i32 @callee(i32 %x)
+  ret i32 %r
+}
+
+; the signature is longer than the arguments
+; CHECK-LABEL: define i32 @long(
+; CHECK-NOT: __vamos_call_start
+; CHECK: ret i32 %x
+define i32 @long(i32 %x) {
+  ret i32 %x
+}
+
+; CHECK: @__vamos_call_start(i64)
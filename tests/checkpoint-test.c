@@ -0,0 +1,163 @@
+#undef NDEBUG
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "core/arbiter.h"
+#include "core/checkpoint.h"
+#include "core/event.h"
+#include "shmbuf/buffer-private.h"
+#include "shmbuf/buffer.h"
+
+#define PATH "checkpoint-test.ckpt"
+
+static void test_roundtrip(void) {
+    unlink(PATH);
+    assert(shm_checkpoint_load(PATH) == NULL);
+
+    int rule_set = 3;
+    uint64_t ids[4] = {1, 2, 3, 1000000};
+    char big[10000];
+    memset(big, 'x', sizeof(big));
+
+    shm_checkpoint_writer *w = shm_checkpoint_begin(PATH);
+    assert(SHM_CHECKPOINT_VAR(w, rule_set) == 0);
+    assert(SHM_CHECKPOINT_VAR(w, ids) == 0);
+    assert(shm_checkpoint_write(w, "big", big, sizeof(big)) == 0);
+    assert(shm_checkpoint_write(w, "empty", NULL, 0) == 0);
+    assert(shm_checkpoint_commit(w) == 0);
+    assert(access(PATH ".tmp", F_OK) != 0);
+
+    /* an aborted checkpoint does not replace the old one */
+    w = shm_checkpoint_begin(PATH);
+    assert(shm_checkpoint_write(w, "rule_set", "", 1) == 0);
+    shm_checkpoint_abort(w);
+
+    rule_set = 0;
+    memset(ids, 0, sizeof(ids));
+    shm_checkpoint *cp = shm_checkpoint_load(PATH);
+    assert(cp);
+    assert(SHM_RESTORE_VAR(cp, rule_set) && rule_set == 3);
+    assert(SHM_RESTORE_VAR(cp, ids) && ids[3] == 1000000);
+    size_t size;
+    const char *data = shm_checkpoint_get(cp, "big", &size);
+    assert(data && size == sizeof(big) && memcmp(data, big, size) == 0);
+    assert(shm_checkpoint_get(cp, "empty", &size) && size == 0);
+    /* missing value and a value of a different size */
+    assert(shm_checkpoint_get(cp, "missing", &size) == NULL);
+    assert(!shm_checkpoint_read(cp, "big", big, 10));
+    shm_checkpoint_free(cp);
+
+    /* a corrupted checkpoint is not loaded */
+    FILE *f = fopen(PATH, "r+b");
+    assert(f);
+    assert(fseek(f, 40, SEEK_SET) == 0);
+    fputc('!', f);
+    fclose(f);
+    assert(shm_checkpoint_load(PATH) == NULL);
+    unlink(PATH);
+}
+
+static bool is_ready(shm_stream *s) {
+    (void)s;
+    return false;
+}
+
+struct event {
+    shm_event base;
+    size_t n;
+};
+
+static void push(struct buffer *buffer, size_t id) {
+    struct event ev;
+    ev.base.kind = shm_get_last_special_kind() + 1;
+    ev.base.id = id;
+    ev.n = id;
+    assert(buffer_push(buffer, &ev, sizeof(ev)));
+}
+
+/* a hole that counts the lost events apart from the dropped ones */
+struct lost_hole {
+    shm_event base;
+    size_t dropped;
+    size_t lost;
+};
+
+static void lost_hole_init(shm_event *ev) {
+    ev->kind = shm_get_hole_kind();
+    ((struct lost_hole *)ev)->dropped = 0;
+    ((struct lost_hole *)ev)->lost = 0;
+}
+
+static void lost_hole_update(shm_event *hole, shm_event *ev) {
+    /* only the events that we have seen */
+    assert(ev->kind > shm_get_last_special_kind());
+    ++((struct lost_hole *)hole)->dropped;
+}
+
+static void lost_hole_add_lost(shm_event *hole, size_t n) {
+    ((struct lost_hole *)hole)->lost += n;
+}
+
+static const shm_stream_hole_handling lost_hole_handling = {
+    .hole_event_size = sizeof(struct lost_hole),
+    .init = lost_hole_init,
+    .update = lost_hole_update,
+    .add_lost = lost_hole_add_lost};
+
+/* restart after processing `processed` events while the stream
+ * starts with the event `first` */
+static void test_resume(size_t processed, size_t first) {
+    struct buffer *buffer =
+        initialize_local_buffer("/dummy", sizeof(struct event), 30, NULL);
+    assert(buffer);
+    for (size_t id = first; id <= 10; ++id) push(buffer, id);
+
+    shm_stream stream;
+    shm_stream_init(&stream, buffer, sizeof(struct event), is_ready, NULL,
+                    NULL, NULL, &lost_hole_handling, "dummy-stream", "dummy");
+    shm_arbiter_buffer *abuf =
+        shm_arbiter_buffer_create(&stream, sizeof(struct event), 20);
+    shm_arbiter_buffer_set_active(abuf, true);
+    shm_arbiter_buffer_resume_after(abuf, processed);
+    assert(shm_arbiter_buffer_last_processed_id(abuf) == processed);
+
+    struct event *ev = stream_fetch(&stream, abuf);
+    assert(ev && ev->n == (first > processed ? first : processed + 1));
+    if (first > processed + 1) {
+        /* the events between the checkpoint and the first event
+         * in the stream were lost */
+        struct lost_hole *hole =
+            (struct lost_hole *)shm_arbiter_buffer_top(abuf);
+        assert(hole && shm_event_is_hole(&hole->base));
+        assert(hole->lost == first - processed - 1 && hole->dropped == 0);
+        assert(shm_event_id(&hole->base) == first - 1);
+        assert(shm_arbiter_buffer_drop(abuf, 1) == 1);
+    }
+    assert(shm_arbiter_buffer_size(abuf) == 0);
+    shm_stream_consume(&stream, 1);
+
+    /* the rest of the events are fetched as usual */
+    for (size_t id = ev->n + 1; id <= 10; ++id) {
+        ev = stream_fetch(&stream, abuf);
+        assert(ev && ev->n == id);
+        shm_arbiter_buffer_push(abuf, ev, sizeof(*ev));
+        shm_stream_consume(&stream, 1);
+        assert(shm_arbiter_buffer_drop(abuf, 1) == 1);
+        assert(shm_arbiter_buffer_last_processed_id(abuf) == id);
+    }
+    assert(stream_fetch(&stream, abuf) == NULL);
+
+    shm_arbiter_buffer_free(abuf);
+    release_local_buffer(buffer);
+}
+
+int main(void) {
+    test_roundtrip();
+    test_resume(3, 1);
+    test_resume(3, 7);
+    test_resume(3, 4);
+    return 0;
+}
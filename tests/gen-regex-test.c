@@ -0,0 +1,61 @@
+/* Compare the events of a source generated by sources/gen-regex
+ * with the events of sources/regex.c for the same expressions.
+ *
+ * Usage: gen-regex-test regex shmkey name expr sig ... -- generated-source ...
+ * The generated source was generated for `shmkey` and the events and it is
+ * run with the given arguments, e.g., a DynamoRIO client under drrun. */
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "source-events.h"
+
+static const char *input =
+    "x1 x22\n"
+    "a=b\n"
+    "ab=\n"
+    "a12b345\n"
+    "no match here\n"
+    "x123x4 a=b\n"
+    "foo=bar\n"
+    "=x9\n"
+    "\n"
+    "xx9 abc12 de\n";
+
+int main(int argc, char *argv[]) {
+    int sep = 1;
+    while (sep < argc && strcmp(argv[sep], "--") != 0)
+        ++sep;
+    if (sep < 6 || (sep - 3) % 3 != 0 || sep + 1 >= argc) {
+        fprintf(stderr, "Usage: gen-regex-test regex shmkey name expr sig "
+                        "[name expr sig] ... -- generated-source ...\n");
+        return 1;
+    }
+    const char *key = argv[2];
+
+    FILE *in = tmpfile();
+    assert(in);
+    fputs(input, in);
+    fflush(in);
+
+    /* regex shmkey name expr sig ... */
+    argv[sep] = NULL;
+    char **regex_argv = argv + 1;
+    char **generated_argv = argv + sep + 1;
+
+    char *generated = source_events(generated_argv, key, fileno(in));
+    char *expected = source_events(regex_argv, key, fileno(in));
+    if (strcmp(generated, expected) != 0) {
+        fprintf(stderr, "The generated source sent:\n%s\nregex sent:\n%s",
+                generated, expected);
+        return 1;
+    }
+    printf("%s", generated);
+
+    free(generated);
+    free(expected);
+    fclose(in);
+    return 0;
+}
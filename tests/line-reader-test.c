@@ -0,0 +1,63 @@
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "core/line_reader.h"
+
+static const char *lines[] = {
+    "first line", "", "a line that is longer than the buffer of the reader",
+    "x", "", "", "the last line has no newline",
+};
+
+#define LINES_NUM (sizeof(lines) / sizeof(lines[0]))
+
+static int fds[2];
+
+/* write the lines in small pieces, so that the reader gets partial lines */
+static int writer_thrd(void *data) {
+    (void)data;
+    char text[512] = {0};
+    for (size_t i = 0; i < LINES_NUM; ++i) {
+        strcat(text, lines[i]);
+        if (i + 1 < LINES_NUM)
+            strcat(text, "\n");
+    }
+    const size_t len = strlen(text);
+    for (size_t off = 0; off < len; off += 5) {
+        const size_t n = len - off < 5 ? len - off : 5;
+        assert(write(fds[1], text + off, n) == (ssize_t)n);
+        thrd_yield();
+    }
+    close(fds[1]);
+    return 0;
+}
+
+int main(void) {
+    assert(pipe(fds) == 0);
+    thrd_t thrd;
+    thrd_create(&thrd, writer_thrd, NULL);
+
+    struct shm_line_reader reader;
+    shm_line_reader_init(&reader, fds[0], 8);
+    char *line;
+    ssize_t len;
+    size_t n = 0;
+    while ((len = shm_line_reader_next(&reader, &line)) >= 0) {
+        assert(n < LINES_NUM);
+        assert((size_t)len == strlen(lines[n]));
+        assert(strcmp(line, lines[n]) == 0);
+        ++n;
+    }
+    assert(n == LINES_NUM);
+    /* the end is sticky */
+    assert(shm_line_reader_next(&reader, &line) == -1);
+
+    thrd_join(thrd, NULL);
+    shm_line_reader_destroy(&reader);
+    close(fds[0]);
+    return 0;
+}
@@ -0,0 +1,241 @@
+#undef NDEBUG
+#include <assert.h>
+#include <regex.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/multi_regex.h"
+
+#define MAXMATCH 20
+
+static const char *exprs[] = {
+    "^Thread ([0-9]+) started$",
+    "write\\(([0-9]+), ?\"([^\"]*)\"\\)",
+    "(error|warning): (.*)",
+    "^$",
+    "a{2,3}b",
+    "x{2,}",
+    "(ab|a)*c",
+    "[]a-]+z",
+    "[^[:space:]]+@[[:alnum:]_.]+",
+    "\\w+=\\S*",
+    "((a|b)?c)+d$",
+    "^(foo)?bar",
+    "[.\\]",
+    "(a)\\1",    /* back-reference, not supported */
+    "\\bword\\b", /* GNU extension, not supported */
+    "()",
+    "a|",
+    "(^a|b$)",
+};
+
+#define EXPRS_NUM (sizeof(exprs) / sizeof(exprs[0]))
+
+static const char *lines[] = {
+    "",
+    "Thread 12 started",
+    " Thread 12 started",
+    "write(1, \"hello\")",
+    "write(1,\"\")",
+    "error: something went wrong",
+    "warning:",
+    "aab aaab ab",
+    "xx",
+    "x",
+    "ababc",
+    "]]-az",
+    "user@host.org",
+    "key= value",
+    "acbcd",
+    "acbcdx",
+    "foobar",
+    "barfoo",
+    "1.2\\3",
+    "aa",
+    "b",
+    "a",
+};
+
+#define LINES_NUM (sizeof(lines) / sizeof(lines[0]))
+
+static void check(struct shm_multi_regex *mre, regex_t *re,
+                  const char *exprs[], size_t num, const char *line) {
+    bool matched[num];
+    size_t count = shm_multi_regex_match(mre, line, strlen(line), matched);
+    size_t expected = 0;
+    for (size_t i = 0; i < num; ++i) {
+        if (!shm_multi_regex_is_exact(mre, i)) {
+            assert(matched[i] && "Inexact expressions always match");
+            ++expected;
+            continue;
+        }
+        /* ask for submatches like the sources do, glibc answers
+         * differently for some anchors in repetitions without them */
+        regmatch_t matches[MAXMATCH];
+        bool m = regexec(&re[i], line, MAXMATCH, matches, 0) == 0;
+        if (m != matched[i]) {
+            fprintf(stderr, "Mismatch on '%s' for line '%s': %d\n", exprs[i],
+                    line, matched[i]);
+            abort();
+        }
+        expected += m;
+    }
+    assert(count == expected);
+}
+
+static void test_exprs(void) {
+    regex_t re[EXPRS_NUM];
+    for (size_t i = 0; i < EXPRS_NUM; ++i) {
+        assert(regcomp(&re[i], exprs[i], REG_EXTENDED) == 0);
+    }
+
+    struct shm_multi_regex *mre = shm_multi_regex_compile(EXPRS_NUM, exprs);
+    assert(!shm_multi_regex_is_exact(mre, 13));
+    assert(!shm_multi_regex_is_exact(mre, 14));
+    for (size_t i = 0; i < 13; ++i) {
+        assert(shm_multi_regex_is_exact(mre, i));
+    }
+    /* twice, the second time from the cached DFA */
+    for (int k = 0; k < 2; ++k) {
+        for (size_t i = 0; i < LINES_NUM; ++i) {
+            check(mre, re, exprs, EXPRS_NUM, lines[i]);
+        }
+    }
+    shm_multi_regex_destroy(mre);
+
+    /* disabled expressions never match */
+    const char *some[] = {"a", NULL, "b"};
+    bool matched[3];
+    mre = shm_multi_regex_compile(3, some);
+    assert(shm_multi_regex_match(mre, "ab", 2, matched) == 2);
+    assert(matched[0] && !matched[1] && matched[2]);
+    shm_multi_regex_destroy(mre);
+
+    for (size_t i = 0; i < EXPRS_NUM; ++i) {
+        regfree(&re[i]);
+    }
+}
+
+/* random expressions over a small alphabet against random strings */
+static void gen_expr(char *buf, size_t *pos, int depth) {
+    const int atoms = 1 + rand() % 3;
+    for (int a = 0; a < atoms; ++a) {
+        switch (rand() % (depth > 1 ? 4 : 6)) {
+            case 0:
+                buf[(*pos)++] = "abc"[rand() % 3];
+                break;
+            case 1:
+                buf[(*pos)++] = '.';
+                break;
+            case 2:
+                *pos += sprintf(buf + *pos, "%s",
+                                (const char *[]){"[ab]", "[^a]", "[b-c]"}
+                                    [rand() % 3]);
+                break;
+            case 3:
+                buf[(*pos)++] = "^$a"[rand() % 3];
+                continue;
+            default:
+                buf[(*pos)++] = '(';
+                gen_expr(buf, pos, depth + 1);
+                if (rand() % 2) {
+                    buf[(*pos)++] = '|';
+                    gen_expr(buf, pos, depth + 1);
+                }
+                buf[(*pos)++] = ')';
+        }
+        if (rand() % 2)
+            *pos += sprintf(buf + *pos, "%s",
+                            (const char *[]){"*", "+", "?", "{1,2}", "{2}",
+                                             "{0,}"}[rand() % 6]);
+    }
+}
+
+static void test_random(void) {
+#define RANDOM_EXPRS 40
+    char bufs[RANDOM_EXPRS][256];
+    const char *rexprs[RANDOM_EXPRS];
+    regex_t re[RANDOM_EXPRS];
+    for (size_t i = 0; i < RANDOM_EXPRS; ++i) {
+        size_t pos = 0;
+        gen_expr(bufs[i], &pos, 0);
+        bufs[i][pos] = '\0';
+        rexprs[i] = bufs[i];
+        if (regcomp(&re[i], rexprs[i], REG_EXTENDED) != 0) {
+            /* try a simple one instead */
+            strcpy(bufs[i], "ab*c");
+            assert(regcomp(&re[i], rexprs[i], REG_EXTENDED) == 0);
+        }
+    }
+
+    struct shm_multi_regex *mre =
+        shm_multi_regex_compile(RANDOM_EXPRS, rexprs);
+    char line[32];
+    for (int n = 0; n < 2000; ++n) {
+        const int len = rand() % (sizeof(line) - 1);
+        for (int i = 0; i < len; ++i) {
+            line[i] = "abcd"[rand() % 4];
+        }
+        line[len] = '\0';
+        check(mre, re, rexprs, RANDOM_EXPRS, line);
+    }
+    shm_multi_regex_destroy(mre);
+
+    for (size_t i = 0; i < RANDOM_EXPRS; ++i) {
+        regfree(&re[i]);
+    }
+}
+
+static void test_prefilter(void) {
+    const char *lexprs[] = {
+        "^Thread ([0-9]+) started",
+        "ERR(OR)?: (.*)",
+        "x=([0-9]+), y=([0-9]+)",
+        "(ab|cd)+#",
+        "[[:digit:]]+ms$",
+    };
+#define LEXPRS_NUM (sizeof(lexprs) / sizeof(lexprs[0]))
+    regex_t re[LEXPRS_NUM];
+    for (size_t i = 0; i < LEXPRS_NUM; ++i) {
+        assert(regcomp(&re[i], lexprs[i], REG_EXTENDED) == 0);
+    }
+
+    struct shm_multi_regex *mre = shm_multi_regex_compile(LEXPRS_NUM, lexprs);
+    assert(shm_multi_regex_has_prefilter(mre));
+
+    /* glue random pieces, the lines are long enough for SIMD */
+    const char *pieces[] = {"Thread ", "12", " started", "ERR", "OR", ": ",
+                            "x=", ", y=", "ab", "cd", "#", "ms", " ", "abc"};
+    char line[256];
+    for (int n = 0; n < 5000; ++n) {
+        line[0] = '\0';
+        const int num = rand() % 12;
+        for (int i = 0; i < num; ++i) {
+            strcat(line, pieces[rand() % (sizeof(pieces) / sizeof(pieces[0]))]);
+        }
+        check(mre, re, lexprs, LEXPRS_NUM, line);
+    }
+    shm_multi_regex_destroy(mre);
+
+    /* an expression without a literal turns the prefilter off */
+    const char *some[] = {"abc", "[0-9]+"};
+    mre = shm_multi_regex_compile(2, some);
+    assert(!shm_multi_regex_has_prefilter(mre));
+    shm_multi_regex_destroy(mre);
+
+    for (size_t i = 0; i < LEXPRS_NUM; ++i) {
+        regfree(&re[i]);
+    }
+}
+
+int main(void) {
+    test_exprs();
+    test_prefilter();
+    srand(1);
+    for (int i = 0; i < 10; ++i) {
+        test_random();
+    }
+    return 0;
+}
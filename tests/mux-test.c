@@ -0,0 +1,83 @@
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "core/source.h"
+#include "shmbuf/buffer-private.h"
+#include "shmbuf/buffer.h"
+#include "shmbuf/mux.h"
+
+#define KEY "/mux-test"
+#define THREADS 8
+#define EVENTS 2000
+#define KIND 5
+
+static struct shm_mux *mux;
+
+static int writer_thrd(void *data) {
+    (void)data;
+    shm_mux_channel ch = shm_mux_open_channel(mux);
+    for (uint64_t n = 1; n <= EVENTS; ++n) {
+        shm_mux_push(mux, ch, KIND, &n, sizeof(n));
+    }
+    return 0;
+}
+
+int main(void) {
+    struct source_control *control = source_control_define(1, "E", "l");
+    mux = shm_mux_create(KEY, 64, control);
+    assert(mux);
+    /* the channel was prepended to the event, the original control
+     * is not changed */
+    assert(strcmp((char *)control->events[0].signature, "l") == 0);
+    size_t num;
+    struct event_record *rec =
+        buffer_get_avail_events(shm_mux_buffer(mux), &num);
+    assert(num == 1 && strcmp((char *)rec[0].signature, "il") == 0);
+    assert(rec[0].size == control->events[0].size + sizeof(int));
+
+    struct buffer *reader = try_get_shared_buffer(KEY, 0);
+    assert(reader);
+    const size_t elem_size = buffer_elem_size(reader);
+    assert(elem_size >= rec[0].size);
+
+    thrd_t thrds[THREADS];
+    for (size_t i = 0; i < THREADS; ++i) {
+        thrd_create(&thrds[i], writer_thrd, NULL);
+    }
+
+    uint64_t last_n[THREADS + 1] = {0};
+    shm_eventid last_id = 0;
+    unsigned char *ev = malloc(elem_size);
+    for (size_t total = 0; total < THREADS * EVENTS;) {
+        if (!buffer_pop(reader, ev)) {
+            thrd_yield();
+            continue;
+        }
+        ++total;
+
+        /* the IDs increase across channels... */
+        assert(shm_event_id((shm_event *)ev) == ++last_id);
+        assert(shm_event_kind((shm_event *)ev) == KIND);
+        /* ...and the events of every channel are in order */
+        shm_mux_channel ch = shm_mux_event_channel((shm_event *)ev);
+        assert(ch >= 1 && ch <= THREADS);
+        uint64_t n;
+        memcpy(&n, ev + sizeof(shm_event) + sizeof(int), sizeof(n));
+        assert(n == ++last_n[ch]);
+    }
+    for (size_t i = 0; i < THREADS; ++i) {
+        thrd_join(thrds[i], NULL);
+        assert(last_n[i + 1] == EVENTS);
+    }
+    assert(buffer_size(reader) == 0);
+
+    free(ev);
+    release_shared_buffer(reader);
+    shm_mux_destroy(mux);
+    free(control);
+    return 0;
+}
@@ -0,0 +1,83 @@
+#undef NDEBUG
+#include <assert.h>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/parse_number.h"
+
+static void check_long(const char *s) {
+    /* the span does not end with NUL */
+    char buf[64];
+    const size_t len = strlen(s);
+    memcpy(buf, s, len);
+    buf[len] = '7';
+    assert(shm_parse_long(buf, len) == atol(s));
+    assert(shm_parse_int(buf, len) == atoi(s));
+}
+
+static void check_double(const char *s) {
+    char buf[512];
+    const size_t len = strlen(s);
+    memcpy(buf, s, len);
+    buf[len] = '7';
+    const double d = shm_parse_double(buf, len), expected = strtod(s, NULL);
+    if (memcmp(&d, &expected, sizeof(d)) != 0 && !(d != d && expected != expected)) {
+        fprintf(stderr, "'%s': %.17g != %.17g\n", s, d, expected);
+        abort();
+    }
+}
+
+int main(void) {
+    const char *longs[] = {"0",     "42",        "-42",        "+7",
+                           "  12x", "\t-3 4",    "",           "-",
+                           "abc",   "007",       "9223372036854775807",
+                           "-9223372036854775807", "12.5"};
+    for (size_t i = 0; i < sizeof(longs) / sizeof(longs[0]); ++i) {
+        check_long(longs[i]);
+    }
+
+    const char *doubles[] = {
+        "0",         "-0",         "1.5",      "  -2.25e3", ".5",      "5.",
+        "1e22",      "1e23",       "1e-22",    "1e-300",    "0.1",     "3.14159",
+        "123456789012345678901234567890",       "0.000000000000000000000001",
+        "1e",        "1e+",        "inf",      "-infinity", "nan",     "0x1p3",
+        "abc",       "",           ".",        "-.e5",      "9007199254740993",
+        "2.5E-3xyz", "17.000000000000000000001"};
+    for (size_t i = 0; i < sizeof(doubles) / sizeof(doubles[0]); ++i) {
+        check_double(doubles[i]);
+    }
+
+    /* random numbers in the formats printf produces */
+    srand(1);
+    char buf[64];
+    for (int n = 0; n < 100000; ++n) {
+        const double d = (double)rand() / (rand() + 1) * (rand() % 2 ? 1 : -1);
+        snprintf(buf, sizeof(buf), (const char *[]){"%g", "%f", "%.3f", "%e",
+                                                    "%.10g", "%.17g"}[n % 6],
+                 d);
+        check_double(buf);
+        snprintf(buf, sizeof(buf), "%ld", (long)rand() * (rand() % 2 ? 1 : -1));
+        check_long(buf);
+    }
+
+    /* the numbers that go to strtod are parsed in the "C" locale too */
+    const char *slow[] = {"0.1234567890123456789012", "1.5e300", "0x1.8p1"};
+    double in_c[sizeof(slow) / sizeof(slow[0])];
+    for (size_t i = 0; i < sizeof(slow) / sizeof(slow[0]); ++i) {
+        in_c[i] = strtod(slow[i], NULL);
+    }
+    const char *comma_locales[] = {"de_DE.UTF-8", "fr_FR.UTF-8", "cs_CZ.UTF-8",
+                                   "de_DE", "fr_FR"};
+    for (size_t i = 0; i < sizeof(comma_locales) / sizeof(comma_locales[0]);
+         ++i) {
+        if (!setlocale(LC_NUMERIC, comma_locales[i]))
+            continue;
+        for (size_t j = 0; j < sizeof(slow) / sizeof(slow[0]); ++j) {
+            assert(shm_parse_double(slow[j], strlen(slow[j])) == in_c[j]);
+        }
+        break;
+    }
+    return 0;
+}
@@ -0,0 +1,210 @@
+#undef NDEBUG
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "shmbuf/payload.h"
+
+#define KEY "/payload-test"
+#define CAPACITY (64 * 1024)
+#define PAYLOADS 2000
+#define MAX_LEN (3 * CAPACITY / 2)
+/* two payloads always fit into the ring */
+#define MAX_STORED (CAPACITY / 2 - 64)
+
+static struct shm_payload *writer;
+static shm_payload_ref refs[PAYLOADS];
+static size_t lens[PAYLOADS];
+static _Atomic size_t pushed;
+
+static unsigned char pattern(size_t n, size_t i) {
+    return (unsigned char)(n * 31 + i * 7);
+}
+
+static int writer_thrd(void *data) {
+    (void)data;
+    unsigned char *buf = malloc(MAX_LEN);
+    srand(1);
+    for (size_t n = 0; n < PAYLOADS; ++n) {
+        /* mostly small payloads, sometimes bigger than the ring */
+        const size_t len = rand() % 10 == 0 ? rand() % MAX_LEN : rand() % 512;
+        for (size_t i = 0; i < len; ++i)
+            buf[i] = pattern(n, i);
+        lens[n] = len;
+        refs[n] = shm_payload_push(writer, SHM_PAYLOAD_NO_EVENT, buf, len,
+                                   SHM_PAYLOAD_WAIT);
+        atomic_store(&pushed, n + 1);
+    }
+    free(buf);
+    return 0;
+}
+
+/* read the payload in chunks and check the data */
+static void check_payload(struct shm_payload *reader, size_t n) {
+    size_t stored, len;
+    assert(shm_payload_get_size(reader, refs[n], &stored, &len));
+    assert(len == lens[n]);
+    assert(stored == (len < MAX_STORED ? len : MAX_STORED));
+
+    size_t offset = 0, chunks = 0;
+    while (offset < stored) {
+        size_t chunk_len;
+        const unsigned char *chunk =
+            shm_payload_chunk(reader, refs[n], offset, &chunk_len);
+        assert(chunk && chunk_len > 0);
+        for (size_t i = 0; i < chunk_len; ++i)
+            assert(chunk[i] == pattern(n, offset + i));
+        offset += chunk_len;
+        ++chunks;
+    }
+    assert(offset == stored && chunks <= 2);
+    size_t chunk_len;
+    assert(shm_payload_chunk(reader, refs[n], stored, &chunk_len) == NULL);
+}
+
+static void test_wait(void) {
+    writer = shm_payload_create(KEY, CAPACITY, MAX_STORED);
+    assert(writer);
+    struct shm_payload *reader = shm_payload_open(KEY);
+    assert(reader);
+
+    thrd_t thrd;
+    thrd_create(&thrd, writer_thrd, NULL);
+
+    /* release the payloads in pairs in the reverse order */
+    for (size_t n = 0; n < PAYLOADS; n += 2) {
+        while (atomic_load(&pushed) < (n + 2 < PAYLOADS ? n + 2 : PAYLOADS))
+            thrd_yield();
+        check_payload(reader, n);
+        if (n + 1 < PAYLOADS) {
+            check_payload(reader, n + 1);
+            shm_payload_release(reader, refs[n + 1]);
+            size_t stored, len;
+            assert(!shm_payload_get_size(reader, refs[n + 1], &stored, &len));
+        }
+        shm_payload_release(reader, refs[n]);
+    }
+    thrd_join(thrd, NULL);
+
+    uint64_t truncated, dropped;
+    shm_payload_get_stats(writer, &truncated, &dropped);
+    assert(dropped == 0);
+    shm_payload_close(reader);
+    shm_payload_destroy(writer);
+}
+
+static void test_policies(void) {
+    writer = shm_payload_create(KEY, 4096, 1000);
+    assert(writer);
+    struct shm_payload *reader = shm_payload_open(KEY);
+    assert(reader);
+    static unsigned char buf[4096];
+    memset(buf, 'x', sizeof(buf));
+    size_t stored, len;
+
+    /* longer than max_len, every entry takes 32 + 1024 bytes */
+    shm_payload_ref r1 =
+        shm_payload_push(writer, 1, buf, 2000, SHM_PAYLOAD_DROP);
+    assert(shm_payload_get_size(reader, r1, &stored, &len));
+    assert(stored == 1000 && len == 2000);
+    shm_payload_ref r2 =
+        shm_payload_push(writer, 2, buf, 1000, SHM_PAYLOAD_TRUNCATE);
+    assert(shm_payload_get_size(reader, r2, &stored, &len));
+    assert(stored == 1000 && len == 1000);
+    shm_payload_ref r3 =
+        shm_payload_push(writer, 3, buf, 1000, SHM_PAYLOAD_DROP);
+    assert(shm_payload_get_size(reader, r3, &stored, &len));
+    assert(stored == 1000);
+    /* does not fit */
+    shm_payload_ref r4 =
+        shm_payload_push(writer, 4, buf, 1000, SHM_PAYLOAD_DROP);
+    assert(shm_payload_get_size(reader, r4, &stored, &len));
+    assert(stored == 0 && len == 1000);
+    shm_payload_ref r5 =
+        shm_payload_push(writer, 5, buf, 1000, SHM_PAYLOAD_TRUNCATE);
+    assert(shm_payload_get_size(reader, r5, &stored, &len));
+    assert(stored == 4096 - 3 * 1056 - 32 - 32 && len == 1000);
+    /* the ring is full */
+    assert(shm_payload_push(writer, 6, buf, 1, SHM_PAYLOAD_TRUNCATE) ==
+           SHM_PAYLOAD_NONE);
+    assert(!shm_payload_get_size(reader, SHM_PAYLOAD_NONE, &stored, &len));
+
+    /* releasing a payload in the middle does not free any space */
+    shm_payload_release(reader, r3);
+    assert(!shm_payload_get_size(reader, r3, &stored, &len));
+    assert(shm_payload_push(writer, 7, buf, 1, SHM_PAYLOAD_DROP) ==
+           SHM_PAYLOAD_NONE);
+    shm_payload_release(reader, r1);
+    shm_payload_release(reader, r2);
+    /* the space of r1, r2 and r3 is free now */
+    shm_payload_ref r6 =
+        shm_payload_push(writer, 8, buf, 1000, SHM_PAYLOAD_DROP);
+    assert(shm_payload_get_size(reader, r6, &stored, &len));
+    assert(stored == 1000 && len == 1000);
+    assert(shm_payload_push(writer, 9, buf, 1000, SHM_PAYLOAD_WAIT) !=
+           SHM_PAYLOAD_NONE);
+    assert(shm_payload_push(writer, 10, buf, 1000, SHM_PAYLOAD_WAIT) !=
+           SHM_PAYLOAD_NONE);
+
+    /* the monitor is gone, the writer does not wait for it */
+    shm_payload_close(reader);
+    assert(shm_payload_push(writer, 11, buf, 1000, SHM_PAYLOAD_WAIT) ==
+           SHM_PAYLOAD_NONE);
+
+    uint64_t truncated, dropped;
+    shm_payload_get_stats(writer, &truncated, &dropped);
+    assert(truncated == 2 && dropped == 4);
+    shm_payload_destroy(writer);
+}
+
+/* the monitor releases the payloads with the events */
+static void test_release_until(void) {
+    writer = shm_payload_create(KEY, 4096, 1000);
+    assert(writer);
+    struct shm_payload *reader = shm_payload_open(KEY);
+    assert(reader);
+    static unsigned char buf[1000];
+    size_t stored, len;
+
+    shm_payload_ref refs[3];
+    for (uint64_t id = 1; id <= 3; ++id)
+        refs[id - 1] =
+            shm_payload_push(writer, id, buf, 1000, SHM_PAYLOAD_TRUNCATE);
+    assert(shm_payload_push(writer, 4, buf, 1000, SHM_PAYLOAD_TRUNCATE) !=
+           SHM_PAYLOAD_NONE);
+    /* the ring is full */
+    assert(shm_payload_push(writer, 5, buf, 1, SHM_PAYLOAD_TRUNCATE) ==
+           SHM_PAYLOAD_NONE);
+
+    shm_payload_release_until(reader, 2);
+    assert(!shm_payload_get_size(reader, refs[0], &stored, &len));
+    assert(!shm_payload_get_size(reader, refs[1], &stored, &len));
+    assert(shm_payload_get_size(reader, refs[2], &stored, &len));
+    assert(stored == 1000);
+    shm_payload_ref r6 =
+        shm_payload_push(writer, 6, buf, 1000, SHM_PAYLOAD_TRUNCATE);
+    assert(shm_payload_get_size(reader, r6, &stored, &len));
+    assert(stored == 1000);
+
+    /* payloads without events are released only explicitly */
+    shm_payload_release_until(reader, 6);
+    shm_payload_ref r7 = shm_payload_push(writer, SHM_PAYLOAD_NO_EVENT, buf,
+                                          1000, SHM_PAYLOAD_TRUNCATE);
+    shm_payload_release_until(reader, 100);
+    assert(shm_payload_get_size(reader, r7, &stored, &len));
+    shm_payload_release(reader, r7);
+    assert(!shm_payload_get_size(reader, r7, &stored, &len));
+
+    shm_payload_close(reader);
+    shm_payload_destroy(writer);
+}
+
+int main(void) {
+    test_wait();
+    test_policies();
+    test_release_until();
+    return 0;
+}
@@ -0,0 +1,72 @@
+/* The program that tests/preload-test.c runs with the preloaded sources */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static int test_write(void) {
+    printf("printf %d\n", 1);
+    fflush(stdout);
+    write(STDOUT_FILENO, "write\n", 6);
+    puts("puts");
+    fputs("fputs\n", stdout);
+    fwrite("fwrite\n", 1, 7, stdout);
+    fflush(stdout);
+    write(STDOUT_FILENO, "write\n", 6);
+    fprintf(stderr, "stderr\n");
+    /* flushed at exit */
+    printf("exit\n");
+    return 0;
+}
+
+/* writes much more data than fits into the payload ring of the test */
+static int test_payload(void) {
+    unsigned char buf[1000];
+    for (size_t n = 0; n < 200; ++n) {
+        for (size_t i = 0; i < sizeof(buf); ++i)
+            buf[i] = (unsigned char)(n * 31 + i * 7);
+        if (write(STDOUT_FILENO, buf, sizeof(buf)) != sizeof(buf))
+            return 1;
+    }
+    return 0;
+}
+
+/* every thread (the main thread is 0) calls puts with different strings,
+ * long enough to fill several aux buffers */
+static void *puts_thrd(void *data) {
+    const int thread = (int)(intptr_t)data;
+    char str[256];
+    for (int i = 0; i < 200; ++i) {
+        snprintf(str, sizeof(str), "thread %d call %d %.*s", thread, i,
+                 i % 150, "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+                          "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+                          "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx");
+        puts(str);
+    }
+    return NULL;
+}
+
+static int test_threads(void) {
+    pthread_t threads[4];
+    for (int t = 0; t < 4; ++t) {
+        if (pthread_create(&threads[t], NULL, puts_thrd,
+                           (void *)(intptr_t)(t + 1)) != 0)
+            return 1;
+    }
+    puts_thrd((void *)0);
+    for (int t = 0; t < 4; ++t) pthread_join(threads[t], NULL);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "write") == 0)
+        return test_write();
+    if (argc == 2 && strcmp(argv[1], "payload") == 0)
+        return test_payload();
+    if (argc == 2 && strcmp(argv[1], "threads") == 0)
+        return test_threads();
+
+    fprintf(stderr, "Usage: preload-prog write|payload|threads\n");
+    return 1;
+}
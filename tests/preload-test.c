@@ -0,0 +1,242 @@
+#undef NDEBUG
+#include <assert.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "core/event.h"
+#include "core/shamon.h"
+#include "core/stream.h"
+#include "shmbuf/buffer.h"
+#include "shmbuf/payload.h"
+#include "streams/stream-generic.h"
+
+static const char *prog;
+
+/* run `prog mode` with `lib` preloaded and the environment variables
+ * `env` set (pairs of names and values terminated by NULL) */
+static pid_t run_preloaded(const char *lib, const char *mode,
+                           const char *const env[]) {
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        /* the program must not write to a terminal */
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        for (; *env; env += 2)
+            setenv(env[0], env[1], 1);
+        setenv("LD_PRELOAD", lib, 1);
+        execl(prog, prog, mode, (char *)NULL);
+        _exit(127);
+    }
+    return pid;
+}
+
+static struct buffer *attach(const char *key) {
+    struct buffer *buffer = try_get_shared_buffer(key, 20);
+    assert(buffer);
+    buffer_register_all_events(buffer);
+    buffer_set_attached(buffer, true);
+    return buffer;
+}
+
+/* copy the next event into `ev`, returns false when the source finished */
+static bool next_event(struct buffer *buffer, void *ev) {
+    size_t size;
+    void *data;
+    while (!(data = buffer_read_pointer(buffer, &size))) {
+        /* the buffer may get destroyed after we checked its size */
+        if (!buffer_is_ready(buffer) && buffer_size(buffer) == 0)
+            return false;
+        sched_yield();
+    }
+    memcpy(ev, data, buffer_elem_size(buffer));
+    buffer_consume(buffer, 1);
+    return true;
+}
+
+static void wait_success(pid_t pid) {
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+/* the arguments of `write` events from a multiplexed buffer */
+struct write_args {
+    int channel;
+    int fd;
+    uint64_t str;
+} __attribute__((packed));
+
+static void test_write(const char *lib) {
+    char key[64];
+    snprintf(key, sizeof(key), "/preload-test-write.%d", (int)getpid());
+    const char *const env[] = {"SHAMON_WRITE_KEY", key, NULL};
+    pid_t pid = run_preloaded(lib, "write", env);
+    struct buffer *buffer = attach(key);
+
+    /* stdio is captured when it is flushed, in order with write() */
+    const struct {
+        int fd;
+        const char *data;
+    } expected[] = {
+        {1, "printf 1\n"},
+        {1, "write\n"},
+        {1, "puts\nfputs\nfwrite\n"},
+        {1, "write\n"},
+        {2, "stderr\n"},
+        {1, "exit\n"},
+    };
+    const size_t expected_num = sizeof(expected) / sizeof(expected[0]);
+
+    unsigned char *ev = malloc(buffer_elem_size(buffer));
+    size_t n = 0;
+    while (next_event(buffer, ev)) {
+        struct write_args args;
+        memcpy(&args, ev + sizeof(shm_event), sizeof(args));
+        const char *data = buffer_get_str(buffer, args.str);
+        assert(n < expected_num);
+        assert(args.fd == expected[n].fd);
+        assert(strcmp(data, expected[n].data) == 0);
+        ++n;
+    }
+    assert(n == expected_num);
+
+    free(ev);
+    release_shared_buffer(buffer);
+    wait_success(pid);
+}
+
+/* the arguments of `write` events with payloads */
+struct write_payload_args {
+    int channel;
+    int fd;
+    uint64_t ref;
+    uint64_t len;
+} __attribute__((packed));
+
+/* the program writes much more than fits into the ring and waits
+ * for the space, the stream releases the payloads of processed events */
+static void test_write_payload(const char *lib) {
+    char key[64];
+    snprintf(key, sizeof(key), "/preload-test-payload.%d", (int)getpid());
+    const char *const env[] = {"SHAMON_WRITE_KEY",     key,
+                               "SHAMON_WRITE_PAYLOAD", "8192",
+                               "SHAMON_WRITE_POLICY",  "wait",
+                               NULL};
+    pid_t pid = run_preloaded(lib, "payload", env);
+
+    struct buffer *buffer = try_get_shared_buffer(key, 20);
+    assert(buffer);
+    shm_stream *stream =
+        shm_create_generic_stream_from_buffer(buffer, "payload", NULL);
+    shm_stream_register_all_events(stream);
+    shm_stream_attach(stream);
+    struct shm_payload *payload = shm_stream_get_payload(stream);
+    assert(payload);
+
+    size_t n = 0;
+    for (;;) {
+        size_t num;
+        shm_event *ev = shm_stream_read_events(stream, &num);
+        if (!ev) {
+            if (shm_stream_is_finished(stream))
+                break;
+            sched_yield();
+            continue;
+        }
+
+        /* what preload-prog.c writes */
+        struct write_payload_args args;
+        memcpy(&args, (unsigned char *)ev + sizeof(shm_event), sizeof(args));
+        assert(args.fd == 1 && args.len == 1000);
+        size_t stored, len;
+        assert(shm_payload_get_size(payload, args.ref, &stored, &len));
+        assert(stored == 1000 && len == 1000);
+        size_t offset = 0, chunk_len;
+        const unsigned char *chunk;
+        while ((chunk = shm_payload_chunk(payload, args.ref, offset,
+                                          &chunk_len))) {
+            for (size_t i = 0; i < chunk_len; ++i)
+                assert(chunk[i] == (unsigned char)(n * 31 + (offset + i) * 7));
+            offset += chunk_len;
+        }
+        assert(offset == 1000);
+        ++n;
+
+        const shm_eventid id = shm_event_id(ev);
+        shm_stream_consume(stream, 1);
+        shm_stream_notify_last_processed_id(stream, id);
+    }
+    assert(n == 200);
+
+    shm_stream_destroy(stream);
+    wait_success(pid);
+}
+
+/* the threads push strings into the top buffer and into sub-buffers
+ * at the same time, the strings of the buffers must not get mixed */
+static void test_funs_threads(const char *lib) {
+    char key[64];
+    snprintf(key, sizeof(key), "/preload-test-funs.%d", (int)getpid());
+    const char *const env[] = {"SHAMON_FUNS_KEY", key, NULL};
+    pid_t pid = run_preloaded(lib, "threads", env);
+
+    struct buffer *buffer = try_get_shared_buffer(key, 20);
+    assert(buffer);
+    shamon *shmn = shamon_create(NULL, NULL);
+    shm_stream *top =
+        shm_create_generic_stream_from_buffer(buffer, "funs", NULL);
+    shm_stream_register_all_events(top);
+    shamon_add_stream(shmn, top, 1024);
+
+    /* what preload-prog.c calls puts with, for threads 0 to 4 */
+    int next_call[5] = {0};
+    size_t events = 0;
+    shm_stream *stream;
+    shm_event *ev;
+    while (shamon_is_ready(shmn)) {
+        while ((ev = shamon_get_next_ev(shmn, &stream))) {
+            if (shm_event_is_hole(ev)) {
+                /* the monitor may fall behind */
+                events += ((shm_event_default_hole *)ev)->n;
+                continue;
+            }
+            uint64_t ref;
+            memcpy(&ref, (unsigned char *)ev + sizeof(shm_event), sizeof(ref));
+            const char *str = shm_stream_get_str(stream, ref);
+            int thread, call, len;
+            assert(sscanf(str, "thread %d call %d %n", &thread, &call, &len) ==
+                   2);
+            assert(thread >= 0 && thread < 5);
+            assert(call >= next_call[thread] && call < 200);
+            next_call[thread] = call + 1;
+            assert(strspn(str + len, "x") == (size_t)call % 150);
+            assert(str[len + call % 150] == '\0');
+            ++events;
+        }
+    }
+    assert(events == 5 * 200);
+
+    shamon_destroy(shmn);
+    wait_success(pid);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr,
+                "Usage: preload-test preload-prog libwrite [libfuns]\n");
+        return 1;
+    }
+    prog = argv[1];
+    test_write(argv[2]);
+    test_write_payload(argv[2]);
+    if (argc == 4)
+        test_funs_threads(argv[3]);
+    return 0;
+}
@@ -0,0 +1,59 @@
+#undef NDEBUG
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include "shmbuf/push-guard.h"
+
+#define THREADS 4
+
+static struct shm_push_guard guard = SHM_PUSH_GUARD_INIT;
+/* stands for the buffers, it is freed after closing the guard */
+static _Atomic(size_t *) resource;
+static _Atomic size_t entered;
+
+static int writer(void *data) {
+    (void)data;
+    while (shm_push_guard_enter(&guard)) {
+        size_t *r = atomic_load(&resource);
+        /* the resource is not freed while we are inside */
+        assert(r && *r == 42);
+        ++entered;
+        thrd_yield();
+        assert(atomic_load(&resource) == r && *r == 42);
+        shm_push_guard_leave(&guard);
+    }
+    return 0;
+}
+
+int main(void) {
+    /* a closed guard cannot be entered */
+    assert(!shm_push_guard_enter(&guard));
+
+    size_t *r = malloc(sizeof(*r));
+    *r = 42;
+    atomic_store(&resource, r);
+    shm_push_guard_open(&guard);
+    assert(shm_push_guard_enter(&guard));
+    shm_push_guard_leave(&guard);
+
+    thrd_t threads[THREADS];
+    for (int i = 0; i < THREADS; ++i) {
+        thrd_create(&threads[i], writer, NULL);
+    }
+    while (atomic_load(&entered) < 1000) thrd_yield();
+
+    shm_push_guard_close(&guard);
+    /* nobody is inside anymore */
+    *r = 0;
+    atomic_store(&resource, NULL);
+    free(r);
+
+    for (int i = 0; i < THREADS; ++i) {
+        thrd_join(threads[i], NULL);
+    }
+    assert(!shm_push_guard_enter(&guard));
+    return 0;
+}
@@ -0,0 +1,147 @@
+/* Record the events of sources/regex.c with shamon-record and check
+ * that they come back unchanged.
+ *
+ * Usage: record-test regex shamon-record shamon-replay [offline-monitor]
+ * The offline monitor is tests/offline-monitor.txt compiled with --offline. */
+#undef NDEBUG
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "source-events.h"
+
+#define KEY "/record-test"
+
+static const char *input =
+    "x1 a=b\n"
+    "x22\n"
+    "\n"
+    "no match here\n"
+    "foo=bar x333\n"
+    "=x9 1=22\n";
+
+static char *regex;
+static char *record;
+static char *replay;
+static char *monitor;
+
+/* run `regex_argv` on `in` and record its events into `path`,
+ * into a columnar trace file if `columnar` is set */
+static void record_events(char *const regex_argv[], int in, bool columnar,
+                          const char *path) {
+    char *record_argv[5];
+    size_t n = 0;
+    record_argv[n++] = record;
+    if (columnar)
+        record_argv[n++] = "-c";
+    record_argv[n++] = (char *)path;
+    record_argv[n++] = "src:generic:" KEY;
+    record_argv[n] = NULL;
+
+    assert(lseek(in, 0, SEEK_SET) == 0);
+    pid_t src = run_program(regex_argv, in, -1);
+    /* shamon-record waits for the buffer to appear */
+    pid_t rec = run_program(record_argv, in, -1);
+    wait_program(src);
+    wait_program(rec);
+}
+
+/* the replayed events are the events of the source */
+static void test_replay(int in) {
+    char path[] = "/tmp/record-test-XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    char *const regex_argv[] = {regex, KEY, "num", "x([0-9]+)", "i",
+                                "pair", "([a-z]+)=([a-z]+)", "SS", NULL};
+    record_events(regex_argv, in, false, path);
+
+    char *const replay_argv[] = {replay, path, "-k", KEY "-replay",
+                                 "-s", "0", NULL};
+    char *expected = source_events(regex_argv, KEY, in);
+    char *replayed = source_events(replay_argv, KEY "-replay", in);
+    if (strcmp(replayed, expected) != 0) {
+        fprintf(stderr, "The source sent:\n%s\nshamon-replay sent:\n%s",
+                expected, replayed);
+        abort();
+    }
+    printf("%s", replayed);
+
+    free(expected);
+    free(replayed);
+    unlink(path);
+}
+
+/* a monitor compiled with --offline sees all the events of a trace file */
+static void test_offline(int in) {
+    char path[] = "/tmp/record-test-XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    /* the events of tests/offline-monitor.txt */
+    char *const regex_argv[] = {regex, KEY, "num", "x([0-9]+)", "i",
+                                "pair", "([0-9]+)=([0-9]+)", "ii", NULL};
+    record_events(regex_argv, in, true, path);
+
+    FILE *out = tmpfile();
+    assert(out);
+    char spec[sizeof(path) + 16];
+    snprintf(spec, sizeof(spec), "Src:tracefile:%s", path);
+    char *const monitor_argv[] = {monitor, spec, NULL};
+    wait_program(run_program(monitor_argv, in, fileno(out)));
+
+    char *expected = source_events(regex_argv, KEY, in);
+    /* the monitor reports its progress on lines that start with "--" */
+    char *monitored;
+    size_t size;
+    FILE *events = open_memstream(&monitored, &size);
+    assert(events);
+    char *line = NULL;
+    size_t line_size = 0;
+    rewind(out);
+    while (getline(&line, &line_size, out) > 0) {
+        if (strncmp(line, "--", 2) != 0)
+            fputs(line, events);
+    }
+    free(line);
+    fclose(events);
+    if (strcmp(monitored, expected) != 0) {
+        fprintf(stderr, "The source sent:\n%s\nthe offline monitor saw:\n%s",
+                expected, monitored);
+        abort();
+    }
+
+    free(expected);
+    free(monitored);
+    fclose(out);
+    unlink(path);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 4 && argc != 5) {
+        fprintf(stderr, "Usage: record-test regex shamon-record "
+                        "shamon-replay [offline-monitor]\n");
+        return 1;
+    }
+    regex = argv[1];
+    record = argv[2];
+    replay = argv[3];
+    monitor = argc == 5 ? argv[4] : NULL;
+
+    FILE *in = tmpfile();
+    assert(in);
+    fputs(input, in);
+    fflush(in);
+
+    test_replay(fileno(in));
+    if (monitor)
+        test_offline(fileno(in));
+
+    fclose(in);
+    return 0;
+}
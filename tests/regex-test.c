@@ -0,0 +1,100 @@
+/* Check the events of sources/regex.c for chosen inputs.
+ *
+ * Usage: regex-test regex */
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "source-events.h"
+
+static const char *regex;
+
+static FILE *make_input(const char *text) {
+    FILE *in = tmpfile();
+    assert(in);
+    fputs(text, in);
+    fflush(in);
+    return in;
+}
+
+static void expect_events(char *const argv[], const char *input,
+                          const char *expected) {
+    FILE *in = make_input(input);
+    char *events = source_events(argv, argv[1], fileno(in));
+    if (strcmp(events, expected) != 0) {
+        fprintf(stderr, "Expected the events:\n%s\nbut regex sent:\n%s",
+                expected, events);
+        abort();
+    }
+    free(events);
+    fclose(in);
+}
+
+/* empty lines are matched like any other line */
+static void test_empty_lines(void) {
+    char *const argv[] = {(char *)regex, "/regex-test", "empty", "^$", "L",
+                          "line", "^x$", "L", NULL};
+    expect_events(argv, "x\n\n\nx\n\n",
+                  "line('x')\n"
+                  "empty('')\n"
+                  "empty('')\n"
+                  "line('x')\n"
+                  "empty('')\n");
+}
+
+/* an optional group that did not match is an empty string or zero */
+static void test_missing_captures(void) {
+    char *const argv[] = {(char *)regex, "/regex-test", "kv",
+                          "^([a-z]+)(=([0-9]+))?$", "SSi", NULL};
+    expect_events(argv, "a=1\nb\nc=22\n",
+                  "kv('a', '=1', 1)\n"
+                  "kv('b', '', 0)\n"
+                  "kv('c', '=22', 22)\n");
+}
+
+/* parallel parsing sends the same events in the same order,
+ * the input spans several chunks of the parser */
+static void test_parallel(void) {
+    char *text = NULL;
+    size_t size = 0;
+    FILE *gen = open_memstream(&text, &size);
+    assert(gen);
+    for (int i = 0; size < 3 * 1024 * 1024; ++i) {
+        fprintf(gen, "x%d y=%d\n", i, i % 7);
+        if (i % 5 == 0)
+            fprintf(gen, "\n");
+        fflush(gen);
+    }
+    fclose(gen);
+    FILE *in = make_input(text);
+    free(text);
+
+    char *const sequential[] = {(char *)regex, "/regex-test", "x", "x([0-9]+)",
+                                "i", "y", "y=([0-9])", "S", NULL};
+    char *const parallel[] = {(char *)regex, "-j", "3", "/regex-test", "x",
+                              "x([0-9]+)", "i", "y", "y=([0-9])", "S", NULL};
+    char *expected = source_events(sequential, "/regex-test", fileno(in));
+    char *events = source_events(parallel, "/regex-test", fileno(in));
+    if (strcmp(events, expected) != 0) {
+        fprintf(stderr, "regex -j 3 sent different events than regex\n");
+        abort();
+    }
+    free(expected);
+    free(events);
+    fclose(in);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: regex-test regex\n");
+        return 1;
+    }
+    regex = argv[1];
+
+    test_empty_lines();
+    test_missing_captures();
+    test_parallel();
+    return 0;
+}
@@ -0,0 +1,200 @@
+#undef NDEBUG
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "core/source.h"
+#include "shmbuf/buffer.h"
+#include "shmbuf/registry.h"
+
+static struct source_control *make_control(void) {
+    const size_t ctrl_size = sizeof(size_t) + sizeof(struct event_record);
+    struct source_control *ctrl = malloc(ctrl_size);
+    ctrl->size = ctrl_size;
+    ctrl->events[0].size = sizeof(size_t);
+    ctrl->events[0].kind = 2;
+    ctrl->events[0].name[0] = '\0';
+    ctrl->events[0].signature[0] = '\0';
+    return ctrl;
+}
+
+static void test_slots(struct shm_registry *host) {
+    struct shm_registry *src = shm_registry_open(shm_registry_key());
+    assert(src);
+
+    char key[SHM_NAME_MAXLEN];
+    assert(shm_registry_take(host, "/", key) == -1);
+
+    uint32_t seq = shm_registry_seq(host);
+    uint32_t gen1, gen2;
+    int s1 = shm_registry_announce(src, "/first", &gen1);
+    int s2 = shm_registry_announce(src, "/second", &gen2);
+    assert(s1 >= 0 && s2 >= 0 && s1 != s2);
+    /* there were announcements, so we do not sleep */
+    assert(shm_registry_wait(host, seq, 10000));
+
+    /* a withdrawn buffer is not taken */
+    shm_registry_withdraw(src, s2, gen2);
+    assert(shm_registry_take(host, "/", key) == s1);
+    assert(strcmp(key, "/first") == 0);
+    assert(shm_registry_take(host, "/", key) == -1);
+    /* withdrawing a taken buffer does nothing */
+    shm_registry_withdraw(src, s1, gen1);
+    shm_registry_release(host, s1);
+
+    /* a reused slot has a new generation, so the old announcement
+     * cannot withdraw it */
+    uint32_t gen3;
+    int s3 = shm_registry_announce(src, "/third", &gen3);
+    assert(s3 >= 0 && (s3 != s1 || gen3 != gen1));
+    shm_registry_withdraw(src, s1, gen1);
+    shm_registry_withdraw(src, s2, gen2);
+    assert(shm_registry_take(host, "/", key) == s3);
+    assert(strcmp(key, "/third") == 0);
+    shm_registry_release(host, s3);
+
+    /* the host takes only the buffers with its prefix */
+    int s4 = shm_registry_announce(src, "/other", &gen1);
+    int s5 = shm_registry_announce(src, "/hosted.1", &gen2);
+    assert(s4 >= 0 && s5 >= 0);
+    assert(shm_registry_take(host, "/hosted", key) == s5);
+    assert(strcmp(key, "/hosted.1") == 0);
+    assert(shm_registry_take(host, "/hosted", key) == -1);
+    assert(shm_registry_take(host, "/", key) == s4);
+    shm_registry_release(host, s4);
+    shm_registry_release(host, s5);
+
+    /* no announcement, we sleep until the timeout */
+    seq = shm_registry_seq(host);
+    assert(!shm_registry_wait(host, seq, 10));
+
+    shm_registry_close(src);
+}
+
+static void test_buffers(struct shm_registry *host) {
+    struct source_control *ctrl = make_control();
+    struct buffer *b = create_shared_buffer("/registry-test", 16, ctrl);
+    assert(b);
+
+    /* the buffer announced itself... */
+    char key[SHM_NAME_MAXLEN];
+    int slot = shm_registry_take(host, "/", key);
+    assert(slot >= 0 && strcmp(key, "/registry-test") == 0);
+    shm_registry_release(host, slot);
+    destroy_shared_buffer(b);
+
+    /* ...and it withdraws the announcement when it is gone */
+    b = create_shared_buffer("/registry-test", 16, ctrl);
+    assert(b);
+    destroy_shared_buffer(b);
+    assert(shm_registry_take(host, "/", key) == -1);
+    free(ctrl);
+}
+
+static int create_later(void *data) {
+    struct buffer **b = data;
+    thrd_sleep(&(struct timespec){.tv_nsec = 50000000}, NULL);
+    struct source_control *ctrl = make_control();
+    *b = create_shared_buffer("/registry-test-late", 16, ctrl);
+    free(ctrl);
+    return 0;
+}
+
+/* a monitor waiting for a buffer is woken up by the announcement */
+static void test_wakeup(void) {
+    struct buffer *b = NULL;
+    thrd_t thrd;
+    thrd_create(&thrd, create_later, &b);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct buffer *m = try_get_shared_buffer("/registry-test-late", 10);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    assert(m);
+    thrd_join(thrd, NULL);
+
+    long ms = (end.tv_sec - start.tv_sec) * 1000 +
+              (end.tv_nsec - start.tv_nsec) / 1000000;
+    /* without the registry, the monitor would poll every 300 ms */
+    assert(ms < 250);
+
+    release_shared_buffer(m);
+    destroy_shared_buffer(b);
+}
+
+/* a non-broadcast buffer can be claimed by one reader only */
+static void test_claim(void) {
+    struct source_control *ctrl = make_control();
+    struct buffer *b = create_shared_buffer("/registry-test-claim", 16, ctrl);
+    assert(b);
+
+    struct buffer *m1 = try_get_shared_buffer("/registry-test-claim", 0);
+    assert(m1);
+    assert(buffer_claim(m1));
+    /* readers that do not claim the buffer get it */
+    struct buffer *m2 = try_get_shared_buffer("/registry-test-claim", 0);
+    assert(m2);
+    assert(!buffer_claim(m2));
+    release_shared_buffer(m1);
+    /* released buffers can be claimed by another reader */
+    assert(buffer_claim(m2));
+    release_shared_buffer(m2);
+
+    destroy_shared_buffer(b);
+    free(ctrl);
+}
+
+static _Atomic int announcing;
+
+static int announce_others(void *data) {
+    struct shm_registry *src = shm_registry_open(shm_registry_key());
+    uint32_t gen;
+    while (atomic_load(&announcing)) {
+        int slot = shm_registry_announce(src, "/registry-test-other", &gen);
+        if (slot >= 0)
+            shm_registry_withdraw(src, slot, gen);
+        thrd_sleep(&(struct timespec){.tv_nsec = 10000000}, NULL);
+    }
+    shm_registry_close(src);
+    (void)data;
+    return 0;
+}
+
+/* announcements of other buffers do not prolong waiting for a buffer */
+static void test_deadline(void) {
+    atomic_store(&announcing, 1);
+    thrd_t thrd;
+    thrd_create(&thrd, announce_others, NULL);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    assert(try_get_shared_buffer("/registry-test-missing", 2) == NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    atomic_store(&announcing, 0);
+    thrd_join(thrd, NULL);
+
+    long ms = (end.tv_sec - start.tv_sec) * 1000 +
+              (end.tv_nsec - start.tv_nsec) / 1000000;
+    assert(ms >= 550 && ms < 1500);
+}
+
+int main(void) {
+    char key[SHM_NAME_MAXLEN];
+    snprintf(key, sizeof(key), "/registry-test.%d", (int)getpid());
+    setenv("SHAMON_REGISTRY", key, 1);
+
+    struct shm_registry *host = shm_registry_create(shm_registry_key());
+    assert(host);
+    test_slots(host);
+    test_buffers(host);
+    test_wakeup();
+    test_claim();
+    test_deadline();
+    shm_registry_destroy(host);
+    return 0;
+}
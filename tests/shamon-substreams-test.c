@@ -0,0 +1,107 @@
+#undef NDEBUG
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "core/event.h"
+#include "core/shamon.h"
+#include "core/source.h"
+#include "core/stream.h"
+#include "shmbuf/buffer.h"
+#include "shmbuf/shm.h"
+#include "streams/stream-generic.h"
+
+#define KEY "/shamon-substreams-test"
+#define SUBSTREAMS 25
+#define EVENTS 100
+
+struct event {
+    shm_event base;
+    uint64_t n;
+};
+
+static struct buffer *top;
+static struct source_control *control;
+
+/* a source that creates a sub-buffer for every "thread" and destroys it
+ * when the thread ends */
+static int source_thrd(void *data) {
+    (void)data;
+    struct event ev;
+    ev.base.kind = shm_get_last_special_kind() + 1;
+    for (size_t s = 0; s < SUBSTREAMS; ++s) {
+        struct buffer *sub = create_shared_sub_buffer(top, 0, control);
+        assert(sub);
+        for (size_t i = 1; i <= EVENTS; ++i) {
+            ev.base.id = i;
+            ev.n = i;
+            while (!buffer_push(sub, &ev, sizeof(ev))) thrd_yield();
+        }
+        destroy_shared_sub_buffer(sub);
+    }
+    return 0;
+}
+
+int main(void) {
+    control = source_control_define(1, "E", "l");
+    top = create_shared_buffer(KEY, 64, control);
+    assert(top);
+
+    shamon *shmn = shamon_create(NULL, NULL);
+    shm_stream *stream = shm_create_generic_stream(KEY, "top", NULL);
+    assert(stream);
+    shm_stream_register_all_events(stream);
+    shamon_add_stream(shmn, stream, 64);
+
+    thrd_t thrd;
+    thrd_create(&thrd, source_thrd, NULL);
+
+    size_t events = 0, streams_num, max_streams = 0;
+    shm_stream *evstream;
+    shm_event *ev;
+    while (events < SUBSTREAMS * EVENTS) {
+        while ((ev = shamon_get_next_ev(shmn, &evstream))) {
+            assert(shm_stream_is_substream(evstream));
+            /* the monitor may fall behind, count the dropped events too */
+            if (shm_event_is_hole(ev))
+                events += ((shm_event_default_hole *)ev)->n;
+            else
+                ++events;
+        }
+        shamon_get_streams(shmn, &streams_num);
+        if (streams_num > max_streams)
+            max_streams = streams_num;
+        thrd_yield();
+    }
+    thrd_join(thrd, NULL);
+    assert(events == SUBSTREAMS * EVENTS);
+
+    /* the finished substreams are removed,
+     * only the stream that we added remains */
+    for (size_t tries = 0; tries < 5000; ++tries) {
+        ev = shamon_get_next_ev(shmn, &evstream);
+        assert(!ev);
+        shamon_get_streams(shmn, &streams_num);
+        if (streams_num == 1)
+            break;
+        thrd_sleep(&(struct timespec){.tv_nsec = 1000000}, NULL);
+    }
+    assert(streams_num == 1);
+    printf("At most %lu streams at once\n", max_streams);
+
+    /* ... and so is their shared memory */
+    for (size_t s = 1; s <= SUBSTREAMS; ++s) {
+        char *key = get_sub_buffer_key(KEY, s);
+        assert(shamon_shm_open(key, O_RDONLY, S_IRWXU) < 0);
+        free(key);
+    }
+
+    destroy_shared_buffer(top);
+    shamon_destroy(shmn);
+    free(control);
+    return 0;
+}
@@ -0,0 +1,123 @@
+/* Helpers for the tests of the regex sources, see source-events.h */
+#undef NDEBUG
+#include <assert.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "core/event.h"
+#include "core/signatures.h"
+#include "core/source.h"
+#include "shmbuf/buffer.h"
+#include "source-events.h"
+
+pid_t run_program(char *const argv[], int in, int out) {
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        dup2(in, STDIN_FILENO);
+        int null = open("/dev/null", O_WRONLY);
+        dup2(out < 0 ? null : out, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+void wait_program(pid_t pid) {
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+static bool next_event(struct buffer *buffer, void *ev) {
+    size_t size;
+    void *data;
+    while (!(data = buffer_read_pointer(buffer, &size))) {
+        if (!buffer_is_ready(buffer) && buffer_size(buffer) == 0)
+            return false;
+        sched_yield();
+    }
+    memcpy(ev, data, buffer_elem_size(buffer));
+    buffer_consume(buffer, 1);
+    return true;
+}
+
+static void print_arg(FILE *out, struct buffer *buffer, unsigned char op,
+                      const unsigned char *p) {
+    signature_operand arg;
+    memcpy(&arg, p, signature_op_get_size(op));
+    switch (op) {
+        case 'S':
+        case 'L':
+        case 'M':
+            fprintf(out, "'%s'", (char *)buffer_get_str(buffer, arg.S.shared));
+            break;
+        case 'c':
+            fprintf(out, "%c", arg.c);
+            break;
+        case 'i':
+            fprintf(out, "%d", (int)arg.i);
+            break;
+        case 'l':
+            fprintf(out, "%ld", (long)arg.l);
+            break;
+        case 'f':
+            fprintf(out, "%f", arg.f);
+            break;
+        case 'd':
+            fprintf(out, "%lf", arg.d);
+            break;
+        default:
+            assert(0 && "Unexpected signature");
+    }
+}
+
+char *source_events(char *const argv[], const char *key, int in) {
+    assert(lseek(in, 0, SEEK_SET) == 0);
+    pid_t pid = run_program(argv, in, -1);
+
+    struct buffer *buffer = try_get_shared_buffer(key, 20);
+    assert(buffer);
+    buffer_register_all_events(buffer);
+    size_t records_num;
+    struct event_record *records =
+        buffer_get_avail_events(buffer, &records_num);
+    buffer_set_attached(buffer, true);
+
+    char *text;
+    size_t size;
+    FILE *out = open_memstream(&text, &size);
+    assert(out);
+    unsigned char *ev = malloc(buffer_elem_size(buffer));
+    while (next_event(buffer, ev)) {
+        const shm_kind kind = shm_event_kind((shm_event *)ev);
+        struct event_record *rec = NULL;
+        for (size_t i = 0; i < records_num; ++i) {
+            if (records[i].kind == kind)
+                rec = &records[i];
+        }
+        assert(rec && "Unknown event");
+
+        fprintf(out, "%s(", rec->name);
+        const unsigned char *p = ev + sizeof(shm_event);
+        for (const unsigned char *o = rec->signature; *o; ++o) {
+            if (o != rec->signature)
+                fprintf(out, ", ");
+            print_arg(out, buffer, *o, p);
+            p += signature_op_get_size(*o);
+        }
+        fprintf(out, ")\n");
+    }
+    fclose(out);
+    free(ev);
+    release_shared_buffer(buffer);
+
+    wait_program(pid);
+    return text;
+}
@@ -0,0 +1,19 @@
+#ifndef SHAMON_TESTS_SOURCE_EVENTS_H
+#define SHAMON_TESTS_SOURCE_EVENTS_H
+
+#include <sys/types.h>
+
+/* Run the program `argv` with the file descriptor `in` as its standard
+ * input and `out` as its standard output (/dev/null if `out` is -1).
+ * The standard error goes to /dev/null. */
+pid_t run_program(char *const argv[], int in, int out);
+/* Wait for the program and assert that it exited with 0 */
+void wait_program(pid_t pid);
+
+/* Run the source `argv` with the file descriptor `in` as its standard input
+ * (from the start of the file), attach to its buffer `key` and return all
+ * its events as text, one event per line, e.g., "pair('a', 'b')".
+ * Asserts that the source exits with 0. The caller frees the text. */
+char *source_events(char *const argv[], const char *key, int in);
+
+#endif /* SHAMON_TESTS_SOURCE_EVENTS_H */
@@ -0,0 +1,169 @@
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/struct_log.h"
+
+static const char *keys[] = {"event", "user", "uid", "msg", "req", "ok"};
+#define KEYS_NUM (sizeof(keys) / sizeof(keys[0]))
+
+static void check_value(struct shm_struct_log_value *v, const char *expected) {
+    if (!expected) {
+        assert(v->str == NULL);
+        return;
+    }
+    assert(v->str);
+    if (v->len != strlen(expected) || memcmp(v->str, expected, v->len) != 0) {
+        fprintf(stderr, "Expected '%s', got '%.*s'\n", expected, (int)v->len,
+                v->str);
+        abort();
+    }
+}
+
+static int parse(struct shm_struct_log *slog, const char *text,
+                 struct shm_struct_log_value *values) {
+    static char line[1024];
+    strcpy(line, text);
+    return shm_struct_log_parse(slog, line, strlen(line), values);
+}
+
+static void test_json(struct shm_struct_log *slog) {
+    struct shm_struct_log_value values[KEYS_NUM];
+
+    assert(parse(slog,
+                 "{\"event\": \"login\", \"uid\":42, \"user\":\"jo\\\"e\","
+                 " \"req\": {\"a\": [1, {\"b\": \"}\"}]}, \"x\": null,"
+                 " \"msg\": \"tab\\there \\u00e9\\ud83d\\ude00 \\/\"}",
+                 values) == 5);
+    check_value(&values[0], "login");
+    check_value(&values[1], "jo\"e");
+    check_value(&values[2], "42");
+    check_value(&values[3], "tab\there \xc3\xa9\xf0\x9f\x98\x80 /");
+    check_value(&values[4], "{\"a\": [1, {\"b\": \"}\"}]}");
+    check_value(&values[5], NULL);
+
+    /* the first value wins, keys are exact */
+    assert(parse(slog, "  {\"ok\" : true , \"ok\": false, \"Ok\": 1}", values) ==
+           1);
+    check_value(&values[5], "true");
+    assert(parse(slog, "{}", values) == 0);
+    assert(parse(slog, "{\"msg\": \"\\\\\"}", values) == 1);
+    check_value(&values[3], "\\");
+
+    /* malformed */
+    assert(parse(slog, "{\"event\": \"login}", values) == -1);
+    assert(parse(slog, "{\"event\" \"login\"}", values) == -1);
+    assert(parse(slog, "{\"event\": }", values) == -1);
+    assert(parse(slog, "{\"req\": {\"a\": 1}", values) == -1);
+}
+
+static void test_logfmt(struct shm_struct_log *slog) {
+    struct shm_struct_log_value values[KEYS_NUM];
+
+    assert(parse(slog,
+                 "level=info event=login user=\"john \\\"doe\\\" x=1\" "
+                 "uid=7  ok msg=a=b",
+                 values) == 5);
+    check_value(&values[0], "login");
+    check_value(&values[1], "john \"doe\" x=1");
+    check_value(&values[2], "7");
+    check_value(&values[3], "a=b");
+    check_value(&values[4], NULL);
+    check_value(&values[5], "");
+
+    assert(parse(slog, "", values) == 0);
+    assert(parse(slog, "event= uid=\"\"", values) == 2);
+    check_value(&values[0], "");
+    check_value(&values[2], "");
+
+    /* malformed */
+    assert(parse(slog, "=x", values) == -1);
+    assert(parse(slog, "msg=\"unterminated", values) == -1);
+}
+
+/* random strings with escapes, long enough to cross the 64-byte blocks */
+static void random_string(char *raw, char *expected) {
+    const int len = rand() % 100;
+    for (int i = 0; i < len; ++i) {
+        switch (rand() % 8) {
+            case 0:
+                strcat(raw, "\\\"");
+                strcat(expected, "\"");
+                break;
+            case 1:
+                strcat(raw, "\\\\");
+                strcat(expected, "\\");
+                break;
+            case 2:
+                strcat(raw, "\\n");
+                strcat(expected, "\n");
+                break;
+            default: {
+                char c[2] = {" ab:,{}[]=x"[rand() % 11], 0};
+                strcat(raw, c);
+                strcat(expected, c);
+            }
+        }
+    }
+}
+
+static void test_random(struct shm_struct_log *slog) {
+    static char line[16384];
+    static char expected[KEYS_NUM][1024];
+    struct shm_struct_log_value values[KEYS_NUM];
+
+    for (int n = 0; n < 2000; ++n) {
+        const bool json = rand() % 2;
+        bool present[KEYS_NUM] = {0};
+        strcpy(line, json ? "{" : "");
+        int num = 0;
+        for (int f = 0; f < 12; ++f) {
+            const size_t k = rand() % (KEYS_NUM + 2);
+            const char *key = k < KEYS_NUM ? keys[k] : "other";
+            if (num > 0)
+                strcat(line, json ? ", " : " ");
+            ++num;
+            char *exp = k < KEYS_NUM && !present[k] ? expected[k] : NULL;
+            char tmp[1024];
+            if (!exp)
+                exp = tmp;
+            exp[0] = '\0';
+            if (k < KEYS_NUM)
+                present[k] = true;
+
+            strcat(line, json ? "\"" : "");
+            strcat(line, key);
+            strcat(line, json ? "\": " : "=");
+            if (rand() % 3 == 0) {
+                sprintf(exp, "%d", rand() - RAND_MAX / 2);
+                strcat(line, exp);
+            } else {
+                strcat(line, "\"");
+                random_string(line, exp);
+                strcat(line, "\"");
+            }
+        }
+        strcat(line, json ? "}" : "");
+
+        int found = 0;
+        for (size_t k = 0; k < KEYS_NUM; ++k)
+            found += present[k];
+        const int ret = shm_struct_log_parse(slog, line, strlen(line), values);
+        assert(ret == found);
+        for (size_t k = 0; k < KEYS_NUM; ++k) {
+            check_value(&values[k], present[k] ? expected[k] : NULL);
+        }
+    }
+}
+
+int main(void) {
+    struct shm_struct_log *slog = shm_struct_log_create(KEYS_NUM, keys);
+    test_json(slog);
+    test_logfmt(slog);
+    srand(1);
+    test_random(slog);
+    shm_struct_log_destroy(slog);
+    return 0;
+}
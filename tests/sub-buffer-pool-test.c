@@ -0,0 +1,137 @@
+#undef NDEBUG
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include "core/source.h"
+#include "shmbuf/buffer.h"
+#include "shmbuf/shm.h"
+#include "shmbuf/sub-buffer-pool.h"
+
+#define KEY "/sub-buffer-pool-test"
+#define THREADS 4
+#define ROUNDS 50
+
+static struct buffer *parent;
+
+static void test_recycle(struct source_control *control) {
+    size_t subs = buffer_get_sub_buffers_no(parent);
+    struct shm_sub_buffer_pool *pool =
+        shm_sub_buffer_pool_create(parent, 8, control, 2, true);
+    /* the buffers are created ahead of time */
+    assert(buffer_get_sub_buffers_no(parent) == subs + 2);
+
+    struct shm_sub_buffer_writer *w1 = shm_sub_buffer_pool_acquire(pool);
+    struct shm_sub_buffer_writer *w2 = shm_sub_buffer_pool_acquire(pool);
+    assert(w1 && w2 && w1 != w2);
+    assert(buffer_capacity(w1->buffer) >= 8);
+    assert(buffer_get_sub_buffers_no(parent) == subs + 2);
+    /* the pool is empty, so the buffer is created right away */
+    struct shm_sub_buffer_writer *w3 = shm_sub_buffer_pool_acquire(pool);
+    assert(w3);
+    assert(buffer_get_sub_buffers_no(parent) == subs + 3);
+
+    /* the next thread continues where the previous one ended */
+    w1->last_id = 10;
+    shm_sub_buffer_pool_release(pool, w1);
+    struct shm_sub_buffer_writer *w = shm_sub_buffer_pool_acquire(pool);
+    assert(w == w1 && w->last_id == 10);
+
+    shm_sub_buffer_pool_release(pool, w1);
+    shm_sub_buffer_pool_release(pool, w2);
+    /* the pool is full, this one is destroyed */
+    shm_sub_buffer_pool_release(pool, w3);
+    assert(buffer_get_sub_buffers_no(parent) == subs + 3);
+    shm_sub_buffer_pool_destroy(pool);
+}
+
+static void test_no_recycle(struct source_control *control) {
+    size_t subs = buffer_get_sub_buffers_no(parent);
+    struct shm_sub_buffer_pool *pool =
+        shm_sub_buffer_pool_create(parent, 0, control, 2, false);
+    assert(buffer_get_sub_buffers_no(parent) == subs + 2);
+
+    struct shm_sub_buffer_writer *w1 = shm_sub_buffer_pool_acquire(pool);
+    assert(buffer_capacity(w1->buffer) == buffer_capacity(parent));
+    /* the buffer is destroyed and a fresh one is created for the pool */
+    shm_sub_buffer_pool_release(pool, w1);
+    assert(buffer_get_sub_buffers_no(parent) == subs + 3);
+    w1 = shm_sub_buffer_pool_acquire(pool);
+    assert(w1 && w1->last_id == 0);
+    struct shm_sub_buffer_writer *w2 = shm_sub_buffer_pool_acquire(pool);
+    struct shm_sub_buffer_writer *w3 = shm_sub_buffer_pool_acquire(pool);
+    assert(w2 && w3);
+    assert(buffer_get_sub_buffers_no(parent) == subs + 4);
+
+    shm_sub_buffer_pool_release(pool, w1);
+    shm_sub_buffer_pool_release(pool, w2);
+    assert(buffer_get_sub_buffers_no(parent) == subs + 6);
+    /* the pool is full, no new buffer is created */
+    shm_sub_buffer_pool_release(pool, w3);
+    assert(buffer_get_sub_buffers_no(parent) == subs + 6);
+    shm_sub_buffer_pool_destroy(pool);
+}
+
+static struct shm_sub_buffer_pool *shared_pool;
+static _Atomic size_t in_use[THREADS * 2];
+
+static int thread_fn(void *data) {
+    (void)data;
+    for (int i = 0; i < ROUNDS; ++i) {
+        struct shm_sub_buffer_writer *w =
+            shm_sub_buffer_pool_acquire(shared_pool);
+        assert(w);
+        /* nobody else got the same writer */
+        assert(atomic_fetch_add(&in_use[w->last_id], 1) == 0);
+        thrd_yield();
+        assert(atomic_fetch_sub(&in_use[w->last_id], 1) == 1);
+        shm_sub_buffer_pool_release(shared_pool, w);
+    }
+    return 0;
+}
+
+static void test_threads(struct source_control *control) {
+    shared_pool = shm_sub_buffer_pool_create(parent, 4, control, THREADS, true);
+    /* number the writers so that we can check they are not shared */
+    struct shm_sub_buffer_writer *ws[THREADS];
+    for (size_t i = 0; i < THREADS; ++i) {
+        ws[i] = shm_sub_buffer_pool_acquire(shared_pool);
+        ws[i]->last_id = i;
+    }
+    for (size_t i = 0; i < THREADS; ++i) {
+        shm_sub_buffer_pool_release(shared_pool, ws[i]);
+    }
+
+    thrd_t thrds[THREADS];
+    for (size_t i = 0; i < THREADS; ++i) {
+        thrd_create(&thrds[i], thread_fn, NULL);
+    }
+    for (size_t i = 0; i < THREADS; ++i) {
+        thrd_join(thrds[i], NULL);
+    }
+    shm_sub_buffer_pool_destroy(shared_pool);
+}
+
+int main(void) {
+    struct source_control *control = source_control_define(1, "E", "l");
+    parent = create_shared_buffer(KEY, 16, control);
+    assert(parent);
+
+    test_recycle(control);
+    test_no_recycle(control);
+    test_threads(control);
+
+    /* there is no monitor that would remove the sub-buffers */
+    char ctrlkey[SHM_NAME_MAXLEN];
+    for (size_t i = 1; i <= buffer_get_sub_buffers_no(parent); ++i) {
+        char *key = get_sub_buffer_key(KEY, i);
+        shamon_shm_unlink(key);
+        shamon_shm_unlink(shamon_map_ctrl_key(key, ctrlkey));
+        free(key);
+    }
+    destroy_shared_buffer(parent);
+    free(control);
+    return 0;
+}
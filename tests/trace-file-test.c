@@ -0,0 +1,123 @@
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "core/signatures.h"
+#include "core/source.h"
+#include "core/trace_file.h"
+
+/* more than two blocks of each kind */
+#define EVENTS_NUM (5 * SHM_TRACE_FILE_BLOCK_EVENTS + 17)
+
+struct ev_a {
+    shm_event base;
+    int i;
+    long l;
+} __attribute__((packed));
+
+struct ev_b {
+    shm_event base;
+    const char *s;
+    double d;
+} __attribute__((packed));
+
+static const char *strs[] = {"foo", "bar", "", "a bit longer string"};
+
+int main(void) {
+    char path[] = "/tmp/shamon-trace-file-XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    struct source_control *control = source_control_define(2, "A", "il",
+                                                           "B", "Sd");
+    control->events[0].kind = 2;
+    control->events[1].kind = 3;
+
+    shm_trace_file_writer *w =
+        shm_trace_file_writer_create(path, control->events, 2);
+    assert(w);
+
+    /* events with even ids are A, the rest are B */
+    _Alignas(shm_event) unsigned char row[sizeof(struct ev_b)];
+    shm_event *ev = (shm_event *)row;
+    for (size_t id = 1; id <= EVENTS_NUM; ++id) {
+        ev->id = id;
+        if (id % 2 == 0) {
+            struct ev_a a = {.i = -(int)id, .l = 3 * id};
+            ev->kind = 2;
+            memcpy(row + sizeof(shm_event), &a.i, sizeof(a) - sizeof(a.base));
+        } else {
+            struct ev_b b = {.s = strs[id % 4], .d = id / 2.0};
+            ev->kind = 3;
+            memcpy(row + sizeof(shm_event), &b.s, sizeof(b) - sizeof(b.base));
+        }
+        assert(shm_trace_file_write(w, 10 * id, ev) == 0);
+    }
+    assert(shm_trace_file_writer_close(w) == 0);
+    free(control);
+
+    shm_trace_file *tf = shm_trace_file_open(path);
+    assert(tf);
+    assert(shm_trace_file_events_num(tf) == EVENTS_NUM);
+
+    size_t num;
+    struct event_record *events = shm_trace_file_events(tf, &num);
+    assert(num == 2);
+    assert(strcmp(events[0].name, "A") == 0);
+    assert(strcmp((char *)events[1].signature, "Sd") == 0);
+    assert(shm_trace_file_max_event_size(tf) == sizeof(struct ev_b));
+
+    /* all the events in the order of ids */
+    shm_trace_file_iter *it = shm_trace_file_iter_create(tf);
+    const shm_event *rev;
+    uint64_t time;
+    size_t id = 0;
+    while ((rev = shm_trace_file_iter_next(it, &time))) {
+        ++id;
+        assert(rev->id == id);
+        assert(time == 10 * id);
+        if (id % 2 == 0) {
+            const struct ev_a *a = (const struct ev_a *)rev;
+            assert(rev->kind == 2);
+            assert(a->i == -(int)id);
+            assert(a->l == (long)(3 * id));
+        } else {
+            const struct ev_b *b = (const struct ev_b *)rev;
+            assert(rev->kind == 3);
+            assert(strcmp(b->s, strs[id % 4]) == 0);
+            assert(b->d == id / 2.0);
+        }
+    }
+    assert(id == EVENTS_NUM);
+    shm_trace_file_iter_destroy(it);
+
+    /* the index */
+    const shm_trace_file_block *blocks =
+        shm_trace_file_kind_blocks(tf, 2, &num);
+    assert(num == 3);
+    assert(blocks[0].first_id == 2);
+    assert(blocks[0].count == SHM_TRACE_FILE_BLOCK_EVENTS);
+    assert(!shm_trace_file_kind_blocks(tf, 4, &num) && num == 0);
+
+    const shm_trace_file_block *b = shm_trace_file_find_block(tf, 3, 8193);
+    assert(b && b->kind == 3 && b->first_id <= 8193 && b->last_id >= 8193);
+    assert(shm_trace_file_find_block(tf, 3, 8194) == b);
+    assert(shm_trace_file_find_block(tf, 3, EVENTS_NUM + 10) == NULL);
+    assert(shm_trace_file_find_block(tf, 2, 0) == NULL);
+
+    /* columns are accessed directly */
+    const long *ls = shm_trace_file_block_column(tf, &blocks[1], 1);
+    assert(ls[0] == (long)(3 * blocks[1].first_id));
+    const uint32_t *sidx = shm_trace_file_block_column(tf, b, 0);
+    assert(strcmp(shm_trace_file_str(tf, sidx[0]), strs[b->first_id % 4]) ==
+           0);
+
+    shm_trace_file_close(tf);
+    unlink(path);
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "core/trace.h"
+
+#define SPANS 100
+
+static int recorder(void *data) {
+    shm_trace_thread_name((const char *)data);
+    for (int i = 0; i < SPANS; ++i) {
+        shm_trace_begin(SHM_TRACE_FETCH, i);
+        shm_trace_instant(SHM_TRACE_DROP, i);
+        shm_trace_end(SHM_TRACE_FETCH, i);
+    }
+    thrd_exit(0);
+}
+
+static size_t count(const char *str, const char *what) {
+    size_t n = 0;
+    while ((str = strstr(str, what))) {
+        ++n;
+        ++str;
+    }
+    return n;
+}
+
+int main(void) {
+    /* the ring of each thread keeps only the last 64 records */
+    setenv("SHAMON_TRACE_RING_SIZE", "64", 1);
+
+    thrd_t t1, t2;
+    thrd_create(&t1, recorder, "first");
+    thrd_create(&t2, recorder, "second");
+    thrd_join(t1, NULL);
+    thrd_join(t2, NULL);
+
+    char path[] = "/tmp/shamon-trace-test.json";
+    assert(shm_trace_dump(path) == 0);
+
+    FILE *f = fopen(path, "r");
+    assert(f);
+    static char data[1 << 16];
+    size_t len = fread(data, 1, sizeof(data) - 1, f);
+    assert(len > 0 && len < sizeof(data) - 1);
+    data[len] = '\0';
+    fclose(f);
+    remove(path);
+
+    assert(strstr(data, "\"traceEvents\""));
+    assert(count(data, "\"name\":\"first\"") == 1);
+    assert(count(data, "\"name\":\"second\"") == 1);
+    assert(count(data, "\"name\":\"fetch\"") + count(data, "\"name\":\"drop\"") ==
+           2 * 64);
+    /* the last record of each thread is the end of the fetch span */
+    assert(count(data, "\"ph\":\"E\"") >= 2);
+    assert(count(data, "\"ph\":\"i\",\"ts\"") ==
+           count(data, "\"s\":\"t\""));
+
+    return 0;
+}